@@ -23,15 +23,50 @@
 #include <DirectXMath.h>
 #include "SimpleMath.h"
 
-#include <random>
-#include <ctime>
+#include <string>
+#include <vector>
 
 #include "include\VertexDefinitions.h"
+#include "include\boundingVolumeHierarchy.h"
 #include "include\cube.h"
+#include "include\cubeRenderer.h"
+#include "include\d3d11CommandRecorder.h"
+#include "include\d3d11RenderDevice.h"
+#include "include\fixedTimestep.h"
+#include "include\frameStats.h"
+#include "include\frustum.h"
+#include "include\jobSystem.h"
+#include "include\occlusionBuffer.h"
+#include "include\profiler.h"
+#include "include\renderQueue.h"
+#include "include\simulationConfig.h"
+#include "include\snapshotBuffer.h"
+#include "include\stateCacheRenderDevice.h"
+#include "include\taskGraph.h"
 
 using namespace DirectX::SimpleMath;
 
-#define CUBE_COUNT 100
+#define CUBE_GRAIN_SIZE 256
+
+// Fewest cubes culled through a BoundingVolumeHierarchy rather than one sphere after another.
+// Below this, refitting the tree costs more than the spheres it lets the cull skip.
+#define BVH_MIN_CUBES 20000
+
+// Ring for per-object constants, which take 256 bytes a cube when bound by offset. 4 MB keeps
+// three frames of 5000 cubes in flight before a frame has to discard.
+#define CONSTANT_RING_BYTES (4 * 1024 * 1024)
+
+// Far clipping plane, which also scales the depth the draws are sorted on
+#define CAMERA_FAR_PLANE 100.0f
+
+// 1 waits for vertical blank, 0 presents as fast as the GPU allows
+#define PRESENT_SYNC_INTERVAL 1
+
+// Debug and Profile builds save what the profiler still holds here on exit, as Chrome trace JSON
+#define PROFILE_TRACE_FILE "frameTrace.json"
+
+// Frame and phase time percentiles for each second of the run, written on exit and when F2 is pressed
+#define FRAME_STATS_FILE "frameStats.txt"
 
 // *************************************************************************************
 // Global Variables
@@ -46,17 +81,22 @@ ID3D11DeviceContext*    g_pImmediateContext = NULL;
 ID3D11Texture2D* g_d3dDepthStencilBuffer = NULL;
 ID3D11DepthStencilView* g_d3dDepthStencilView = NULL;
 ID3D11DepthStencilState* g_d3dDepthStencilState = NULL;
+
+// Set by WndProc when F2 asks for the frame statistics so far
+bool                    g_frameStatsRequested = false;
+
 // *************************************************************************************
 // Forward declarations
 // *************************************************************************************
 
+HRESULT LoadSimulationConfig(SimulationConfig& config);
 HRESULT InitWindow(HINSTANCE hInstance, int nCmdShow);
 HRESULT InitDevice(IDXGISwapChain* &pSwapChain);
 LRESULT CALLBACK    WndProc(HWND, UINT, WPARAM, LPARAM);
 HRESULT CompileShaderFromFile(WCHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut);
-HRESULT InitInputAssembler(ID3DBlob* pVSBlob, ID3D11InputLayout* &pVertexLayout, ID3D11Buffer* &pVertexBuffer, ID3D11Buffer* &pIndexBuffer);
-HRESULT InitVertexShader(ID3DBlob* &pVSBlob, ID3D11VertexShader* &pVertexShader, ID3D11Buffer* &pConstantBuffer);
-HRESULT InitRasteriser();
+HRESULT InitInputAssembler(ID3DBlob* pVSBlob, ID3DBlob* pInstancedVSBlob, ID3D11InputLayout* &pVertexLayout, ID3D11InputLayout* &pInstancedLayout, ID3D11Buffer* &pVertexBuffer, ID3D11Buffer* &pIndexBuffer);
+HRESULT InitVertexShader(ID3DBlob* &pVSBlob, ID3D11VertexShader* &pVertexShader, ID3DBlob* &pInstancedVSBlob, ID3D11VertexShader* &pInstancedVertexShader, ID3D11Buffer* &pFrameConstantBuffer, ID3D11Buffer* &pObjectConstantBuffer);
+HRESULT InitRasteriser(D3D11_VIEWPORT &viewport);
 HRESULT InitPixelShader(ID3D11PixelShader* &pPixelShader);
 HRESULT InitOutputMerger(IDXGISwapChain* pSwapChain, ID3D11RenderTargetView* &pRenderTargetView);
 
@@ -78,27 +118,49 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 	UNREFERENCED_PARAMETER(hPrevInstance);
 	UNREFERENCED_PARAMETER(lpCmdLine);
 
+	// Cube count, seed, spawn box and step rate come from the command line or a config file.
+	// Every random draw is a function of the seed, so logging it is enough to replay a run.
+	SimulationConfig config;
+	if (FAILED(LoadSimulationConfig(config)))
+		return 0;
+	const size_t cubeCount = config.cubeCount;
+
 	// First initialise the window using the Win32 API 
 	if (FAILED(InitWindow(hInstance, nCmdShow)))
 		return 0;
 
-	srand((unsigned)time(0));
+	Cube* pCubes;
+	pCubes = new Cube[cubeCount];
 
+	// The workers name themselves in the profiler's trace
+	PROFILE_THREAD_NAME("main");
 
-	const auto generateRandomVec3 = [](float min, float max)
-	{
-		Vector3 v;
-		v.x = min + static_cast <float> (rand()) / (static_cast <float> (RAND_MAX / (max - min)));
-
-		return v;
-	};
+	// One worker per core besides this thread unless told otherwise; the frame graph below runs on them
+	JobSystem jobs(config.threadCount > 0 ? config.threadCount - 1 : JobSystem::DEFAULT_WORKERS);
+	ObjectConstants* pObjectConstants = new ObjectConstants[cubeCount];
+	std::vector<InstanceData> instances(config.instanced ? cubeCount : 0);
+	std::vector<int> drawList;
+	drawList.reserve(cubeCount);
 
-	Cube* pCubes;
-	pCubes = new Cube[CUBE_COUNT];
+	std::vector<Vector3> spawnPositions;
+	generateSpawnPositions(config, cubeCount, spawnPositions);
+	for (size_t i = 0; i < cubeCount; ++i)
+	{
+		pCubes[i] = Cube(spawnPositions[i], Vector3(0, 0, 0), RandomStream(config.seed, static_cast<uint32_t>(i)));
+	}
 
-	for (int i = 0; i < 100; ++i)
+	// The simulation writes one copy of the cube transforms while the renderer reads the
+	// other, so both start out holding the spawn state
+	SnapshotBuffer<CubeSnapshot> snapshots;
+	for (int copy = 0; copy < 2; ++copy)
 	{
-		pCubes[i] = Cube(generateRandomVec3(-10.0f, 10.0f), Vector3(0, 0, 0));
+		CubeSnapshot& snapshot = snapshots.getWriteBuffer();
+		snapshot.transforms.resize(cubeCount);
+		for (size_t i = 0; i < cubeCount; ++i)
+		{
+			snapshot.transforms[i] = pCubes[i].getTransform();
+		}
+		snapshots.publish();
 	}
 
 	// Retrieve the coordinates of a window's client area so that we can create  
@@ -118,7 +180,7 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 	Matrix mView = Matrix::CreateLookAt(Eye, At, Up);
 
 	// Initialize the projection matrix
-	Matrix mProjection = Matrix::CreatePerspectiveFieldOfView(3.142 / 2.0, width / (FLOAT)height, 0.01f, 100.0f);
+	Matrix mProjection = Matrix::CreatePerspectiveFieldOfView(3.142 / 2.0, width / (FLOAT)height, 0.01f, CAMERA_FAR_PLANE);
 
 	// Pointers to the D3D11 Device and DevideContext COM objects have been declared as
 	// global variables, because they are used everywhere, but the other relevant COM objects
@@ -128,12 +190,16 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 	IDXGISwapChain*         pSwapChain = NULL;
 	ID3D11RenderTargetView* pRenderTargetView = NULL;
 	ID3DBlob*				pVSBlob = NULL;
+	ID3DBlob*				pInstancedVSBlob = NULL;
 	ID3D11VertexShader*     pVertexShader = NULL;
+	ID3D11VertexShader*     pInstancedVertexShader = NULL;
 	ID3D11PixelShader*      pPixelShader = NULL;
 	ID3D11InputLayout*      pVertexLayout = NULL;
+	ID3D11InputLayout*      pInstancedLayout = NULL;
 	ID3D11Buffer*           pVertexBuffer = NULL;
 	ID3D11Buffer*           pIndexBuffer = NULL;
-	ID3D11Buffer*           pConstantBuffer = NULL;
+	ID3D11Buffer*           pFrameConstantBuffer = NULL;
+	ID3D11Buffer*           pObjectConstantBuffer = NULL;
 
 	// Initialise the DirectX11 devices and create the Swap Chain
 	InitDevice(pSwapChain);
@@ -144,23 +210,23 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 	// The shader program is loaded and compiled into a binary blob which is used create and return a Pixel Shader
 	InitPixelShader(pPixelShader);
 
-	// Sets up the viewport for the Rasteriser
-	InitRasteriser();
+	// Sets up the viewport for the Rasteriser. Command lists start without one, so it is also
+	// handed to the render device to bind with the rest of the pipeline.
+	D3D11_VIEWPORT viewport;
+	InitRasteriser(viewport);
 
 	// The shader program is loaded and compiled into a binary blob which is used create and return a Vertex Shader.
 	// The vertex shader's binary blob is also returned as this is needed by the Input Assembler to determine if the
-	// input layout matches the input signature of the shader code. A Constant Buffer is created and returned to 
-	// contain the constant data used for all vertices (primarily the world, view and projection matrices).
-	InitVertexShader(pVSBlob, pVertexShader, pConstantBuffer);
+	// input layout matches the input signature of the shader code. Two Constant Buffers are created and returned:
+	// one for the data shared by every draw in a frame (the view-projection matrix) and one for each object's world matrix.
+	// The instanced variant reads its world matrix from a second vertex stream instead.
+	InitVertexShader(pVSBlob, pVertexShader, pInstancedVSBlob, pInstancedVertexShader, pFrameConstantBuffer, pObjectConstantBuffer);
 
 	// An InputLayout is created from an element decriptor and bound to the Input Assembler. Vertex and Index
 	// buffers  are created for the cubeand set as input to the Input Assembler
-	InitInputAssembler(pVSBlob, pVertexLayout, pVertexBuffer, pIndexBuffer);
-
-	// Main message loop
-	MSG msg = { 0 };
-
+	InitInputAssembler(pVSBlob, pInstancedVSBlob, pVertexLayout, pInstancedLayout, pVertexBuffer, pIndexBuffer);
 
+	// A depth buffer the size of the back buffer, tested LESS and written
 	{
 		D3D11_TEXTURE2D_DESC depthStencilBufferDesc;
 		ZeroMemory(&depthStencilBufferDesc, sizeof(D3D11_TEXTURE2D_DESC));
@@ -169,8 +235,8 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 		depthStencilBufferDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
 		depthStencilBufferDesc.CPUAccessFlags = 0; // No CPU access required.
 		depthStencilBufferDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
-		depthStencilBufferDesc.Width = 640;
-		depthStencilBufferDesc.Height = 480;
+		depthStencilBufferDesc.Width = width;
+		depthStencilBufferDesc.Height = height;
 		depthStencilBufferDesc.MipLevels = 1;
 		depthStencilBufferDesc.SampleDesc.Count = 1;
 		depthStencilBufferDesc.SampleDesc.Quality = 0;
@@ -183,6 +249,10 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 		}
 
 		hr = g_pD3DDevice->CreateDepthStencilView(g_d3dDepthStencilBuffer, nullptr, &g_d3dDepthStencilView);
+		if (FAILED(hr))
+		{
+			return -1;
+		}
 
 		D3D11_DEPTH_STENCIL_DESC depthStencilStateDesc;
 		ZeroMemory(&depthStencilStateDesc, sizeof(D3D11_DEPTH_STENCIL_DESC));
@@ -193,9 +263,224 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 		depthStencilStateDesc.StencilEnable = FALSE;
 
 		hr = g_pD3DDevice->CreateDepthStencilState(&depthStencilStateDesc, &g_d3dDepthStencilState);
-		g_pImmediateContext->OMSetDepthStencilState(0, 0);
+		if (FAILED(hr))
+		{
+			return -1;
+		}
 	}
 
+	// Submission goes through the device by name, so the same code can be checked against a
+	// recording device. The instance buffer is sized on first use.
+	D3D11RenderDevice renderDevice(g_pD3DDevice, g_pImmediateContext);
+	renderDevice.attachBuffer(RENDER_BUFFER_CUBE_VERTICES, pVertexBuffer);
+	renderDevice.attachBuffer(RENDER_BUFFER_CUBE_INDICES, pIndexBuffer);
+	renderDevice.attachBuffer(RENDER_BUFFER_FRAME_CONSTANTS, pFrameConstantBuffer);
+	renderDevice.attachBuffer(RENDER_BUFFER_OBJECT_CONSTANTS, pObjectConstantBuffer);
+	renderDevice.attachRingBuffer(RENDER_BUFFER_OBJECT_CONSTANT_RING, D3D11_BIND_CONSTANT_BUFFER, CONSTANT_RING_BYTES);
+	renderDevice.attachDynamicBuffer(RENDER_BUFFER_INSTANCES, D3D11_BIND_VERTEX_BUFFER);
+	renderDevice.attachVertexShader(RENDER_SHADER_CUBE_VS, pVertexShader);
+	renderDevice.attachVertexShader(RENDER_SHADER_CUBE_INSTANCED_VS, pInstancedVertexShader);
+	renderDevice.attachPixelShader(RENDER_SHADER_CUBE_PS, pPixelShader);
+	renderDevice.attachInputLayout(RENDER_LAYOUT_CUBE, pVertexLayout);
+	renderDevice.attachInputLayout(RENDER_LAYOUT_CUBE_INSTANCED, pInstancedLayout);
+
+	renderDevice.attachRenderTarget(RENDER_TARGET_BACK_BUFFER, pRenderTargetView, g_d3dDepthStencilView);
+	renderDevice.attachDepthStencilState(RENDER_DEPTH_STATE_DEFAULT, g_d3dDepthStencilState);
+	renderDevice.attachViewport(RENDER_VIEWPORT_BACK_BUFFER, viewport);
+
+	// Frames re-bind everything they draw with; the cache drops the binds that change nothing
+	// and counts how many that was
+	StateCacheRenderDevice stateCache(renderDevice);
+
+	// Cube-at-a-time draws can be recorded into deferred contexts on the worker threads
+	D3D11CommandRecorder recorder(g_pD3DDevice, g_pImmediateContext, renderDevice, config.instanced ? 0 : config.deferredContexts);
+
+	// Main message loop
+	MSG msg = { 0 };
+
+
+	// The camera does not move, so the view-projection matrix is combined and transposed once
+	FrameConstants frameConstants;
+	frameConstants.mViewProjection = (mView * mProjection).Transpose();
+
+	// Steps due this frame; how far the render time sits between the last two steps travels
+	// with the snapshot
+	FixedTimestep timestep(config.stepRate);
+	unsigned int simSteps = 0;
+
+	// The frame as a task graph. The simulation of the next frame runs alongside
+	// cull -> sort -> pack -> submit of the last published one; the two only meet at publish(), after
+	// the graph has finished. Clearing the back buffer depends on neither, so it runs on this
+	// thread while the workers are busy.
+	TaskGraph frameGraph;
+
+	// Animate the cubes and write their transforms into the unpublished snapshot. Cubes do not
+	// interact, so running every due step on one cube before the next gives the same result as
+	// stepping the whole set at a time.
+	const TaskGraph::NodeId simulateNode = frameGraph.addParallelTask("simulate", [cubeCount]() { return cubeCount; }, CUBE_GRAIN_SIZE,
+		[&](size_t begin, size_t end)
+	{
+		const float stepSeconds = timestep.getStepSeconds();
+		CubeSnapshot& snapshot = snapshots.getWriteBuffer();
+		for (size_t i = begin; i < end; ++i)
+		{
+			for (unsigned int step = 0; step < simSteps; ++step)
+			{
+				pCubes[i].update(stepSeconds);
+			}
+			snapshot.transforms[i] = pCubes[i].getTransform();
+		}
+	});
+
+	// Build the list of cubes to draw this frame: those whose bounding sphere, where the cube
+	// is drawn this frame, reaches into the view frustum. Large fields go through a tree over
+	// the spheres, which is refitted each frame. The nearest of those are then drawn into a
+	// small CPU depth buffer, and cubes wholly behind them are dropped.
+	const Matrix viewProjection = mView * mProjection;
+	const Frustum frustum(viewProjection);
+	std::vector<Vector3> cullCenters(cubeCount);
+	BoundingVolumeHierarchy cullTree;
+	OcclusionBuffer occlusionBuffer;
+	std::vector<int> occluders;
+	std::vector<Matrix> occluderWorlds;
+	size_t culledCount = 0;
+	size_t occludedCount = 0;
+	const TaskGraph::NodeId cullNode = frameGraph.addTask("cull", [&]()
+	{
+		const CubeSnapshot& snapshot = snapshots.getReadBuffer();
+		for (size_t i = 0; i < cubeCount; ++i)
+		{
+			const CubeTransform& transform = snapshot.transforms[i];
+			cullCenters[i] = Vector3::Lerp(transform.previousPosition, transform.position, snapshot.alpha);
+		}
+
+		if (cubeCount >= BVH_MIN_CUBES)
+		{
+			if (cullTree.getObjectCount() == 0)
+			{
+				cullTree.build(cullCenters.data(), cubeCount, CUBE_BOUNDING_RADIUS, jobs);
+			}
+			else
+			{
+				cullTree.update(cullCenters.data(), jobs);
+			}
+			drawList.clear();
+			cullTree.queryFrustum(frustum, drawList);
+		}
+		else
+		{
+			drawList.resize(cubeCount);
+			drawList.resize(frustum.cullSpheres(cullCenters.data(), cubeCount, CUBE_BOUNDING_RADIUS, 0, drawList.data()));
+		}
+		culledCount = cubeCount - drawList.size();
+
+		if (config.occluderCount > 0)
+		{
+			OcclusionBuffer::selectOccluders(viewProjection, cullCenters.data(), drawList.data(), drawList.size(), config.occluderCount, occluders);
+			occluderWorlds.resize(occluders.size());
+			for (size_t i = 0; i < occluders.size(); ++i)
+			{
+				occluderWorlds[i] = Cube::interpolateWorldMatrix(snapshot.transforms[occluders[i]], snapshot.alpha);
+			}
+			occlusionBuffer.render(viewProjection, occluderWorlds.data(), occluderWorlds.size(), jobs);
+
+			const size_t inFrustum = drawList.size();
+			drawList.resize(occlusionBuffer.cullOccluded(cullCenters.data(), CUBE_BOUNDING_RADIUS, drawList.data(), inFrustum, jobs));
+			occludedCount = inFrustum - drawList.size();
+		}
+
+		PROFILE_COUNTER("cubes culled", culledCount);
+		PROFILE_COUNTER("cubes occluded", occludedCount);
+	});
+
+	// Put what is left through a render queue so it is drawn sorted by state and then nearest
+	// first, letting the depth test reject the pixels of cubes behind those already drawn
+	RenderQueue renderQueue;
+	renderQueue.reserve(cubeCount);
+	const TaskGraph::NodeId sortNode = frameGraph.addTask("sort", [&]()
+	{
+		// Every cube is opaque with one shader and material, so this only orders them by depth
+		renderQueue.clear();
+		renderQueue.pushOpaque(viewProjection, CAMERA_FAR_PLANE, config.instanced ? RENDER_SHADER_CUBE_INSTANCED_VS : RENDER_SHADER_CUBE_VS, 0,
+			cullCenters.data(), drawList.data(), drawList.size());
+		renderQueue.sort(jobs);
+		renderQueue.getItems(drawList);
+	});
+
+	// Fill the per-object constant buffers from the published snapshot with the interpolated world
+	// matrix, in draw order. Instanced drawing only needs the world matrices, which go
+	// into the instance stream untransposed, one row per WORLDn element.
+	const TaskGraph::NodeId packNode = frameGraph.addParallelTask("pack", [&drawList]() { return drawList.size(); }, CUBE_GRAIN_SIZE,
+		[&](size_t begin, size_t end)
+	{
+		const CubeSnapshot& snapshot = snapshots.getReadBuffer();
+		if (config.instanced)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				instances[i].mWorld = Cube::interpolateWorldMatrix(snapshot.transforms[drawList[i]], snapshot.alpha);
+			}
+			return;
+		}
+
+		for (size_t i = begin; i < end; ++i)
+		{
+			pObjectConstants[i].mWorld = Cube::interpolateWorldMatrix(snapshot.transforms[drawList[i]], snapshot.alpha).Transpose();
+		}
+	});
+
+	// Clear the back buffer to a dark blue and the depth buffer to the far plane
+	const TaskGraph::NodeId clearNode = frameGraph.addMainThreadTask("clear", [&pRenderTargetView]()
+	{
+		float ClearColor[4] = { 0.0f, 0.125f, 0.3f, 1.0f }; // red,green,blue,alpha
+		g_pImmediateContext->ClearRenderTargetView(pRenderTargetView, ClearColor);
+		g_pImmediateContext->ClearDepthStencilView(g_d3dDepthStencilView, D3D11_CLEAR_DEPTH, 1.0f, 0);
+	});
+
+	// The immediate context is not thread safe, so everything that talks to it stays on this thread
+	const TaskGraph::NodeId submitNode = frameGraph.addMainThreadTask("submit", [&]()
+	{
+		stateCache.beginFrame();
+		if (config.instanced)
+		{
+			submitCubesInstanced(stateCache, frameConstants, instances.data(), drawList.size());
+		}
+		else if (recorder.getContextCount() > 0)
+		{
+			submitCubesRecorded(stateCache, recorder, jobs, frameConstants, pObjectConstants, drawList.size(), CUBE_GRAIN_SIZE);
+
+			// ExecuteCommandList leaves the immediate context with nothing bound
+			stateCache.invalidate();
+		}
+		else
+		{
+			submitCubes(stateCache, frameConstants, pObjectConstants, drawList.size());
+		}
+		stateCache.endFrame();
+
+		// Deferred draws go to the contexts rather than the cache, so count draws from the list
+		PROFILE_COUNTER("draws", config.instanced ? (drawList.empty() ? 0 : 1) : drawList.size());
+		PROFILE_COUNTER("bytes uploaded", stateCache.getUploadedBytes());
+
+		// Present our back buffer to our front buffer
+		PROFILE_ZONE("present");
+		pSwapChain->Present(PRESENT_SYNC_INTERVAL, 0);
+	});
+
+	frameGraph.addDependency(cullNode, sortNode);
+	frameGraph.addDependency(sortNode, packNode);
+	frameGraph.addDependency(packNode, submitNode);
+	frameGraph.addDependency(clearNode, submitNode);
+
+	// Every frame goes into histograms of frame and phase times, and each second becomes an
+	// interval of the summary, which keeps the last minute of them. The title bar shows the
+	// culling and state cache counters and the frame time percentiles of the last second.
+	FrameStats frameStats;
+	LARGE_INTEGER counterFrequency;
+	LARGE_INTEGER lastFrameStart = { 0 };
+	QueryPerformanceFrequency(&counterFrequency);
+	ULONGLONG lastTitleUpdate = GetTickCount64();
+
 	// Keep looping until the application is closed
 	while (WM_QUIT != msg.message)
 	{
@@ -210,57 +495,116 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 		}
 		else
 		{
-			// Animate the cube by rotating it in the Y axis
-			for (int i = 0; i < CUBE_COUNT; ++i)
+			PROFILE_ZONE("frame");
+			LARGE_INTEGER frameStart;
+			QueryPerformanceCounter(&frameStart);
+			if (lastFrameStart.QuadPart != 0)
 			{
-				pCubes[i].update();
+				frameStats.record(FrameStats::PHASE_FRAME, (frameStart.QuadPart - lastFrameStart.QuadPart) * 1000000000ull / counterFrequency.QuadPart);
 			}
-			// Clear the back buffer to a dark blue
-			float ClearColor[4] = { 0.0f, 0.125f, 0.3f, 1.0f }; // red,green,blue,alpha
-			g_pImmediateContext->ClearRenderTargetView(pRenderTargetView, ClearColor);
-
-			for (int i = 0; i < CUBE_COUNT; ++i)
+			lastFrameStart = frameStart;
+
+			simSteps = timestep.beginFrame();
+			snapshots.getWriteBuffer().alpha = timestep.getAlpha();
+			frameGraph.run(jobs);
+			frameStats.record(FrameStats::PHASE_SIMULATE, frameGraph.getLastDurationNs(simulateNode));
+			frameStats.record(FrameStats::PHASE_CULL, frameGraph.getLastDurationNs(cullNode));
+			frameStats.record(FrameStats::PHASE_SORT, frameGraph.getLastDurationNs(sortNode));
+			frameStats.record(FrameStats::PHASE_PACK, frameGraph.getLastDurationNs(packNode));
+			frameStats.record(FrameStats::PHASE_SUBMIT, frameGraph.getLastDurationNs(submitNode));
+
+			// Nothing reads or writes either snapshot between graph runs, so hand over here
+			snapshots.publish();
+
+			const ULONGLONG now = GetTickCount64();
+			if (now - lastTitleUpdate >= 1000)
 			{
-				// Update the constant buffer with the latest world, view and projection matrix
-				ConstantBuffer cb;
-				cb.mWorld = pCubes[i].getWorldMatrix().Transpose();//mWorld.Transpose();
-				cb.mView = mView.Transpose();
-				cb.mProjection = mProjection.Transpose();
-				// This is sending data to the graphics card
-				g_pImmediateContext->UpdateSubresource(pConstantBuffer, 0, NULL, &cb, 0, 0);
-
-				// Render the triangles
-				g_pImmediateContext->VSSetShader(pVertexShader, NULL, 0);
-				g_pImmediateContext->VSSetConstantBuffers(0, 1, &pConstantBuffer);
-				g_pImmediateContext->PSSetShader(pPixelShader, NULL, 0);
-				//g_pImmediateContext->DrawIndexed(36, 0, 0);        // 36 vertices needed for 12 triangles in a triangle list
-				pCubes[i].draw(g_pImmediateContext);
+				const FrameStats::PhaseSummary& frame = frameStats.closeInterval((now - lastTitleUpdate) / 1000.0).phases[FrameStats::PHASE_FRAME];
+				WCHAR title[256];
+				swprintf_s(title, L"Direct3D 11 Basic 3D Application - %zu cubes visible, %zu culled, %zu occluded, %llu calls issued, %llu filtered per frame, "
+					L"frame p50 %.2f p99 %.2f max %.2f ms", drawList.size(), culledCount, occludedCount, stateCache.getIssuedCount(), stateCache.getFilteredCount(),
+					frame.p50 / 1.0e6, frame.p99 / 1.0e6, frame.max / 1.0e6);
+				SetWindowText(g_hWnd, title);
+				lastTitleUpdate = now;
 			}
-			// Present our back buffer to our front buffer
-			pSwapChain->Present(0, 0);
 
+			if (g_frameStatsRequested)
+			{
+				frameStats.writeSummary(FRAME_STATS_FILE);
+				g_frameStatsRequested = false;
+			}
 		}
 	}
 
+#ifdef PROFILE
+	Profiler::writeChromeTrace(PROFILE_TRACE_FILE);
+#endif
+
+	frameStats.closeInterval((GetTickCount64() - lastTitleUpdate) / 1000.0);
+	frameStats.writeSummary(FRAME_STATS_FILE);
+
 	// Release all of the COM objects associated with this application
 	if (g_pImmediateContext) g_pImmediateContext->ClearState();
-	if (pConstantBuffer) pConstantBuffer->Release();
+	if (pFrameConstantBuffer) pFrameConstantBuffer->Release();
+	if (pObjectConstantBuffer) pObjectConstantBuffer->Release();
 	if (pVertexBuffer) pVertexBuffer->Release();
 	if (pIndexBuffer) pIndexBuffer->Release();
 	if (pVertexLayout) pVertexLayout->Release();
+	if (pInstancedLayout) pInstancedLayout->Release();
 	if (pVertexShader) pVertexShader->Release();
+	if (pInstancedVertexShader) pInstancedVertexShader->Release();
 	if (pPixelShader) pPixelShader->Release();
 	if (pRenderTargetView) pRenderTargetView->Release();
+	if (g_d3dDepthStencilState) g_d3dDepthStencilState->Release();
+	if (g_d3dDepthStencilView) g_d3dDepthStencilView->Release();
+	if (g_d3dDepthStencilBuffer) g_d3dDepthStencilBuffer->Release();
 	if (pSwapChain) pSwapChain->Release();
 	if (g_pImmediateContext) g_pImmediateContext->Release();
 	if (g_pD3DDevice) g_pD3DDevice->Release();
 
+	delete[] pObjectConstants;
 	delete[] pCubes;
 
 	return (int)msg.wParam;
 }
 
 
+// *************************************************************************************
+// LoadSimulationConfig:	Applies --name=value options from the command line, such as
+//						--cubes=10000 or --config=cubes.cfg, on top of the defaults.
+//						See simulationConfig.h for the settings.
+// config			= Receives the settings
+// *************************************************************************************
+HRESULT LoadSimulationConfig(SimulationConfig& config)
+{
+	// The CRT has already split the wide command line; the parser works on UTF-8
+	std::vector<std::string> arguments(__argc);
+	std::vector<const char*> argv(__argc);
+	for (int i = 0; i < __argc; ++i)
+	{
+		const int bytes = WideCharToMultiByte(CP_UTF8, 0, __wargv[i], -1, NULL, 0, NULL, NULL);
+		arguments[i].resize(bytes > 0 ? bytes : 1);
+		WideCharToMultiByte(CP_UTF8, 0, __wargv[i], -1, &arguments[i][0], bytes, NULL, NULL);
+		argv[i] = arguments[i].c_str();
+	}
+
+	std::vector<std::string> unparsed;
+	std::string error;
+	if (!parseCommandLine(__argc, argv.data(), config, unparsed, error))
+	{
+		MessageBoxA(NULL, error.c_str(), "Invalid settings", MB_OK | MB_ICONERROR);
+		return E_INVALIDARG;
+	}
+	if (!unparsed.empty())
+	{
+		MessageBoxA(NULL, ("Unknown argument '" + unparsed.front() + "'").c_str(), "Invalid settings", MB_OK | MB_ICONERROR);
+		return E_INVALIDARG;
+	}
+
+	return S_OK;
+}
+
+
 // *************************************************************************************
 // InitWindow:	Goes through the standard Win32 motions to create a new window
 // hInstance		= Handle to the current instance
@@ -460,7 +804,7 @@ HRESULT InitPixelShader(ID3D11PixelShader* &pPixelShader)
 // *************************************************************************************
 // InitPixelShader:	Sets up the viewport for the Rasteriser stage 
 // *************************************************************************************
-HRESULT InitRasteriser()
+HRESULT InitRasteriser(D3D11_VIEWPORT &viewport)
 {
 	// Retrieve the coordinates of a window's client area so that we can create  
 	// a viewport of the same resolution.
@@ -470,16 +814,15 @@ HRESULT InitRasteriser()
 	UINT height = rc.bottom - rc.top;
 
 	// Setup the viewport
-	D3D11_VIEWPORT vp;
-	vp.Width = (FLOAT)width;
-	vp.Height = (FLOAT)height;
-	vp.MinDepth = 0.0f;
-	vp.MaxDepth = 1.0f;
-	vp.TopLeftX = 0;
-	vp.TopLeftY = 0;
+	viewport.Width = (FLOAT)width;
+	viewport.Height = (FLOAT)height;
+	viewport.MinDepth = 0.0f;
+	viewport.MaxDepth = 1.0f;
+	viewport.TopLeftX = 0;
+	viewport.TopLeftY = 0;
 
 	//Set the viewport for the Rasteriser stage
-	g_pImmediateContext->RSSetViewports(1, &vp);
+	g_pImmediateContext->RSSetViewports(1, &viewport);
 
 	return S_OK;
 }
@@ -489,10 +832,11 @@ HRESULT InitRasteriser()
 //					 used create and return a Vertex Shader. The binary blob is also
 //					 returned as this is needed by the Input Assembler to determine if 
 //					 the input layout matches the input signature of the shader code. 
-//					 A Constant Buffer is created and returned to contain the constant 
-//					 data common to all vertices.
+//					 The same is done for the instanced Vertex Shader.
+//					 Constant Buffers are created and returned for the per-frame and
+//					 per-object constant data.
 // *************************************************************************************
-HRESULT InitVertexShader(ID3DBlob* &pVSBlob, ID3D11VertexShader* &pVertexShader, ID3D11Buffer* &pConstantBuffer)
+HRESULT InitVertexShader(ID3DBlob* &pVSBlob, ID3D11VertexShader* &pVertexShader, ID3DBlob* &pInstancedVSBlob, ID3D11VertexShader* &pInstancedVertexShader, ID3D11Buffer* &pFrameConstantBuffer, ID3D11Buffer* &pObjectConstantBuffer)
 {
 	HRESULT hr = S_OK;
 
@@ -514,15 +858,37 @@ HRESULT InitVertexShader(ID3DBlob* &pVSBlob, ID3D11VertexShader* &pVertexShader,
 		return hr;
 	}
 
+	// Compile the instanced vertex shader
+	pInstancedVSBlob = NULL;
+	hr = CompileShaderFromFile(L"basic.fx", "VS_Instanced", "vs_4_0", &pInstancedVSBlob);
+	if (FAILED(hr))
+	{
+		MessageBox(NULL,
+			L"The FX file cannot be compiled.  Please run this executable from the directory that contains the FX file.", L"Error", MB_OK);
+		return hr;
+	}
+
+	hr = g_pD3DDevice->CreateVertexShader(pInstancedVSBlob->GetBufferPointer(), pInstancedVSBlob->GetBufferSize(), NULL, &pInstancedVertexShader);
+	if (FAILED(hr))
+	{
+		pInstancedVSBlob->Release();
+		return hr;
+	}
+
 	D3D11_BUFFER_DESC bd;
 	ZeroMemory(&bd, sizeof(bd));
 
-	// Create the constant buffer for passing data to the vertex shader
+	// Create the constant buffers for passing data to the vertex shader
 	bd.Usage = D3D11_USAGE_DEFAULT;
-	bd.ByteWidth = sizeof(ConstantBuffer);
+	bd.ByteWidth = sizeof(FrameConstants);
 	bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
 	bd.CPUAccessFlags = 0;
-	hr = g_pD3DDevice->CreateBuffer(&bd, NULL, &pConstantBuffer);
+	hr = g_pD3DDevice->CreateBuffer(&bd, NULL, &pFrameConstantBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	bd.ByteWidth = sizeof(ObjectConstants);
+	hr = g_pD3DDevice->CreateBuffer(&bd, NULL, &pObjectConstantBuffer);
 	if (FAILED(hr))
 		return hr;
 
@@ -531,10 +897,12 @@ HRESULT InitVertexShader(ID3DBlob* &pVSBlob, ID3D11VertexShader* &pVertexShader,
 
 // *************************************************************************************
 // InitInputAssembler:	Creates an InputLayout for the geometry from an element decriptor 
-//						and binds this to the Input Assembler. Creates Vertex and Index 
-//						Buffers for the cube and sets these as input to the Input Assembler
+//						and binds this to the Input Assembler. Creates a second InputLayout
+//						that also reads a world matrix per instance from vertex stream 1.
+//						Creates Vertex and Index Buffers for the cube and sets these as
+//						input to the Input Assembler
 // *************************************************************************************
-HRESULT InitInputAssembler(ID3DBlob* pVSBlob, ID3D11InputLayout* &pVertexLayout, ID3D11Buffer* &pVertexBuffer, ID3D11Buffer* &pIndexBuffer)
+HRESULT InitInputAssembler(ID3DBlob* pVSBlob, ID3DBlob* pInstancedVSBlob, ID3D11InputLayout* &pVertexLayout, ID3D11InputLayout* &pInstancedLayout, ID3D11Buffer* &pVertexBuffer, ID3D11Buffer* &pIndexBuffer)
 {
 	HRESULT hr = S_OK;
 
@@ -550,6 +918,26 @@ HRESULT InitInputAssembler(ID3DBlob* pVSBlob, ID3D11InputLayout* &pVertexLayout,
 	hr = g_pD3DDevice->CreateInputLayout(layout, numElements, pVSBlob->GetBufferPointer(),
 		pVSBlob->GetBufferSize(), &pVertexLayout);
 	pVSBlob->Release();
+	if (FAILED(hr))
+	{
+		pInstancedVSBlob->Release();
+		return hr;
+	}
+
+	// The instanced layout adds the rows of the world matrix, stepped once per instance
+	D3D11_INPUT_ELEMENT_DESC instancedLayout[] =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "WORLD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	};
+
+	hr = g_pD3DDevice->CreateInputLayout(instancedLayout, ARRAYSIZE(instancedLayout), pInstancedVSBlob->GetBufferPointer(),
+		pInstancedVSBlob->GetBufferSize(), &pInstancedLayout);
+	pInstancedVSBlob->Release();
 	if (FAILED(hr))
 		return hr;
 
@@ -557,27 +945,15 @@ HRESULT InitInputAssembler(ID3DBlob* pVSBlob, ID3D11InputLayout* &pVertexLayout,
 	g_pImmediateContext->IASetInputLayout(pVertexLayout);
 
 	// Create vertex buffer
-	SimpleVertex vertices[] =
-	{
-		{ Vector3(-1.0f, 1.0f, -1.0f), Vector4(0.25f, 0.35f, 0.0f, 1.0f) },
-		{ Vector3(1.0f, 1.0f, -1.0f), Vector4(0.25f, 0.35f, 0.0f, 1.0f) },
-		{ Vector3(1.0f, 1.0f, 1.0f), Vector4(0.5f, 0.7f, 0.0f, 1.0f) },
-		{ Vector3(-1.0f, 1.0f, 1.0f), Vector4(0.5f, 0.7f, 0.0f, 1.0f) },
-		{ Vector3(-1.0f, -1.0f, -1.0f), Vector4(0.25f, 0.35f, 0.0f, 1.0f) },
-		{ Vector3(1.0f, -1.0f, -1.0f), Vector4(0.25f, 0.35f, 0.0f, 1.0f) },
-		{ Vector3(1.0f, -1.0f, 1.0f), Vector4(0.5f, 0.7f, 0.0f, 1.0f) },
-		{ Vector3(-1.0f, -1.0f, 1.0f), Vector4(0.5f, 0.7f, 0.0f, 1.0f) },
-	};
-
 	D3D11_BUFFER_DESC bd;
 	ZeroMemory(&bd, sizeof(bd));
 	bd.Usage = D3D11_USAGE_DEFAULT;
-	bd.ByteWidth = sizeof(SimpleVertex) * 8;
+	bd.ByteWidth = sizeof(CUBE_VERTICES);
 	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
 	bd.CPUAccessFlags = 0;
 	D3D11_SUBRESOURCE_DATA InitData;
 	ZeroMemory(&InitData, sizeof(InitData));
-	InitData.pSysMem = vertices;
+	InitData.pSysMem = CUBE_VERTICES;
 	hr = g_pD3DDevice->CreateBuffer(&bd, &InitData, &pVertexBuffer);
 	if (FAILED(hr))
 		return hr;
@@ -588,21 +964,11 @@ HRESULT InitInputAssembler(ID3DBlob* pVSBlob, ID3D11InputLayout* &pVertexLayout,
 	g_pImmediateContext->IASetVertexBuffers(0, 1, &pVertexBuffer, &stride, &offset);
 
 	// Create index buffer
-	WORD indices[] =
-	{
-		0,1,3,	3,1,2, // Face 1
-		4,5,0,	0,5,1, // Face 2
-		7,4,3,	3,4,0, // Face 3
-		5,6,1,	1,6,2, // Face 4
-		6,7,2,	2,7,3, // Face 5
-		5,4,6,	6,4,7, // Face 6
-	};
-
 	bd.Usage = D3D11_USAGE_DEFAULT;
-	bd.ByteWidth = sizeof(WORD) * 36;        // 36 vertices needed for 12 triangles in a triangle list
+	bd.ByteWidth = sizeof(CUBE_INDICES);        // 36 vertices needed for 12 triangles in a triangle list
 	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
 	bd.CPUAccessFlags = 0;
-	InitData.pSysMem = indices;
+	InitData.pSysMem = CUBE_INDICES;
 	hr = g_pD3DDevice->CreateBuffer(&bd, &InitData, &pIndexBuffer);
 	if (FAILED(hr))
 		return hr;
@@ -664,6 +1030,15 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 		EndPaint(hWnd, &ps);
 		break;
 
+	case WM_KEYDOWN:
+		// F2 writes the frame statistics so far without waiting for exit
+		if (wParam == VK_F2)
+		{
+			g_frameStatsRequested = true;
+			break;
+		}
+		return DefWindowProc(hWnd, message, wParam, lParam);
+
 	case WM_DESTROY:
 		PostQuitMessage(0);
 		break;
@@ -384,7 +384,7 @@ struct Matrix : public XMFLOAT4X4
     bool operator != ( const Matrix& M ) const;
 
     // Assignment operators
-    Matrix& operator= (const Matrix& M) { memcpy_s( this, sizeof(float)*16, &M, sizeof(float)*16); return *this; }
+    Matrix& operator= (const Matrix& M) { memcpy( this, &M, sizeof(float)*16 ); return *this; }
     Matrix& operator+= (const Matrix& M);
     Matrix& operator-= (const Matrix& M);
     Matrix& operator*= (const Matrix& M);
@@ -463,6 +463,11 @@ struct Matrix : public XMFLOAT4X4
 
     static Matrix CreateFromYawPitchRoll( float yaw, float pitch, float roll );
 
+    static Matrix CreateFromEulerTranslation( const Vector3& radians, const Vector3& position );
+    static void CreateFromEulerTranslation( _In_reads_(count) const Vector3* radiansArray, _In_reads_(count) const Vector3* positionArray, size_t count, _Out_writes_(count) Matrix* resultArray );
+        // Same result as CreateRotationX * CreateRotationY * CreateRotationZ * CreateTranslation,
+        // written directly from one sin/cos pair per axis
+
     static Matrix CreateShadow( const Vector3& lightDir, const Plane& plane );
 
     static Matrix CreateReflection( const Plane& plane );
@@ -2448,6 +2448,32 @@ inline Matrix Matrix::CreateFromYawPitchRoll( float yaw, float pitch, float roll
     return R;
 }
 
+inline Matrix Matrix::CreateFromEulerTranslation( const Vector3& radians, const Vector3& position )
+{
+    using namespace DirectX;
+    float sx, cx, sy, cy, sz, cz;
+    XMScalarSinCos( &sx, &cx, radians.x );
+    XMScalarSinCos( &sy, &cy, radians.y );
+    XMScalarSinCos( &sz, &cz, radians.z );
+
+    const float sxsy = sx * sy;
+    const float cxsy = cx * sy;
+
+    return Matrix( cy * cz,               cy * sz,               -sy,      0,
+                   sxsy * cz - cx * sz,   sxsy * sz + cx * cz,   sx * cy,  0,
+                   cxsy * cz + sx * sz,   cxsy * sz - sx * cz,   cx * cy,  0,
+                   position.x,            position.y,            position.z, 1.f );
+}
+
+_Use_decl_annotations_
+inline void Matrix::CreateFromEulerTranslation( const Vector3* radiansArray, const Vector3* positionArray, size_t count, Matrix* resultArray )
+{
+    for( size_t i = 0; i < count; ++i )
+    {
+        resultArray[i] = CreateFromEulerTranslation( radiansArray[i], positionArray[i] );
+    }
+}
+
 inline Matrix Matrix::CreateShadow( const Vector3& lightDir, const Plane& plane )
 {
     using namespace DirectX;
@@ -7,11 +7,14 @@
 //--------------------------------------------------------------------------------------
 // Constant Buffer Variables
 //--------------------------------------------------------------------------------------
-cbuffer ConstantBuffer : register( b0 )
+cbuffer FrameConstants : register( b0 )
+{
+	matrix ViewProjection;
+}
+
+cbuffer ObjectConstants : register( b1 )
 {
 	matrix World;
-	matrix View;
-	matrix Projection;
 }
 
 //--------------------------------------------------------------------------------------
@@ -28,8 +31,23 @@ VS_OUTPUT VS( float4 Pos : POSITION, float4 Color : COLOR )
 {
     VS_OUTPUT output = (VS_OUTPUT)0;
     output.Pos = mul( Pos, World );
-    output.Pos = mul( output.Pos, View );
-    output.Pos = mul( output.Pos, Projection );
+    output.Pos = mul( output.Pos, ViewProjection );
+    output.Color = Color;
+    return output;
+}
+
+//--------------------------------------------------------------------------------------
+// Instanced Vertex Shader: the world matrix comes from vertex stream 1, one row per
+// WORLDn element, so ObjectConstants is not used
+//--------------------------------------------------------------------------------------
+VS_OUTPUT VS_Instanced( float4 Pos : POSITION, float4 Color : COLOR,
+    float4 World0 : WORLD0, float4 World1 : WORLD1, float4 World2 : WORLD2, float4 World3 : WORLD3 )
+{
+    float4x4 world = float4x4( World0, World1, World2, World3 );
+
+    VS_OUTPUT output = (VS_OUTPUT)0;
+    output.Pos = mul( Pos, world );
+    output.Pos = mul( output.Pos, ViewProjection );
     output.Color = Color;
     return output;
 }
@@ -1,6 +1,6 @@
 #ifndef VERTEX_DEFINITIONS_H
 #define VERTEX_DEFINITIONS_H
-#include "..\SimpleMath.h"
+#include "../SimpleMath.h"
 
 // *************************************************************************************
 // Structures
@@ -11,11 +11,24 @@ struct SimpleVertex
 	DirectX::SimpleMath::Vector4 Color;
 };
 
-struct ConstantBuffer
+// Constants shared by every draw in a frame, register b0. The view and projection are
+// combined and transposed once on the CPU rather than per draw.
+struct FrameConstants
+{
+	DirectX::SimpleMath::Matrix mViewProjection;
+};
+
+// Constants that change per draw, register b1
+struct ObjectConstants
+{
+	DirectX::SimpleMath::Matrix mWorld;
+};
+
+// One element of the per-instance vertex stream read by VS_Instanced. The world matrix goes
+// in untransposed, one row per WORLDn element.
+struct InstanceData
 {
 	DirectX::SimpleMath::Matrix mWorld;
-	DirectX::SimpleMath::Matrix mView;
-	DirectX::SimpleMath::Matrix mProjection;
 };
 
 
@@ -0,0 +1,68 @@
+#ifndef BENCHMARK_REPORT_H
+#define BENCHMARK_REPORT_H
+
+#include <stddef.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Results of one benchmark run as JSON, for BenchmarkCompare to check against a baseline. Each
+// metric keeps every sample, one per repeated run, and is summarised by its median and median
+// absolute deviation (MAD), which one slow run barely moves, unlike the mean and the standard
+// deviation. Properties describe the machine, the build and the settings, so that a comparison
+// can tell when the two runs were not measuring the same thing.
+//
+// Every metric is a time, so lower is better.
+class BenchmarkReport
+{
+public:
+
+	struct Metric
+	{
+		std::string name;
+		std::string unit;
+		std::vector<double> samples;
+
+		double getMedian() const { return median(samples); }
+		double getMad() const { return medianAbsoluteDeviation(samples); }
+	};
+
+	static double median(std::vector<double> values);
+	static double medianAbsoluteDeviation(const std::vector<double>& values);
+
+	// Starts a report of the given benchmark with the properties of this machine and build:
+	// date, host, os, cpu, cores, compiler and build
+	explicit BenchmarkReport(const std::string& benchmark = std::string());
+
+	const std::string& getBenchmark() const { return m_benchmark; }
+
+	// Adds or replaces a property, such as a setting of the run
+	void setProperty(const std::string& name, const std::string& value);
+	void setProperty(const std::string& name, double value);
+
+	// Empty if the property is not set
+	std::string getProperty(const std::string& name) const;
+	const std::vector<std::pair<std::string, std::string>>& getProperties() const { return m_properties; }
+
+	// Appends a sample to the named metric, adding the metric on its first sample
+	void addSample(const std::string& metric, const std::string& unit, double value);
+
+	// Null if there is no such metric
+	const Metric* findMetric(const std::string& name) const;
+	const std::vector<Metric>& getMetrics() const { return m_metrics; }
+
+	// False if the file cannot be written
+	bool write(const char* path) const;
+
+	// Replaces this report with one written by write(). Unknown keys are skipped. False, with
+	// the problem in error, if the file cannot be read or is not such a report.
+	bool read(const char* path, std::string& error);
+
+private:
+
+	std::string m_benchmark;
+	std::vector<std::pair<std::string, std::string>> m_properties;
+	std::vector<Metric> m_metrics;
+};
+
+#endif
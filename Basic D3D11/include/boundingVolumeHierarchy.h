@@ -0,0 +1,128 @@
+#ifndef BOUNDING_VOLUME_HIERARCHY_H
+#define BOUNDING_VOLUME_HIERARCHY_H
+
+#include <DirectXMath.h>
+#include "../SimpleMath.h"
+#include "frustum.h"
+#include "jobSystem.h"
+#include <stdint.h>
+#include <vector>
+
+// Binary tree of axis-aligned boxes over a set of equal spheres, such as the cubes' bounding
+// spheres, for frustum, ray and box queries that skip whole groups of objects at once.
+//
+// Each frame refit() grows and shrinks the boxes around where the spheres have moved to
+// without changing the tree. That keeps every query exact, but the boxes get looser as
+// neighbours drift apart, so update() rebuilds once the surface area cost has grown by
+// REBUILD_COST_RATIO since the last build. Building splits each node at the median of its
+// widest axis; the levels near the root are split on the calling thread and the subtrees
+// below them are built, and later refitted, in parallel. Node layout depends only on the
+// input, not on the thread count or timing.
+class BoundingVolumeHierarchy
+{
+public:
+
+	// Objects per leaf at most
+	static const size_t MAX_LEAF_SIZE = 4;
+
+	// Objects in a subtree that is built or refitted as one job
+	static const size_t SUBTREE_SIZE = 4096;
+
+	static const float REBUILD_COST_RATIO;
+
+	BoundingVolumeHierarchy();
+
+	// Builds over spheres of radius radius centred on pCenters[0, count)
+	void build(const DirectX::SimpleMath::Vector3* pCenters, size_t count, float radius, JobSystem& jobs);
+
+	// Fits the boxes to the spheres' new centres, which must be for the same objects as the
+	// last build
+	void refit(const DirectX::SimpleMath::Vector3* pCenters, JobSystem& jobs);
+
+	// Refits, or rebuilds if the refitted tree has got too much worse than a fresh one. True
+	// if it rebuilt.
+	bool update(const DirectX::SimpleMath::Vector3* pCenters, JobSystem& jobs);
+
+	// Appends every object whose sphere reaches into the frustum, in tree order. Gives the
+	// same set as testing every sphere with Frustum::intersectsSphere.
+	void queryFrustum(const Frustum& frustum, std::vector<int>& objects) const;
+
+	// Nearest object whose sphere the ray hits, by Ray::Intersects, and the distance to it
+	// along the ray. False if it misses every sphere.
+	bool raycast(const DirectX::SimpleMath::Ray& ray, int& object, float& distance) const;
+
+	// Appends every object whose sphere's bounding box overlaps the box, in tree order
+	void queryBox(const DirectX::SimpleMath::Vector3& boundsMin, const DirectX::SimpleMath::Vector3& boundsMax, std::vector<int>& objects) const;
+
+	size_t getObjectCount() const { return m_objects.size(); }
+	size_t getNodeCount() const { return m_nodeCount; }
+
+	// Surface area heuristic cost of the tree now, and as it was when last built
+	float getCost() const { return m_cost; }
+	float getBuildCost() const { return m_buildCost; }
+
+	uint64_t getBuildCount() const { return m_buildCount; }
+
+	// Nodes the last query on this tree opened, for comparing against a flat scan
+	uint64_t getLastQueryNodeCount() const { return m_lastQueryNodes; }
+
+private:
+
+	// Interior nodes have objectCount 0 and children first and first + 1; leaves hold
+	// m_objects[first, first + objectCount)
+	struct Node
+	{
+		DirectX::SimpleMath::Vector3 boundsMin;
+		uint32_t first;
+		DirectX::SimpleMath::Vector3 boundsMax;
+		uint32_t objectCount;
+	};
+
+	// A subtree built and refitted as one job. Its nodes below the root are
+	// [firstChild, firstChild + 2 * (end - begin) - 2), which is as many as it can need.
+	struct Subtree
+	{
+		uint32_t node;
+		uint32_t begin;
+		uint32_t end;
+		uint32_t firstChild;
+	};
+
+	// An object and where it was when the build started, kept together so splitting moves
+	// both in one pass over memory
+	struct BuildObject
+	{
+		DirectX::SimpleMath::Vector3 center;
+		int object;
+	};
+
+	// Builds node over m_buildObjects[begin, end), taking child nodes from cursor. With
+	// pSubtrees, ranges of at most SUBTREE_SIZE objects are left for later and listed there.
+	void buildNode(uint32_t node, uint32_t begin, uint32_t end, uint32_t& cursor, std::vector<Subtree>* pSubtrees);
+
+	// Refits the tree under node, stopping at subtree roots when skipSubtrees is set, and
+	// returns the unnormalised cost of what it refitted
+	float refitNode(uint32_t node, bool skipSubtrees);
+
+	void setLeafBounds(Node& node) const;
+	static float surfaceArea(const Node& node);
+
+	std::vector<Node> m_nodes;
+	size_t m_nodeCount;
+	std::vector<int> m_objects;
+	std::vector<Subtree> m_subtrees;
+	std::vector<float> m_subtreeCosts;
+	std::vector<char> m_isSubtreeRoot;
+	std::vector<BuildObject> m_buildObjects;
+
+	// Sphere centres in m_objects order, as of the last build or refit
+	std::vector<DirectX::SimpleMath::Vector3> m_centers;
+	float m_radius;
+
+	float m_cost;
+	float m_buildCost;
+	uint64_t m_buildCount;
+	mutable uint64_t m_lastQueryNodes;
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef COMMAND_RECORDER_H
+#define COMMAND_RECORDER_H
+
+#include "renderDevice.h"
+
+// Records RenderDevice calls on several threads at once and plays them back in a fixed order
+// on one device, as D3D11 deferred contexts and command lists do. Each context is a
+// RenderDevice that records rather than draws. A context may only be used by one thread at a
+// time, but different contexts can record at the same time.
+//
+// Every command list starts with nothing bound, so whatever records into a context binds all
+// it draws with. Contexts cannot append to ring buffers; append through the immediate device
+// before the lists are executed and bind ranges of the ring from the contexts.
+class CommandRecorder
+{
+public:
+
+	virtual ~CommandRecorder() {}
+
+	virtual unsigned int getContextCount() const = 0;
+	virtual RenderDevice& getContext(unsigned int context) = 0;
+
+	// Closes everything context has recorded since its last command list into a new one.
+	// Call from the thread that recorded it.
+	virtual void finishCommandList(unsigned int context) = 0;
+
+	// Plays the finished command lists of contexts 0 to count - 1, in that order, on the
+	// immediate device and frees them. Leaves nothing bound on the immediate device, so
+	// invalidate any StateCacheRenderDevice in front of it afterwards.
+	virtual void executeCommandLists(unsigned int count) = 0;
+};
+
+#endif
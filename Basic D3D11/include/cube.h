@@ -1,26 +1,61 @@
 #ifndef CUBE_H
 #define CUBE_H
 
-#include <D3D11.h>
 #include <DirectXMath.h>
-#include "..\SimpleMath.h"
-#include "VertexDefinitions.h"
-#include <assert.h>
-#include <random>
+#include "../SimpleMath.h"
+#include "randomStream.h"
+#include <vector>
+
+// Radius of the sphere through the corners of a cube, whose vertices are 1 from its centre
+// along each axis
+const float CUBE_BOUNDING_RADIUS = 1.7320508f;
+
+// The part of a cube's state that drawing needs: where it is now and where it was one step ago
+struct CubeTransform
+{
+	DirectX::SimpleMath::Vector3 previousPosition;
+	DirectX::SimpleMath::Vector3 previousRotation;
+	DirectX::SimpleMath::Vector3 position;
+	DirectX::SimpleMath::Vector3 rotation;
+};
+
+// Everything drawing reads for one frame, published as a whole once the simulation is done
+struct CubeSnapshot
+{
+	std::vector<CubeTransform> transforms;
+	float alpha = 1.0f;
+};
+
 class Cube
 {
 public:
 
 	Cube();
-	Cube(const DirectX::SimpleMath::Vector3& position, const DirectX::SimpleMath::Vector3& rotation);
+	// Every random choice the cube makes is drawn from its own stream
+	Cube(const DirectX::SimpleMath::Vector3& position, const DirectX::SimpleMath::Vector3& rotation, const RandomStream& random);
 	~Cube() = default;
 
-	const DirectX::SimpleMath::Matrix& getWorldMatrix() const { return m_world; }
+	// Transform changes only mark the world matrix dirty; it is rebuilt here on first read.
+	// Not safe to call on the same cube from several threads at once.
+	const DirectX::SimpleMath::Matrix& getWorldMatrix() const;
 	const DirectX::SimpleMath::Vector3& getPosition() const { return m_position; }
 	const DirectX::SimpleMath::Vector3& getRotation() const { return m_rotation; }
 
-	void update();
-	void draw(ID3D11DeviceContext* g_pImmediateContext) const;
+	// Advances the cube by one fixed step, keeping the state it had before for interpolation
+	void update(float deltaSeconds);
+
+	// World matrix blended between the state before and after the last update; alpha 1 is
+	// the current state. Built on every call rather than cached.
+	DirectX::SimpleMath::Matrix getInterpolatedWorldMatrix(float alpha) const;
+
+	CubeTransform getTransform() const;
+
+	// Same blend as getInterpolatedWorldMatrix for a copy of the state, so a published
+	// snapshot can be drawn while the cube itself moves on
+	static DirectX::SimpleMath::Matrix interpolateWorldMatrix(const CubeTransform& transform, float alpha);
+
+	// Number of times the world matrix has been rebuilt since construction
+	unsigned int getWorldRebuildCount() const { return m_worldRebuildCount; }
 
 private:
 
@@ -34,15 +69,21 @@ private:
 	void move(const DirectX::SimpleMath::Vector3& move);
 
 
-	void updateWorldMatrix();
+	void markWorldDirty() { m_worldDirty = true; }
+	void updateWorldMatrix() const;
 
 
-	int m_rotationAxis = (rand() % 3) + 1;
+	RandomStream m_random;
+	int m_rotationAxis = 1;
 	DirectX::SimpleMath::Vector3 m_direction;
 
 	DirectX::SimpleMath::Vector3 m_position;
 	DirectX::SimpleMath::Vector3 m_rotation;
-	DirectX::SimpleMath::Matrix m_world;
+	DirectX::SimpleMath::Vector3 m_previousPosition;
+	DirectX::SimpleMath::Vector3 m_previousRotation;
+	mutable DirectX::SimpleMath::Matrix m_world;
+	mutable bool m_worldDirty = true;
+	mutable unsigned int m_worldRebuildCount = 0;
 };
 
 #endif
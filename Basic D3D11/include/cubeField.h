@@ -0,0 +1,92 @@
+#ifndef CUBE_FIELD_H
+#define CUBE_FIELD_H
+
+#include <DirectXMath.h>
+#include "../SimpleMath.h"
+#include "randomStream.h"
+#include <stdint.h>
+#include <stddef.h>
+
+// Structure-of-arrays alternative to an array of Cube objects. Every attribute lives in its
+// own 64-byte aligned stream, padded to a whole number of SIMD lanes, and update() advances
+// the whole field with DirectXMath vector kernels instead of one call per cube.
+class CubeField
+{
+public:
+
+	static const size_t LANE_COUNT = 4;
+
+	// Cube i draws from RandomStream(seed, i), so a field matches an array of Cube objects
+	// built with the same streams
+	CubeField(size_t capacity, uint64_t seed);
+	~CubeField();
+
+	CubeField(const CubeField&) = delete;
+	CubeField& operator=(const CubeField&) = delete;
+
+	// Adds a cube with the random direction and rotation axis Cube would pick from the same stream
+	size_t add(const DirectX::SimpleMath::Vector3& position, const DirectX::SimpleMath::Vector3& rotation);
+
+	// Advances every cube by one fixed step, keeping the previous state for interpolation
+	void update(float deltaSeconds);
+
+	// Advances cubes [begin, end) only, so disjoint ranges can run on different threads.
+	// Cubes move a whole group of LANE_COUNT at a time, so begin must be a multiple of
+	// LANE_COUNT and end must be one too or be size().
+	void update(size_t begin, size_t end, float deltaSeconds);
+
+	// Writes world matrices for cubes [begin, end) blended between the state before and after
+	// the last update into pOut[0, end - begin); alpha 1 is the current state. begin must be a
+	// multiple of LANE_COUNT.
+	void interpolateWorldMatrices(size_t begin, size_t end, float alpha, DirectX::SimpleMath::Matrix* pOut) const;
+
+	size_t size() const { return m_size; }
+	size_t capacity() const { return m_capacity; }
+
+	// Size of the single block that holds every stream
+	size_t getMemoryBytes() const { return m_blockBytes; }
+
+	DirectX::SimpleMath::Vector3 getPosition(size_t index) const;
+
+	// Current positions, one stream per axis, readable up to a whole number of lanes past size()
+	const float* getPositionsX() const { return m_positionX; }
+	const float* getPositionsY() const { return m_positionY; }
+	const float* getPositionsZ() const { return m_positionZ; }
+	DirectX::SimpleMath::Vector3 getRotation(size_t index) const;
+
+	const DirectX::SimpleMath::Matrix& getWorldMatrix(size_t index) const { return m_world[index]; }
+	const DirectX::SimpleMath::Matrix* getWorldMatrices() const { return m_world; }
+
+private:
+
+	void updateLanes(size_t first, float delta);
+	void buildWorldMatrices(size_t first);
+
+	size_t m_size = 0;
+	size_t m_capacity = 0;
+	uint64_t m_seed = 0;
+
+	void* m_block = nullptr;
+	size_t m_blockBytes = 0;
+
+	float* m_positionX = nullptr;
+	float* m_positionY = nullptr;
+	float* m_positionZ = nullptr;
+	float* m_directionX = nullptr;
+	float* m_directionY = nullptr;
+	float* m_directionZ = nullptr;
+	float* m_rotationX = nullptr;
+	float* m_rotationY = nullptr;
+	float* m_rotationZ = nullptr;
+	float* m_previousPositionX = nullptr;
+	float* m_previousPositionY = nullptr;
+	float* m_previousPositionZ = nullptr;
+	float* m_previousRotationX = nullptr;
+	float* m_previousRotationY = nullptr;
+	float* m_previousRotationZ = nullptr;
+	uint32_t* m_rotationAxis = nullptr;
+	uint32_t* m_randomCounter = nullptr;
+	DirectX::SimpleMath::Matrix* m_world = nullptr;
+};
+
+#endif
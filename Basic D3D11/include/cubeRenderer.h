@@ -0,0 +1,41 @@
+#ifndef CUBE_RENDERER_H
+#define CUBE_RENDERER_H
+
+#include "commandRecorder.h"
+#include "jobSystem.h"
+#include "renderDevice.h"
+#include "VertexDefinitions.h"
+#include <stdint.h>
+
+// 36 indices for the 12 triangles of the cube
+const unsigned int CUBE_INDEX_COUNT = 36;
+const unsigned int CUBE_VERTEX_COUNT = 8;
+
+// The cube mesh the vertex and index buffers are made from: corners 1 from the centre along
+// each axis, and a triangle list whose faces are clockwise on screen when they face the camera
+extern const SimpleVertex CUBE_VERTICES[CUBE_VERTEX_COUNT];
+extern const uint16_t CUBE_INDICES[CUBE_INDEX_COUNT];
+
+// The submit functions all bind the whole pipeline they draw with, so they do not depend on what
+// was bound before; put a StateCacheRenderDevice in front to drop the binds that repeat.
+
+// Uploads and binds frameConstants once. If the device can bind constant buffer ranges and
+// the ring has room, every world matrix is then written with one map and each cube costs
+// three state calls and a draw; otherwise each cube also uploads its own world matrix.
+// Call between beginFrame() and endFrame().
+void submitCubes(RenderDevice& device, const FrameConstants& frameConstants, const ObjectConstants* pObjectConstants, size_t count);
+
+// Draws the same cubes as submitCubes, but records them on the job system's threads: the
+// cubes are split into one chunk per recorder context, of at least minChunkSize cubes each,
+// and the contexts' command lists are executed in chunk order. Uploads go through device
+// before the lists run. device is left with nothing bound, so invalidate any state cache in
+// front of it afterwards. Call between beginFrame() and endFrame() from a thread that may
+// wait on jobs.
+void submitCubesRecorded(RenderDevice& device, CommandRecorder& recorder, JobSystem& jobs, const FrameConstants& frameConstants,
+	const ObjectConstants* pObjectConstants, size_t count, size_t minChunkSize);
+
+// Uploads every world matrix as one per-instance vertex stream and draws them all with a
+// single DrawIndexedInstanced
+void submitCubesInstanced(RenderDevice& device, const FrameConstants& frameConstants, const InstanceData* pInstances, size_t count);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef D3D11_COMMAND_RECORDER_H
+#define D3D11_COMMAND_RECORDER_H
+
+#include <d3d11_1.h>
+#include <memory>
+#include <vector>
+#include "commandRecorder.h"
+#include "d3d11RenderDevice.h"
+
+// CommandRecorder over D3D11 deferred contexts. Each context records through a
+// D3D11RenderDevice that shares the immediate device's resources, FinishCommandList closes it,
+// and the immediate context runs the lists with ExecuteCommandList without restoring its own
+// state. Where the driver has no command list support the runtime emulates it, so this works
+// everywhere but may not run any faster there.
+class D3D11CommandRecorder : public CommandRecorder
+{
+public:
+
+	// Creates up to contextCount deferred contexts; getContextCount() says how many succeeded.
+	// Attach everything to resources before this.
+	D3D11CommandRecorder(ID3D11Device* pDevice, ID3D11DeviceContext* pImmediateContext, const D3D11RenderDevice& resources, unsigned int contextCount);
+	~D3D11CommandRecorder();
+
+	D3D11CommandRecorder(const D3D11CommandRecorder&) = delete;
+	D3D11CommandRecorder& operator=(const D3D11CommandRecorder&) = delete;
+
+	unsigned int getContextCount() const override { return static_cast<unsigned int>(m_contexts.size()); }
+	RenderDevice& getContext(unsigned int context) override { return *m_devices[context]; }
+	void finishCommandList(unsigned int context) override;
+	void executeCommandLists(unsigned int count) override;
+
+	// Whether the driver records command lists itself rather than the runtime emulating them
+	bool hasDriverCommandLists() const { return m_driverCommandLists; }
+
+private:
+
+	ID3D11DeviceContext* m_pImmediateContext;
+	bool m_driverCommandLists;
+
+	std::vector<ID3D11DeviceContext*> m_contexts;
+	std::vector<std::unique_ptr<D3D11RenderDevice>> m_devices;
+
+	// The finished list of each context, NULL until there is one
+	std::vector<ID3D11CommandList*> m_commandLists;
+};
+
+#endif
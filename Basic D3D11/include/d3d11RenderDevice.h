@@ -0,0 +1,130 @@
+#ifndef D3D11_RENDER_DEVICE_H
+#define D3D11_RENDER_DEVICE_H
+
+#include <d3d11_1.h>
+#include <deque>
+#include <vector>
+#include "renderDevice.h"
+#include "ringAllocator.h"
+
+// RenderDevice over a D3D11 immediate context. The resources behind each name are attached
+// once at start-up; the device holds a reference to each and releases it when destroyed.
+// Ring buffers need the D3D11.1 runtime for constant buffer offsets and no-overwrite maps of
+// constant buffers; without them getConstantBufferAlignment() is 0 and appends fail.
+class D3D11RenderDevice : public RenderDevice
+{
+public:
+
+	D3D11RenderDevice(ID3D11Device* pDevice, ID3D11DeviceContext* pContext);
+
+	// A device over a deferred context that draws with everything attached to resources so far.
+	// Ring buffers can be bound but not appended to, and dynamic buffers are left out because
+	// resources may replace them when they grow.
+	D3D11RenderDevice(ID3D11DeviceContext* pDeferredContext, const D3D11RenderDevice& resources);
+	~D3D11RenderDevice();
+
+	D3D11RenderDevice(const D3D11RenderDevice&) = delete;
+	D3D11RenderDevice& operator=(const D3D11RenderDevice&) = delete;
+
+	// A D3D11_USAGE_DEFAULT buffer, updated with UpdateSubresource
+	void attachBuffer(RenderBuffer buffer, ID3D11Buffer* pBuffer);
+
+	// A D3D11_USAGE_DYNAMIC buffer created on first update, grown whenever an update is larger
+	// than it and written with Map(WRITE_DISCARD). Vertex slots it is bound to are rebound when
+	// it grows, so callers that skip redundant binds stay correct.
+	void attachDynamicBuffer(RenderBuffer buffer, UINT bindFlags);
+
+	// A D3D11_USAGE_DYNAMIC buffer of capacity bytes shared out by a RingAllocator. Each frame
+	// appends with Map(WRITE_NO_OVERWRITE), and an event query per frame tells the allocator
+	// when the GPU is done with it. If the ring is full of in-flight data the append maps with
+	// WRITE_DISCARD instead and starts again from the front.
+	HRESULT attachRingBuffer(RenderBuffer buffer, UINT bindFlags, size_t capacity);
+
+	void attachVertexShader(RenderShader shader, ID3D11VertexShader* pShader);
+	void attachPixelShader(RenderShader shader, ID3D11PixelShader* pShader);
+	void attachInputLayout(RenderLayout layout, ID3D11InputLayout* pLayout);
+	void attachRenderTarget(RenderTarget target, ID3D11RenderTargetView* pRenderTargetView, ID3D11DepthStencilView* pDepthStencilView);
+
+	// NULL stands for the default depth-stencil state
+	void attachDepthStencilState(RenderDepthState state, ID3D11DepthStencilState* pState);
+
+	void attachViewport(RenderViewport viewport, const D3D11_VIEWPORT& area);
+
+	void beginFrame() override;
+	void endFrame() override;
+	void clearState() override;
+	void updateBuffer(RenderBuffer buffer, const void* pData, size_t bytes) override;
+	size_t getConstantBufferAlignment() const override;
+	bool appendBuffer(RenderBuffer buffer, const void* pData, size_t elementBytes, size_t count, size_t stride, size_t& offset) override;
+	void setRenderTarget(RenderTarget target) override;
+	void setDepthStencilState(RenderDepthState state) override;
+	void setViewport(RenderViewport viewport) override;
+	void setPrimitiveTopology(RenderTopology topology) override;
+	void setInputLayout(RenderLayout layout) override;
+	void setVertexShader(RenderShader shader) override;
+	void setPixelShader(RenderShader shader) override;
+	void setVertexConstantBuffer(unsigned int slot, RenderBuffer buffer) override;
+	void setVertexConstantBufferRange(unsigned int slot, RenderBuffer buffer, size_t offset, size_t bytes) override;
+	void setVertexBuffer(unsigned int slot, RenderBuffer buffer, unsigned int stride) override;
+	void setIndexBuffer(RenderBuffer buffer) override;
+	void drawIndexed(unsigned int indexCount) override;
+	void drawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount) override;
+
+private:
+
+	// VSSetConstantBuffers1 binds whole multiples of 16 constants of 16 bytes
+	static const size_t CONSTANT_RANGE_ALIGNMENT = 256;
+
+	struct Buffer
+	{
+		ID3D11Buffer* pBuffer;
+		bool dynamic;
+		bool ring;
+		bool discardNext;
+		UINT bindFlags;
+		size_t capacity;
+	};
+
+	struct RenderTargetViews
+	{
+		ID3D11RenderTargetView* pRenderTargetView;
+		ID3D11DepthStencilView* pDepthStencilView;
+	};
+
+	struct VertexBinding
+	{
+		int buffer;
+		UINT stride;
+	};
+
+	struct PendingFrame
+	{
+		uint64_t frame;
+		ID3D11Query* pQuery;
+	};
+
+	ID3D11Device* m_pDevice;
+	ID3D11DeviceContext* m_pContext;
+	ID3D11DeviceContext1* m_pContext1;
+	bool m_constantOffsets;
+
+	Buffer m_buffers[RENDER_BUFFER_COUNT];
+	RingAllocator m_rings[RENDER_BUFFER_COUNT];
+
+	// Frames submitted but not yet known to be finished, oldest first, and spare queries
+	uint64_t m_frame;
+	std::deque<PendingFrame> m_pendingFrames;
+	std::vector<ID3D11Query*> m_freeQueries;
+
+	ID3D11VertexShader* m_vertexShaders[RENDER_SHADER_COUNT];
+	ID3D11PixelShader* m_pixelShaders[RENDER_SHADER_COUNT];
+	ID3D11InputLayout* m_layouts[RENDER_LAYOUT_COUNT];
+	RenderTargetViews m_renderTargets[RENDER_TARGET_COUNT];
+	ID3D11DepthStencilState* m_depthStates[RENDER_DEPTH_STATE_COUNT];
+	D3D11_VIEWPORT m_viewports[RENDER_VIEWPORT_COUNT];
+
+	// What each vertex slot was last bound to through this device, -1 for nothing
+	VertexBinding m_vertexBindings[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+};
+
+#endif
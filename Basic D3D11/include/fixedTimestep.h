@@ -0,0 +1,51 @@
+#ifndef FIXED_TIMESTEP_H
+#define FIXED_TIMESTEP_H
+
+#include <chrono>
+
+// Fixed-step accumulator for the simulation. Real time measured by a high-resolution clock
+// is banked each frame and paid out in whole steps of 1 / stepRate seconds, so the simulation
+// produces the same results whatever the render rate. Whatever is left over is returned as
+// getAlpha() for blending the previous and current state when drawing.
+class FixedTimestep
+{
+public:
+
+	static const unsigned int DEFAULT_MAX_STEPS = 8;
+
+	// maxStepsPerFrame stops a slow frame from queuing ever more steps; time beyond it is dropped
+	explicit FixedTimestep(double stepRate, unsigned int maxStepsPerFrame = DEFAULT_MAX_STEPS);
+
+	// Reads the clock and returns the number of steps to run this frame. The first call only
+	// starts the clock.
+	unsigned int beginFrame();
+
+	// Same as beginFrame() with the elapsed time supplied by the caller
+	unsigned int advance(double elapsedSeconds);
+
+	void setStepRate(double stepRate);
+	double getStepRate() const { return 1.0 / m_stepSeconds; }
+	float getStepSeconds() const { return static_cast<float>(m_stepSeconds); }
+
+	// Fraction of a step still in the accumulator, in [0, 1]
+	float getAlpha() const { return m_accumulator < m_stepSeconds ? static_cast<float>(m_accumulator / m_stepSeconds) : 1.0f; }
+
+	unsigned long long getStepCount() const { return m_stepCount; }
+	unsigned long long getDroppedStepCount() const { return m_droppedStepCount; }
+
+private:
+
+	typedef std::chrono::steady_clock Clock;
+
+	Clock::time_point m_lastTime;
+	bool m_started = false;
+
+	double m_stepSeconds;
+	double m_accumulator = 0.0;
+	unsigned int m_maxStepsPerFrame;
+
+	unsigned long long m_stepCount = 0;
+	unsigned long long m_droppedStepCount = 0;
+};
+
+#endif
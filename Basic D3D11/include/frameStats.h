@@ -0,0 +1,127 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Counts of nanosecond durations in log-linear buckets, as HdrHistogram does: values below
+// 2^SUB_BUCKET_BITS get a bucket each, and every power of two above that is split into
+// 2^(SUB_BUCKET_BITS - 1) equal buckets. A percentile read back is the top of its bucket, so it
+// is never under the true value and over it by less than 1 part in 2^(SUB_BUCKET_BITS - 1),
+// whatever the range. Recording is an increment, and the memory does not grow.
+class LatencyHistogram
+{
+public:
+
+	static const unsigned int SUB_BUCKET_BITS = 7;
+
+	// Values are clamped to 2^VALUE_BITS - 1 ns, a little over a minute
+	static const unsigned int VALUE_BITS = 36;
+
+	static size_t getBucketIndex(uint64_t value);
+
+	// Largest value that falls into bucket
+	static uint64_t getBucketHighest(size_t bucket);
+
+	static size_t getBucketCount() { return getBucketIndex(MAX_VALUE) + 1; }
+
+	LatencyHistogram();
+
+	void record(uint64_t value);
+	void merge(const LatencyHistogram& other);
+	void reset();
+
+	uint64_t getCount() const { return m_count; }
+	uint64_t getMin() const { return m_count > 0 ? m_min : 0; }
+	uint64_t getMax() const { return m_max; }
+	double getMean() const { return m_count > 0 ? static_cast<double>(m_sum) / m_count : 0.0; }
+
+	// Smallest bucket top with at least percentile percent of the values at or below it, no
+	// more than the largest value recorded; 0 when empty
+	uint64_t getPercentile(double percentile) const;
+
+private:
+
+	static const uint64_t MAX_VALUE = (1ull << VALUE_BITS) - 1;
+
+	std::vector<uint64_t> m_buckets;
+	uint64_t m_count;
+	uint64_t m_sum;
+	uint64_t m_min;
+	uint64_t m_max;
+};
+
+// Always-on timing of the frame loop. Each phase of every frame is recorded into a histogram
+// for the current interval; closeInterval() reads p50, p95, p99 and the maximum of each off it,
+// keeps them, folds the interval into the run as a whole and starts the next. Only the last
+// MAX_INTERVALS summaries are kept, so the memory and the summary file stay the same size
+// however long the loop runs, while the totals cover every frame. Tails show up here that
+// averages hide: one 50 ms hitch in a second of 16 ms frames moves the p99 and the maximum and
+// barely moves the mean.
+class FrameStats
+{
+public:
+
+	static const size_t MAX_INTERVALS = 60;
+
+	enum Phase
+	{
+		PHASE_FRAME,
+		PHASE_SIMULATE,
+		PHASE_CULL,
+		PHASE_SORT,
+		PHASE_PACK,
+		PHASE_SUBMIT,
+		PHASE_COUNT,
+	};
+
+	struct PhaseSummary
+	{
+		uint64_t count;
+		uint64_t p50;
+		uint64_t p95;
+		uint64_t p99;
+		uint64_t max;
+	};
+
+	struct IntervalSummary
+	{
+		double seconds;
+		PhaseSummary phases[PHASE_COUNT];
+	};
+
+	static const char* getPhaseName(Phase phase);
+	static PhaseSummary summarize(const LatencyHistogram& histogram);
+
+	// Only the thread running the frame loop may record, close intervals or write summaries
+	void record(Phase phase, uint64_t nanoseconds) { m_interval[phase].record(nanoseconds); }
+
+	// seconds is how long the interval ran, for the summary
+	const IntervalSummary& closeInterval(double seconds);
+
+	// Intervals closed over the run, and how many of the most recent are still kept
+	uint64_t getClosedCount() const { return m_closedCount; }
+	size_t getKeptCount() const { return static_cast<size_t>(m_closedCount < MAX_INTERVALS ? m_closedCount : MAX_INTERVALS); }
+
+	// index counts from the oldest interval kept
+	const IntervalSummary& getInterval(size_t index) const;
+
+	const LatencyHistogram& getIntervalHistogram(Phase phase) const { return m_interval[phase]; }
+	const LatencyHistogram& getTotalHistogram(Phase phase) const { return m_total[phase]; }
+
+	// Writes a table of the intervals kept in milliseconds, numbered from the start of the run,
+	// then of every interval closed. Close the last interval first to include it. False if the
+	// file cannot be written.
+	bool writeSummary(const char* path) const;
+
+private:
+
+	LatencyHistogram m_interval[PHASE_COUNT];
+	LatencyHistogram m_total[PHASE_COUNT];
+	IntervalSummary m_intervals[MAX_INTERVALS];
+	uint64_t m_closedCount = 0;
+	double m_totalSeconds = 0.0;
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <DirectXMath.h>
+#include "../SimpleMath.h"
+#include <stddef.h>
+
+// The six planes of a view frustum, facing inwards and normalised so the distance of a point
+// from each is a plain dot product. Spheres are culled four at a time, one per SIMD lane,
+// with the planes splatted across the lanes.
+class Frustum
+{
+public:
+
+	static const size_t PLANE_COUNT = 6;
+	static const size_t LANE_COUNT = 4;
+
+	enum BoxTest
+	{
+		BOX_OUTSIDE,
+		BOX_INTERSECTS,
+		BOX_INSIDE,
+	};
+
+	// Planes of the volume viewProjection maps into clip space, taking SimpleMath's row
+	// vectors and D3D's 0 to 1 depth range
+	explicit Frustum(const DirectX::SimpleMath::Matrix& viewProjection);
+
+	const DirectX::SimpleMath::Plane& getPlane(size_t plane) const { return m_planes[plane]; }
+
+	// One sphere at a time, for checking the batched tests
+	bool intersectsSphere(const DirectX::SimpleMath::Vector3& center, float radius) const;
+
+	// Whether the axis-aligned box is clear of the frustum, crosses it or lies wholly inside.
+	// Conservative: a box near a corner may read as crossing when it is outside.
+	BoxTest testBox(const DirectX::SimpleMath::Vector3& boundsMin, const DirectX::SimpleMath::Vector3& boundsMax) const;
+
+	// Writes firstIndex + i to pVisible, in order, for every sphere i of radius radius that is
+	// at least partly inside the frustum, and returns how many it wrote. pVisible needs room
+	// for count indices.
+	size_t cullSpheres(const DirectX::SimpleMath::Vector3* pCenters, size_t count, float radius, int firstIndex, int* pVisible) const;
+
+	// Same, with the centres in three streams that can be read to a whole number of lanes
+	// past count, as CubeField's are
+	size_t cullSpheres(const float* pCenterX, const float* pCenterY, const float* pCenterZ, size_t count, float radius, int firstIndex, int* pVisible) const;
+
+private:
+
+	DirectX::SimpleMath::Plane m_planes[PLANE_COUNT];
+};
+
+#endif
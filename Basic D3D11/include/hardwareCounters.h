@@ -0,0 +1,78 @@
+#ifndef HARDWARE_COUNTERS_H
+#define HARDWARE_COUNTERS_H
+
+#include <stdint.h>
+#include <string>
+
+// CPU event counts of the calling thread from Linux perf_event_open, user mode only: cycles,
+// instructions, L1 data cache read misses, last level cache misses and branch misses. The
+// counters are opened as one group led by cycles, so when the CPU has fewer counters than
+// events and has to take turns, the group is counted over the same time slices and the IPC
+// stays consistent. A counter the group refuses is opened on its own, and a counter that
+// cannot be opened at all is reported as unavailable. In a container perf_event_open is
+// often blocked by seccomp or by kernel.perf_event_paranoid; elsewhere than Linux nothing is
+// available. Either way the counters read 0 and getError() says why, so callers carry on
+// timing.
+//
+// The counts cover only the thread that constructed the counters, so time single-threaded
+// work with them.
+class HardwareCounters
+{
+public:
+
+	enum Counter
+	{
+		COUNTER_CYCLES,
+		COUNTER_INSTRUCTIONS,
+		COUNTER_L1D_MISSES,
+		COUNTER_LLC_MISSES,
+		COUNTER_BRANCH_MISSES,
+		COUNTER_COUNT,
+	};
+
+	struct Reading
+	{
+		uint64_t values[COUNTER_COUNT];
+
+		// Some counter shared the hardware with others for part of the time, so its value is
+		// scaled up from the time it ran
+		bool scaled;
+
+		Reading();
+
+		void add(const Reading& other);
+
+		// Instructions per cycle, 0 without both counters
+		double getIpc() const;
+	};
+
+	static const char* getCounterName(Counter counter);
+
+	HardwareCounters();
+	~HardwareCounters();
+
+	HardwareCounters(const HardwareCounters&) = delete;
+	HardwareCounters& operator=(const HardwareCounters&) = delete;
+
+	bool isAvailable(Counter counter) const { return m_files[counter] >= 0; }
+	bool isAnyAvailable() const;
+
+	// Why the first counter that failed to open did, empty if all of them opened
+	const std::string& getError() const { return m_error; }
+
+	// Zeroes the counters and starts them
+	void start();
+
+	// Stops the counters and reads what they counted since start()
+	Reading stop();
+
+private:
+
+	int m_files[COUNTER_COUNT];
+
+	// Whether each counter is in the group led by COUNTER_CYCLES
+	bool m_grouped[COUNTER_COUNT];
+	std::string m_error;
+};
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Tracks outstanding work for a group of tasks. onComplete, if set, is run by whichever
+// thread finishes the last piece of work, and the counter must outlive that call.
+struct JobCounter
+{
+	JobCounter() : pending(0) {}
+
+	std::atomic<size_t> pending;
+	std::function<void()> onComplete;
+
+	bool isDone() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+// Fixed pool of worker threads with one deque per thread. Ranges are split in half on the
+// fly: a thread keeps working on the lower half and pushes the upper half onto the back of
+// its own deque, while idle threads steal the oldest (largest) pieces from the front of the
+// others. The thread that calls wait(), waitFor() or parallelFor() runs tasks too, so a pool
+// with no workers is still usable.
+class JobSystem
+{
+public:
+
+	typedef std::function<void(size_t begin, size_t end)> RangeFunction;
+	typedef std::function<void()> TaskFunction;
+
+	// Starts one worker per hardware thread, less the calling thread
+	static const unsigned int DEFAULT_WORKERS = ~0u;
+
+	explicit JobSystem(unsigned int workerCount = DEFAULT_WORKERS);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// Workers plus the calling thread
+	unsigned int getThreadCount() const { return static_cast<unsigned int>(m_workers.size()) + 1; }
+
+	// Queues body over [0, count), split into pieces of at most grainSize indices, and
+	// charges the work to counter. Returns at once.
+	void run(size_t count, size_t grainSize, const RangeFunction& body, JobCounter& counter);
+	void run(const TaskFunction& task, JobCounter& counter);
+
+	// Runs queued tasks on the calling thread until counter has no work left
+	void waitFor(const JobCounter& counter);
+
+	// Queues body over [0, count) against the pool's own counter and returns at once
+	void dispatch(size_t count, size_t grainSize, const RangeFunction& body);
+
+	// Frame barrier: helps run queued tasks and returns once every dispatch has finished
+	void wait() { waitFor(m_dispatched); }
+
+	void parallelFor(size_t count, size_t grainSize, const RangeFunction& body)
+	{
+		dispatch(count, grainSize, body);
+		wait();
+	}
+
+	// Runs one queued task on the calling thread; false if there was nothing to run
+	bool runOneTask();
+
+private:
+
+	struct Task
+	{
+		std::shared_ptr<const RangeFunction> body;
+		size_t begin;
+		size_t end;
+		size_t grainSize;
+		JobCounter* pCounter;
+	};
+
+	struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	void push(const Task& task);
+	bool pop(size_t queueIndex, Task& task);
+	void execute(Task task);
+	void workerLoop(size_t queueIndex);
+
+	size_t getQueueIndex() const;
+
+	std::vector<std::thread> m_workers;
+
+	// Queue 0 belongs to threads outside the pool; queue i + 1 to worker i
+	std::vector<std::unique_ptr<WorkQueue>> m_queues;
+
+	std::atomic<size_t> m_queuedTasks;
+	std::mutex m_sleepMutex;
+	std::condition_variable m_workAvailable;
+	bool m_quit = false;
+
+	JobCounter m_dispatched;
+};
+
+#endif
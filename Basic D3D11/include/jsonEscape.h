@@ -0,0 +1,10 @@
+#ifndef JSON_ESCAPE_H
+#define JSON_ESCAPE_H
+
+#include <stdio.h>
+
+// Writes text as the inside of a JSON string: quotes and backslashes are escaped and control
+// characters written as \uXXXX. The surrounding quotes are left to the caller.
+void writeJsonEscaped(FILE* pFile, const char* text);
+
+#endif
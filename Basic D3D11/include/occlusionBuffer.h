@@ -0,0 +1,129 @@
+#ifndef OCCLUSION_BUFFER_H
+#define OCCLUSION_BUFFER_H
+
+#include <DirectXMath.h>
+#include "../SimpleMath.h"
+#include "jobSystem.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Small depth-only software render target for occlusion culling. The nearest cubes are drawn
+// into it as occluders, four pixels at a time per SIMD lane, in horizontal bands that run as
+// separate jobs. A pyramid of the farthest depth under each 2x2 block of the level below then
+// lets a cube's screen-space bounds be tested against a handful of cells at whatever level
+// they fit.
+//
+// Depth runs 0 near to 1 far as in D3D. A triangle only writes the cells it covers completely,
+// allowing for its vertices having been snapped, and writes the farthest depth it reaches over
+// each, so a cell is never nearer than the occluder at any point of it. The test only reports
+// a sphere as occluded if its nearest point lies behind every cell under its bounds, so
+// culling never removes a cube that would have shown at any resolution. Occluders that reach
+// behind the near plane or far off screen are left out rather than clipped, which is also on
+// the safe side.
+class OcclusionBuffer
+{
+public:
+
+	static const unsigned int DEFAULT_WIDTH = 256;
+	static const unsigned int DEFAULT_HEIGHT = 128;
+
+	// Sizes above this would take the edge tests past what a float holds exactly
+	static const unsigned int MAX_SIZE = 512;
+
+	// Rows rasterised by one job
+	static const unsigned int BAND_HEIGHT = 16;
+
+	static const size_t LANE_COUNT = 4;
+
+	// width is rounded up to a whole number of lanes and height to whole bands
+	OcclusionBuffer(unsigned int width = DEFAULT_WIDTH, unsigned int height = DEFAULT_HEIGHT);
+
+	// Picks from pIndices[0, count) the maxOccluders cubes nearest the camera, by clip-space w
+	// of their centres, and writes them to occluders nearest first
+	static void selectOccluders(const DirectX::SimpleMath::Matrix& viewProjection, const DirectX::SimpleMath::Vector3* pCenters, const int* pIndices,
+		size_t count, size_t maxOccluders, std::vector<int>& occluders);
+
+	// Clears, draws the front faces of the cubes with these world matrices and builds the
+	// depth pyramid. isOccluded() then tests against this view.
+	void render(const DirectX::SimpleMath::Matrix& viewProjection, const DirectX::SimpleMath::Matrix* pWorlds, size_t count, JobSystem& jobs);
+
+	// Same as render, one pixel at a time on the calling thread, for checking it
+	void renderReference(const DirectX::SimpleMath::Matrix& viewProjection, const DirectX::SimpleMath::Matrix* pWorlds, size_t count);
+
+	// Whether everything drawn covers the sphere's screen-space bounds and is nearer than
+	// any point of it
+	bool isOccluded(const DirectX::SimpleMath::Vector3& center, float radius) const;
+
+	// Removes from pIndices[0, count) the cubes whose bounding spheres are occluded, keeping
+	// the order of the rest, and returns how many are left
+	size_t cullOccluded(const DirectX::SimpleMath::Vector3* pCenters, float radius, int* pIndices, size_t count, JobSystem& jobs);
+
+	unsigned int getWidth() const { return m_width; }
+	unsigned int getHeight() const { return m_height; }
+	float getDepth(unsigned int x, unsigned int y) const { return m_levels[0][y * m_width + x]; }
+
+	// Front-facing triangles drawn by the last render, and occluders it left out
+	size_t getTriangleCount() const { return m_triangleCount; }
+	size_t getSkippedCount() const { return m_skippedCount; }
+
+private:
+
+	// A front-facing triangle in pixels, vertices snapped to a quarter pixel so the edge tests
+	// are exact, with its depth as a plane through vertex 0 and the cells it can cover. Each
+	// edge is tested at the corner of a cell least inside it, and depth is read at the corner
+	// where it is farthest; both are offsets from the cell's top-left corner.
+	struct Triangle
+	{
+		float x[3];
+		float y[3];
+		float edgeCornerX[3];
+		float edgeCornerY[3];
+		float edgeMargin[3];
+		float z0;
+		float zdx;
+		float zdy;
+		float depthCornerX;
+		float depthCornerY;
+		int minX;
+		int maxX;
+		int minY;
+		int maxY;
+	};
+
+	struct Level
+	{
+		unsigned int width;
+		unsigned int height;
+	};
+
+	// Writes the front faces of one cube to pTriangles, at most 12, and their number to count.
+	// False if the cube reaches behind the near plane or far enough off screen that its edge
+	// tests would not be exact.
+	bool setupCube(const DirectX::SimpleMath::Matrix& worldViewProjection, Triangle* pTriangles, unsigned int& count) const;
+
+	void setupAll(const DirectX::SimpleMath::Matrix* pWorlds, size_t count, JobSystem* pJobs);
+	void rasterizeBand(unsigned int firstRow, unsigned int endRow);
+	void rasterizeReference(const Triangle& triangle, float* pDepth) const;
+	void buildPyramid();
+
+	unsigned int m_width;
+	unsigned int m_height;
+	DirectX::SimpleMath::Matrix m_viewProjection;
+
+	// Level 0 is the depth buffer; each level after holds the farthest depth of 2x2 cells of
+	// the one before
+	std::vector<std::vector<float>> m_levels;
+	std::vector<Level> m_levelSizes;
+
+	// 12 slots per occluder, filled from the front
+	std::vector<Triangle> m_triangles;
+	std::vector<unsigned int> m_cubeTriangleCounts;
+	std::vector<char> m_cubeDrawn;
+	size_t m_triangleCount;
+	size_t m_skippedCount;
+
+	std::vector<char> m_occluded;
+};
+
+#endif
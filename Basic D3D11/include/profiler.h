@@ -0,0 +1,103 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// CPU timeline of the frame. PROFILE_ZONE times the rest of the enclosing scope and
+// PROFILE_COUNTER records a named value at this moment; both go into a ring of
+// EVENTS_PER_THREAD events owned by the calling thread, so recording takes no lock and only
+// the oldest events are lost when a ring fills. Zones nest, and each one records how deeply.
+// writeChromeTrace() saves the rings as trace event JSON for chrome://tracing or Perfetto.
+//
+// Everything here only exists when PROFILE is defined, as in the Debug and Profile builds.
+// Otherwise the macros expand to nothing and their arguments are not evaluated.
+//
+// Names are kept as pointers, so pass string literals or strings that outlive the export.
+#ifdef PROFILE
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) Profiler::Zone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_COUNTER(name, value) Profiler::recordCounter(name, static_cast<int64_t>(value))
+#define PROFILE_THREAD_NAME(name) Profiler::setThreadName(name)
+
+class Profiler
+{
+public:
+
+	static const size_t EVENTS_PER_THREAD = 1 << 16;
+
+	enum EventKind
+	{
+		EVENT_ZONE,
+		EVENT_COUNTER,
+	};
+
+	// A finished zone, or a counter value at start. Times are steady clock nanoseconds.
+	struct Event
+	{
+		const char* name;
+		uint64_t start;
+		int64_t value;
+		uint32_t kind;
+		uint32_t depth;
+
+		uint64_t getEnd() const { return kind == EVENT_ZONE ? start + static_cast<uint64_t>(value) : start; }
+	};
+
+	// The events of one thread still in its ring, oldest first
+	struct ThreadEvents
+	{
+		uint32_t thread;
+		std::string name;
+		std::vector<Event> events;
+
+		// Overwritten before they could be collected, since the last clear()
+		uint64_t dropped;
+	};
+
+	class Zone
+	{
+	public:
+
+		explicit Zone(const char* name);
+		~Zone();
+
+		Zone(const Zone&) = delete;
+		Zone& operator=(const Zone&) = delete;
+
+	private:
+
+		const char* m_name;
+		uint64_t m_start;
+		uint32_t m_depth;
+	};
+
+	static void recordCounter(const char* name, int64_t value);
+
+	// Copied, so any string will do. Threads that never set one are named by number.
+	static void setThreadName(const char* name);
+
+	static uint64_t now();
+
+	// Reading races with recording, so only collect, export or clear while no other thread is
+	// recording, such as between frames
+	static void collect(std::vector<ThreadEvents>& threads);
+	static bool writeChromeTrace(const char* path);
+
+	// Forgets every event recorded so far
+	static void clear();
+};
+
+#else
+
+#define PROFILE_ZONE(name)
+#define PROFILE_COUNTER(name, value)
+#define PROFILE_THREAD_NAME(name)
+
+#endif
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef RANDOM_STREAM_H
+#define RANDOM_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Counter-based random numbers built on Philox4x32-10 (Salmon et al., "Parallel Random
+// Numbers: As Easy as 1, 2, 3"). Every value is a pure function of (seed, stream, counter),
+// so a cube that owns its own stream draws the same numbers whichever thread updates it and
+// however many threads there are.
+class RandomStream
+{
+public:
+
+	// Stream reserved for spawn positions so they never overlap a cube's own stream
+	static const uint32_t SPAWN_STREAM = 0xFFFFFFFFu;
+
+	RandomStream() : m_seed(0), m_stream(0), m_counter(0) {}
+	RandomStream(uint64_t seed, uint32_t stream, uint32_t counter = 0) : m_seed(seed), m_stream(stream), m_counter(counter) {}
+
+	uint32_t nextUInt() { return generate(m_seed, m_stream, m_counter++); }
+
+	// Uniform in [0, bound) by multiply-shift; the bias is below 2^-32 * bound
+	uint32_t nextBelow(uint32_t bound) { return static_cast<uint32_t>((static_cast<uint64_t>(nextUInt()) * bound) >> 32); }
+
+	// Uniform in [0, 1) with 24 bits of precision
+	float nextFloat() { return toUnitFloat(nextUInt()); }
+	float nextFloat(float min, float max) { return min + (max - min) * nextFloat(); }
+
+	uint64_t getSeed() const { return m_seed; }
+	uint32_t getStream() const { return m_stream; }
+	uint32_t getCounter() const { return m_counter; }
+
+	// Value number counter of a stream: word (counter % 4) of the Philox block counter / 4
+	static uint32_t generate(uint64_t seed, uint32_t stream, uint32_t counter)
+	{
+		uint32_t block[4];
+		philox4x32(seed, stream, counter >> 2, block);
+		return block[counter & 3];
+	}
+
+	// Batch forms of count successive draws from counter firstCounter onwards. Each Philox
+	// block is independent of the others, so the loop has no carried state and vectorises.
+	static void fill(uint64_t seed, uint32_t stream, uint32_t firstCounter, uint32_t* pOut, size_t count);
+	static void fillFloat(uint64_t seed, uint32_t stream, uint32_t firstCounter, float min, float max, float* pOut, size_t count);
+
+	static float toUnitFloat(uint32_t value) { return static_cast<float>(value >> 8) * (1.0f / 16777216.0f); }
+
+	static void philox4x32(uint64_t seed, uint32_t stream, uint32_t block, uint32_t out[4])
+	{
+		uint32_t c0 = block;
+		uint32_t c1 = stream;
+		uint32_t c2 = 0;
+		uint32_t c3 = 0;
+		uint32_t k0 = static_cast<uint32_t>(seed);
+		uint32_t k1 = static_cast<uint32_t>(seed >> 32);
+
+		for (int round = 0; round < 10; ++round)
+		{
+			const uint64_t product0 = static_cast<uint64_t>(0xD2511F53u) * c0;
+			const uint64_t product1 = static_cast<uint64_t>(0xCD9E8D57u) * c2;
+
+			c0 = static_cast<uint32_t>(product1 >> 32) ^ c1 ^ k0;
+			c1 = static_cast<uint32_t>(product1);
+			c2 = static_cast<uint32_t>(product0 >> 32) ^ c3 ^ k1;
+			c3 = static_cast<uint32_t>(product0);
+
+			k0 += 0x9E3779B9u;
+			k1 += 0xBB67AE85u;
+		}
+
+		out[0] = c0;
+		out[1] = c1;
+		out[2] = c2;
+		out[3] = c3;
+	}
+
+private:
+
+	uint64_t m_seed;
+	uint32_t m_stream;
+	uint32_t m_counter;
+};
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef RECORDING_RENDER_DEVICE_H
+#define RECORDING_RENDER_DEVICE_H
+
+#include "renderDevice.h"
+#include "ringAllocator.h"
+#include <stdint.h>
+#include <vector>
+
+// Stand-in for the D3D11 device where there is no GPU. Counts every call and every byte
+// uploaded, keeps the last contents of each buffer so tests can check what would have
+// reached the GPU, and flags draws that read past the end of the bound instance stream, bind
+// a constant range the device could not, or have no render target or viewport to draw to.
+// Every draw folds the state bound at that point, and the contents of the constant buffers
+// bound, into a checksum, so two call streams that draw with the same state and constants
+// give the same checksum. Ring buffers behave as if the GPU finished each frame frameLatency
+// frames after it was submitted.
+class RecordingRenderDevice : public RenderDevice
+{
+public:
+
+	// constantBufferAlignment 0 stands in for a device without constant buffer offsets
+	explicit RecordingRenderDevice(size_t constantBufferAlignment = 0, unsigned int frameLatency = 2);
+
+	void attachRingBuffer(RenderBuffer buffer, size_t capacity);
+
+	void beginFrame() override;
+	void endFrame() override;
+	void clearState() override;
+	void updateBuffer(RenderBuffer buffer, const void* pData, size_t bytes) override;
+	size_t getConstantBufferAlignment() const override { return m_constantBufferAlignment; }
+	bool appendBuffer(RenderBuffer buffer, const void* pData, size_t elementBytes, size_t count, size_t stride, size_t& offset) override;
+	void setRenderTarget(RenderTarget target) override;
+	void setDepthStencilState(RenderDepthState state) override;
+	void setViewport(RenderViewport viewport) override;
+	void setPrimitiveTopology(RenderTopology topology) override;
+	void setInputLayout(RenderLayout layout) override;
+	void setVertexShader(RenderShader shader) override;
+	void setPixelShader(RenderShader shader) override;
+	void setVertexConstantBuffer(unsigned int slot, RenderBuffer buffer) override;
+	void setVertexConstantBufferRange(unsigned int slot, RenderBuffer buffer, size_t offset, size_t bytes) override;
+	void setVertexBuffer(unsigned int slot, RenderBuffer buffer, unsigned int stride) override;
+	void setIndexBuffer(RenderBuffer buffer) override;
+	void drawIndexed(unsigned int indexCount) override;
+	void drawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount) override;
+
+	// Clears the counters but keeps the buffer contents and bound state, like a new frame
+	void resetCounters();
+
+	uint64_t getCallCount(RenderCall call) const { return m_callCounts[call]; }
+	uint64_t getTotalCallCount() const;
+	uint64_t getBytesUploaded() const { return m_bytesUploaded; }
+	uint64_t getDrawCallCount() const { return m_callCounts[RENDER_CALL_DRAW_INDEXED] + m_callCounts[RENDER_CALL_DRAW_INDEXED_INSTANCED]; }
+	uint64_t getInstancesDrawn() const { return m_instancesDrawn; }
+	uint64_t getInvalidDrawCount() const { return m_invalidDraws; }
+	uint64_t getDrawStateChecksum() const { return m_drawStateChecksum; }
+
+	// Appends that found the ring full of in-flight data and started it again, as
+	// Map(WRITE_DISCARD) would
+	uint64_t getDiscardCount() const { return m_discards; }
+
+	const std::vector<uint8_t>& getBufferContents(RenderBuffer buffer) const { return m_buffers[buffer]; }
+	size_t getLastAppendOffset(RenderBuffer buffer) const { return m_lastAppendOffsets[buffer]; }
+
+	static const char* getCallName(RenderCall call);
+
+private:
+
+	static const unsigned int VERTEX_SLOT_COUNT = 2;
+	static const unsigned int CONSTANT_SLOT_COUNT = 2;
+
+	uint64_t m_callCounts[RENDER_CALL_COUNT];
+	uint64_t m_bytesUploaded = 0;
+	uint64_t m_instancesDrawn = 0;
+	uint64_t m_invalidDraws = 0;
+	uint64_t m_discards = 0;
+	uint64_t m_drawStateChecksum;
+
+	std::vector<uint8_t> m_buffers[RENDER_BUFFER_COUNT];
+	RingAllocator m_rings[RENDER_BUFFER_COUNT];
+	size_t m_lastAppendOffsets[RENDER_BUFFER_COUNT];
+
+	size_t m_constantBufferAlignment;
+	unsigned int m_frameLatency;
+	uint64_t m_frame = 0;
+
+	// Everything bound, -1 where nothing is. Only fixed-size integers and no padding, so the
+	// bytes can be hashed as they are.
+	struct BoundState
+	{
+		uint64_t constantOffset[CONSTANT_SLOT_COUNT];
+		uint64_t constantBytes[CONSTANT_SLOT_COUNT];
+		int32_t constantBuffer[CONSTANT_SLOT_COUNT];
+		int32_t vertexBuffer[VERTEX_SLOT_COUNT];
+		uint32_t vertexStride[VERTEX_SLOT_COUNT];
+		int32_t renderTarget;
+		int32_t depthState;
+		int32_t topology;
+		int32_t layout;
+		int32_t vertexShader;
+		int32_t pixelShader;
+		int32_t indexBuffer;
+		int32_t viewport;
+	};
+
+	void recordDraw();
+
+	// Whether a draw now would land anywhere; D3D11 draws nothing without both
+	bool isOutputBound() const { return m_state.renderTarget >= 0 && m_state.viewport >= 0; }
+
+	BoundState m_state;
+
+	// Whether the range bound to each constant slot was one the device could bind
+	bool m_constantRangeValid[CONSTANT_SLOT_COUNT];
+};
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef RENDER_DEVICE_H
+#define RENDER_DEVICE_H
+
+#include <stddef.h>
+
+// GPU resources the cube renderer uses. They are named rather than passed around as D3D11
+// pointers so that the submission code also runs against RecordingRenderDevice.
+enum RenderBuffer
+{
+	RENDER_BUFFER_CUBE_VERTICES,
+	RENDER_BUFFER_CUBE_INDICES,
+	RENDER_BUFFER_FRAME_CONSTANTS,
+	RENDER_BUFFER_OBJECT_CONSTANTS,
+	RENDER_BUFFER_OBJECT_CONSTANT_RING,
+	RENDER_BUFFER_INSTANCES,
+	RENDER_BUFFER_COUNT
+};
+
+enum RenderShader
+{
+	RENDER_SHADER_CUBE_VS,
+	RENDER_SHADER_CUBE_INSTANCED_VS,
+	RENDER_SHADER_CUBE_PS,
+	RENDER_SHADER_COUNT
+};
+
+enum RenderLayout
+{
+	RENDER_LAYOUT_CUBE,
+	RENDER_LAYOUT_CUBE_INSTANCED,
+	RENDER_LAYOUT_COUNT
+};
+
+enum RenderTopology
+{
+	RENDER_TOPOLOGY_TRIANGLE_LIST,
+	RENDER_TOPOLOGY_COUNT
+};
+
+enum RenderDepthState
+{
+	RENDER_DEPTH_STATE_DEFAULT,
+	RENDER_DEPTH_STATE_COUNT
+};
+
+// A render target view together with the depth-stencil view drawn with it
+enum RenderTarget
+{
+	RENDER_TARGET_BACK_BUFFER,
+	RENDER_TARGET_COUNT
+};
+
+// The rectangle of a render target draws map onto, with its depth range
+enum RenderViewport
+{
+	RENDER_VIEWPORT_BACK_BUFFER,
+	RENDER_VIEWPORT_COUNT
+};
+
+// Every RenderDevice call that reaches the context, for counting them
+enum RenderCall
+{
+	RENDER_CALL_UPDATE_BUFFER,
+	RENDER_CALL_APPEND_BUFFER,
+	RENDER_CALL_CLEAR_STATE,
+	RENDER_CALL_SET_RENDER_TARGET,
+	RENDER_CALL_SET_DEPTH_STENCIL_STATE,
+	RENDER_CALL_SET_VIEWPORT,
+	RENDER_CALL_SET_PRIMITIVE_TOPOLOGY,
+	RENDER_CALL_SET_INPUT_LAYOUT,
+	RENDER_CALL_SET_VERTEX_SHADER,
+	RENDER_CALL_SET_PIXEL_SHADER,
+	RENDER_CALL_SET_VERTEX_CONSTANT_BUFFER,
+	RENDER_CALL_SET_VERTEX_CONSTANT_BUFFER_RANGE,
+	RENDER_CALL_SET_VERTEX_BUFFER,
+	RENDER_CALL_SET_INDEX_BUFFER,
+	RENDER_CALL_DRAW_INDEXED,
+	RENDER_CALL_DRAW_INDEXED_INSTANCED,
+	RENDER_CALL_COUNT
+};
+
+// The slice of ID3D11DeviceContext that submitting cubes needs. Each call maps onto one
+// context call, so counting calls here counts the API calls made.
+class RenderDevice
+{
+public:
+
+	virtual ~RenderDevice() {}
+
+	// Bracket everything submitted for one frame. Ring buffer data written in a frame is kept
+	// until the GPU has finished that frame.
+	virtual void beginFrame() = 0;
+	virtual void endFrame() = 0;
+
+	// Unbinds everything, as ClearState() does
+	virtual void clearState() = 0;
+
+	// Replaces the contents of buffer with bytes from pData
+	virtual void updateBuffer(RenderBuffer buffer, const void* pData, size_t bytes) = 0;
+
+	// Alignment of the ranges setVertexConstantBufferRange can bind, or 0 if the device can
+	// only bind whole constant buffers
+	virtual size_t getConstantBufferAlignment() const = 0;
+
+	// Writes count elements of elementBytes each into the ring buffer, stride bytes apart, with
+	// a single map, and returns the offset of the first in offset. At most one append per ring
+	// per frame. False if the ring cannot take them this frame.
+	virtual bool appendBuffer(RenderBuffer buffer, const void* pData, size_t elementBytes, size_t count, size_t stride, size_t& offset) = 0;
+
+	virtual void setRenderTarget(RenderTarget target) = 0;
+	virtual void setDepthStencilState(RenderDepthState state) = 0;
+	virtual void setViewport(RenderViewport viewport) = 0;
+	virtual void setPrimitiveTopology(RenderTopology topology) = 0;
+	virtual void setInputLayout(RenderLayout layout) = 0;
+	virtual void setVertexShader(RenderShader shader) = 0;
+	virtual void setPixelShader(RenderShader shader) = 0;
+	virtual void setVertexConstantBuffer(unsigned int slot, RenderBuffer buffer) = 0;
+
+	// Binds bytes bytes of buffer from offset, both multiples of getConstantBufferAlignment()
+	virtual void setVertexConstantBufferRange(unsigned int slot, RenderBuffer buffer, size_t offset, size_t bytes) = 0;
+
+	// Binds buffer as vertex stream slot, stride bytes per element
+	virtual void setVertexBuffer(unsigned int slot, RenderBuffer buffer, unsigned int stride) = 0;
+
+	// Binds buffer as the index buffer, 16 bits per index
+	virtual void setIndexBuffer(RenderBuffer buffer) = 0;
+
+	virtual void drawIndexed(unsigned int indexCount) = 0;
+	virtual void drawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount) = 0;
+};
+
+#endif
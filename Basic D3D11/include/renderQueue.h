@@ -0,0 +1,92 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <DirectXMath.h>
+#include "../SimpleMath.h"
+#include "jobSystem.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// The draws of one frame, each an item index under a 64-bit sort key, put into key order by
+// an LSD radix sort. From the top the key holds the pass, then the shader, then the material
+// and then the depth, so sorting groups draws by the state they bind and, within a group,
+// puts opaque draws front to back for early depth rejection and transparent ones back to
+// front for blending. Items with equal keys keep the order they were pushed in.
+//
+// The sort takes RADIX_BITS of the key per pass, but skips the digits in which every key is
+// the same; cubes differ only in depth, so they take two passes rather than six. Given a job
+// system, each pass is split into blocks of at least SORT_BLOCK_SIZE entries that count and
+// scatter their digits in parallel.
+class RenderQueue
+{
+public:
+
+	enum Pass
+	{
+		PASS_OPAQUE,
+		PASS_TRANSPARENT,
+	};
+
+	static const unsigned int PASS_BITS = 4;
+	static const unsigned int SHADER_BITS = 8;
+	static const unsigned int MATERIAL_BITS = 16;
+	static const unsigned int DEPTH_BITS = 24;
+
+	// Two digits cover the depth. 4096 counts per digit still fit in the L1 cache.
+	static const unsigned int RADIX_BITS = 12;
+	static const unsigned int RADIX_PASSES = (64 + RADIX_BITS - 1) / RADIX_BITS;
+
+	static const size_t SORT_BLOCK_SIZE = 16384;
+	static const size_t MAX_SORT_BLOCKS = 64;
+
+	// shader and material are cut to their fields. depth runs 0 at the near plane to 1 at the
+	// far plane, is clamped to that and reversed for the transparent pass.
+	static uint64_t makeKey(Pass pass, unsigned int shader, unsigned int material, float depth);
+
+	// Depth as makeKey() quantised it, 0 to 2^DEPTH_BITS - 1 nearest first
+	static uint32_t getKeyDepth(uint64_t key) { return static_cast<uint32_t>(key & ((1u << DEPTH_BITS) - 1)); }
+
+	void clear() { m_entries.clear(); }
+	void reserve(size_t count);
+	void push(uint64_t key, uint32_t item);
+
+	// Pushes pIndices[0, count) as opaque draws with this shader and material, keyed on the
+	// view depth of their centres as a fraction of farPlane
+	void pushOpaque(const DirectX::SimpleMath::Matrix& viewProjection, float farPlane, unsigned int shader, unsigned int material,
+		const DirectX::SimpleMath::Vector3* pCenters, const int* pIndices, size_t count);
+
+	// Sorts what was pushed since clear() by key, on the calling thread or as jobs. Call the
+	// second from a thread that may wait on jobs.
+	void sort();
+	void sort(JobSystem& jobs);
+
+	size_t getCount() const { return m_entries.size(); }
+	uint64_t getKey(size_t i) const { return m_entries[i].key; }
+	uint32_t getItem(size_t i) const { return m_entries[i].item; }
+
+	// Copies the items out in queue order
+	void getItems(std::vector<int>& items) const;
+
+	// Digits the last sort had to scatter on, out of RADIX_PASSES
+	unsigned int getLastPassCount() const { return m_lastPassCount; }
+
+private:
+
+	struct Entry
+	{
+		uint64_t key;
+		uint32_t item;
+	};
+
+	void sortEntries(JobSystem* pJobs);
+
+	std::vector<Entry> m_entries;
+	std::vector<Entry> m_scratch;
+
+	// RADIX_SIZE counts, and then offsets, for each block
+	std::vector<uint32_t> m_blockCounts;
+	unsigned int m_lastPassCount = 0;
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef RING_ALLOCATOR_H
+#define RING_ALLOCATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+
+// Hands out byte ranges of a fixed-size ring buffer, frame by frame. Everything allocated in a
+// frame stays live until retireFrames() is told the GPU has finished that frame, and allocate()
+// never returns a range that overlaps live data. Only offsets are tracked, so the bookkeeping
+// works the same with or without a GPU behind it.
+class RingAllocator
+{
+public:
+
+	static const size_t INVALID_OFFSET = ~static_cast<size_t>(0);
+
+	explicit RingAllocator(size_t capacity = 0);
+
+	// Offset of bytes bytes aligned to alignment, a power of two, or INVALID_OFFSET if they
+	// would overwrite live data. Skipping the tail of the buffer to wrap counts as used.
+	size_t allocate(size_t bytes, size_t alignment);
+
+	// Closes the current frame under the given id; ids must increase from frame to frame
+	void endFrame(uint64_t frame);
+
+	// Frees every closed frame with an id up to and including completedFrame
+	void retireFrames(uint64_t completedFrame);
+
+	// Frees everything, including the current frame, e.g. once Map(WRITE_DISCARD) has given
+	// the buffer fresh memory
+	void reset();
+
+	size_t getCapacity() const { return m_capacity; }
+	size_t getUsedBytes() const { return m_used; }
+	size_t getFrameBytes() const { return m_frameBytes; }
+	size_t getFramesInFlight() const { return m_frames.size(); }
+
+private:
+
+	struct Frame
+	{
+		uint64_t id;
+		size_t bytes;
+	};
+
+	size_t m_capacity;
+
+	// Live data runs from m_tail up to m_head, wrapping at m_capacity
+	size_t m_head;
+	size_t m_tail;
+	size_t m_used;
+
+	size_t m_frameBytes;
+	std::deque<Frame> m_frames;
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef SIMULATION_CONFIG_H
+#define SIMULATION_CONFIG_H
+
+#include <DirectXMath.h>
+#include "../SimpleMath.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// Most cubes a config accepts. Spawn positions take count draws per axis from one 32-bit
+// counter of the spawn stream, which more than this would wrap, overlapping the axes.
+const size_t MAX_CUBE_COUNT = 0xFFFFFFFFu / 3;
+
+// Settings that used to be compile-time constants. Each one can be given on the command line
+// as --name=value or in a config file as a "name = value" line, where # starts a comment:
+//
+//   cubes      number of cubes, up to MAX_CUBE_COUNT          (100)
+//   seed       seed for every random stream                  (current time)
+//   spawn-min  corner of the spawn box, as x,y,z             (-10,0,0)
+//   spawn-max  opposite corner of the spawn box              (10,0,0)
+//   step-rate  simulation steps per second                   (60)
+//   threads    threads to run on, 0 for one per core         (0)
+//   instanced  1 to draw every cube in one instanced call    (1)
+//   deferred   deferred contexts to record cube-at-a-time    (0)
+//              draws on, 0 to draw on the immediate context
+//   occluders  nearest visible cubes drawn into the CPU        (256)
+//              occlusion buffer, 0 to skip occlusion culling
+//
+// --config=path reads a file at that point in the command line, so later options override it.
+// Real values must be finite.
+struct SimulationConfig
+{
+	SimulationConfig();
+
+	size_t cubeCount;
+	uint64_t seed;
+	DirectX::SimpleMath::Vector3 spawnMin;
+	DirectX::SimpleMath::Vector3 spawnMax;
+	double stepRate;
+	unsigned int threadCount;
+	bool instanced;
+	unsigned int deferredContexts;
+	unsigned int occluderCount;
+};
+
+// Applies every --name=value option in argv[1, argc). Arguments that are not options, and
+// options this struct does not know, are left in unparsed for the caller. Returns false and
+// describes the problem in error if a value is malformed or a config file cannot be read.
+bool parseCommandLine(int argc, const char* const argv[], SimulationConfig& config, std::vector<std::string>& unparsed, std::string& error);
+
+bool loadConfigFile(const char* path, SimulationConfig& config, std::string& error);
+
+// Sets one setting by name; false if the name is unknown or the value is malformed
+bool applySetting(const std::string& name, const std::string& value, SimulationConfig& config, std::string& error);
+
+// Spawn positions uniform in the spawn box, drawn in batches from the spawn stream. Each axis
+// takes its own run of count draws, x first, so a flat box along x matches earlier seeds.
+void generateSpawnPositions(const SimulationConfig& config, size_t count, std::vector<DirectX::SimpleMath::Vector3>& positions);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef SNAPSHOT_BUFFER_H
+#define SNAPSHOT_BUFFER_H
+
+#include <atomic>
+
+// Two copies of some state: one the producer is filling and one published, read-only copy.
+// The producer writes the next frame into getWriteBuffer() while any number of readers use
+// getReadBuffer(), and neither side takes a lock. publish() hands the new copy over and must
+// only be called once both sides are finished with the frame, e.g. at the end of a TaskGraph
+// run.
+template <typename T>
+class SnapshotBuffer
+{
+public:
+
+	SnapshotBuffer() : m_readIndex(0) {}
+
+	SnapshotBuffer(const SnapshotBuffer&) = delete;
+	SnapshotBuffer& operator=(const SnapshotBuffer&) = delete;
+
+	T& getWriteBuffer() { return m_buffers[1 - m_readIndex.load(std::memory_order_relaxed)]; }
+	const T& getReadBuffer() const { return m_buffers[m_readIndex.load(std::memory_order_acquire)]; }
+
+	void publish() { m_readIndex.store(1 - m_readIndex.load(std::memory_order_relaxed), std::memory_order_release); }
+
+private:
+
+	T m_buffers[2];
+	std::atomic<unsigned int> m_readIndex;
+};
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef SOFTWARE_COMMAND_RECORDER_H
+#define SOFTWARE_COMMAND_RECORDER_H
+
+#include "commandRecorder.h"
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+// CommandRecorder that keeps each command list as an array of calls, with a copy of the data
+// of every upload, and plays it back by making the same calls on another RenderDevice. Runs
+// the same threading and ordering as D3D11 command lists where there is no GPU, usually with a
+// RecordingRenderDevice as the immediate device. As ExecuteCommandList does without restoring
+// state, each list plays from nothing bound and the immediate device is cleared afterwards.
+class SoftwareCommandRecorder : public CommandRecorder
+{
+public:
+
+	SoftwareCommandRecorder(RenderDevice& immediate, unsigned int contextCount);
+
+	SoftwareCommandRecorder(const SoftwareCommandRecorder&) = delete;
+	SoftwareCommandRecorder& operator=(const SoftwareCommandRecorder&) = delete;
+
+	unsigned int getContextCount() const override { return static_cast<unsigned int>(m_contexts.size()); }
+	RenderDevice& getContext(unsigned int context) override;
+	void finishCommandList(unsigned int context) override;
+	void executeCommandLists(unsigned int count) override;
+
+private:
+
+	// One recorded call. Fields a call has no use for are 0; uploads keep their data in the
+	// command list at dataOffset.
+	struct Command
+	{
+		RenderCall call;
+		int resource;
+		unsigned int slot;
+		unsigned int count;
+		unsigned int instanceCount;
+		size_t offset;
+		size_t bytes;
+	};
+
+	struct CommandList
+	{
+		std::vector<Command> commands;
+		std::vector<uint8_t> data;
+	};
+
+	class Context : public RenderDevice
+	{
+	public:
+
+		explicit Context(size_t constantBufferAlignment) : m_constantBufferAlignment(constantBufferAlignment) {}
+
+		// Hands over everything recorded so far and starts an empty list
+		void finish(CommandList& list);
+
+		void beginFrame() override {}
+		void endFrame() override {}
+		void clearState() override;
+		void updateBuffer(RenderBuffer buffer, const void* pData, size_t bytes) override;
+		size_t getConstantBufferAlignment() const override { return m_constantBufferAlignment; }
+		bool appendBuffer(RenderBuffer, const void*, size_t, size_t, size_t, size_t&) override { return false; }
+		void setRenderTarget(RenderTarget target) override;
+		void setDepthStencilState(RenderDepthState state) override;
+		void setViewport(RenderViewport viewport) override;
+		void setPrimitiveTopology(RenderTopology topology) override;
+		void setInputLayout(RenderLayout layout) override;
+		void setVertexShader(RenderShader shader) override;
+		void setPixelShader(RenderShader shader) override;
+		void setVertexConstantBuffer(unsigned int slot, RenderBuffer buffer) override;
+		void setVertexConstantBufferRange(unsigned int slot, RenderBuffer buffer, size_t offset, size_t bytes) override;
+		void setVertexBuffer(unsigned int slot, RenderBuffer buffer, unsigned int stride) override;
+		void setIndexBuffer(RenderBuffer buffer) override;
+		void drawIndexed(unsigned int indexCount) override;
+		void drawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount) override;
+
+	private:
+
+		Command& record(RenderCall call, int resource);
+
+		size_t m_constantBufferAlignment;
+		CommandList m_recording;
+	};
+
+	void play(const CommandList& list);
+
+	RenderDevice& m_immediate;
+	std::vector<std::unique_ptr<Context>> m_contexts;
+
+	// The finished list of each context, waiting to be executed
+	std::vector<CommandList> m_finished;
+};
+
+#endif
@@ -0,0 +1,206 @@
+#ifndef SOFTWARE_RENDER_DEVICE_H
+#define SOFTWARE_RENDER_DEVICE_H
+
+#include <DirectXMath.h>
+#include "../SimpleMath.h"
+#include "jobSystem.h"
+#include "renderDevice.h"
+#include "ringAllocator.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Draws what is submitted to it into a colour and depth buffer in memory, for rendering the
+// cube scene where there is no GPU. It runs basic.fx: VS takes the world matrix from b1 and
+// VS_Instanced from vertex stream 1, both then multiply by the view-projection in b0, and PS
+// returns the vertex colour interpolated with perspective. As with the D3D11 defaults, faces
+// clockwise on screen are front faces and back faces are culled, and depth is tested LESS
+// and written.
+//
+// Draws are only copied as they come in. endFrame() transforms and sets up their triangles in
+// chunks of INSTANCES_PER_CHUNK cubes as parallel jobs, binning each into the TILE_SIZE
+// square tiles it overlaps, then draws each tile as a job of its own, four pixels at a time
+// per SIMD lane. A tile goes through the chunks in submission order, so the image does not
+// depend on the thread count. Triangles are clipped to the near plane and to a guard band
+// around the screen; depth beyond the far plane is clipped per pixel.
+//
+// The mesh buffers are not created for it, so upload the cube vertices and indices with
+// updateBuffer() before the first draw.
+class SoftwareRenderDevice : public RenderDevice
+{
+public:
+
+	static const unsigned int TILE_SIZE = 64;
+	static const size_t LANE_COUNT = 4;
+
+	// Cubes transformed and set up by one job
+	static const size_t INSTANCES_PER_CHUNK = 1024;
+
+	// width is rounded up to a whole number of lanes
+	SoftwareRenderDevice(unsigned int width, unsigned int height, JobSystem& jobs, size_t constantBufferAlignment = 256);
+
+	void attachRingBuffer(RenderBuffer buffer, size_t capacity);
+
+	// Colour the frame is cleared to, red, green, blue and alpha from 0 to 1
+	void setClearColor(const DirectX::SimpleMath::Vector4& color) { m_clearColor = color; }
+
+	void beginFrame() override;
+	void endFrame() override;
+	void clearState() override;
+	void updateBuffer(RenderBuffer buffer, const void* pData, size_t bytes) override;
+	size_t getConstantBufferAlignment() const override { return m_constantBufferAlignment; }
+	bool appendBuffer(RenderBuffer buffer, const void* pData, size_t elementBytes, size_t count, size_t stride, size_t& offset) override;
+	void setRenderTarget(RenderTarget target) override;
+	void setDepthStencilState(RenderDepthState state) override;
+	void setViewport(RenderViewport viewport) override;
+	void setPrimitiveTopology(RenderTopology topology) override;
+	void setInputLayout(RenderLayout layout) override;
+	void setVertexShader(RenderShader shader) override;
+	void setPixelShader(RenderShader shader) override;
+	void setVertexConstantBuffer(unsigned int slot, RenderBuffer buffer) override;
+	void setVertexConstantBufferRange(unsigned int slot, RenderBuffer buffer, size_t offset, size_t bytes) override;
+	void setVertexBuffer(unsigned int slot, RenderBuffer buffer, unsigned int stride) override;
+	void setIndexBuffer(RenderBuffer buffer) override;
+	void drawIndexed(unsigned int indexCount) override;
+	void drawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount) override;
+
+	// Same as endFrame, but sets up and draws every triangle one pixel at a time on the
+	// calling thread, for checking it
+	void endFrameReference();
+
+	unsigned int getWidth() const { return m_width; }
+	unsigned int getHeight() const { return m_height; }
+
+	// Pixels as R8G8B8A8_UNORM, red in the lowest byte, m_width to a row
+	const std::vector<uint32_t>& getColorBuffer() const { return m_color; }
+	uint32_t getPixel(unsigned int x, unsigned int y) const { return m_color[y * m_width + x]; }
+	float getDepth(unsigned int x, unsigned int y) const { return m_depth[y * m_width + x]; }
+
+	// Triangles the draws of the last frame asked for, and how many were left to rasterise
+	// once back faces and those off screen were dropped and the rest clipped
+	uint64_t getSubmittedTriangleCount() const { return m_submittedTriangles; }
+	uint64_t getRasterizedTriangleCount() const { return m_rasterizedTriangles; }
+
+	// Draws skipped because something they read was not bound or was too small
+	uint64_t getInvalidDrawCount() const { return m_invalidDraws; }
+
+private:
+
+	static const unsigned int VERTEX_SLOT_COUNT = 2;
+	static const unsigned int CONSTANT_SLOT_COUNT = 2;
+
+	// Value of an attribute at (x, y) is origin + dx * (x - x[0]) + dy * (y - y[0])
+	struct AttributePlane
+	{
+		float origin;
+		float dx;
+		float dy;
+	};
+
+	// A front-facing triangle in pixels, vertices snapped to a sixteenth of a pixel, with
+	// depth, 1 / w and colour / w as planes and the pixels whose centres its extent covers
+	struct Triangle
+	{
+		float x[3];
+		float y[3];
+		AttributePlane z;
+		AttributePlane inverseW;
+		AttributePlane color[4];
+		int minX;
+		int maxX;
+		int minY;
+		int maxY;
+	};
+
+	// Vertex and index data as they were when a draw was made
+	struct Mesh
+	{
+		std::vector<DirectX::SimpleMath::Vector4> positions;
+		std::vector<DirectX::SimpleMath::Vector4> colors;
+		std::vector<uint16_t> indices;
+	};
+
+	struct Draw
+	{
+		uint32_t mesh;
+		uint32_t viewProjection;
+	};
+
+	// One cube to draw: the world matrix its vertex shader would have read, untransposed
+	struct Instance
+	{
+		DirectX::SimpleMath::Matrix world;
+		uint32_t draw;
+	};
+
+	// Triangles set up from one run of instances, and per tile the ones that overlap it in
+	// the order they were drawn
+	struct Chunk
+	{
+		std::vector<Triangle> triangles;
+		std::vector<std::vector<uint32_t>> bins;
+		std::vector<DirectX::SimpleMath::Vector4> clipPositions;
+		uint64_t submittedTriangles;
+	};
+
+	struct ClipVertex
+	{
+		DirectX::SimpleMath::Vector4 position;
+		DirectX::SimpleMath::Vector4 color;
+	};
+
+	// Copies what the draw reads and returns its index, or false if it cannot be drawn
+	bool beginDraw(unsigned int indexCount, uint32_t& draw);
+	bool readMatrix(unsigned int slot, DirectX::SimpleMath::Matrix& matrix) const;
+
+	void setupChunk(size_t chunk);
+	void setupTriangle(Chunk& chunk, const ClipVertex* pVertices);
+	void rasterizeTile(unsigned int tile);
+	void rasterizeReference(const Triangle& triangle);
+	void finishFrame(bool reference);
+
+	unsigned int m_width;
+	unsigned int m_height;
+	unsigned int m_tilesX;
+	unsigned int m_tilesY;
+	JobSystem& m_jobs;
+	DirectX::SimpleMath::Vector4 m_clearColor;
+	uint32_t m_clearPixel;
+
+	std::vector<uint32_t> m_color;
+	std::vector<float> m_depth;
+
+	std::vector<uint8_t> m_buffers[RENDER_BUFFER_COUNT];
+	uint64_t m_bufferVersions[RENDER_BUFFER_COUNT];
+	RingAllocator m_rings[RENDER_BUFFER_COUNT];
+	size_t m_constantBufferAlignment;
+	uint64_t m_frame;
+
+	// Bound state, -1 where nothing is
+	int m_constantBuffer[CONSTANT_SLOT_COUNT];
+	size_t m_constantOffset[CONSTANT_SLOT_COUNT];
+	size_t m_constantBytes[CONSTANT_SLOT_COUNT];
+	int m_vertexBuffer[VERTEX_SLOT_COUNT];
+	unsigned int m_vertexStride[VERTEX_SLOT_COUNT];
+	int m_indexBuffer;
+	int m_renderTarget;
+	int m_viewport;
+	int m_topology;
+	int m_layout;
+	int m_vertexShader;
+	int m_pixelShader;
+
+	// The frame's draws. A mesh or view-projection is only copied again when it changes.
+	std::vector<Mesh> m_meshes;
+	uint64_t m_meshKey[4];
+	std::vector<DirectX::SimpleMath::Matrix> m_viewProjections;
+	std::vector<Draw> m_draws;
+	std::vector<Instance> m_instances;
+	std::vector<Chunk> m_chunks;
+
+	uint64_t m_submittedTriangles;
+	uint64_t m_rasterizedTriangles;
+	uint64_t m_invalidDraws;
+};
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef STATE_CACHE_RENDER_DEVICE_H
+#define STATE_CACHE_RENDER_DEVICE_H
+
+#include "renderDevice.h"
+#include <stdint.h>
+
+// Sits in front of another RenderDevice and drops state calls that would bind what is already
+// bound: render target, depth-stencil state, viewport, topology, input layout, shaders, constant buffers
+// and ranges, and vertex and index buffers. Uploads and draws always go through. Counts the
+// calls issued to the device behind it and the calls filtered out, per frame and in total,
+// and the bytes uploaded per frame.
+//
+// The cache only knows what went through it. clearState() forgets everything along with the
+// device; call invalidate() after anything else changes context state, such as executing
+// command lists.
+class StateCacheRenderDevice : public RenderDevice
+{
+public:
+
+	explicit StateCacheRenderDevice(RenderDevice& device);
+
+	// Forgets everything bound, so the next call of each kind is issued
+	void invalidate();
+
+	void beginFrame() override;
+	void endFrame() override;
+	void clearState() override;
+	void updateBuffer(RenderBuffer buffer, const void* pData, size_t bytes) override;
+	size_t getConstantBufferAlignment() const override { return m_device.getConstantBufferAlignment(); }
+	bool appendBuffer(RenderBuffer buffer, const void* pData, size_t elementBytes, size_t count, size_t stride, size_t& offset) override;
+	void setRenderTarget(RenderTarget target) override;
+	void setDepthStencilState(RenderDepthState state) override;
+	void setViewport(RenderViewport viewport) override;
+	void setPrimitiveTopology(RenderTopology topology) override;
+	void setInputLayout(RenderLayout layout) override;
+	void setVertexShader(RenderShader shader) override;
+	void setPixelShader(RenderShader shader) override;
+	void setVertexConstantBuffer(unsigned int slot, RenderBuffer buffer) override;
+	void setVertexConstantBufferRange(unsigned int slot, RenderBuffer buffer, size_t offset, size_t bytes) override;
+	void setVertexBuffer(unsigned int slot, RenderBuffer buffer, unsigned int stride) override;
+	void setIndexBuffer(RenderBuffer buffer) override;
+	void drawIndexed(unsigned int indexCount) override;
+	void drawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount) override;
+
+	// Counts for the last frame closed by endFrame()
+	uint64_t getIssuedCount(RenderCall call) const { return m_lastFrameIssued[call]; }
+	uint64_t getFilteredCount(RenderCall call) const { return m_lastFrameFiltered[call]; }
+	uint64_t getIssuedCount() const;
+	uint64_t getFilteredCount() const;
+	uint64_t getUploadedBytes() const { return m_lastFrameUploadedBytes; }
+
+	// Counts over every frame so far
+	uint64_t getTotalIssuedCount() const { return m_totalIssued; }
+	uint64_t getTotalFilteredCount() const { return m_totalFiltered; }
+
+private:
+
+	static const unsigned int CONSTANT_SLOT_COUNT = 14;
+	static const unsigned int VERTEX_SLOT_COUNT = 16;
+
+	// A constant slot bound to a whole buffer has bytes 0
+	struct ConstantBinding
+	{
+		int buffer;
+		size_t offset;
+		size_t bytes;
+	};
+
+	struct VertexBinding
+	{
+		int buffer;
+		unsigned int stride;
+	};
+
+	// True if the call goes through, after counting it either way
+	bool issue(RenderCall call, bool redundant);
+
+	RenderDevice& m_device;
+
+	// -1 where nothing is known to be bound
+	int m_renderTarget;
+	int m_depthState;
+	int m_viewport;
+	int m_topology;
+	int m_layout;
+	int m_vertexShader;
+	int m_pixelShader;
+	int m_indexBuffer;
+	ConstantBinding m_constants[CONSTANT_SLOT_COUNT];
+	VertexBinding m_vertexBuffers[VERTEX_SLOT_COUNT];
+
+	uint64_t m_frameIssued[RENDER_CALL_COUNT];
+	uint64_t m_frameFiltered[RENDER_CALL_COUNT];
+	uint64_t m_lastFrameIssued[RENDER_CALL_COUNT];
+	uint64_t m_lastFrameFiltered[RENDER_CALL_COUNT];
+	uint64_t m_totalIssued;
+	uint64_t m_totalFiltered;
+	uint64_t m_frameUploadedBytes;
+	uint64_t m_lastFrameUploadedBytes;
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef TASK_GRAPH_H
+#define TASK_GRAPH_H
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "jobSystem.h"
+
+// Frame work expressed as a dependency graph and run on a JobSystem. A node is released as
+// soon as everything it depends on has finished, so independent nodes overlap. Build the
+// graph once and call run() every frame.
+class TaskGraph
+{
+public:
+
+	typedef size_t NodeId;
+	typedef std::function<size_t()> CountFunction;
+
+	TaskGraph() : m_pJobs(nullptr) {}
+
+	TaskGraph(const TaskGraph&) = delete;
+	TaskGraph& operator=(const TaskGraph&) = delete;
+
+	NodeId addTask(const char* name, const JobSystem::TaskFunction& task);
+
+	// count is evaluated when the node is released, so it can depend on earlier nodes
+	NodeId addParallelTask(const char* name, const CountFunction& count, size_t grainSize, const JobSystem::RangeFunction& body);
+
+	// Runs on the thread that called run(), for work such as D3D11 immediate context calls
+	NodeId addMainThreadTask(const char* name, const JobSystem::TaskFunction& task);
+
+	void addDependency(NodeId before, NodeId after);
+
+	// Runs every node once and returns when all of them have finished
+	void run(JobSystem& jobs);
+
+	size_t getNodeCount() const { return m_nodes.size(); }
+	const std::string& getName(NodeId node) const { return m_nodes[node]->name; }
+
+	// Nanoseconds from the node being free to start to it finishing, in the last run()
+	uint64_t getLastDurationNs(NodeId node) const { return m_nodes[node]->lastDurationNs; }
+
+private:
+
+	enum NodeKind
+	{
+		NODE_TASK,
+		NODE_PARALLEL,
+		NODE_MAIN_THREAD,
+	};
+
+	struct Node
+	{
+		Node() : unresolved(0) {}
+
+		std::string name;
+		NodeKind kind = NODE_TASK;
+		JobSystem::TaskFunction task;
+		CountFunction count;
+		size_t grainSize = 1;
+		JobSystem::RangeFunction body;
+
+		std::vector<NodeId> successors;
+		size_t predecessorCount = 0;
+		std::atomic<size_t> unresolved;
+		JobCounter counter;
+
+		uint64_t releasedAt = 0;
+		uint64_t lastDurationNs = 0;
+	};
+
+	NodeId addNode(const char* name, NodeKind kind);
+	void release(NodeId node);
+	void complete(NodeId node);
+
+	std::vector<std::unique_ptr<Node>> m_nodes;
+
+	JobSystem* m_pJobs;
+	JobCounter m_remaining;
+
+	std::mutex m_mainThreadMutex;
+	std::deque<NodeId> m_mainThreadReady;
+};
+
+#endif
@@ -0,0 +1,153 @@
+// *************************************************************************************
+// File: benchmarkCompare.cpp
+//
+// Checks a benchmark report against a baseline report of the same benchmark, as written by
+// CubeSimHeadless bench --json and SimpleMathBenchmark --json, and fails if any metric got
+// slower by more than the noise of the two runs allows.
+//
+// Usage: BenchmarkCompare [--threshold=P] [--noise=K] baseline.json current.json
+//        --threshold=P  smallest change in percent that counts (5)
+//        --noise=K      changes must also exceed K standard deviations of the difference,
+//                       estimated as 1.4826 MAD from the samples of each run (3)
+//
+// Each metric's tolerance is the larger of the two, so a quiet metric is held to the threshold
+// and a noisy one is not flagged for its noise. Metrics with fewer than MIN_SAMPLES runs on
+// either side are held to the threshold alone, since their MAD says little.
+//
+// Properties that differ between the runs, such as the CPU, the compiler or the cube count,
+// are printed as warnings; the numbers are still compared.
+//
+// Exits 0 if nothing got slower, 1 if a metric got slower or is missing from the current
+// report, and 2 if the reports cannot be read or are of different benchmarks.
+// *************************************************************************************
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "../include/benchmarkReport.h"
+
+namespace
+{
+	// MAD of normally distributed samples times this estimates their standard deviation
+	const double MAD_TO_SIGMA = 1.4826;
+
+	const size_t MIN_SAMPLES = 3;
+
+	bool parseValue(const char* argument, const char* prefix, double& value)
+	{
+		const size_t prefixLength = strlen(prefix);
+		if (strncmp(argument, prefix, prefixLength) != 0)
+		{
+			return false;
+		}
+		char* pEnd = nullptr;
+		value = strtod(argument + prefixLength, &pEnd);
+		return pEnd != argument + prefixLength && *pEnd == '\0' && value >= 0.0;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const char* usage = "usage: %s [--threshold=percent] [--noise=k] baseline.json current.json\n";
+	double thresholdPercent = 5.0;
+	double noiseSigmas = 3.0;
+	const char* paths[2] = { nullptr, nullptr };
+	int pathCount = 0;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (parseValue(argv[i], "--threshold=", thresholdPercent) || parseValue(argv[i], "--noise=", noiseSigmas))
+		{
+			continue;
+		}
+		if (argv[i][0] == '-' || pathCount == 2)
+		{
+			fprintf(stderr, "unknown argument '%s'\n", argv[i]);
+			fprintf(stderr, usage, argv[0]);
+			return 2;
+		}
+		paths[pathCount++] = argv[i];
+	}
+	if (pathCount != 2)
+	{
+		fprintf(stderr, usage, argv[0]);
+		return 2;
+	}
+
+	BenchmarkReport baseline;
+	BenchmarkReport current;
+	std::string error;
+	if (!baseline.read(paths[0], error) || !current.read(paths[1], error))
+	{
+		fprintf(stderr, "%s\n", error.c_str());
+		return 2;
+	}
+	if (baseline.getBenchmark() != current.getBenchmark())
+	{
+		fprintf(stderr, "%s is a %s report but %s is a %s report\n", paths[0], baseline.getBenchmark().c_str(), paths[1], current.getBenchmark().c_str());
+		return 2;
+	}
+
+	printf("benchmark: %s  baseline: %s (%s)  threshold: %.1f%%  noise: %.1f sigma\n", current.getBenchmark().c_str(), paths[0],
+		baseline.getProperty("date").c_str(), thresholdPercent, noiseSigmas);
+	for (const auto& property : baseline.getProperties())
+	{
+		const std::string value = current.getProperty(property.first);
+		if (property.first != "date" && value != property.second)
+		{
+			printf("warning: %s differs: baseline '%s', this run '%s'\n", property.first.c_str(), property.second.c_str(), value.c_str());
+		}
+	}
+
+	printf("%-28s %-10s %12s %12s %9s %10s  %s\n", "metric", "unit", "baseline", "current", "change", "tolerance", "verdict");
+	int slower = 0;
+	int missing = 0;
+	for (const BenchmarkReport::Metric& before : baseline.getMetrics())
+	{
+		const BenchmarkReport::Metric* pAfter = current.findMetric(before.name);
+		if (!pAfter)
+		{
+			printf("%-28s %-10s %12.4g %12s %9s %10s  MISSING\n", before.name.c_str(), before.unit.c_str(), before.getMedian(), "-", "-", "-");
+			++missing;
+			continue;
+		}
+
+		const double baselineMedian = before.getMedian();
+		const double currentMedian = pAfter->getMedian();
+		double tolerance = baselineMedian * thresholdPercent / 100.0;
+		const bool enoughSamples = before.samples.size() >= MIN_SAMPLES && pAfter->samples.size() >= MIN_SAMPLES;
+		if (enoughSamples)
+		{
+			const double sigma = MAD_TO_SIGMA * std::sqrt(before.getMad() * before.getMad() + pAfter->getMad() * pAfter->getMad());
+			tolerance = std::max(tolerance, noiseSigmas * sigma);
+		}
+
+		const double change = currentMedian - baselineMedian;
+		const char* verdict = "ok";
+		if (change > tolerance)
+		{
+			verdict = "SLOWER";
+			++slower;
+		}
+		else if (change < -tolerance)
+		{
+			verdict = "faster";
+		}
+		const double scale = baselineMedian > 0.0 ? 100.0 / baselineMedian : 0.0;
+		printf("%-28s %-10s %12.4g %12.4g %+8.1f%% %9.1f%%  %s%s\n", before.name.c_str(), before.unit.c_str(), baselineMedian, currentMedian,
+			change * scale, tolerance * scale, verdict, enoughSamples ? "" : " (too few runs to judge noise)");
+	}
+	for (const BenchmarkReport::Metric& after : current.getMetrics())
+	{
+		if (!baseline.findMetric(after.name))
+		{
+			printf("%-28s %-10s %12s %12.4g %9s %10s  new\n", after.name.c_str(), after.unit.c_str(), "-", after.getMedian(), "-", "-");
+		}
+	}
+
+	const bool passed = slower == 0 && missing == 0;
+	printf("%s: %d slower, %d missing\n", passed ? "PASSED" : "FAILED", slower, missing);
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,529 @@
+#include "../include/benchmarkReport.h"
+#include "../include/jsonEscape.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/utsname.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	// Just enough of a JSON reader for what write() produces: objects, arrays, strings and
+	// numbers, plus true, false and null so that values it does not know can be skipped
+	class JsonReader
+	{
+	public:
+
+		explicit JsonReader(const std::string& text) : m_text(text), m_position(0) {}
+
+		// Consumes c if it is the next character other than whitespace
+		bool accept(char c)
+		{
+			skipSpace();
+			if (m_position < m_text.size() && m_text[m_position] == c)
+			{
+				++m_position;
+				return true;
+			}
+			return false;
+		}
+
+		bool atEnd()
+		{
+			skipSpace();
+			return m_position == m_text.size();
+		}
+
+		size_t getPosition() const { return m_position; }
+
+		bool readString(std::string& value)
+		{
+			if (!accept('"'))
+			{
+				return false;
+			}
+			value.clear();
+			while (m_position < m_text.size())
+			{
+				const char c = m_text[m_position++];
+				if (c == '"')
+				{
+					return true;
+				}
+				if (c != '\\')
+				{
+					value += c;
+					continue;
+				}
+				if (m_position == m_text.size())
+				{
+					return false;
+				}
+				const char escaped = m_text[m_position++];
+				switch (escaped)
+				{
+				case 'b': value += '\b'; break;
+				case 'f': value += '\f'; break;
+				case 'n': value += '\n'; break;
+				case 'r': value += '\r'; break;
+				case 't': value += '\t'; break;
+				case 'u':
+				{
+					if (m_position + 4 > m_text.size())
+					{
+						return false;
+					}
+					const unsigned long code = strtoul(m_text.substr(m_position, 4).c_str(), nullptr, 16);
+					m_position += 4;
+					appendUtf8(code, value);
+					break;
+				}
+				default: value += escaped; break;
+				}
+			}
+			return false;
+		}
+
+		bool readNumber(double& value)
+		{
+			skipSpace();
+			const char* pStart = m_text.c_str() + m_position;
+			char* pEnd = nullptr;
+			value = strtod(pStart, &pEnd);
+			m_position += pEnd - pStart;
+			return pEnd != pStart;
+		}
+
+		bool skipValue()
+		{
+			skipSpace();
+			if (m_position == m_text.size())
+			{
+				return false;
+			}
+			std::string scratch;
+			double number;
+			switch (m_text[m_position])
+			{
+			case '"':
+				return readString(scratch);
+			case '{':
+				return readObject([this](const std::string&) { return skipValue(); });
+			case '[':
+				return readArray([this]() { return skipValue(); });
+			}
+			const char* literals[] = { "true", "false", "null" };
+			for (const char* literal : literals)
+			{
+				if (m_text.compare(m_position, strlen(literal), literal) == 0)
+				{
+					m_position += strlen(literal);
+					return true;
+				}
+			}
+			return readNumber(number);
+		}
+
+		// Calls readMember(key) with the reader on each member's value
+		template <typename Function>
+		bool readObject(Function readMember)
+		{
+			if (!accept('{'))
+			{
+				return false;
+			}
+			if (accept('}'))
+			{
+				return true;
+			}
+			do
+			{
+				std::string key;
+				if (!readString(key) || !accept(':') || !readMember(key))
+				{
+					return false;
+				}
+			} while (accept(','));
+			return accept('}');
+		}
+
+		// Calls readElement() with the reader on each element
+		template <typename Function>
+		bool readArray(Function readElement)
+		{
+			if (!accept('['))
+			{
+				return false;
+			}
+			if (accept(']'))
+			{
+				return true;
+			}
+			do
+			{
+				if (!readElement())
+				{
+					return false;
+				}
+			} while (accept(','));
+			return accept(']');
+		}
+
+	private:
+
+		void skipSpace()
+		{
+			while (m_position < m_text.size() && (m_text[m_position] == ' ' || m_text[m_position] == '\t' || m_text[m_position] == '\n' || m_text[m_position] == '\r'))
+			{
+				++m_position;
+			}
+		}
+
+		static void appendUtf8(unsigned long code, std::string& value)
+		{
+			if (code < 0x80)
+			{
+				value += static_cast<char>(code);
+			}
+			else if (code < 0x800)
+			{
+				value += static_cast<char>(0xC0 | (code >> 6));
+				value += static_cast<char>(0x80 | (code & 0x3F));
+			}
+			else
+			{
+				value += static_cast<char>(0xE0 | (code >> 12));
+				value += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+				value += static_cast<char>(0x80 | (code & 0x3F));
+			}
+		}
+
+		const std::string& m_text;
+		size_t m_position;
+	};
+
+	std::string getHostName()
+	{
+#if defined(__linux__) || defined(__APPLE__)
+		char name[256] = {};
+		if (gethostname(name, sizeof(name) - 1) == 0)
+		{
+			return name;
+		}
+#elif defined(_WIN32)
+		if (const char* pName = getenv("COMPUTERNAME"))
+		{
+			return pName;
+		}
+#endif
+		return "unknown";
+	}
+
+	std::string getOperatingSystem()
+	{
+#if defined(__linux__) || defined(__APPLE__)
+		utsname name;
+		if (uname(&name) == 0)
+		{
+			return std::string(name.sysname) + " " + name.release + " " + name.machine;
+		}
+		return "unknown";
+#elif defined(_WIN32)
+		return "Windows";
+#else
+		return "unknown";
+#endif
+	}
+
+	std::string getCpuName()
+	{
+#if defined(__linux__)
+		FILE* pFile = fopen("/proc/cpuinfo", "r");
+		if (pFile)
+		{
+			char line[512];
+			while (fgets(line, sizeof(line), pFile))
+			{
+				if (strncmp(line, "model name", 10) == 0)
+				{
+					const char* pName = strchr(line, ':');
+					std::string name = pName ? pName + 1 : "";
+					name.erase(0, name.find_first_not_of(" \t"));
+					name.erase(name.find_last_not_of(" \t\r\n") + 1);
+					fclose(pFile);
+					return name;
+				}
+			}
+			fclose(pFile);
+		}
+#elif defined(_WIN32)
+		if (const char* pName = getenv("PROCESSOR_IDENTIFIER"))
+		{
+			return pName;
+		}
+#endif
+		return "unknown";
+	}
+
+	std::string getCompiler()
+	{
+		char name[128];
+#if defined(_MSC_FULL_VER)
+		snprintf(name, sizeof(name), "MSVC %d", _MSC_FULL_VER);
+#elif defined(__clang__)
+		snprintf(name, sizeof(name), "Clang %s", __clang_version__);
+#elif defined(__GNUC__)
+		snprintf(name, sizeof(name), "GCC %s", __VERSION__);
+#else
+		snprintf(name, sizeof(name), "unknown");
+#endif
+		return name;
+	}
+}
+
+double BenchmarkReport::median(std::vector<double> values)
+{
+	if (values.empty())
+	{
+		return 0.0;
+	}
+	const size_t middle = values.size() / 2;
+	std::nth_element(values.begin(), values.begin() + middle, values.end());
+	if (values.size() % 2)
+	{
+		return values[middle];
+	}
+	return 0.5 * (values[middle] + *std::max_element(values.begin(), values.begin() + middle));
+}
+
+double BenchmarkReport::medianAbsoluteDeviation(const std::vector<double>& values)
+{
+	const double centre = median(values);
+	std::vector<double> deviations(values.size());
+	for (size_t i = 0; i < values.size(); ++i)
+	{
+		deviations[i] = std::fabs(values[i] - centre);
+	}
+	return median(deviations);
+}
+
+BenchmarkReport::BenchmarkReport(const std::string& benchmark)
+	: m_benchmark(benchmark)
+{
+	char date[32];
+	const time_t now = time(nullptr);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+	setProperty("date", date);
+	setProperty("host", getHostName());
+	setProperty("os", getOperatingSystem());
+	setProperty("cpu", getCpuName());
+	setProperty("cores", static_cast<double>(std::thread::hardware_concurrency()));
+	setProperty("compiler", getCompiler());
+#ifdef NDEBUG
+	std::string build = "release";
+#else
+	std::string build = "debug";
+#endif
+#ifdef PROFILE
+	build += " profile";
+#endif
+	setProperty("build", build);
+}
+
+void BenchmarkReport::setProperty(const std::string& name, const std::string& value)
+{
+	for (std::pair<std::string, std::string>& property : m_properties)
+	{
+		if (property.first == name)
+		{
+			property.second = value;
+			return;
+		}
+	}
+	m_properties.push_back(std::make_pair(name, value));
+}
+
+void BenchmarkReport::setProperty(const std::string& name, double value)
+{
+	char text[32];
+	snprintf(text, sizeof(text), "%.15g", value);
+	setProperty(name, std::string(text));
+}
+
+std::string BenchmarkReport::getProperty(const std::string& name) const
+{
+	for (const std::pair<std::string, std::string>& property : m_properties)
+	{
+		if (property.first == name)
+		{
+			return property.second;
+		}
+	}
+	return std::string();
+}
+
+void BenchmarkReport::addSample(const std::string& metric, const std::string& unit, double value)
+{
+	for (Metric& existing : m_metrics)
+	{
+		if (existing.name == metric)
+		{
+			existing.samples.push_back(value);
+			return;
+		}
+	}
+	Metric added;
+	added.name = metric;
+	added.unit = unit;
+	added.samples.push_back(value);
+	m_metrics.push_back(added);
+}
+
+const BenchmarkReport::Metric* BenchmarkReport::findMetric(const std::string& name) const
+{
+	for (const Metric& metric : m_metrics)
+	{
+		if (metric.name == name)
+		{
+			return &metric;
+		}
+	}
+	return nullptr;
+}
+
+bool BenchmarkReport::write(const char* path) const
+{
+	FILE* pFile = fopen(path, "w");
+	if (!pFile)
+	{
+		return false;
+	}
+
+	fprintf(pFile, "{\n\t\"benchmark\": \"");
+	writeJsonEscaped(pFile, m_benchmark.c_str());
+	fprintf(pFile, "\",\n\t\"properties\": {");
+	for (size_t i = 0; i < m_properties.size(); ++i)
+	{
+		fprintf(pFile, "%s\n\t\t\"", i > 0 ? "," : "");
+		writeJsonEscaped(pFile, m_properties[i].first.c_str());
+		fprintf(pFile, "\": \"");
+		writeJsonEscaped(pFile, m_properties[i].second.c_str());
+		fprintf(pFile, "\"");
+	}
+	fprintf(pFile, "\n\t},\n\t\"metrics\": [");
+	for (size_t i = 0; i < m_metrics.size(); ++i)
+	{
+		const Metric& metric = m_metrics[i];
+		fprintf(pFile, "%s\n\t\t{\"name\": \"", i > 0 ? "," : "");
+		writeJsonEscaped(pFile, metric.name.c_str());
+		fprintf(pFile, "\", \"unit\": \"");
+		writeJsonEscaped(pFile, metric.unit.c_str());
+		fprintf(pFile, "\", \"median\": %.9g, \"mad\": %.9g, \"samples\": [", metric.getMedian(), metric.getMad());
+		for (size_t sample = 0; sample < metric.samples.size(); ++sample)
+		{
+			fprintf(pFile, "%s%.9g", sample > 0 ? ", " : "", metric.samples[sample]);
+		}
+		fprintf(pFile, "]}");
+	}
+	fprintf(pFile, "\n\t]\n}\n");
+
+	const bool written = ferror(pFile) == 0;
+	return fclose(pFile) == 0 && written;
+}
+
+bool BenchmarkReport::read(const char* path, std::string& error)
+{
+	FILE* pFile = fopen(path, "rb");
+	if (!pFile)
+	{
+		error = std::string("cannot open ") + path;
+		return false;
+	}
+	std::string text;
+	char buffer[4096];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+	{
+		text.append(buffer, read);
+	}
+	fclose(pFile);
+
+	// The median and MAD written alongside each metric are recomputed from its samples
+	BenchmarkReport report;
+	report.m_properties.clear();
+	JsonReader reader(text);
+	const bool parsed = reader.readObject([&](const std::string& key)
+	{
+		if (key == "benchmark")
+		{
+			return reader.readString(report.m_benchmark);
+		}
+		if (key == "properties")
+		{
+			return reader.readObject([&](const std::string& name)
+			{
+				std::string value;
+				if (!reader.readString(value))
+				{
+					return false;
+				}
+				report.setProperty(name, value);
+				return true;
+			});
+		}
+		if (key == "metrics")
+		{
+			return reader.readArray([&]()
+			{
+				Metric metric;
+				const bool metricParsed = reader.readObject([&](const std::string& field)
+				{
+					if (field == "name")
+					{
+						return reader.readString(metric.name);
+					}
+					if (field == "unit")
+					{
+						return reader.readString(metric.unit);
+					}
+					if (field == "samples")
+					{
+						return reader.readArray([&]()
+						{
+							double sample;
+							if (!reader.readNumber(sample))
+							{
+								return false;
+							}
+							metric.samples.push_back(sample);
+							return true;
+						});
+					}
+					return reader.skipValue();
+				});
+				if (!metricParsed || metric.name.empty())
+				{
+					return false;
+				}
+				report.m_metrics.push_back(metric);
+				return true;
+			});
+		}
+		return reader.skipValue();
+	});
+
+	if (!parsed || !reader.atEnd())
+	{
+		error = std::string(path) + ": not a benchmark report, stopped at byte " + std::to_string(reader.getPosition());
+		return false;
+	}
+	*this = report;
+	return true;
+}
@@ -0,0 +1,417 @@
+#include "../include/boundingVolumeHierarchy.h"
+#include "../include/profiler.h"
+#include <algorithm>
+#include <cfloat>
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+const float BoundingVolumeHierarchy::REBUILD_COST_RATIO = 1.5f;
+
+namespace
+{
+	// Deeper than any median split tree over 32-bit object counts gets
+	const size_t STACK_SIZE = 64;
+
+	inline float axisValue(const Vector3& v, int axis)
+	{
+		return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+	}
+
+	inline bool boxesOverlap(const Vector3& aMin, const Vector3& aMax, const Vector3& bMin, const Vector3& bMax)
+	{
+		return aMin.x <= bMax.x && aMax.x >= bMin.x && aMin.y <= bMax.y && aMax.y >= bMin.y && aMin.z <= bMax.z && aMax.z >= bMin.z;
+	}
+
+	BoundingBox makeBox(const Vector3& boundsMin, const Vector3& boundsMax)
+	{
+		BoundingBox box;
+		box.Center = (boundsMin + boundsMax) * 0.5f;
+		box.Extents = (boundsMax - boundsMin) * 0.5f;
+		return box;
+	}
+}
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy()
+	: m_nodeCount(0), m_radius(0.0f), m_cost(0.0f), m_buildCost(0.0f), m_buildCount(0), m_lastQueryNodes(0)
+{
+}
+
+void BoundingVolumeHierarchy::build(const Vector3* pCenters, size_t count, float radius, JobSystem& jobs)
+{
+	PROFILE_ZONE("bvh build");
+	m_radius = radius;
+	m_objects.resize(count);
+	m_centers.resize(count);
+	m_buildObjects.resize(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		m_buildObjects[i].center = pCenters[i];
+		m_buildObjects[i].object = static_cast<int>(i);
+	}
+
+	// A binary tree with one object per leaf has 2n - 1 nodes, and fuller leaves need fewer
+	m_nodes.resize(count > 0 ? 2 * count - 1 : 0);
+	m_isSubtreeRoot.assign(m_nodes.size(), 0);
+	m_subtrees.clear();
+	m_nodeCount = 0;
+	++m_buildCount;
+	if (count == 0)
+	{
+		m_cost = 0.0f;
+		m_buildCost = 0.0f;
+		return;
+	}
+
+	// Split the top of the tree here until the pieces are small enough to hand out
+	uint32_t cursor = 1;
+	buildNode(0, 0, static_cast<uint32_t>(count), cursor, &m_subtrees);
+	for (const Subtree& subtree : m_subtrees)
+	{
+		m_isSubtreeRoot[subtree.node] = 1;
+	}
+
+	JobCounter built;
+	jobs.run(m_subtrees.size(), 1, [this](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			const Subtree& subtree = m_subtrees[i];
+			uint32_t subtreeCursor = subtree.firstChild;
+			buildNode(subtree.node, subtree.begin, subtree.end, subtreeCursor, nullptr);
+		}
+	}, built);
+	jobs.waitFor(built);
+
+	// Reserved ranges leave gaps, so this counts the slots in use rather than the nodes
+	m_nodeCount = cursor;
+	for (size_t slot = 0; slot < count; ++slot)
+	{
+		m_objects[slot] = m_buildObjects[slot].object;
+	}
+
+	refit(pCenters, jobs);
+	m_buildCost = m_cost;
+}
+
+void BoundingVolumeHierarchy::buildNode(uint32_t nodeIndex, uint32_t begin, uint32_t end, uint32_t& cursor, std::vector<Subtree>* pSubtrees)
+{
+	const uint32_t count = end - begin;
+	if (pSubtrees && count <= SUBTREE_SIZE && count > MAX_LEAF_SIZE)
+	{
+		Subtree subtree = { nodeIndex, begin, end, cursor };
+		pSubtrees->push_back(subtree);
+		cursor += 2 * count - 2;
+		return;
+	}
+
+	Node& node = m_nodes[nodeIndex];
+	node.first = begin;
+	node.objectCount = count;
+	if (count <= MAX_LEAF_SIZE)
+	{
+		return;
+	}
+
+	// Split at the median of the axis the centres spread furthest along
+	Vector3 centerMin(FLT_MAX, FLT_MAX, FLT_MAX);
+	Vector3 centerMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		centerMin = Vector3::Min(centerMin, m_buildObjects[i].center);
+		centerMax = Vector3::Max(centerMax, m_buildObjects[i].center);
+	}
+	const Vector3 spread = centerMax - centerMin;
+	const int axis = spread.x >= spread.y && spread.x >= spread.z ? 0 : (spread.y >= spread.z ? 1 : 2);
+
+	// Ties go by object so the split does not depend on the order nth_element leaves them in
+	const uint32_t middle = count / 2;
+	std::nth_element(m_buildObjects.begin() + begin, m_buildObjects.begin() + begin + middle, m_buildObjects.begin() + end,
+		[axis](const BuildObject& a, const BuildObject& b)
+	{
+		const float valueA = axisValue(a.center, axis);
+		const float valueB = axisValue(b.center, axis);
+		return valueA < valueB || (valueA == valueB && a.object < b.object);
+	});
+
+	const uint32_t left = cursor;
+	cursor += 2;
+	node.first = left;
+	node.objectCount = 0;
+	buildNode(left, begin, begin + middle, cursor, pSubtrees);
+	buildNode(left + 1, begin + middle, end, cursor, pSubtrees);
+}
+
+void BoundingVolumeHierarchy::refit(const Vector3* pCenters, JobSystem& jobs)
+{
+	PROFILE_ZONE("bvh refit");
+	if (m_nodeCount == 0)
+	{
+		return;
+	}
+
+	m_subtreeCosts.resize(m_subtrees.size());
+	JobCounter refitted;
+	jobs.run(m_subtrees.size(), 1, [this, pCenters](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			const Subtree& subtree = m_subtrees[i];
+			for (uint32_t slot = subtree.begin; slot < subtree.end; ++slot)
+			{
+				m_centers[slot] = pCenters[m_objects[slot]];
+			}
+			m_subtreeCosts[i] = refitNode(subtree.node, false);
+		}
+	}, refitted);
+
+	// Subtrees cover every object unless there are too few to split, and then the top pass
+	// refits the only leaf
+	if (m_subtrees.empty())
+	{
+		for (size_t slot = 0; slot < m_objects.size(); ++slot)
+		{
+			m_centers[slot] = pCenters[m_objects[slot]];
+		}
+	}
+	jobs.waitFor(refitted);
+
+	float cost = refitNode(0, true);
+	for (float subtreeCost : m_subtreeCosts)
+	{
+		cost += subtreeCost;
+	}
+	const float rootArea = surfaceArea(m_nodes[0]);
+	m_cost = rootArea > 0.0f ? cost / rootArea : 0.0f;
+}
+
+bool BoundingVolumeHierarchy::update(const Vector3* pCenters, JobSystem& jobs)
+{
+	refit(pCenters, jobs);
+	if (m_cost <= m_buildCost * REBUILD_COST_RATIO)
+	{
+		return false;
+	}
+	build(pCenters, m_objects.size(), m_radius, jobs);
+	return true;
+}
+
+float BoundingVolumeHierarchy::refitNode(uint32_t nodeIndex, bool skipSubtrees)
+{
+	Node& node = m_nodes[nodeIndex];
+	if (skipSubtrees && m_isSubtreeRoot[nodeIndex])
+	{
+		return 0.0f;
+	}
+
+	if (node.objectCount > 0)
+	{
+		setLeafBounds(node);
+		return surfaceArea(node) * node.objectCount;
+	}
+
+	const float cost = refitNode(node.first, skipSubtrees) + refitNode(node.first + 1, skipSubtrees);
+	const Node& left = m_nodes[node.first];
+	const Node& right = m_nodes[node.first + 1];
+	node.boundsMin = Vector3::Min(left.boundsMin, right.boundsMin);
+	node.boundsMax = Vector3::Max(left.boundsMax, right.boundsMax);
+	return cost + surfaceArea(node);
+}
+
+void BoundingVolumeHierarchy::setLeafBounds(Node& node) const
+{
+	Vector3 centerMin(FLT_MAX, FLT_MAX, FLT_MAX);
+	Vector3 centerMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (uint32_t slot = node.first; slot < node.first + node.objectCount; ++slot)
+	{
+		centerMin = Vector3::Min(centerMin, m_centers[slot]);
+		centerMax = Vector3::Max(centerMax, m_centers[slot]);
+	}
+	const Vector3 extent(m_radius);
+	node.boundsMin = centerMin - extent;
+	node.boundsMax = centerMax + extent;
+}
+
+float BoundingVolumeHierarchy::surfaceArea(const Node& node)
+{
+	const Vector3 size = node.boundsMax - node.boundsMin;
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+void BoundingVolumeHierarchy::queryFrustum(const Frustum& frustum, std::vector<int>& objects) const
+{
+	PROFILE_ZONE("bvh frustum query");
+	m_lastQueryNodes = 0;
+	if (m_nodeCount == 0)
+	{
+		return;
+	}
+
+	uint32_t stack[STACK_SIZE];
+	size_t depth = 0;
+	stack[depth++] = 0;
+	while (depth > 0)
+	{
+		const Node& node = m_nodes[stack[--depth]];
+		++m_lastQueryNodes;
+
+		const Frustum::BoxTest test = frustum.testBox(node.boundsMin, node.boundsMax);
+		if (test == Frustum::BOX_OUTSIDE)
+		{
+			continue;
+		}
+
+		if (test == Frustum::BOX_INSIDE)
+		{
+			// Everything below is inside too; walk down to the leaves without testing
+			uint32_t inner[STACK_SIZE];
+			size_t innerDepth = 0;
+			inner[innerDepth++] = static_cast<uint32_t>(&node - m_nodes.data());
+			while (innerDepth > 0)
+			{
+				const Node& child = m_nodes[inner[--innerDepth]];
+				if (child.objectCount > 0)
+				{
+					objects.insert(objects.end(), m_objects.begin() + child.first, m_objects.begin() + child.first + child.objectCount);
+				}
+				else
+				{
+					inner[innerDepth++] = child.first + 1;
+					inner[innerDepth++] = child.first;
+				}
+			}
+			continue;
+		}
+
+		if (node.objectCount > 0)
+		{
+			for (uint32_t slot = node.first; slot < node.first + node.objectCount; ++slot)
+			{
+				if (frustum.intersectsSphere(m_centers[slot], m_radius))
+				{
+					objects.push_back(m_objects[slot]);
+				}
+			}
+			continue;
+		}
+
+		stack[depth++] = node.first + 1;
+		stack[depth++] = node.first;
+	}
+}
+
+bool BoundingVolumeHierarchy::raycast(const Ray& ray, int& object, float& distance) const
+{
+	m_lastQueryNodes = 0;
+	if (m_nodeCount == 0)
+	{
+		return false;
+	}
+
+	float entry = 0.0f;
+	if (!ray.Intersects(makeBox(m_nodes[0].boundsMin, m_nodes[0].boundsMax), entry))
+	{
+		return false;
+	}
+
+	// Nodes waiting to be opened with the distance at which the ray enters them
+	uint32_t stack[STACK_SIZE];
+	float stackEntry[STACK_SIZE];
+	size_t depth = 0;
+	stack[depth] = 0;
+	stackEntry[depth++] = entry;
+
+	bool hit = false;
+	float nearest = FLT_MAX;
+	while (depth > 0)
+	{
+		--depth;
+		if (stackEntry[depth] > nearest)
+		{
+			continue;
+		}
+
+		const Node& node = m_nodes[stack[depth]];
+		++m_lastQueryNodes;
+		if (node.objectCount > 0)
+		{
+			for (uint32_t slot = node.first; slot < node.first + node.objectCount; ++slot)
+			{
+				BoundingSphere sphere;
+				sphere.Center = m_centers[slot];
+				sphere.Radius = m_radius;
+				float sphereDistance = 0.0f;
+				if (ray.Intersects(sphere, sphereDistance) &&
+					(sphereDistance < nearest || (sphereDistance == nearest && m_objects[slot] < object)))
+				{
+					nearest = sphereDistance;
+					object = m_objects[slot];
+					hit = true;
+				}
+			}
+			continue;
+		}
+
+		// Open the nearer child first by pushing it last
+		float childEntry[2];
+		bool childHit[2];
+		for (int child = 0; child < 2; ++child)
+		{
+			const Node& childNode = m_nodes[node.first + child];
+			childHit[child] = ray.Intersects(makeBox(childNode.boundsMin, childNode.boundsMax), childEntry[child]) && childEntry[child] <= nearest;
+		}
+		const int nearer = childHit[1] && (!childHit[0] || childEntry[1] < childEntry[0]) ? 1 : 0;
+		const int farther = 1 - nearer;
+		if (childHit[farther])
+		{
+			stack[depth] = node.first + farther;
+			stackEntry[depth++] = childEntry[farther];
+		}
+		if (childHit[nearer])
+		{
+			stack[depth] = node.first + nearer;
+			stackEntry[depth++] = childEntry[nearer];
+		}
+	}
+
+	distance = nearest;
+	return hit;
+}
+
+void BoundingVolumeHierarchy::queryBox(const Vector3& boundsMin, const Vector3& boundsMax, std::vector<int>& objects) const
+{
+	m_lastQueryNodes = 0;
+	if (m_nodeCount == 0)
+	{
+		return;
+	}
+
+	const Vector3 extent(m_radius);
+	uint32_t stack[STACK_SIZE];
+	size_t depth = 0;
+	stack[depth++] = 0;
+	while (depth > 0)
+	{
+		const Node& node = m_nodes[stack[--depth]];
+		++m_lastQueryNodes;
+		if (!boxesOverlap(node.boundsMin, node.boundsMax, boundsMin, boundsMax))
+		{
+			continue;
+		}
+
+		if (node.objectCount > 0)
+		{
+			for (uint32_t slot = node.first; slot < node.first + node.objectCount; ++slot)
+			{
+				if (boxesOverlap(m_centers[slot] - extent, m_centers[slot] + extent, boundsMin, boundsMax))
+				{
+					objects.push_back(m_objects[slot]);
+				}
+			}
+			continue;
+		}
+
+		stack[depth++] = node.first + 1;
+		stack[depth++] = node.first;
+	}
+}
@@ -1,18 +1,40 @@
-#include "..\include\cube.h"
+#include "../include/cube.h"
 
 using namespace DirectX::SimpleMath;
 
+namespace
+{
+	// Distance and angle covered per second along each direction axis
+	const float CUBE_SPEED = 1.0f;
+
+	// Equivalent to RotationX * RotationY * RotationZ * CreateWorld(position, +Z, +Y). That
+	// CreateWorld is a translation that negates the X and Z basis vectors, so flip those columns.
+	Matrix buildWorldMatrix(const Vector3& rotation, const Vector3& position)
+	{
+		Matrix world = Matrix::CreateFromEulerTranslation(rotation, position);
+		for (int row = 0; row < 3; ++row)
+		{
+			world.m[row][0] = -world.m[row][0];
+			world.m[row][2] = -world.m[row][2];
+		}
+		return world;
+	}
+}
+
 Cube::Cube()
 	: m_rotation(Vector3(0.0f, 0.0f, 0.0f)), m_position(Vector3(0.0f, 0.0f, 0.0f))
 {
 }
 
-Cube::Cube(const Vector3& position, const Vector3& rotation)
+Cube::Cube(const Vector3& position, const Vector3& rotation, const RandomStream& random)
+	: m_random(random)
 {
 	m_position = position;
 	m_rotation = rotation;
 
-	int i = (rand() % 4) + 1;
+	m_rotationAxis = static_cast<int>(m_random.nextBelow(3)) + 1;
+
+	int i = static_cast<int>(m_random.nextBelow(4)) + 1;
 	switch (i)
 	{
 	default:
@@ -22,52 +44,99 @@ Cube::Cube(const Vector3& position, const Vector3& rotation)
 	case 4: m_direction.x = 1.0f; m_direction.y = -1.0f; break;
 	}
 
-	m_direction.z = rand() % 2;
+	m_direction.z = static_cast<float>(m_random.nextBelow(2));
 	m_direction.z == 0 ? m_direction.z = -1 : m_direction.z = 1;
 
-	updateWorldMatrix();
+	m_previousPosition = m_position;
+	m_previousRotation = m_rotation;
+	markWorldDirty();
+}
+
+const Matrix& Cube::getWorldMatrix() const
+{
+	if (m_worldDirty)
+	{
+		updateWorldMatrix();
+	}
+	return m_world;
 }
 
 void Cube::setPosition(const DirectX::SimpleMath::Vector3 & position)
 {
 	m_position = position;
-	updateWorldMatrix();
+	markWorldDirty();
 }
 
 void Cube::setRotation(const DirectX::SimpleMath::Vector3 & rotation)
 {
 	m_rotation = rotation;
-	updateWorldMatrix();
+	markWorldDirty();
 }
 
 void Cube::rotateX(float radians)
 {
 	m_rotation.x += radians;
-	updateWorldMatrix();
+	markWorldDirty();
 }
 
 void Cube::rotateY(float radians)
 {
 	m_rotation.y += radians;
-	updateWorldMatrix();
+	markWorldDirty();
 }
 
 void Cube::rotateZ(float radians)
 {
 	m_rotation.z += radians;
+	markWorldDirty();
 }
 
 void Cube::move(const DirectX::SimpleMath::Vector3 & move)
 {
 	m_position += move;
-	updateWorldMatrix();
+	markWorldDirty();
 }
 
-void Cube::update()
+Matrix Cube::getInterpolatedWorldMatrix(float alpha) const
 {
-	const float delta = 0.001f;
+	if (alpha >= 1.0f)
+	{
+		return getWorldMatrix();
+	}
+	return interpolateWorldMatrix(getTransform(), alpha);
+}
+
+CubeTransform Cube::getTransform() const
+{
+	CubeTransform transform;
+	transform.previousPosition = m_previousPosition;
+	transform.previousRotation = m_previousRotation;
+	transform.position = m_position;
+	transform.rotation = m_rotation;
+	return transform;
+}
+
+Matrix Cube::interpolateWorldMatrix(const CubeTransform& transform, float alpha)
+{
+	if (alpha >= 1.0f)
+	{
+		return buildWorldMatrix(transform.rotation, transform.position);
+	}
+
+	// Only one Euler angle changes per step and by a small amount, so blending the angles
+	// is close enough to blending the rotations
+	return buildWorldMatrix(Vector3::Lerp(transform.previousRotation, transform.rotation, alpha),
+		Vector3::Lerp(transform.previousPosition, transform.position, alpha));
+}
+
+void Cube::update(float deltaSeconds)
+{
+	const float delta = CUBE_SPEED * deltaSeconds;
 	const Vector3 position = getPosition();
 
+	m_previousPosition = m_position;
+	m_previousRotation = m_rotation;
+
 	if (position.y >= 3.5f || position.y <= -3.5f || position.x > 3.5f || position.x < -3.5f)
 	{
 		m_direction.x *= -1;
@@ -75,7 +144,7 @@ void Cube::update()
 		m_direction.z *= -1;
 		//m_direction.z = 0;
 
-		m_rotationAxis = (rand() % 3) + 1;
+		m_rotationAxis = static_cast<int>(m_random.nextBelow(3)) + 1;
 	}
 	move(m_direction* delta);
 
@@ -88,18 +157,10 @@ void Cube::update()
 	}
 }
 
-void Cube::draw(ID3D11DeviceContext * g_pImmediateContext) const
+void Cube::updateWorldMatrix() const
 {
-	assert(g_pImmediateContext);
-	if (g_pImmediateContext == nullptr)
-	{
-		return;
-	}
-	// Render the triangles
-	g_pImmediateContext->DrawIndexed(36, 0, 0);        // 36 vertices needed for 12 triangles in a triangle list
-}
+	m_worldDirty = false;
+	++m_worldRebuildCount;
 
-void Cube::updateWorldMatrix()
-{
-	m_world = (Matrix::CreateRotationX(m_rotation.x) * Matrix::CreateRotationY(m_rotation.y) * Matrix::CreateRotationZ(m_rotation.z)) * Matrix::CreateWorld(m_position, Vector3(0.0f, 0.0f, 1.0f), Vector3(0.0f, 1.0f, 0.0f));
+	m_world = buildWorldMatrix(m_rotation, m_position);
 }
@@ -0,0 +1,333 @@
+#include "../include/cubeField.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+namespace
+{
+	const size_t STREAM_ALIGNMENT = 64;
+
+	// Same speed and bounds that Cube::update uses
+	const float CUBE_SPEED = 1.0f;
+	const float CUBE_BOUND = 3.5f;
+
+	size_t roundUp(size_t value, size_t multiple)
+	{
+		return ((value + multiple - 1) / multiple) * multiple;
+	}
+
+	void* allocateAligned(size_t bytes)
+	{
+#ifdef _WIN32
+		return _aligned_malloc(bytes, STREAM_ALIGNMENT);
+#else
+		void* pMemory = nullptr;
+		return posix_memalign(&pMemory, STREAM_ALIGNMENT, bytes) == 0 ? pMemory : nullptr;
+#endif
+	}
+
+	void freeAligned(void* pMemory)
+	{
+#ifdef _WIN32
+		_aligned_free(pMemory);
+#else
+		free(pMemory);
+#endif
+	}
+
+	inline XMVECTOR loadLanes(const float* pStream)
+	{
+		return XMLoadFloat4A(reinterpret_cast<const XMFLOAT4A*>(pStream));
+	}
+
+	inline void storeLanes(float* pStream, FXMVECTOR v)
+	{
+		XMStoreFloat4A(reinterpret_cast<XMFLOAT4A*>(pStream), v);
+	}
+
+	// Expanded form of RotationX * RotationY * RotationZ * CreateWorld(position, +Z, +Y) for
+	// four cubes at once, the composition Cube::updateWorldMatrix uses. CreateWorld with those
+	// axes is a pure translation that also negates the X and Z basis vectors. Returns the
+	// matrix rows transposed so that rows[row].r[lane] is that row of lane's matrix.
+	void composeWorldRows(FXMVECTOR rotationX, FXMVECTOR rotationY, FXMVECTOR rotationZ,
+		GXMVECTOR positionX, HXMVECTOR positionY, HXMVECTOR positionZ, XMMATRIX rows[4])
+	{
+		XMVECTOR sinX, cosX, sinY, cosY, sinZ, cosZ;
+		XMVectorSinCos(&sinX, &cosX, rotationX);
+		XMVectorSinCos(&sinY, &cosY, rotationY);
+		XMVectorSinCos(&sinZ, &cosZ, rotationZ);
+
+		const XMVECTOR sinXsinY = XMVectorMultiply(sinX, sinY);
+		const XMVECTOR cosXsinY = XMVectorMultiply(cosX, sinY);
+
+		XMMATRIX columns;
+		columns.r[0] = XMVectorNegate(XMVectorMultiply(cosY, cosZ));
+		columns.r[1] = XMVectorMultiply(cosY, sinZ);
+		columns.r[2] = sinY;
+		columns.r[3] = XMVectorZero();
+		rows[0] = XMMatrixTranspose(columns);
+
+		columns.r[0] = XMVectorNegativeMultiplySubtract(sinXsinY, cosZ, XMVectorMultiply(cosX, sinZ));
+		columns.r[1] = XMVectorMultiplyAdd(sinXsinY, sinZ, XMVectorMultiply(cosX, cosZ));
+		columns.r[2] = XMVectorNegate(XMVectorMultiply(sinX, cosY));
+		rows[1] = XMMatrixTranspose(columns);
+
+		columns.r[0] = XMVectorNegate(XMVectorMultiplyAdd(cosXsinY, cosZ, XMVectorMultiply(sinX, sinZ)));
+		columns.r[1] = XMVectorNegativeMultiplySubtract(sinX, cosZ, XMVectorMultiply(cosXsinY, sinZ));
+		columns.r[2] = XMVectorNegate(XMVectorMultiply(cosX, cosY));
+		rows[2] = XMMatrixTranspose(columns);
+
+		columns.r[0] = positionX;
+		columns.r[1] = positionY;
+		columns.r[2] = positionZ;
+		columns.r[3] = XMVectorSplatOne();
+		rows[3] = XMMatrixTranspose(columns);
+	}
+}
+
+CubeField::CubeField(size_t capacity, uint64_t seed)
+	: m_seed(seed)
+{
+	const size_t lanes = roundUp(capacity, LANE_COUNT);
+	const size_t floatStreamBytes = roundUp(lanes * sizeof(float), STREAM_ALIGNMENT);
+	const size_t matrixStreamBytes = lanes * sizeof(Matrix);
+	const size_t blockBytes = floatStreamBytes * 17 + matrixStreamBytes;
+
+	if (blockBytes == 0)
+	{
+		return;
+	}
+
+	m_block = allocateAligned(blockBytes);
+	if (m_block == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+	memset(m_block, 0, blockBytes);
+	m_blockBytes = blockBytes;
+	m_capacity = capacity;
+
+	char* pCursor = static_cast<char*>(m_block);
+	float** floatStreams[] =
+	{
+		&m_positionX, &m_positionY, &m_positionZ,
+		&m_directionX, &m_directionY, &m_directionZ,
+		&m_rotationX, &m_rotationY, &m_rotationZ,
+		&m_previousPositionX, &m_previousPositionY, &m_previousPositionZ,
+		&m_previousRotationX, &m_previousRotationY, &m_previousRotationZ,
+	};
+	for (float** ppStream : floatStreams)
+	{
+		*ppStream = reinterpret_cast<float*>(pCursor);
+		pCursor += floatStreamBytes;
+	}
+	m_rotationAxis = reinterpret_cast<uint32_t*>(pCursor);
+	pCursor += floatStreamBytes;
+	m_randomCounter = reinterpret_cast<uint32_t*>(pCursor);
+	pCursor += floatStreamBytes;
+
+	m_world = reinterpret_cast<Matrix*>(pCursor);
+	for (size_t i = 0; i < lanes; ++i)
+	{
+		new (&m_world[i]) Matrix();
+	}
+}
+
+CubeField::~CubeField()
+{
+	freeAligned(m_block);
+}
+
+size_t CubeField::add(const Vector3& position, const Vector3& rotation)
+{
+	assert(m_size < m_capacity);
+	const size_t index = m_size++;
+
+	// Draw in the same order as Cube's constructor
+	RandomStream random(m_seed, static_cast<uint32_t>(index));
+	m_rotationAxis[index] = random.nextBelow(3) + 1;
+
+	int i = static_cast<int>(random.nextBelow(4)) + 1;
+	switch (i)
+	{
+	default:
+	case 1: m_directionX[index] = 1.0f; m_directionY[index] = 1.0f; break;
+	case 2: m_directionX[index] = -1.0f; m_directionY[index] = 1.0f; break;
+	case 3: m_directionX[index] = -1.0f; m_directionY[index] = -1.0f; break;
+	case 4: m_directionX[index] = 1.0f; m_directionY[index] = -1.0f; break;
+	}
+	m_directionZ[index] = random.nextBelow(2) == 0 ? -1.0f : 1.0f;
+	m_randomCounter[index] = random.getCounter();
+
+	m_positionX[index] = position.x;
+	m_positionY[index] = position.y;
+	m_positionZ[index] = position.z;
+	m_rotationX[index] = rotation.x;
+	m_rotationY[index] = rotation.y;
+	m_rotationZ[index] = rotation.z;
+	m_previousPositionX[index] = position.x;
+	m_previousPositionY[index] = position.y;
+	m_previousPositionZ[index] = position.z;
+	m_previousRotationX[index] = rotation.x;
+	m_previousRotationY[index] = rotation.y;
+	m_previousRotationZ[index] = rotation.z;
+
+	buildWorldMatrices(index - (index % LANE_COUNT));
+
+	return index;
+}
+
+Vector3 CubeField::getPosition(size_t index) const
+{
+	assert(index < m_size);
+	return Vector3(m_positionX[index], m_positionY[index], m_positionZ[index]);
+}
+
+Vector3 CubeField::getRotation(size_t index) const
+{
+	assert(index < m_size);
+	return Vector3(m_rotationX[index], m_rotationY[index], m_rotationZ[index]);
+}
+
+void CubeField::update(float deltaSeconds)
+{
+	update(0, m_size, deltaSeconds);
+}
+
+void CubeField::update(size_t begin, size_t end, float deltaSeconds)
+{
+	assert(begin % LANE_COUNT == 0);
+	assert(end % LANE_COUNT == 0 || end == m_size);
+	assert(end <= m_size);
+
+	// Padding lanes past m_size sit at the origin with no direction, so they never bounce
+	// and can be processed with the rest of their group.
+	const float delta = CUBE_SPEED * deltaSeconds;
+	for (size_t first = begin; first < end; first += LANE_COUNT)
+	{
+		updateLanes(first, delta);
+		buildWorldMatrices(first);
+	}
+}
+
+void CubeField::interpolateWorldMatrices(size_t begin, size_t end, float alpha, Matrix* pOut) const
+{
+	assert(begin % LANE_COUNT == 0);
+	assert(end <= m_size);
+
+	const XMVECTOR t = XMVectorReplicate(alpha);
+	for (size_t first = begin; first < end; first += LANE_COUNT)
+	{
+		// Only one Euler angle changes per step and by a small amount, so blending the angles
+		// is close enough to blending the rotations
+		XMMATRIX rows[4];
+		composeWorldRows(
+			XMVectorLerpV(loadLanes(m_previousRotationX + first), loadLanes(m_rotationX + first), t),
+			XMVectorLerpV(loadLanes(m_previousRotationY + first), loadLanes(m_rotationY + first), t),
+			XMVectorLerpV(loadLanes(m_previousRotationZ + first), loadLanes(m_rotationZ + first), t),
+			XMVectorLerpV(loadLanes(m_previousPositionX + first), loadLanes(m_positionX + first), t),
+			XMVectorLerpV(loadLanes(m_previousPositionY + first), loadLanes(m_positionY + first), t),
+			XMVectorLerpV(loadLanes(m_previousPositionZ + first), loadLanes(m_positionZ + first), t),
+			rows);
+
+		// pOut is only as long as the range asked for, so the last group may be partial
+		const size_t laneCount = end - first < LANE_COUNT ? end - first : LANE_COUNT;
+		for (size_t lane = 0; lane < laneCount; ++lane)
+		{
+			Matrix& world = pOut[first - begin + lane];
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&world._11), rows[0].r[lane]);
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&world._21), rows[1].r[lane]);
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&world._31), rows[2].r[lane]);
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&world._41), rows[3].r[lane]);
+		}
+	}
+}
+
+void CubeField::updateLanes(size_t first, float stepDelta)
+{
+	const XMVECTOR bound = XMVectorReplicate(CUBE_BOUND);
+	const XMVECTOR negativeBound = XMVectorReplicate(-CUBE_BOUND);
+	const XMVECTOR delta = XMVectorReplicate(stepDelta);
+
+	XMVECTOR positionX = loadLanes(m_positionX + first);
+	XMVECTOR positionY = loadLanes(m_positionY + first);
+	XMVECTOR positionZ = loadLanes(m_positionZ + first);
+	const XMVECTOR rotationX = loadLanes(m_rotationX + first);
+	const XMVECTOR rotationY = loadLanes(m_rotationY + first);
+	const XMVECTOR rotationZ = loadLanes(m_rotationZ + first);
+
+	storeLanes(m_previousPositionX + first, positionX);
+	storeLanes(m_previousPositionY + first, positionY);
+	storeLanes(m_previousPositionZ + first, positionZ);
+	storeLanes(m_previousRotationX + first, rotationX);
+	storeLanes(m_previousRotationY + first, rotationY);
+	storeLanes(m_previousRotationZ + first, rotationZ);
+	XMVECTOR directionX = loadLanes(m_directionX + first);
+	XMVECTOR directionY = loadLanes(m_directionY + first);
+	XMVECTOR directionZ = loadLanes(m_directionZ + first);
+
+	// Same bounds test as Cube::update, evaluated on the position before the move
+	const XMVECTOR bounce = XMVectorOrInt(
+		XMVectorOrInt(XMVectorGreaterOrEqual(positionY, bound), XMVectorLessOrEqual(positionY, negativeBound)),
+		XMVectorOrInt(XMVectorGreater(positionX, bound), XMVectorLess(positionX, negativeBound)));
+
+	directionX = XMVectorSelect(directionX, XMVectorNegate(directionX), bounce);
+	directionY = XMVectorSelect(directionY, XMVectorNegate(directionY), bounce);
+	directionZ = XMVectorSelect(directionZ, XMVectorNegate(directionZ), bounce);
+
+	// Bounces are rare, so picking a new axis from each cube's own stream stays scalar
+	if (XMVector4NotEqualInt(bounce, XMVectorFalseInt()))
+	{
+		for (size_t lane = 0; lane < LANE_COUNT; ++lane)
+		{
+			if (XMVectorGetIntByIndex(bounce, lane) != 0)
+			{
+				const size_t index = first + lane;
+				RandomStream random(m_seed, static_cast<uint32_t>(index), m_randomCounter[index]);
+				m_rotationAxis[index] = random.nextBelow(3) + 1;
+				m_randomCounter[index] = random.getCounter();
+			}
+		}
+	}
+
+	positionX = XMVectorMultiplyAdd(directionX, delta, positionX);
+	positionY = XMVectorMultiplyAdd(directionY, delta, positionY);
+	positionZ = XMVectorMultiplyAdd(directionZ, delta, positionZ);
+
+	// Axis 1 spins about Y, 2 about Z and anything else about X
+	const XMVECTOR axis = XMLoadInt4A(m_rotationAxis + first);
+	const XMVECTOR aboutY = XMVectorEqualInt(axis, XMVectorReplicateInt(1));
+	const XMVECTOR aboutZ = XMVectorEqualInt(axis, XMVectorReplicateInt(2));
+	const XMVECTOR step = XMVectorMultiply(directionX, delta);
+
+	storeLanes(m_rotationX + first, XMVectorAdd(rotationX, XMVectorAndCInt(step, XMVectorOrInt(aboutY, aboutZ))));
+	storeLanes(m_rotationY + first, XMVectorAdd(rotationY, XMVectorAndInt(step, aboutY)));
+	storeLanes(m_rotationZ + first, XMVectorAdd(rotationZ, XMVectorAndInt(step, aboutZ)));
+
+	storeLanes(m_positionX + first, positionX);
+	storeLanes(m_positionY + first, positionY);
+	storeLanes(m_positionZ + first, positionZ);
+	storeLanes(m_directionX + first, directionX);
+	storeLanes(m_directionY + first, directionY);
+	storeLanes(m_directionZ + first, directionZ);
+}
+
+void CubeField::buildWorldMatrices(size_t first)
+{
+	XMMATRIX rows[4];
+	composeWorldRows(loadLanes(m_rotationX + first), loadLanes(m_rotationY + first), loadLanes(m_rotationZ + first),
+		loadLanes(m_positionX + first), loadLanes(m_positionY + first), loadLanes(m_positionZ + first), rows);
+
+	for (size_t lane = 0; lane < LANE_COUNT; ++lane)
+	{
+		Matrix& world = m_world[first + lane];
+		XMStoreFloat4A(reinterpret_cast<XMFLOAT4A*>(&world._11), rows[0].r[lane]);
+		XMStoreFloat4A(reinterpret_cast<XMFLOAT4A*>(&world._21), rows[1].r[lane]);
+		XMStoreFloat4A(reinterpret_cast<XMFLOAT4A*>(&world._31), rows[2].r[lane]);
+		XMStoreFloat4A(reinterpret_cast<XMFLOAT4A*>(&world._41), rows[3].r[lane]);
+	}
+}
@@ -0,0 +1,168 @@
+#include "../include/cubeRenderer.h"
+#include "../include/profiler.h"
+#include "../include/stateCacheRenderDevice.h"
+#include <algorithm>
+
+using namespace DirectX::SimpleMath;
+
+const SimpleVertex CUBE_VERTICES[CUBE_VERTEX_COUNT] =
+{
+	{ Vector3(-1.0f, 1.0f, -1.0f), Vector4(0.25f, 0.35f, 0.0f, 1.0f) },
+	{ Vector3(1.0f, 1.0f, -1.0f), Vector4(0.25f, 0.35f, 0.0f, 1.0f) },
+	{ Vector3(1.0f, 1.0f, 1.0f), Vector4(0.5f, 0.7f, 0.0f, 1.0f) },
+	{ Vector3(-1.0f, 1.0f, 1.0f), Vector4(0.5f, 0.7f, 0.0f, 1.0f) },
+	{ Vector3(-1.0f, -1.0f, -1.0f), Vector4(0.25f, 0.35f, 0.0f, 1.0f) },
+	{ Vector3(1.0f, -1.0f, -1.0f), Vector4(0.25f, 0.35f, 0.0f, 1.0f) },
+	{ Vector3(1.0f, -1.0f, 1.0f), Vector4(0.5f, 0.7f, 0.0f, 1.0f) },
+	{ Vector3(-1.0f, -1.0f, 1.0f), Vector4(0.5f, 0.7f, 0.0f, 1.0f) },
+};
+
+const uint16_t CUBE_INDICES[CUBE_INDEX_COUNT] =
+{
+	0,1,3,	3,1,2, // Face 1
+	4,5,0,	0,5,1, // Face 2
+	7,4,3,	3,4,0, // Face 3
+	5,6,1,	1,6,2, // Face 4
+	6,7,2,	2,7,3, // Face 5
+	5,4,6,	6,4,7, // Face 6
+};
+
+namespace
+{
+	// Everything a cube draw needs besides its shaders and constants. Nothing else in a frame
+	// changes these, so behind a StateCacheRenderDevice they cost nothing after the first frame.
+	void bindCubePipeline(RenderDevice& device)
+	{
+		device.setRenderTarget(RENDER_TARGET_BACK_BUFFER);
+		device.setDepthStencilState(RENDER_DEPTH_STATE_DEFAULT);
+		device.setViewport(RENDER_VIEWPORT_BACK_BUFFER);
+		device.setPrimitiveTopology(RENDER_TOPOLOGY_TRIANGLE_LIST);
+		device.setVertexBuffer(0, RENDER_BUFFER_CUBE_VERTICES, sizeof(SimpleVertex));
+		device.setIndexBuffer(RENDER_BUFFER_CUBE_INDICES);
+	}
+
+	// The pipeline plus the frame constants and the per-object layout, for cube-at-a-time draws
+	void bindCubeDraws(RenderDevice& device)
+	{
+		bindCubePipeline(device);
+		device.setVertexConstantBuffer(0, RENDER_BUFFER_FRAME_CONSTANTS);
+		device.setInputLayout(RENDER_LAYOUT_CUBE);
+	}
+
+	// Where the device can bind part of a constant buffer, every world matrix goes into the ring
+	// with one map and each draw binds its own slice. Returns the distance between slices, or 0
+	// if the cubes have to upload their own.
+	size_t appendObjectConstants(RenderDevice& device, const ObjectConstants* pObjectConstants, size_t count, size_t& offset)
+	{
+		const size_t alignment = device.getConstantBufferAlignment();
+		if (alignment == 0)
+		{
+			return 0;
+		}
+
+		const size_t stride = (sizeof(ObjectConstants) + alignment - 1) & ~(alignment - 1);
+		return device.appendBuffer(RENDER_BUFFER_OBJECT_CONSTANT_RING, pObjectConstants, sizeof(ObjectConstants), count, stride, offset) ? stride : 0;
+	}
+
+	// Draws cubes begin to end - 1 with bindCubeDraws() already done. With a ring stride, cube
+	// i reads the slice at ringOffset + i * ringStride.
+	void drawCubes(RenderDevice& device, const ObjectConstants* pObjectConstants, size_t begin, size_t end, size_t ringOffset, size_t ringStride)
+	{
+		if (ringStride > 0)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				device.setVertexShader(RENDER_SHADER_CUBE_VS);
+				device.setVertexConstantBufferRange(1, RENDER_BUFFER_OBJECT_CONSTANT_RING, ringOffset + i * ringStride, ringStride);
+				device.setPixelShader(RENDER_SHADER_CUBE_PS);
+				device.drawIndexed(CUBE_INDEX_COUNT);
+			}
+			return;
+		}
+
+		for (size_t i = begin; i < end; ++i)
+		{
+			// This is sending data to the graphics card
+			device.updateBuffer(RENDER_BUFFER_OBJECT_CONSTANTS, &pObjectConstants[i], sizeof(ObjectConstants));
+
+			// Render the triangles
+			device.setVertexShader(RENDER_SHADER_CUBE_VS);
+			device.setVertexConstantBuffer(1, RENDER_BUFFER_OBJECT_CONSTANTS);
+			device.setPixelShader(RENDER_SHADER_CUBE_PS);
+			device.drawIndexed(CUBE_INDEX_COUNT);
+		}
+	}
+}
+
+void submitCubes(RenderDevice& device, const FrameConstants& frameConstants, const ObjectConstants* pObjectConstants, size_t count)
+{
+	PROFILE_ZONE("submit cubes");
+	if (count == 0)
+	{
+		return;
+	}
+
+	// View and projection are the same for every cube, so they go up and are bound once
+	device.updateBuffer(RENDER_BUFFER_FRAME_CONSTANTS, &frameConstants, sizeof(FrameConstants));
+	bindCubeDraws(device);
+
+	size_t ringOffset = 0;
+	const size_t ringStride = appendObjectConstants(device, pObjectConstants, count, ringOffset);
+	drawCubes(device, pObjectConstants, 0, count, ringOffset, ringStride);
+}
+
+void submitCubesRecorded(RenderDevice& device, CommandRecorder& recorder, JobSystem& jobs, const FrameConstants& frameConstants,
+	const ObjectConstants* pObjectConstants, size_t count, size_t minChunkSize)
+{
+	PROFILE_ZONE("record cubes");
+	if (count == 0 || recorder.getContextCount() == 0)
+	{
+		submitCubes(device, frameConstants, pObjectConstants, count);
+		return;
+	}
+
+	// Uploads go through the immediate device first, so they land before any list reads them
+	device.updateBuffer(RENDER_BUFFER_FRAME_CONSTANTS, &frameConstants, sizeof(FrameConstants));
+	size_t ringOffset = 0;
+	const size_t ringStride = appendObjectConstants(device, pObjectConstants, count, ringOffset);
+
+	// One chunk per context, so no two threads ever share one
+	const size_t chunkSize = std::max<size_t>(minChunkSize, 1);
+	const unsigned int chunkCount = static_cast<unsigned int>(std::min<size_t>(recorder.getContextCount(), (count + chunkSize - 1) / chunkSize));
+	// A counter of its own, so waiting does not also wait on whatever else the pool is running
+	JobCounter recorded;
+	jobs.run(chunkCount, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t chunk = begin; chunk < end; ++chunk)
+		{
+			// Each list starts with nothing bound, and so does a new cache
+			StateCacheRenderDevice context(recorder.getContext(static_cast<unsigned int>(chunk)));
+			bindCubeDraws(context);
+			drawCubes(context, pObjectConstants, count * chunk / chunkCount, count * (chunk + 1) / chunkCount, ringOffset, ringStride);
+			recorder.finishCommandList(static_cast<unsigned int>(chunk));
+		}
+	}, recorded);
+	jobs.waitFor(recorded);
+
+	recorder.executeCommandLists(chunkCount);
+}
+
+void submitCubesInstanced(RenderDevice& device, const FrameConstants& frameConstants, const InstanceData* pInstances, size_t count)
+{
+	PROFILE_ZONE("submit cubes instanced");
+	if (count == 0)
+	{
+		return;
+	}
+
+	bindCubePipeline(device);
+	device.updateBuffer(RENDER_BUFFER_FRAME_CONSTANTS, &frameConstants, sizeof(FrameConstants));
+	device.updateBuffer(RENDER_BUFFER_INSTANCES, pInstances, count * sizeof(InstanceData));
+
+	device.setInputLayout(RENDER_LAYOUT_CUBE_INSTANCED);
+	device.setVertexBuffer(1, RENDER_BUFFER_INSTANCES, sizeof(InstanceData));
+	device.setVertexShader(RENDER_SHADER_CUBE_INSTANCED_VS);
+	device.setVertexConstantBuffer(0, RENDER_BUFFER_FRAME_CONSTANTS);
+	device.setPixelShader(RENDER_SHADER_CUBE_PS);
+	device.drawIndexedInstanced(CUBE_INDEX_COUNT, static_cast<unsigned int>(count));
+}
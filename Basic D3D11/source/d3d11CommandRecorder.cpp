@@ -0,0 +1,66 @@
+#include "../include/d3d11CommandRecorder.h"
+
+D3D11CommandRecorder::D3D11CommandRecorder(ID3D11Device* pDevice, ID3D11DeviceContext* pImmediateContext, const D3D11RenderDevice& resources, unsigned int contextCount)
+	: m_pImmediateContext(pImmediateContext), m_driverCommandLists(false)
+{
+	D3D11_FEATURE_DATA_THREADING threading;
+	ZeroMemory(&threading, sizeof(threading));
+	if (SUCCEEDED(pDevice->CheckFeatureSupport(D3D11_FEATURE_THREADING, &threading, sizeof(threading))))
+	{
+		m_driverCommandLists = threading.DriverCommandLists != FALSE;
+	}
+
+	for (unsigned int context = 0; context < contextCount; ++context)
+	{
+		ID3D11DeviceContext* pContext = NULL;
+		if (FAILED(pDevice->CreateDeferredContext(0, &pContext)))
+		{
+			break;
+		}
+		m_contexts.push_back(pContext);
+		m_devices.emplace_back(new D3D11RenderDevice(pContext, resources));
+	}
+	m_commandLists.assign(m_contexts.size(), NULL);
+}
+
+D3D11CommandRecorder::~D3D11CommandRecorder()
+{
+	for (ID3D11CommandList* pCommandList : m_commandLists)
+	{
+		if (pCommandList) pCommandList->Release();
+	}
+
+	// The devices draw on the contexts, so they go first
+	m_devices.clear();
+	for (ID3D11DeviceContext* pContext : m_contexts)
+	{
+		pContext->Release();
+	}
+}
+
+void D3D11CommandRecorder::finishCommandList(unsigned int context)
+{
+	ID3D11CommandList*& pCommandList = m_commandLists[context];
+	if (pCommandList)
+	{
+		pCommandList->Release();
+		pCommandList = NULL;
+	}
+
+	// FALSE leaves the deferred context with nothing bound, ready for the next list
+	m_contexts[context]->FinishCommandList(FALSE, &pCommandList);
+}
+
+void D3D11CommandRecorder::executeCommandLists(unsigned int count)
+{
+	for (unsigned int context = 0; context < count; ++context)
+	{
+		ID3D11CommandList*& pCommandList = m_commandLists[context];
+		if (pCommandList)
+		{
+			m_pImmediateContext->ExecuteCommandList(pCommandList, FALSE);
+			pCommandList->Release();
+			pCommandList = NULL;
+		}
+	}
+}
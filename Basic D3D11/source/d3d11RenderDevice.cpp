@@ -0,0 +1,422 @@
+#include "../include/d3d11RenderDevice.h"
+#include <assert.h>
+#include <string.h>
+
+namespace
+{
+	template <typename T>
+	void releaseReference(T*& pHeld)
+	{
+		if (pHeld) pHeld->Release();
+		pHeld = NULL;
+	}
+
+	template <typename T>
+	void replaceReference(T*& pHeld, T* pNew)
+	{
+		if (pNew) pNew->AddRef();
+		releaseReference(pHeld);
+		pHeld = pNew;
+	}
+}
+
+D3D11RenderDevice::D3D11RenderDevice(ID3D11Device* pDevice, ID3D11DeviceContext* pContext)
+	: m_pDevice(pDevice), m_pContext(pContext), m_pContext1(NULL), m_constantOffsets(false), m_frame(0)
+{
+	ZeroMemory(m_buffers, sizeof(m_buffers));
+	ZeroMemory(m_vertexShaders, sizeof(m_vertexShaders));
+	ZeroMemory(m_pixelShaders, sizeof(m_pixelShaders));
+	ZeroMemory(m_layouts, sizeof(m_layouts));
+	ZeroMemory(m_renderTargets, sizeof(m_renderTargets));
+	ZeroMemory(m_depthStates, sizeof(m_depthStates));
+	ZeroMemory(m_viewports, sizeof(m_viewports));
+	for (VertexBinding& binding : m_vertexBindings)
+	{
+		binding.buffer = -1;
+		binding.stride = 0;
+	}
+
+	// Binding part of a constant buffer, and appending to one without discarding it, are both
+	// D3D11.1 features that the driver may still leave out
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options;
+	ZeroMemory(&options, sizeof(options));
+	if (SUCCEEDED(m_pContext->QueryInterface(__uuidof(ID3D11DeviceContext1), reinterpret_cast<void**>(&m_pContext1))) &&
+		SUCCEEDED(m_pDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))))
+	{
+		m_constantOffsets = options.ConstantBufferOffsetting && options.MapNoOverwriteOnDynamicConstantBuffer;
+	}
+}
+
+D3D11RenderDevice::D3D11RenderDevice(ID3D11DeviceContext* pDeferredContext, const D3D11RenderDevice& resources)
+	: D3D11RenderDevice(resources.m_pDevice, pDeferredContext)
+{
+	for (int buffer = 0; buffer < RENDER_BUFFER_COUNT; ++buffer)
+	{
+		const Buffer& source = resources.m_buffers[buffer];
+		if (source.pBuffer && (!source.dynamic || source.ring))
+		{
+			// The immediate device owns the ring, so this one only ever binds it
+			attachBuffer(static_cast<RenderBuffer>(buffer), source.pBuffer);
+		}
+	}
+	for (int shader = 0; shader < RENDER_SHADER_COUNT; ++shader)
+	{
+		replaceReference(m_vertexShaders[shader], resources.m_vertexShaders[shader]);
+		replaceReference(m_pixelShaders[shader], resources.m_pixelShaders[shader]);
+	}
+	for (int layout = 0; layout < RENDER_LAYOUT_COUNT; ++layout)
+	{
+		replaceReference(m_layouts[layout], resources.m_layouts[layout]);
+	}
+	for (int target = 0; target < RENDER_TARGET_COUNT; ++target)
+	{
+		attachRenderTarget(static_cast<RenderTarget>(target), resources.m_renderTargets[target].pRenderTargetView,
+			resources.m_renderTargets[target].pDepthStencilView);
+	}
+	for (int state = 0; state < RENDER_DEPTH_STATE_COUNT; ++state)
+	{
+		replaceReference(m_depthStates[state], resources.m_depthStates[state]);
+	}
+	memcpy(m_viewports, resources.m_viewports, sizeof(m_viewports));
+}
+
+D3D11RenderDevice::~D3D11RenderDevice()
+{
+	for (const PendingFrame& pending : m_pendingFrames) pending.pQuery->Release();
+	for (ID3D11Query* pQuery : m_freeQueries) pQuery->Release();
+	releaseReference(m_pContext1);
+	for (Buffer& buffer : m_buffers) releaseReference(buffer.pBuffer);
+	for (ID3D11VertexShader*& pShader : m_vertexShaders) releaseReference(pShader);
+	for (ID3D11PixelShader*& pShader : m_pixelShaders) releaseReference(pShader);
+	for (ID3D11InputLayout*& pLayout : m_layouts) releaseReference(pLayout);
+	for (RenderTargetViews& views : m_renderTargets)
+	{
+		releaseReference(views.pRenderTargetView);
+		releaseReference(views.pDepthStencilView);
+	}
+	for (ID3D11DepthStencilState*& pState : m_depthStates) releaseReference(pState);
+}
+
+void D3D11RenderDevice::attachBuffer(RenderBuffer buffer, ID3D11Buffer* pBuffer)
+{
+	Buffer& entry = m_buffers[buffer];
+	replaceReference(entry.pBuffer, pBuffer);
+	entry.dynamic = false;
+	entry.ring = false;
+	entry.bindFlags = 0;
+	entry.capacity = 0;
+}
+
+void D3D11RenderDevice::attachDynamicBuffer(RenderBuffer buffer, UINT bindFlags)
+{
+	Buffer& entry = m_buffers[buffer];
+	releaseReference(entry.pBuffer);
+	entry.dynamic = true;
+	entry.ring = false;
+	entry.bindFlags = bindFlags;
+	entry.capacity = 0;
+}
+
+HRESULT D3D11RenderDevice::attachRingBuffer(RenderBuffer buffer, UINT bindFlags, size_t capacity)
+{
+	Buffer& entry = m_buffers[buffer];
+	releaseReference(entry.pBuffer);
+	entry.dynamic = true;
+	entry.ring = false;
+	entry.bindFlags = bindFlags;
+	entry.capacity = 0;
+
+	D3D11_BUFFER_DESC bd;
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_DYNAMIC;
+	bd.ByteWidth = static_cast<UINT>(capacity);
+	bd.BindFlags = bindFlags;
+	bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	HRESULT hr = m_pDevice->CreateBuffer(&bd, NULL, &entry.pBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	entry.ring = true;
+	entry.discardNext = true;
+	entry.capacity = capacity;
+	m_rings[buffer] = RingAllocator(capacity);
+	return S_OK;
+}
+
+void D3D11RenderDevice::beginFrame()
+{
+	// Queries finish in order, so stop at the first one that has not
+	bool retired = false;
+	uint64_t completedFrame = 0;
+	while (!m_pendingFrames.empty() && m_pContext->GetData(m_pendingFrames.front().pQuery, NULL, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK)
+	{
+		completedFrame = m_pendingFrames.front().frame;
+		m_freeQueries.push_back(m_pendingFrames.front().pQuery);
+		m_pendingFrames.pop_front();
+		retired = true;
+	}
+
+	if (retired)
+	{
+		for (RingAllocator& ring : m_rings)
+		{
+			ring.retireFrames(completedFrame);
+		}
+	}
+}
+
+void D3D11RenderDevice::endFrame()
+{
+	for (RingAllocator& ring : m_rings)
+	{
+		ring.endFrame(m_frame);
+	}
+
+	ID3D11Query* pQuery = NULL;
+	if (!m_freeQueries.empty())
+	{
+		pQuery = m_freeQueries.back();
+		m_freeQueries.pop_back();
+	}
+	else
+	{
+		D3D11_QUERY_DESC desc;
+		desc.Query = D3D11_QUERY_EVENT;
+		desc.MiscFlags = 0;
+		m_pDevice->CreateQuery(&desc, &pQuery);
+	}
+
+	// Without a query there is no way to know when this frame is done, so the ring keeps it
+	// until the next discard
+	if (pQuery)
+	{
+		m_pContext->End(pQuery);
+		PendingFrame pending = { m_frame, pQuery };
+		m_pendingFrames.push_back(pending);
+	}
+	++m_frame;
+}
+
+void D3D11RenderDevice::attachVertexShader(RenderShader shader, ID3D11VertexShader* pShader)
+{
+	replaceReference(m_vertexShaders[shader], pShader);
+}
+
+void D3D11RenderDevice::attachPixelShader(RenderShader shader, ID3D11PixelShader* pShader)
+{
+	replaceReference(m_pixelShaders[shader], pShader);
+}
+
+void D3D11RenderDevice::attachInputLayout(RenderLayout layout, ID3D11InputLayout* pLayout)
+{
+	replaceReference(m_layouts[layout], pLayout);
+}
+
+void D3D11RenderDevice::attachRenderTarget(RenderTarget target, ID3D11RenderTargetView* pRenderTargetView, ID3D11DepthStencilView* pDepthStencilView)
+{
+	replaceReference(m_renderTargets[target].pRenderTargetView, pRenderTargetView);
+	replaceReference(m_renderTargets[target].pDepthStencilView, pDepthStencilView);
+}
+
+void D3D11RenderDevice::attachDepthStencilState(RenderDepthState state, ID3D11DepthStencilState* pState)
+{
+	replaceReference(m_depthStates[state], pState);
+}
+
+void D3D11RenderDevice::attachViewport(RenderViewport viewport, const D3D11_VIEWPORT& area)
+{
+	m_viewports[viewport] = area;
+}
+
+void D3D11RenderDevice::updateBuffer(RenderBuffer buffer, const void* pData, size_t bytes)
+{
+	Buffer& entry = m_buffers[buffer];
+	if (!entry.dynamic)
+	{
+		assert(entry.pBuffer);
+		m_pContext->UpdateSubresource(entry.pBuffer, 0, NULL, pData, 0, 0);
+		return;
+	}
+
+	// Grow to the next power of two so a slowly rising count does not recreate every frame
+	if (entry.pBuffer == NULL || bytes > entry.capacity)
+	{
+		size_t capacity = 4096;
+		while (capacity < bytes)
+		{
+			capacity *= 2;
+		}
+
+		D3D11_BUFFER_DESC bd;
+		ZeroMemory(&bd, sizeof(bd));
+		bd.Usage = D3D11_USAGE_DYNAMIC;
+		bd.ByteWidth = static_cast<UINT>(capacity);
+		bd.BindFlags = entry.bindFlags;
+		bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+		ID3D11Buffer* pBuffer = NULL;
+		if (FAILED(m_pDevice->CreateBuffer(&bd, NULL, &pBuffer)))
+		{
+			return;
+		}
+		replaceReference(entry.pBuffer, pBuffer);
+		pBuffer->Release();
+		entry.capacity = capacity;
+
+		// Anything still bound to the old buffer would go on drawing from it
+		for (UINT slot = 0; slot < D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT; ++slot)
+		{
+			if (m_vertexBindings[slot].buffer == buffer)
+			{
+				UINT offset = 0;
+				m_pContext->IASetVertexBuffers(slot, 1, &entry.pBuffer, &m_vertexBindings[slot].stride, &offset);
+			}
+		}
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (SUCCEEDED(m_pContext->Map(entry.pBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+	{
+		memcpy(mapped.pData, pData, bytes);
+		m_pContext->Unmap(entry.pBuffer, 0);
+	}
+}
+
+size_t D3D11RenderDevice::getConstantBufferAlignment() const
+{
+	return m_constantOffsets ? CONSTANT_RANGE_ALIGNMENT : 0;
+}
+
+bool D3D11RenderDevice::appendBuffer(RenderBuffer buffer, const void* pData, size_t elementBytes, size_t count, size_t stride, size_t& offset)
+{
+	Buffer& entry = m_buffers[buffer];
+	RingAllocator& ring = m_rings[buffer];
+	if (!entry.ring || !m_constantOffsets || count == 0 || count * stride > ring.getCapacity() || elementBytes > stride)
+	{
+		return false;
+	}
+
+	offset = ring.allocate(count * stride, CONSTANT_RANGE_ALIGNMENT);
+	if (offset == RingAllocator::INVALID_OFFSET)
+	{
+		// Discarding would also lose anything appended earlier this frame
+		if (ring.getFrameBytes() > 0)
+		{
+			return false;
+		}
+		ring.reset();
+		entry.discardNext = true;
+		offset = ring.allocate(count * stride, CONSTANT_RANGE_ALIGNMENT);
+		if (offset == RingAllocator::INVALID_OFFSET)
+		{
+			return false;
+		}
+	}
+
+	// The allocator has already kept this range clear of anything the GPU may still read
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(m_pContext->Map(entry.pBuffer, 0, entry.discardNext ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE, 0, &mapped)))
+	{
+		return false;
+	}
+	entry.discardNext = false;
+
+	const BYTE* pSource = static_cast<const BYTE*>(pData);
+	BYTE* pDestination = static_cast<BYTE*>(mapped.pData) + offset;
+	for (size_t i = 0; i < count; ++i)
+	{
+		memcpy(pDestination + i * stride, pSource + i * elementBytes, elementBytes);
+	}
+	m_pContext->Unmap(entry.pBuffer, 0);
+	return true;
+}
+
+void D3D11RenderDevice::clearState()
+{
+	m_pContext->ClearState();
+	for (VertexBinding& binding : m_vertexBindings)
+	{
+		binding.buffer = -1;
+		binding.stride = 0;
+	}
+}
+
+void D3D11RenderDevice::setRenderTarget(RenderTarget target)
+{
+	m_pContext->OMSetRenderTargets(1, &m_renderTargets[target].pRenderTargetView, m_renderTargets[target].pDepthStencilView);
+}
+
+void D3D11RenderDevice::setDepthStencilState(RenderDepthState state)
+{
+	m_pContext->OMSetDepthStencilState(m_depthStates[state], 0);
+}
+
+void D3D11RenderDevice::setViewport(RenderViewport viewport)
+{
+	m_pContext->RSSetViewports(1, &m_viewports[viewport]);
+}
+
+void D3D11RenderDevice::setPrimitiveTopology(RenderTopology topology)
+{
+	switch (topology)
+	{
+	case RENDER_TOPOLOGY_TRIANGLE_LIST:
+	default:
+		m_pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		break;
+	}
+}
+
+void D3D11RenderDevice::setInputLayout(RenderLayout layout)
+{
+	m_pContext->IASetInputLayout(m_layouts[layout]);
+}
+
+void D3D11RenderDevice::setVertexShader(RenderShader shader)
+{
+	m_pContext->VSSetShader(m_vertexShaders[shader], NULL, 0);
+}
+
+void D3D11RenderDevice::setPixelShader(RenderShader shader)
+{
+	m_pContext->PSSetShader(m_pixelShaders[shader], NULL, 0);
+}
+
+void D3D11RenderDevice::setVertexConstantBuffer(unsigned int slot, RenderBuffer buffer)
+{
+	m_pContext->VSSetConstantBuffers(slot, 1, &m_buffers[buffer].pBuffer);
+}
+
+void D3D11RenderDevice::setVertexConstantBufferRange(unsigned int slot, RenderBuffer buffer, size_t offset, size_t bytes)
+{
+	// Offsets and sizes are counted in 16-byte constants
+	const UINT firstConstant = static_cast<UINT>(offset / 16);
+	const UINT constantCount = static_cast<UINT>(bytes / 16);
+	m_pContext1->VSSetConstantBuffers1(slot, 1, &m_buffers[buffer].pBuffer, &firstConstant, &constantCount);
+}
+
+void D3D11RenderDevice::setVertexBuffer(unsigned int slot, RenderBuffer buffer, unsigned int stride)
+{
+	UINT offset = 0;
+	m_pContext->IASetVertexBuffers(slot, 1, &m_buffers[buffer].pBuffer, &stride, &offset);
+	if (slot < D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT)
+	{
+		m_vertexBindings[slot].buffer = buffer;
+		m_vertexBindings[slot].stride = stride;
+	}
+}
+
+void D3D11RenderDevice::setIndexBuffer(RenderBuffer buffer)
+{
+	m_pContext->IASetIndexBuffer(m_buffers[buffer].pBuffer, DXGI_FORMAT_R16_UINT, 0);
+}
+
+void D3D11RenderDevice::drawIndexed(unsigned int indexCount)
+{
+	m_pContext->DrawIndexed(indexCount, 0, 0);
+}
+
+void D3D11RenderDevice::drawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount)
+{
+	m_pContext->DrawIndexedInstanced(indexCount, instanceCount, 0, 0, 0);
+}
@@ -0,0 +1,57 @@
+#include "../include/fixedTimestep.h"
+#include <assert.h>
+
+FixedTimestep::FixedTimestep(double stepRate, unsigned int maxStepsPerFrame)
+	: m_maxStepsPerFrame(maxStepsPerFrame > 0 ? maxStepsPerFrame : 1)
+{
+	setStepRate(stepRate);
+}
+
+unsigned int FixedTimestep::beginFrame()
+{
+	const Clock::time_point now = Clock::now();
+	if (!m_started)
+	{
+		m_started = true;
+		m_lastTime = now;
+		return 0;
+	}
+
+	const double elapsedSeconds = std::chrono::duration<double>(now - m_lastTime).count();
+	m_lastTime = now;
+	return advance(elapsedSeconds);
+}
+
+unsigned int FixedTimestep::advance(double elapsedSeconds)
+{
+	if (elapsedSeconds > 0.0)
+	{
+		m_accumulator += elapsedSeconds;
+	}
+
+	const double dueSteps = static_cast<double>(static_cast<unsigned long long>(m_accumulator / m_stepSeconds));
+	m_accumulator -= dueSteps * m_stepSeconds;
+	if (m_accumulator < 0.0)
+	{
+		m_accumulator = 0.0;
+	}
+
+	unsigned int steps = m_maxStepsPerFrame;
+	if (dueSteps <= m_maxStepsPerFrame)
+	{
+		steps = static_cast<unsigned int>(dueSteps);
+	}
+	else
+	{
+		m_droppedStepCount += static_cast<unsigned long long>(dueSteps) - m_maxStepsPerFrame;
+	}
+
+	m_stepCount += steps;
+	return steps;
+}
+
+void FixedTimestep::setStepRate(double stepRate)
+{
+	assert(stepRate > 0.0);
+	m_stepSeconds = 1.0 / stepRate;
+}
@@ -0,0 +1,183 @@
+#include "../include/frameStats.h"
+#include <stdio.h>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	const uint64_t SUB_BUCKET_COUNT = 1ull << LatencyHistogram::SUB_BUCKET_BITS;
+
+	unsigned int highestBit(uint64_t value)
+	{
+		unsigned int bit = 0;
+		for (unsigned int step = 32; step > 0; step >>= 1)
+		{
+			if (value >= (1ull << step))
+			{
+				value >>= step;
+				bit += step;
+			}
+		}
+		return bit;
+	}
+
+	const char* PHASE_NAMES[FrameStats::PHASE_COUNT] = { "frame", "simulate", "cull", "sort", "pack", "submit" };
+
+	void writeRow(FILE* pFile, const char* interval, double seconds, const FrameStats::PhaseSummary* pPhases)
+	{
+		for (int phase = 0; phase < FrameStats::PHASE_COUNT; ++phase)
+		{
+			const FrameStats::PhaseSummary& summary = pPhases[phase];
+			fprintf(pFile, "%8s  %8.3f  %-8s  %8llu  %9.3f  %9.3f  %9.3f  %9.3f\n", interval, seconds, PHASE_NAMES[phase],
+				static_cast<unsigned long long>(summary.count), summary.p50 / 1.0e6, summary.p95 / 1.0e6, summary.p99 / 1.0e6, summary.max / 1.0e6);
+		}
+	}
+}
+
+size_t LatencyHistogram::getBucketIndex(uint64_t value)
+{
+	value = std::min(value, MAX_VALUE);
+	if (value < SUB_BUCKET_COUNT)
+	{
+		return static_cast<size_t>(value);
+	}
+
+	// The top SUB_BUCKET_BITS bits pick the bucket within the value's power of two
+	const unsigned int shift = highestBit(value) - (SUB_BUCKET_BITS - 1);
+	return static_cast<size_t>(shift * (SUB_BUCKET_COUNT / 2) + (value >> shift));
+}
+
+uint64_t LatencyHistogram::getBucketHighest(size_t bucket)
+{
+	if (bucket < SUB_BUCKET_COUNT)
+	{
+		return bucket;
+	}
+
+	const unsigned int shift = static_cast<unsigned int>(bucket / (SUB_BUCKET_COUNT / 2) - 1);
+	const uint64_t leading = bucket - shift * (SUB_BUCKET_COUNT / 2);
+	return ((leading + 1) << shift) - 1;
+}
+
+LatencyHistogram::LatencyHistogram()
+	: m_buckets(getBucketCount(), 0)
+{
+	reset();
+}
+
+void LatencyHistogram::record(uint64_t value)
+{
+	++m_buckets[getBucketIndex(value)];
+	++m_count;
+	m_sum += value;
+	m_min = std::min(m_min, value);
+	m_max = std::max(m_max, value);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+	for (size_t bucket = 0; bucket < m_buckets.size(); ++bucket)
+	{
+		m_buckets[bucket] += other.m_buckets[bucket];
+	}
+	m_count += other.m_count;
+	m_sum += other.m_sum;
+	m_min = std::min(m_min, other.m_min);
+	m_max = std::max(m_max, other.m_max);
+}
+
+void LatencyHistogram::reset()
+{
+	std::fill(m_buckets.begin(), m_buckets.end(), 0);
+	m_count = 0;
+	m_sum = 0;
+	m_min = ~0ull;
+	m_max = 0;
+}
+
+uint64_t LatencyHistogram::getPercentile(double percentile) const
+{
+	if (m_count == 0)
+	{
+		return 0;
+	}
+
+	const double clamped = std::min(std::max(percentile, 0.0), 100.0);
+	const uint64_t rank = std::max<uint64_t>(static_cast<uint64_t>(std::ceil(clamped / 100.0 * m_count)), 1);
+	uint64_t seen = 0;
+	for (size_t bucket = 0; bucket < m_buckets.size(); ++bucket)
+	{
+		seen += m_buckets[bucket];
+		if (seen >= rank)
+		{
+			return std::min(getBucketHighest(bucket), m_max);
+		}
+	}
+	return m_max;
+}
+
+const char* FrameStats::getPhaseName(Phase phase)
+{
+	return PHASE_NAMES[phase];
+}
+
+FrameStats::PhaseSummary FrameStats::summarize(const LatencyHistogram& histogram)
+{
+	PhaseSummary summary;
+	summary.count = histogram.getCount();
+	summary.p50 = histogram.getPercentile(50.0);
+	summary.p95 = histogram.getPercentile(95.0);
+	summary.p99 = histogram.getPercentile(99.0);
+	summary.max = histogram.getMax();
+	return summary;
+}
+
+const FrameStats::IntervalSummary& FrameStats::getInterval(size_t index) const
+{
+	return m_intervals[(m_closedCount - getKeptCount() + index) % MAX_INTERVALS];
+}
+
+const FrameStats::IntervalSummary& FrameStats::closeInterval(double seconds)
+{
+	// Overwrites the oldest summary once the window is full
+	IntervalSummary& interval = m_intervals[m_closedCount % MAX_INTERVALS];
+	interval.seconds = seconds;
+	for (int phase = 0; phase < PHASE_COUNT; ++phase)
+	{
+		interval.phases[phase] = summarize(m_interval[phase]);
+		m_total[phase].merge(m_interval[phase]);
+		m_interval[phase].reset();
+	}
+	m_totalSeconds += seconds;
+	++m_closedCount;
+	return interval;
+}
+
+bool FrameStats::writeSummary(const char* path) const
+{
+	FILE* pFile = fopen(path, "w");
+	if (!pFile)
+	{
+		return false;
+	}
+
+	fprintf(pFile, "%8s  %8s  %-8s  %8s  %9s  %9s  %9s  %9s\n", "interval", "seconds", "phase", "count", "p50 ms", "p95 ms", "p99 ms", "max ms");
+	const size_t kept = getKeptCount();
+	char name[32];
+	for (size_t i = 0; i < kept; ++i)
+	{
+		const IntervalSummary& interval = getInterval(i);
+		snprintf(name, sizeof(name), "%llu", static_cast<unsigned long long>(m_closedCount - kept + i + 1));
+		writeRow(pFile, name, interval.seconds, interval.phases);
+	}
+
+	PhaseSummary total[PHASE_COUNT];
+	for (int phase = 0; phase < PHASE_COUNT; ++phase)
+	{
+		total[phase] = summarize(m_total[phase]);
+	}
+	writeRow(pFile, "all", m_totalSeconds, total);
+
+	const bool written = ferror(pFile) == 0;
+	return fclose(pFile) == 0 && written;
+}
@@ -0,0 +1,176 @@
+#include "../include/frustum.h"
+#include <cmath>
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+namespace
+{
+	// One plane splatted across every lane
+	struct PlaneLanes
+	{
+		XMVECTOR a;
+		XMVECTOR b;
+		XMVECTOR c;
+		XMVECTOR d;
+	};
+
+	void splatPlanes(const Frustum& frustum, PlaneLanes lanes[Frustum::PLANE_COUNT])
+	{
+		for (size_t plane = 0; plane < Frustum::PLANE_COUNT; ++plane)
+		{
+			const Plane& source = frustum.getPlane(plane);
+			lanes[plane].a = XMVectorReplicate(source.x);
+			lanes[plane].b = XMVectorReplicate(source.y);
+			lanes[plane].c = XMVectorReplicate(source.z);
+			lanes[plane].d = XMVectorReplicate(source.w);
+		}
+	}
+
+	// Bit i is set if sphere i is on the inner side of, or crosses, every plane
+	inline unsigned int testLanes(const PlaneLanes planes[Frustum::PLANE_COUNT], FXMVECTOR x, FXMVECTOR y, FXMVECTOR z, FXMVECTOR negativeRadius)
+	{
+		XMVECTOR inside = XMVectorTrueInt();
+		for (size_t plane = 0; plane < Frustum::PLANE_COUNT; ++plane)
+		{
+			XMVECTOR distance = XMVectorMultiplyAdd(planes[plane].a, x, planes[plane].d);
+			distance = XMVectorMultiplyAdd(planes[plane].b, y, distance);
+			distance = XMVectorMultiplyAdd(planes[plane].c, z, distance);
+			inside = XMVectorAndInt(inside, XMVectorGreaterOrEqual(distance, negativeRadius));
+
+			// Most of the spheres that are out are out past the first plane or two
+			if (XMVector4EqualInt(inside, XMVectorFalseInt()))
+			{
+				return 0;
+			}
+		}
+
+		XMVECTORU32 mask;
+		mask.v = inside;
+		return (mask.u[0] & 1) | (mask.u[1] & 2) | (mask.u[2] & 4) | (mask.u[3] & 8);
+	}
+
+	inline size_t appendLanes(unsigned int mask, size_t laneCount, int firstIndex, int* pVisible)
+	{
+		size_t written = 0;
+		for (size_t lane = 0; lane < laneCount; ++lane)
+		{
+			if (mask & (1u << lane))
+			{
+				pVisible[written++] = firstIndex + static_cast<int>(lane);
+			}
+		}
+		return written;
+	}
+}
+
+Frustum::Frustum(const Matrix& viewProjection)
+{
+	// Clip coordinates are v * viewProjection, so each is the dot product of the point with a
+	// column, and the volume is -w <= x <= w, -w <= y <= w and 0 <= z <= w
+	const Matrix& m = viewProjection;
+	const Vector4 columnX(m._11, m._21, m._31, m._41);
+	const Vector4 columnY(m._12, m._22, m._32, m._42);
+	const Vector4 columnZ(m._13, m._23, m._33, m._43);
+	const Vector4 columnW(m._14, m._24, m._34, m._44);
+
+	const Vector4 planes[PLANE_COUNT] =
+	{
+		Vector4(columnW.x + columnX.x, columnW.y + columnX.y, columnW.z + columnX.z, columnW.w + columnX.w),
+		Vector4(columnW.x - columnX.x, columnW.y - columnX.y, columnW.z - columnX.z, columnW.w - columnX.w),
+		Vector4(columnW.x + columnY.x, columnW.y + columnY.y, columnW.z + columnY.z, columnW.w + columnY.w),
+		Vector4(columnW.x - columnY.x, columnW.y - columnY.y, columnW.z - columnY.z, columnW.w - columnY.w),
+		columnZ,
+		Vector4(columnW.x - columnZ.x, columnW.y - columnZ.y, columnW.z - columnZ.z, columnW.w - columnZ.w),
+	};
+
+	for (size_t plane = 0; plane < PLANE_COUNT; ++plane)
+	{
+		const Vector4& p = planes[plane];
+		const float length = std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+		const float scale = length > 0.0f ? 1.0f / length : 0.0f;
+		m_planes[plane] = Plane(p.x * scale, p.y * scale, p.z * scale, p.w * scale);
+	}
+}
+
+bool Frustum::intersectsSphere(const Vector3& center, float radius) const
+{
+	for (const Plane& plane : m_planes)
+	{
+		if (plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w < -radius)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+Frustum::BoxTest Frustum::testBox(const Vector3& boundsMin, const Vector3& boundsMax) const
+{
+	BoxTest result = BOX_INSIDE;
+	for (const Plane& plane : m_planes)
+	{
+		// The corner furthest along the plane's normal, and the one furthest against it
+		const float farthest = plane.x * (plane.x >= 0.0f ? boundsMax.x : boundsMin.x) +
+			plane.y * (plane.y >= 0.0f ? boundsMax.y : boundsMin.y) +
+			plane.z * (plane.z >= 0.0f ? boundsMax.z : boundsMin.z) + plane.w;
+		if (farthest < 0.0f)
+		{
+			return BOX_OUTSIDE;
+		}
+
+		const float nearest = plane.x * (plane.x >= 0.0f ? boundsMin.x : boundsMax.x) +
+			plane.y * (plane.y >= 0.0f ? boundsMin.y : boundsMax.y) +
+			plane.z * (plane.z >= 0.0f ? boundsMin.z : boundsMax.z) + plane.w;
+		if (nearest < 0.0f)
+		{
+			result = BOX_INTERSECTS;
+		}
+	}
+	return result;
+}
+
+size_t Frustum::cullSpheres(const Vector3* pCenters, size_t count, float radius, int firstIndex, int* pVisible) const
+{
+	PlaneLanes planes[PLANE_COUNT];
+	splatPlanes(*this, planes);
+	const XMVECTOR negativeRadius = XMVectorReplicate(-radius);
+
+	size_t visible = 0;
+	for (size_t first = 0; first < count; first += LANE_COUNT)
+	{
+		// The last group repeats its last sphere in the lanes past count
+		const size_t laneCount = count - first < LANE_COUNT ? count - first : LANE_COUNT;
+		const Vector3& c0 = pCenters[first];
+		const Vector3& c1 = pCenters[first + (laneCount > 1 ? 1 : 0)];
+		const Vector3& c2 = pCenters[first + (laneCount > 2 ? 2 : laneCount - 1)];
+		const Vector3& c3 = pCenters[first + laneCount - 1];
+		const XMVECTOR x = XMVectorSet(c0.x, c1.x, c2.x, c3.x);
+		const XMVECTOR y = XMVectorSet(c0.y, c1.y, c2.y, c3.y);
+		const XMVECTOR z = XMVectorSet(c0.z, c1.z, c2.z, c3.z);
+
+		const unsigned int mask = testLanes(planes, x, y, z, negativeRadius);
+		visible += appendLanes(mask, laneCount, firstIndex + static_cast<int>(first), pVisible + visible);
+	}
+	return visible;
+}
+
+size_t Frustum::cullSpheres(const float* pCenterX, const float* pCenterY, const float* pCenterZ, size_t count, float radius, int firstIndex, int* pVisible) const
+{
+	PlaneLanes planes[PLANE_COUNT];
+	splatPlanes(*this, planes);
+	const XMVECTOR negativeRadius = XMVectorReplicate(-radius);
+
+	size_t visible = 0;
+	for (size_t first = 0; first < count; first += LANE_COUNT)
+	{
+		const size_t laneCount = count - first < LANE_COUNT ? count - first : LANE_COUNT;
+		const XMVECTOR x = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(pCenterX + first));
+		const XMVECTOR y = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(pCenterY + first));
+		const XMVECTOR z = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(pCenterZ + first));
+
+		const unsigned int mask = testLanes(planes, x, y, z, negativeRadius);
+		visible += appendLanes(mask, laneCount, firstIndex + static_cast<int>(first), pVisible + visible);
+	}
+	return visible;
+}
@@ -0,0 +1,238 @@
+#include "../include/hardwareCounters.h"
+
+#if defined(__linux__)
+#include <errno.h>
+#include <string.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	const char* COUNTER_NAMES[HardwareCounters::COUNTER_COUNT] = { "cycles", "instructions", "L1D misses", "LLC misses", "branch misses" };
+
+#if defined(__linux__)
+	struct EventType
+	{
+		uint32_t type;
+		uint64_t config;
+	};
+
+	const EventType COUNTER_EVENTS[HardwareCounters::COUNTER_COUNT] =
+	{
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+		{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	};
+
+	// Opens counter as a member of the group led by groupFile, or on its own if groupFile is -1.
+	// A leader or a counter on its own starts disabled; members follow their leader.
+	int openCounter(int counter, int groupFile)
+	{
+		perf_event_attr attributes;
+		memset(&attributes, 0, sizeof(attributes));
+		attributes.size = sizeof(attributes);
+		attributes.type = COUNTER_EVENTS[counter].type;
+		attributes.config = COUNTER_EVENTS[counter].config;
+		attributes.disabled = groupFile < 0 ? 1 : 0;
+
+		// Counting user mode alone is all that perf_event_paranoid 2, the usual default, allows
+		attributes.exclude_kernel = 1;
+		attributes.exclude_hv = 1;
+		attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		if (groupFile >= 0 || counter == HardwareCounters::COUNTER_CYCLES)
+		{
+			attributes.read_format |= PERF_FORMAT_GROUP;
+		}
+
+		return static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, groupFile, 0));
+	}
+
+	// What perf_event_open failing with this errno most likely means
+	const char* describeOpenError(int error)
+	{
+		switch (error)
+		{
+		case EACCES:
+		case EPERM:
+			return "not permitted; lower kernel.perf_event_paranoid or allow perf_event_open in the container's seccomp profile";
+		case ENOSYS:
+			return "perf_event_open is not available, as when a container's seccomp profile blocks it";
+		case ENOENT:
+		case EOPNOTSUPP:
+		case EINVAL:
+			return "not supported by this CPU, or not exposed by the hypervisor";
+		default:
+			return strerror(error);
+		}
+	}
+#endif
+}
+
+HardwareCounters::Reading::Reading()
+	: scaled(false)
+{
+	for (uint64_t& value : values)
+	{
+		value = 0;
+	}
+}
+
+void HardwareCounters::Reading::add(const Reading& other)
+{
+	for (int counter = 0; counter < COUNTER_COUNT; ++counter)
+	{
+		values[counter] += other.values[counter];
+	}
+	scaled = scaled || other.scaled;
+}
+
+double HardwareCounters::Reading::getIpc() const
+{
+	return values[COUNTER_CYCLES] > 0 ? static_cast<double>(values[COUNTER_INSTRUCTIONS]) / values[COUNTER_CYCLES] : 0.0;
+}
+
+const char* HardwareCounters::getCounterName(Counter counter)
+{
+	return COUNTER_NAMES[counter];
+}
+
+HardwareCounters::HardwareCounters()
+{
+	for (int counter = 0; counter < COUNTER_COUNT; ++counter)
+	{
+		m_files[counter] = -1;
+		m_grouped[counter] = false;
+	}
+
+#if defined(__linux__)
+	// Cycles lead the group, which the kernel only schedules onto the CPU's counters as a
+	// whole. A counter the group will not take is opened on its own instead.
+	const int leader = openCounter(COUNTER_CYCLES, -1);
+	for (int counter = 0; counter < COUNTER_COUNT; ++counter)
+	{
+		if (counter == COUNTER_CYCLES)
+		{
+			m_files[counter] = leader;
+			m_grouped[counter] = leader >= 0;
+		}
+		else
+		{
+			if (leader >= 0)
+			{
+				m_files[counter] = openCounter(counter, leader);
+				m_grouped[counter] = m_files[counter] >= 0;
+			}
+			if (m_files[counter] < 0)
+			{
+				m_files[counter] = openCounter(counter, -1);
+			}
+		}
+		if (m_files[counter] < 0 && m_error.empty())
+		{
+			m_error = std::string(COUNTER_NAMES[counter]) + ": " + describeOpenError(errno);
+		}
+	}
+#else
+	m_error = "hardware counters need Linux perf_event_open";
+#endif
+}
+
+HardwareCounters::~HardwareCounters()
+{
+#if defined(__linux__)
+	for (int file : m_files)
+	{
+		if (file >= 0)
+		{
+			close(file);
+		}
+	}
+#endif
+}
+
+bool HardwareCounters::isAnyAvailable() const
+{
+	for (int counter = 0; counter < COUNTER_COUNT; ++counter)
+	{
+		if (isAvailable(static_cast<Counter>(counter)))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void HardwareCounters::start()
+{
+#if defined(__linux__)
+	// The group resets and starts together through its leader
+	for (int counter = 0; counter < COUNTER_COUNT; ++counter)
+	{
+		if (m_files[counter] >= 0 && (!m_grouped[counter] || counter == COUNTER_CYCLES))
+		{
+			const int flags = m_grouped[counter] ? PERF_IOC_FLAG_GROUP : 0;
+			ioctl(m_files[counter], PERF_EVENT_IOC_RESET, flags);
+			ioctl(m_files[counter], PERF_EVENT_IOC_ENABLE, flags);
+		}
+	}
+#endif
+}
+
+HardwareCounters::Reading HardwareCounters::stop()
+{
+	Reading reading;
+#if defined(__linux__)
+	for (int counter = 0; counter < COUNTER_COUNT; ++counter)
+	{
+		if (m_files[counter] >= 0 && (!m_grouped[counter] || counter == COUNTER_CYCLES))
+		{
+			ioctl(m_files[counter], PERF_EVENT_IOC_DISABLE, m_grouped[counter] ? PERF_IOC_FLAG_GROUP : 0);
+		}
+	}
+
+	// The group reads as its size, time enabled, time running and then each value, leader
+	// first and the rest in the order they joined. All of them ran for the same time, so one
+	// scale applies to every value.
+	if (m_grouped[COUNTER_CYCLES])
+	{
+		uint64_t values[3 + COUNTER_COUNT];
+		const ssize_t bytes = read(m_files[COUNTER_CYCLES], values, sizeof(values));
+		if (bytes >= static_cast<ssize_t>(3 * sizeof(uint64_t)) && values[2] > 0)
+		{
+			const double scale = static_cast<double>(values[1]) / values[2];
+			reading.scaled = values[2] < values[1];
+			uint64_t member = 0;
+			for (int counter = 0; counter < COUNTER_COUNT && member < values[0]; ++counter)
+			{
+				if (m_grouped[counter])
+				{
+					reading.values[counter] = reading.scaled ? static_cast<uint64_t>(values[3 + member] * scale) : values[3 + member];
+					++member;
+				}
+			}
+		}
+	}
+
+	for (int counter = 0; counter < COUNTER_COUNT; ++counter)
+	{
+		// value, time enabled, time running
+		uint64_t values[3];
+		if (m_grouped[counter] || m_files[counter] < 0 || read(m_files[counter], values, sizeof(values)) != static_cast<ssize_t>(sizeof(values)) || values[2] == 0)
+		{
+			continue;
+		}
+		if (values[2] < values[1])
+		{
+			values[0] = static_cast<uint64_t>(static_cast<double>(values[0]) * values[1] / values[2]);
+			reading.scaled = true;
+		}
+		reading.values[counter] = values[0];
+	}
+#endif
+	return reading;
+}
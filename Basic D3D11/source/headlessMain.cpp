@@ -0,0 +1,2298 @@
+// *************************************************************************************
+// File: headlessMain.cpp
+//
+// Runs the Cube simulation loop from wWinMain without a window or a D3D11 device so the
+// CPU side of the frame can be timed on any platform.
+//
+// Usage: CubeSimHeadless [options] [cube|field|overlap|scale|verify|submit|record|cull|bvh|occlusion|queue|raster|profile|stats|ring|bench|counters]
+//        cube    = array of Cube objects, updated then packed (default)
+//        field   = structure-of-arrays CubeField
+//        overlap = array of Cube objects, updating the next frame while packing the last
+//                  published snapshot, as in wWinMain
+//        scale   = cube, field and overlap at 1e2, 1e3, ... up to --max-cubes cubes,
+//                  reporting time and memory per cube at each size
+//        verify  = check Matrix::CreateFromEulerTranslation against the matrix
+//                  composition it replaces, and the interpolated world matrices,
+//                  over --cubes random transforms
+//        submit  = submit --cubes cubes one draw at a time, one draw at a time from a
+//                  constant ring, and instanced into RecordingRenderDevices, with and
+//                  without a StateCacheRenderDevice in front, report the calls and
+//                  bytes per frame of each, and check all would draw the same world
+//                  matrices with the same state
+//        record  = submit --cubes cubes one draw at a time, and again recorded in chunks
+//                  on --threads threads through a SoftwareCommandRecorder, and check the
+//                  recorded lists play back the same draws in the same order and leave
+//                  nothing bound
+//        cull    = check the frustum planes, then cull --cubes moving cubes every frame
+//                  four at a time and one at a time, and report visible and culled counts
+//        bvh     = keep a bounding volume hierarchy over --cubes moving cubes, one in a
+//                  thousand of which jump elsewhere each frame, check its frustum, ray
+//                  and box queries against testing every cube, and report update and
+//                  query times against a flat scan
+//        occlusion = cull --cubes moving cubes to the frustum, then draw the nearest
+//                  --occluders into an OcclusionBuffer and cull the cubes it hides,
+//                  checking the drawing against one pixel at a time and that no cube
+//                  culled would win a pixel of the 640x480 image
+//        queue   = sort the cubes left after culling --cubes moving cubes through a
+//                  RenderQueue every frame, on their depth alone and again with mixed
+//                  passes, shaders and materials, check the radix sort against a
+//                  stable comparison sort and keys at the near and far planes, and
+//                  report sort times
+//        raster  = draw --cubes moving cubes into a SoftwareRenderDevice each frame,
+//                  report frames and triangles per second, and check the tiles match
+//                  drawing one pixel at a time and drawing the cubes instanced
+//        profile = run simulate, cull, sort and pack as a frame graph under the
+//                  profiler, check its zones nest and it counted every frame, report
+//                  what a zone costs and write the Chrome trace to --trace (needs a
+//                  PROFILE build)
+//        stats   = check the percentiles of LatencyHistogram against sorting, then time
+//                  the phases of a frame graph like wWinMain's into FrameStats and write
+//                  the summary of the last intervals of 10 frames to --stats
+//        ring    = check RingAllocator never hands out data still in flight, over
+//                  --frames random frames
+//        bench   = time Cube::update, the world matrix rebuilds, constant packing and
+//                  drawing into a SoftwareRenderDevice over --runs runs of --frames frames,
+//                  and write every run to --json for BenchmarkCompare
+//        counters = run update, world matrix rebuilds and packing on one thread and report
+//                  cycles, instructions, IPC, L1D, LLC and branch misses per cube of each,
+//                  from perf_event_open on Linux; timings alone where counters are blocked
+//
+// Options are those of SimulationConfig (--cubes, --seed, --spawn-min, --spawn-max,
+// --step-rate, --threads, --occluders, --config) plus
+//        --frames=N     frames to run, or the most to run per size in scale mode (1000)
+//        --max-cubes=N  largest size in scale mode (1e7)
+//        --trace=path   trace file in profile mode (cubeSimTrace.json)
+//        --stats=path   summary file in stats mode (cubeSimFrameStats.txt)
+//        --runs=N       runs in bench mode, after one more to warm up (10)
+//        --json=path    report file in bench mode (cubeSimBench.json)
+// A fixed seed gives the same checksum for every thread count and mode.
+// *************************************************************************************
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "../include/benchmarkReport.h"
+#include "../include/boundingVolumeHierarchy.h"
+#include "../include/cube.h"
+#include "../include/cubeField.h"
+#include "../include/cubeRenderer.h"
+#include "../include/frameStats.h"
+#include "../include/frustum.h"
+#include "../include/hardwareCounters.h"
+#include "../include/jobSystem.h"
+#include "../include/occlusionBuffer.h"
+#include "../include/profiler.h"
+#include "../include/randomStream.h"
+#include "../include/recordingRenderDevice.h"
+#include "../include/renderQueue.h"
+#include "../include/ringAllocator.h"
+#include "../include/simulationConfig.h"
+#include "../include/snapshotBuffer.h"
+#include "../include/softwareCommandRecorder.h"
+#include "../include/softwareRenderDevice.h"
+#include "../include/stateCacheRenderDevice.h"
+#include "../include/taskGraph.h"
+#include "../include/VertexDefinitions.h"
+
+using namespace DirectX::SimpleMath;
+
+namespace
+{
+	// Cubes per parallel-for chunk; a multiple of CubeField::LANE_COUNT
+	const size_t GRAIN_SIZE = 1024;
+
+	// Cube-frames each size gets in scale mode, so small sizes run long enough to time
+	const double SCALE_CUBE_FRAMES = 1.0e7;
+
+	// Same ring as wWinMain, bound in 256-byte ranges as D3D11.1 requires
+	const size_t CONSTANT_RING_BYTES = 4 * 1024 * 1024;
+	const size_t CONSTANT_RANGE_ALIGNMENT = 256;
+
+	// Fewest cubes worth handing a deferred context of their own
+	const size_t RECORD_CHUNK_SIZE = 256;
+
+	// Far plane of the camera, as in wWinMain, which also scales the depth draws sort on
+	const float CAMERA_FAR_PLANE = 100.0f;
+
+	// Frames per interval of the frame statistics in stats mode, few enough that the default
+	// run closes more intervals than FrameStats keeps
+	const int STATS_INTERVAL_FRAMES = 10;
+
+	// Software render target, the 640x480 client area of wWinMain, cleared to the same colour
+	const unsigned int RASTER_WIDTH = 640;
+	const unsigned int RASTER_HEIGHT = 480;
+	const Vector4 RASTER_CLEAR_COLOR(0.0f, 0.125f, 0.3f, 1.0f);
+
+	// What a run needs besides the cubes. Every frame runs one simulation step.
+	struct RunSetup
+	{
+		SimulationConfig config;
+		size_t cubeCount;
+		int frameCount;
+		Matrix view;
+		Matrix projection;
+	};
+
+	struct RunResult
+	{
+		double updateNs = 0.0;
+		double packNs = 0.0;
+		double frameNs = 0.0;
+
+		// Bytes held per cube by the per-cube arrays of the run, constants included
+		double bytesPerCube = 0.0;
+
+		unsigned long long rebuilds = 0;
+		float checksum = 0.0f;
+	};
+
+	double elapsedNs(const std::chrono::high_resolution_clock::time_point& start)
+	{
+		const auto end = std::chrono::high_resolution_clock::now();
+		return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+	}
+
+	// Same per-cube constant packing as the draw loop in wWinMain
+	// View and projection live in FrameConstants, packed once per run, so only the world
+	// matrix is packed per cube
+	void packConstants(const Matrix& world, ObjectConstants& constants)
+	{
+		constants.mWorld = world.Transpose();
+	}
+
+	// Error in units of the float spacing at max(|reference|, 1). Rotation terms are bounded by
+	// one, so this keeps cancellation near zero from reading as a huge relative error.
+	float ulpError(const Matrix& reference, const Matrix& m)
+	{
+		float worst = 0.0f;
+		for (int row = 0; row < 4; ++row)
+		{
+			for (int column = 0; column < 4; ++column)
+			{
+				const float scale = std::max(std::fabs(reference.m[row][column]), 1.0f) * FLT_EPSILON;
+				worst = std::max(worst, std::fabs(reference.m[row][column] - m.m[row][column]) / scale);
+			}
+		}
+		return worst;
+	}
+
+	int verifyEulerTranslation(int samples, uint64_t seed, float stepSeconds)
+	{
+		const float maxUlps = 4.0f;
+		RandomStream random(seed, RandomStream::SPAWN_STREAM);
+		const auto randomRange = [&random](float min, float max)
+		{
+			return random.nextFloat(min, max);
+		};
+
+		std::vector<Vector3> rotations(samples);
+		std::vector<Vector3> positions(samples);
+		std::vector<Matrix> batch(samples);
+		for (int i = 0; i < samples; ++i)
+		{
+			rotations[i] = Vector3(randomRange(-12.6f, 12.6f), randomRange(-12.6f, 12.6f), randomRange(-12.6f, 12.6f));
+			positions[i] = Vector3(randomRange(-100.0f, 100.0f), randomRange(-100.0f, 100.0f), randomRange(-100.0f, 100.0f));
+		}
+		Matrix::CreateFromEulerTranslation(rotations.data(), positions.data(), samples, batch.data());
+
+		float worstFused = 0.0f;
+		float worstCube = 0.0f;
+		int batchMismatches = 0;
+		for (int i = 0; i < samples; ++i)
+		{
+			const Vector3& r = rotations[i];
+			const Vector3& p = positions[i];
+			const Matrix rotation = Matrix::CreateRotationX(r.x) * Matrix::CreateRotationY(r.y) * Matrix::CreateRotationZ(r.z);
+
+			const Matrix fused = Matrix::CreateFromEulerTranslation(r, p);
+			worstFused = std::max(worstFused, ulpError(rotation * Matrix::CreateTranslation(p), fused));
+			batchMismatches += memcmp(&fused, &batch[i], sizeof(Matrix)) != 0 ? 1 : 0;
+
+			const Cube cube(p, r, RandomStream(seed, i));
+			worstCube = std::max(worstCube, ulpError(rotation * Matrix::CreateWorld(p, Vector3(0.0f, 0.0f, 1.0f), Vector3(0.0f, 1.0f, 0.0f)), cube.getWorldMatrix()));
+		}
+
+		// Step every sample once and blend back part of the way. Alpha 0 must give the starting
+		// transform, and CubeField must agree with Cube up to its vector sin/cos.
+		const float maxFieldUlps = 64.0f;
+		const float alpha = random.nextFloat();
+		std::vector<Cube> cubes;
+		cubes.reserve(samples);
+		CubeField field(samples, seed);
+		for (int i = 0; i < samples; ++i)
+		{
+			cubes.push_back(Cube(positions[i], rotations[i], RandomStream(seed, i)));
+			cubes.back().update(stepSeconds);
+			field.add(positions[i], rotations[i]);
+		}
+		field.update(stepSeconds);
+
+		std::vector<Matrix> blended(samples);
+		field.interpolateWorldMatrices(0, samples, alpha, blended.data());
+
+		float worstPrevious = 0.0f;
+		float worstField = 0.0f;
+		for (int i = 0; i < samples; ++i)
+		{
+			const Cube start(positions[i], rotations[i], RandomStream(seed, i));
+			worstPrevious = std::max(worstPrevious, ulpError(start.getWorldMatrix(), cubes[i].getInterpolatedWorldMatrix(0.0f)));
+			worstField = std::max(worstField, ulpError(cubes[i].getInterpolatedWorldMatrix(alpha), blended[i]));
+		}
+
+		printf("samples: %d\n", samples);
+		printf("CreateFromEulerTranslation: max %.2f ulp\n", worstFused);
+		printf("Cube world matrix: max %.2f ulp\n", worstCube);
+		printf("batch/single mismatches: %d\n", batchMismatches);
+		printf("interpolated at alpha 0: max %.2f ulp\n", worstPrevious);
+		printf("CubeField interpolated at alpha %.3f: max %.2f ulp (tolerance %.0f ulp)\n", alpha, worstField, maxFieldUlps);
+
+		const bool passed = worstFused <= maxUlps && worstCube <= maxUlps && batchMismatches == 0 &&
+			worstPrevious <= maxUlps && worstField <= maxFieldUlps;
+		printf("%s (tolerance %.0f ulp)\n", passed ? "PASSED" : "FAILED", maxUlps);
+		return passed ? 0 : 1;
+	}
+
+	// Folds the packed world matrices into a checksum so the frame loop cannot be optimised away
+	float checksumConstants(const std::vector<ObjectConstants>& constants)
+	{
+		float checksum = 0.0f;
+		for (const ObjectConstants& cb : constants)
+		{
+			checksum += cb.mWorld._14 + cb.mWorld._24 + cb.mWorld._34;
+		}
+		return checksum;
+	}
+
+	std::vector<Cube> spawnCubes(const RunSetup& setup)
+	{
+		std::vector<Vector3> positions;
+		generateSpawnPositions(setup.config, setup.cubeCount, positions);
+
+		std::vector<Cube> cubes;
+		cubes.reserve(setup.cubeCount);
+		for (size_t i = 0; i < setup.cubeCount; ++i)
+		{
+			cubes.push_back(Cube(positions[i], Vector3(0, 0, 0), RandomStream(setup.config.seed, static_cast<uint32_t>(i))));
+		}
+		return cubes;
+	}
+
+	RunResult runField(const RunSetup& setup, JobSystem& jobs)
+	{
+		const float stepSeconds = static_cast<float>(1.0 / setup.config.stepRate);
+		std::vector<ObjectConstants> constants(setup.cubeCount);
+
+		std::vector<Vector3> positions;
+		generateSpawnPositions(setup.config, setup.cubeCount, positions);
+		CubeField field(setup.cubeCount, setup.config.seed);
+		for (size_t i = 0; i < setup.cubeCount; ++i)
+		{
+			field.add(positions[i], Vector3(0, 0, 0));
+		}
+
+		RunResult result;
+		for (int frame = 0; frame < setup.frameCount; ++frame)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			jobs.parallelFor(field.size(), GRAIN_SIZE, [&field, stepSeconds](size_t begin, size_t end)
+			{
+				field.update(begin, end, stepSeconds);
+			});
+			result.updateNs += elapsedNs(start);
+
+			start = std::chrono::high_resolution_clock::now();
+			jobs.parallelFor(field.size(), GRAIN_SIZE, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; ++i)
+				{
+					packConstants(field.getWorldMatrix(i), constants[i]);
+				}
+			});
+			result.packNs += elapsedNs(start);
+		}
+		result.frameNs = result.updateNs + result.packNs;
+
+		result.bytesPerCube = static_cast<double>(field.getMemoryBytes()) / setup.cubeCount + sizeof(ObjectConstants);
+		result.checksum = checksumConstants(constants);
+		return result;
+	}
+
+	RunResult runOverlap(const RunSetup& setup, JobSystem& jobs)
+	{
+		const float stepSeconds = static_cast<float>(1.0 / setup.config.stepRate);
+		std::vector<ObjectConstants> constants(setup.cubeCount);
+		std::vector<Cube> cubes = spawnCubes(setup);
+
+		SnapshotBuffer<CubeSnapshot> snapshots;
+		for (int copy = 0; copy < 2; ++copy)
+		{
+			CubeSnapshot& snapshot = snapshots.getWriteBuffer();
+			snapshot.transforms.resize(cubes.size());
+			for (size_t i = 0; i < cubes.size(); ++i)
+			{
+				snapshot.transforms[i] = cubes[i].getTransform();
+			}
+			snapshots.publish();
+		}
+
+		const auto packSnapshot = [&](size_t begin, size_t end)
+		{
+			const CubeSnapshot& snapshot = snapshots.getReadBuffer();
+			for (size_t i = begin; i < end; ++i)
+			{
+				packConstants(Cube::interpolateWorldMatrix(snapshot.transforms[i], snapshot.alpha), constants[i]);
+			}
+		};
+
+		// Same shape as the frame graph in wWinMain: no edge between simulate and pack
+		TaskGraph frameGraph;
+		frameGraph.addParallelTask("simulate", [&cubes]() { return cubes.size(); }, GRAIN_SIZE, [&](size_t begin, size_t end)
+		{
+			CubeSnapshot& snapshot = snapshots.getWriteBuffer();
+			for (size_t i = begin; i < end; ++i)
+			{
+				cubes[i].update(stepSeconds);
+				snapshot.transforms[i] = cubes[i].getTransform();
+			}
+		});
+		frameGraph.addParallelTask("pack", [&cubes]() { return cubes.size(); }, GRAIN_SIZE, packSnapshot);
+
+		RunResult result;
+		for (int frame = 0; frame < setup.frameCount; ++frame)
+		{
+			const auto start = std::chrono::high_resolution_clock::now();
+			frameGraph.run(jobs);
+			snapshots.publish();
+			result.frameNs += elapsedNs(start);
+		}
+
+		// Packing trails the simulation by a frame, so catch up on the last snapshot to make
+		// the checksum comparable with the other modes
+		packSnapshot(0, cubes.size());
+
+		result.bytesPerCube = static_cast<double>(sizeof(Cube) + 2 * sizeof(CubeTransform) + sizeof(ObjectConstants));
+		result.checksum = checksumConstants(constants);
+		return result;
+	}
+
+	RunResult runCubes(const RunSetup& setup, JobSystem& jobs)
+	{
+		const float stepSeconds = static_cast<float>(1.0 / setup.config.stepRate);
+		std::vector<ObjectConstants> constants(setup.cubeCount);
+		std::vector<Cube> cubes = spawnCubes(setup);
+
+		RunResult result;
+		for (int frame = 0; frame < setup.frameCount; ++frame)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			jobs.parallelFor(cubes.size(), GRAIN_SIZE, [&cubes, stepSeconds](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; ++i)
+				{
+					cubes[i].update(stepSeconds);
+				}
+			});
+			result.updateNs += elapsedNs(start);
+
+			// Packing is where the lazily rebuilt world matrices are read back
+			start = std::chrono::high_resolution_clock::now();
+			jobs.parallelFor(cubes.size(), GRAIN_SIZE, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; ++i)
+				{
+					packConstants(cubes[i].getWorldMatrix(), constants[i]);
+				}
+			});
+			result.packNs += elapsedNs(start);
+		}
+		result.frameNs = result.updateNs + result.packNs;
+
+		for (const Cube& cube : cubes)
+		{
+			result.rebuilds += cube.getWorldRebuildCount();
+		}
+		result.bytesPerCube = static_cast<double>(sizeof(Cube) + sizeof(ObjectConstants));
+		result.checksum = checksumConstants(constants);
+		return result;
+	}
+
+	void printSubmission(const char* name, const RecordingRenderDevice& device, int frameCount, double submitNs)
+	{
+		printf("%s: %.1f calls/frame  %.0f bytes/frame  %.1f draws/frame  %.3f ms/frame to record\n", name,
+			static_cast<double>(device.getTotalCallCount()) / frameCount, static_cast<double>(device.getBytesUploaded()) / frameCount,
+			static_cast<double>(device.getDrawCallCount()) / frameCount, submitNs / frameCount / 1.0e6);
+		for (int call = 0; call < RENDER_CALL_COUNT; ++call)
+		{
+			const uint64_t count = device.getCallCount(static_cast<RenderCall>(call));
+			if (count > 0)
+			{
+				printf("  %-24s %.1f/frame\n", RecordingRenderDevice::getCallName(static_cast<RenderCall>(call)), static_cast<double>(count) / frameCount);
+			}
+		}
+	}
+
+	// Packs one frame both ways and submits each into its own recording device. The instance
+	// stream must hold, row for row, the transposed world matrices the per-object path uploads,
+	// every instanced draw must stay inside the stream, and both must draw every cube.
+	// One way of submitting a frame. A constant buffer alignment of 0 is a device without
+	// constant buffer offsets, which falls back to per-draw updates.
+	struct SubmissionPath
+	{
+		const char* name;
+		size_t constantBufferAlignment;
+		bool instanced;
+	};
+
+	// World matrices in what the device holds after the last frame that differ from the
+	// per-object constants; the plain per-object path has nothing to compare beyond the last
+	int countSubmittedMismatches(const RecordingRenderDevice& device, const SubmissionPath& path, const std::vector<ObjectConstants>& constants)
+	{
+		int mismatches = 0;
+		if (path.instanced)
+		{
+			const std::vector<uint8_t>& stream = device.getBufferContents(RENDER_BUFFER_INSTANCES);
+			if (stream.size() != constants.size() * sizeof(InstanceData))
+			{
+				return static_cast<int>(constants.size());
+			}
+			for (size_t i = 0; i < constants.size(); ++i)
+			{
+				const Matrix world = constants[i].mWorld.Transpose();
+				mismatches += memcmp(&stream[i * sizeof(InstanceData)], &world, sizeof(Matrix)) != 0 ? 1 : 0;
+			}
+		}
+		else if (device.getCallCount(RENDER_CALL_APPEND_BUFFER) > 0)
+		{
+			const std::vector<uint8_t>& contents = device.getBufferContents(RENDER_BUFFER_OBJECT_CONSTANT_RING);
+			const size_t offset = device.getLastAppendOffset(RENDER_BUFFER_OBJECT_CONSTANT_RING);
+			for (size_t i = 0; i < constants.size(); ++i)
+			{
+				mismatches += memcmp(&contents[offset + i * path.constantBufferAlignment], &constants[i], sizeof(ObjectConstants)) != 0 ? 1 : 0;
+			}
+		}
+		else
+		{
+			const std::vector<uint8_t>& contents = device.getBufferContents(RENDER_BUFFER_OBJECT_CONSTANTS);
+			mismatches += contents.size() != sizeof(ObjectConstants) || memcmp(contents.data(), &constants.back(), sizeof(ObjectConstants)) != 0 ? 1 : 0;
+		}
+		return mismatches;
+	}
+
+	// Steps freshly spawned cubes once and packs the frame both ways the renderer draws it
+	void packSubmissionFrame(const RunSetup& setup, FrameConstants& frameConstants, std::vector<ObjectConstants>& constants, std::vector<InstanceData>& instances)
+	{
+		std::vector<Cube> cubes = spawnCubes(setup);
+		const float stepSeconds = static_cast<float>(1.0 / setup.config.stepRate);
+		constants.resize(setup.cubeCount);
+		instances.resize(setup.cubeCount);
+		for (size_t i = 0; i < cubes.size(); ++i)
+		{
+			cubes[i].update(stepSeconds);
+			const Matrix world = cubes[i].getInterpolatedWorldMatrix(1.0f);
+			packConstants(world, constants[i]);
+			instances[i].mWorld = world;
+		}
+		frameConstants.mViewProjection = (setup.view * setup.projection).Transpose();
+	}
+
+	// Packs one frame and submits it along each path into a recording device, both directly and
+	// through a StateCacheRenderDevice. Every path must leave exactly the per-object world
+	// matrices where its shader reads them, bind only what the device allows and draw every
+	// cube, and the cache must not change the state any draw sees.
+	int verifySubmission(const RunSetup& setup)
+	{
+		std::vector<ObjectConstants> constants;
+		std::vector<InstanceData> instances;
+		FrameConstants frameConstants;
+		packSubmissionFrame(setup, frameConstants, constants, instances);
+
+		const SubmissionPath paths[] =
+		{
+			{ "per-object", 0, false },
+			{ "per-object ring", CONSTANT_RANGE_ALIGNMENT, false },
+			{ "instanced", 0, true },
+		};
+
+		printf("cubes: %zu  frames: %d  seed: %llu\n", setup.cubeCount, setup.frameCount, static_cast<unsigned long long>(setup.config.seed));
+		const uint64_t expectedInstances = static_cast<uint64_t>(setup.cubeCount) * setup.frameCount;
+		bool passed = true;
+		for (const SubmissionPath& path : paths)
+		{
+			RecordingRenderDevice direct(path.constantBufferAlignment);
+			RecordingRenderDevice filtered(path.constantBufferAlignment);
+			direct.attachRingBuffer(RENDER_BUFFER_OBJECT_CONSTANT_RING, CONSTANT_RING_BYTES);
+			filtered.attachRingBuffer(RENDER_BUFFER_OBJECT_CONSTANT_RING, CONSTANT_RING_BYTES);
+			StateCacheRenderDevice cache(filtered);
+
+			RenderDevice* targets[] = { &direct, &cache };
+			double submitNs[2] = { 0.0, 0.0 };
+			for (int frame = 0; frame < setup.frameCount; ++frame)
+			{
+				for (int target = 0; target < 2; ++target)
+				{
+					RenderDevice& device = *targets[target];
+					const auto start = std::chrono::high_resolution_clock::now();
+					device.beginFrame();
+					if (path.instanced)
+					{
+						submitCubesInstanced(device, frameConstants, instances.data(), instances.size());
+					}
+					else
+					{
+						submitCubes(device, frameConstants, constants.data(), constants.size());
+					}
+					device.endFrame();
+					submitNs[target] += elapsedNs(start);
+				}
+			}
+
+			const int mismatches = countSubmittedMismatches(direct, path, constants) + countSubmittedMismatches(filtered, path, constants);
+			const uint64_t invalidDraws = direct.getInvalidDrawCount() + filtered.getInvalidDrawCount();
+			const bool sameState = direct.getDrawStateChecksum() == filtered.getDrawStateChecksum();
+			const bool allDrawn = direct.getInstancesDrawn() == expectedInstances && filtered.getInstancesDrawn() == expectedInstances;
+
+			printSubmission(path.name, direct, setup.frameCount, submitNs[0]);
+			if (path.constantBufferAlignment > 0)
+			{
+				printf("  ring discards: %llu%s\n", static_cast<unsigned long long>(direct.getDiscardCount()),
+					direct.getCallCount(RENDER_CALL_APPEND_BUFFER) > 0 ? "" : " (frame larger than the ring)");
+			}
+			printf("  state cache: %.1f calls/frame issued  %.1f filtered  %.3f ms/frame to record  draw state %s\n",
+				static_cast<double>(cache.getTotalIssuedCount()) / setup.frameCount, static_cast<double>(cache.getTotalFilteredCount()) / setup.frameCount,
+				submitNs[1] / setup.frameCount / 1.0e6, sameState ? "unchanged" : "CHANGED");
+			printf("  matrices differing from per-object constants: %d  invalid draws: %llu\n", mismatches, static_cast<unsigned long long>(invalidDraws));
+
+			passed = passed && mismatches == 0 && invalidDraws == 0 && sameState && allDrawn;
+		}
+
+		printf("%s\n", passed ? "PASSED" : "FAILED");
+		return passed ? 0 : 1;
+	}
+
+	// Submits each frame one draw at a time into one recording device, and again recorded in
+	// chunks on the job system's threads into a SoftwareCommandRecorder played back into
+	// another. The playback must draw every cube with the same state and constants, in the
+	// same order, as the direct submission, with and without a constant ring. Each list starts
+	// with nothing bound, so a chunk that forgets its render target or viewport shows up as
+	// invalid draws. Then alternates direct and recorded frames through one state cache, which
+	// only draws correctly if the cache is invalidated after the lists clear the device.
+	int verifyRecording(const RunSetup& setup, JobSystem& jobs)
+	{
+		std::vector<ObjectConstants> constants;
+		std::vector<InstanceData> instances;
+		FrameConstants frameConstants;
+		packSubmissionFrame(setup, frameConstants, constants, instances);
+
+		const SubmissionPath paths[] =
+		{
+			{ "per-object", 0, false },
+			{ "per-object ring", CONSTANT_RANGE_ALIGNMENT, false },
+		};
+
+		const unsigned int contextCount = jobs.getThreadCount();
+		const unsigned int chunkCount = static_cast<unsigned int>(std::min<size_t>(contextCount, (setup.cubeCount + RECORD_CHUNK_SIZE - 1) / RECORD_CHUNK_SIZE));
+		printf("cubes: %zu  frames: %d  threads: %u  chunks: %u  seed: %llu\n", setup.cubeCount, setup.frameCount, jobs.getThreadCount(),
+			chunkCount, static_cast<unsigned long long>(setup.config.seed));
+		const uint64_t expectedInstances = static_cast<uint64_t>(setup.cubeCount) * setup.frameCount;
+		bool passed = true;
+		for (const SubmissionPath& path : paths)
+		{
+			RecordingRenderDevice direct(path.constantBufferAlignment);
+			RecordingRenderDevice played(path.constantBufferAlignment);
+			direct.attachRingBuffer(RENDER_BUFFER_OBJECT_CONSTANT_RING, CONSTANT_RING_BYTES);
+			played.attachRingBuffer(RENDER_BUFFER_OBJECT_CONSTANT_RING, CONSTANT_RING_BYTES);
+			SoftwareCommandRecorder recorder(played, contextCount);
+
+			double submitNs[2] = { 0.0, 0.0 };
+			for (int frame = 0; frame < setup.frameCount; ++frame)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				direct.beginFrame();
+				submitCubes(direct, frameConstants, constants.data(), constants.size());
+				direct.endFrame();
+				submitNs[0] += elapsedNs(start);
+
+				start = std::chrono::high_resolution_clock::now();
+				played.beginFrame();
+				submitCubesRecorded(played, recorder, jobs, frameConstants, constants.data(), constants.size(), RECORD_CHUNK_SIZE);
+				played.endFrame();
+				submitNs[1] += elapsedNs(start);
+			}
+
+			const uint64_t invalidDraws = direct.getInvalidDrawCount() + played.getInvalidDrawCount();
+			const bool sameDraws = direct.getDrawStateChecksum() == played.getDrawStateChecksum();
+			const bool allDrawn = direct.getInstancesDrawn() == expectedInstances && played.getInstancesDrawn() == expectedInstances;
+
+			printSubmission(path.name, direct, setup.frameCount, submitNs[0]);
+			printSubmission("  recorded", played, setup.frameCount, submitNs[1]);
+			printf("  draws, state and constants %s  invalid draws: %llu\n", sameDraws ? "unchanged" : "CHANGED", static_cast<unsigned long long>(invalidDraws));
+
+			// Without invalidate() the cache filters the binds of the next direct frame
+			uint64_t cachedInvalidDraws[2];
+			for (int invalidate = 0; invalidate < 2; ++invalidate)
+			{
+				RecordingRenderDevice cached(path.constantBufferAlignment);
+				cached.attachRingBuffer(RENDER_BUFFER_OBJECT_CONSTANT_RING, CONSTANT_RING_BYTES);
+				SoftwareCommandRecorder cachedRecorder(cached, contextCount);
+				StateCacheRenderDevice cache(cached);
+				for (int frame = 0; frame < std::max(setup.frameCount, 3); ++frame)
+				{
+					cache.beginFrame();
+					if (frame % 2 == 0)
+					{
+						submitCubes(cache, frameConstants, constants.data(), constants.size());
+					}
+					else
+					{
+						submitCubesRecorded(cache, cachedRecorder, jobs, frameConstants, constants.data(), constants.size(), RECORD_CHUNK_SIZE);
+						if (invalidate)
+						{
+							cache.invalidate();
+						}
+					}
+					cache.endFrame();
+				}
+				cachedInvalidDraws[invalidate] = cached.getInvalidDrawCount();
+			}
+			printf("  alternating through a state cache: invalid draws %llu, %llu without invalidate()\n",
+				static_cast<unsigned long long>(cachedInvalidDraws[1]), static_cast<unsigned long long>(cachedInvalidDraws[0]));
+
+			passed = passed && invalidDraws == 0 && sameDraws && allDrawn && cachedInvalidDraws[1] == 0 && cachedInvalidDraws[0] > 0;
+		}
+
+		printf("%s\n", passed ? "PASSED" : "FAILED");
+		return passed ? 0 : 1;
+	}
+
+	// Least distance from the sphere to the planes it has to be inside of; negative if culled
+	float sphereMargin(const Frustum& frustum, const Vector3& center, float radius)
+	{
+		float margin = FLT_MAX;
+		for (size_t plane = 0; plane < Frustum::PLANE_COUNT; ++plane)
+		{
+			const Plane& p = frustum.getPlane(plane);
+			margin = std::min(margin, p.x * center.x + p.y * center.y + p.z * center.z + p.w + radius);
+		}
+		return margin;
+	}
+
+	// Spheres the list disagrees about with the one-at-a-time test, leaving out those within
+	// tolerance of a plane, where the order of the arithmetic can decide either way
+	int countCullMismatches(const Frustum& frustum, const std::vector<Vector3>& centers, const std::vector<int>& visible, size_t visibleCount, float tolerance)
+	{
+		std::vector<char> listed(centers.size(), 0);
+		for (size_t i = 0; i < visibleCount; ++i)
+		{
+			listed[visible[i]] = 1;
+		}
+
+		int mismatches = 0;
+		for (size_t i = 0; i < centers.size(); ++i)
+		{
+			const float margin = sphereMargin(frustum, centers[i], CUBE_BOUNDING_RADIUS);
+			if (std::fabs(margin) > tolerance && (margin >= 0.0f) != (listed[i] != 0))
+			{
+				++mismatches;
+			}
+		}
+		return mismatches;
+	}
+
+	// Checks the frustum planes against the clip-space test over random points, then runs the
+	// simulation and culls every frame both from an array of cube positions and from
+	// CubeField's position streams, four spheres at a time, checking both against the test one
+	// sphere at a time and reporting how many cubes each frame keeps.
+	int verifyCulling(const RunSetup& setup)
+	{
+		const float tolerance = 1.0e-3f;
+		const Matrix viewProjection = setup.view * setup.projection;
+		const Frustum frustum(viewProjection);
+
+		RandomStream random(setup.config.seed, RandomStream::SPAWN_STREAM);
+		const int pointCount = 100000;
+		int planeMismatches = 0;
+		for (int i = 0; i < pointCount; ++i)
+		{
+			const Vector3 point(random.nextFloat(-30.0f, 30.0f), random.nextFloat(-30.0f, 30.0f), random.nextFloat(-30.0f, 120.0f));
+			const Vector4 clip = Vector4::Transform(Vector4(point.x, point.y, point.z, 1.0f), viewProjection);
+			if (clip.w <= 0.0f)
+			{
+				planeMismatches += sphereMargin(frustum, point, 0.0f) > tolerance ? 1 : 0;
+				continue;
+			}
+
+			// Depth near the far plane loses most of its precision in clip space, so points are
+			// only compared where both tests are clear of the boundary
+			const float clipMargin = std::min(std::min(clip.w - std::fabs(clip.x), clip.w - std::fabs(clip.y)), std::min(clip.z, clip.w - clip.z)) / clip.w;
+			const float margin = sphereMargin(frustum, point, 0.0f);
+			if (std::fabs(margin) > tolerance && std::fabs(clipMargin) > tolerance && (margin >= 0.0f) != (clipMargin >= 0.0f))
+			{
+				++planeMismatches;
+			}
+		}
+
+		std::vector<Vector3> positions;
+		generateSpawnPositions(setup.config, setup.cubeCount, positions);
+		std::vector<Cube> cubes;
+		cubes.reserve(setup.cubeCount);
+		CubeField field(setup.cubeCount, setup.config.seed);
+		for (size_t i = 0; i < setup.cubeCount; ++i)
+		{
+			cubes.push_back(Cube(positions[i], Vector3(0, 0, 0), RandomStream(setup.config.seed, static_cast<uint32_t>(i))));
+			field.add(positions[i], Vector3(0, 0, 0));
+		}
+
+		const float stepSeconds = static_cast<float>(1.0 / setup.config.stepRate);
+		std::vector<Vector3> centers(setup.cubeCount);
+		std::vector<Vector3> fieldCenters(setup.cubeCount);
+		std::vector<int> scalarVisible(setup.cubeCount);
+		std::vector<int> visible(setup.cubeCount);
+		std::vector<int> fieldVisible(setup.cubeCount);
+		double cullNs[3] = { 0.0, 0.0, 0.0 };
+		unsigned long long visibleTotal = 0;
+		int mismatches = 0;
+		for (int frame = 0; frame < setup.frameCount; ++frame)
+		{
+			for (size_t i = 0; i < cubes.size(); ++i)
+			{
+				cubes[i].update(stepSeconds);
+				centers[i] = cubes[i].getPosition();
+			}
+			field.update(stepSeconds);
+
+			auto start = std::chrono::high_resolution_clock::now();
+			size_t scalarCount = 0;
+			for (size_t i = 0; i < centers.size(); ++i)
+			{
+				if (frustum.intersectsSphere(centers[i], CUBE_BOUNDING_RADIUS))
+				{
+					scalarVisible[scalarCount++] = static_cast<int>(i);
+				}
+			}
+			cullNs[0] += elapsedNs(start);
+
+			start = std::chrono::high_resolution_clock::now();
+			const size_t visibleCount = frustum.cullSpheres(centers.data(), centers.size(), CUBE_BOUNDING_RADIUS, 0, visible.data());
+			cullNs[1] += elapsedNs(start);
+
+			start = std::chrono::high_resolution_clock::now();
+			const size_t fieldCount = frustum.cullSpheres(field.getPositionsX(), field.getPositionsY(), field.getPositionsZ(), field.size(),
+				CUBE_BOUNDING_RADIUS, 0, fieldVisible.data());
+			cullNs[2] += elapsedNs(start);
+
+			for (size_t i = 0; i < field.size(); ++i)
+			{
+				fieldCenters[i] = field.getPosition(i);
+			}
+			mismatches += countCullMismatches(frustum, centers, scalarVisible, scalarCount, tolerance);
+			mismatches += countCullMismatches(frustum, centers, visible, visibleCount, tolerance);
+			mismatches += countCullMismatches(frustum, fieldCenters, fieldVisible, fieldCount, tolerance);
+			visibleTotal += visibleCount;
+		}
+
+		const double cubeFrames = static_cast<double>(setup.cubeCount) * setup.frameCount;
+		const double visiblePerFrame = static_cast<double>(visibleTotal) / setup.frameCount;
+		printf("cubes: %zu  frames: %d  seed: %llu\n", setup.cubeCount, setup.frameCount, static_cast<unsigned long long>(setup.config.seed));
+		printf("points misplaced by the planes: %d of %d\n", planeMismatches, pointCount);
+		printf("visible: %.1f/frame  culled: %.1f/frame\n", visiblePerFrame, setup.cubeCount - visiblePerFrame);
+		printf("one at a time: %.2f ns/cube\n", cullNs[0] / cubeFrames);
+		printf("4 lanes, array of positions: %.2f ns/cube\n", cullNs[1] / cubeFrames);
+		printf("4 lanes, CubeField streams: %.2f ns/cube\n", cullNs[2] / cubeFrames);
+		printf("spheres culled differently from the one-at-a-time test: %d\n", mismatches);
+
+		const bool passed = planeMismatches == 0 && mismatches == 0;
+		printf("%s\n", passed ? "PASSED" : "FAILED");
+		return passed ? 0 : 1;
+	}
+
+	// Nearest sphere the ray hits, testing every one
+	bool raycastSpheres(const Ray& ray, const std::vector<Vector3>& centers, int& object, float& distance)
+	{
+		bool hit = false;
+		for (size_t i = 0; i < centers.size(); ++i)
+		{
+			DirectX::BoundingSphere sphere;
+			sphere.Center = centers[i];
+			sphere.Radius = CUBE_BOUNDING_RADIUS;
+			float sphereDistance = 0.0f;
+			if (ray.Intersects(sphere, sphereDistance) && (!hit || sphereDistance < distance))
+			{
+				object = static_cast<int>(i);
+				distance = sphereDistance;
+				hit = true;
+			}
+		}
+		return hit;
+	}
+
+	// Whether the ray only just touches or misses the sphere, where Ray::Intersects loses
+	// precision with distance and can decide either way
+	bool rayGrazes(const Ray& ray, const Vector3& center, float tolerance)
+	{
+		const Vector3 toCenter = center - ray.position;
+		const float missDistance = toCenter.Cross(ray.direction).Length();
+		return std::fabs(missDistance - CUBE_BOUNDING_RADIUS) < tolerance * std::max(toCenter.Length(), 1.0f);
+	}
+
+	// Runs the simulation with a BoundingVolumeHierarchy over the cubes' bounding spheres,
+	// updating it every frame, and checks its frustum, ray and box queries against testing every
+	// sphere. Reports build and refit times, how often it rebuilt, and how many nodes the
+	// queries opened against the spheres a flat scan tests.
+	int verifyBoundingVolumeHierarchy(const RunSetup& setup, JobSystem& jobs)
+	{
+		const float tolerance = 1.0e-3f;
+		const int queriesPerFrame = 64;
+		const Frustum frustum(setup.view * setup.projection);
+
+		std::vector<Vector3> positions;
+		generateSpawnPositions(setup.config, setup.cubeCount, positions);
+		std::vector<Cube> cubes;
+		cubes.reserve(setup.cubeCount);
+		for (size_t i = 0; i < setup.cubeCount; ++i)
+		{
+			cubes.push_back(Cube(positions[i], Vector3(0, 0, 0), RandomStream(setup.config.seed, static_cast<uint32_t>(i))));
+		}
+		std::vector<Vector3> centers(positions);
+		std::vector<Vector3> offsets(setup.cubeCount, Vector3(0, 0, 0));
+
+		BoundingVolumeHierarchy bvh;
+		auto start = std::chrono::high_resolution_clock::now();
+		bvh.build(centers.data(), centers.size(), CUBE_BOUNDING_RADIUS, jobs);
+		const double buildNs = elapsedNs(start);
+
+		RandomStream random(setup.config.seed, RandomStream::SPAWN_STREAM);
+		const float stepSeconds = static_cast<float>(1.0 / setup.config.stepRate);
+		std::vector<int> visible(setup.cubeCount);
+		std::vector<int> bvhVisible;
+		std::vector<int> boxObjects;
+		std::vector<int> bvhBoxObjects;
+		double updateNs = 0.0;
+		double cullNs[2] = { 0.0, 0.0 };
+		double rayNs[2] = { 0.0, 0.0 };
+		double boxNs[2] = { 0.0, 0.0 };
+		unsigned long long cullNodes = 0;
+		unsigned long long rayNodes = 0;
+		unsigned long long boxNodes = 0;
+		unsigned long long visibleTotal = 0;
+		unsigned long long rayHits = 0;
+		unsigned long long rebuilds = 0;
+		double costRatioTotal = 0.0;
+		int cullMismatches = 0;
+		int rayMismatches = 0;
+		int boxMismatches = 0;
+		for (int frame = 0; frame < setup.frameCount; ++frame)
+		{
+			// Cubes only bounce around their spawn points, so some jump to another cube's spot
+			// each frame to loosen the tree the way a longer drift would
+			for (size_t jump = 0; jump < setup.cubeCount / 1000; ++jump)
+			{
+				const uint32_t from = random.nextBelow(static_cast<uint32_t>(setup.cubeCount));
+				const uint32_t to = random.nextBelow(static_cast<uint32_t>(setup.cubeCount));
+				offsets[from] = centers[to] - cubes[from].getPosition();
+			}
+			for (size_t i = 0; i < cubes.size(); ++i)
+			{
+				cubes[i].update(stepSeconds);
+				centers[i] = cubes[i].getPosition() + offsets[i];
+			}
+
+			start = std::chrono::high_resolution_clock::now();
+			rebuilds += bvh.update(centers.data(), jobs) ? 1 : 0;
+			updateNs += elapsedNs(start);
+			costRatioTotal += bvh.getBuildCost() > 0.0f ? bvh.getCost() / bvh.getBuildCost() : 1.0;
+
+			start = std::chrono::high_resolution_clock::now();
+			const size_t visibleCount = frustum.cullSpheres(centers.data(), centers.size(), CUBE_BOUNDING_RADIUS, 0, visible.data());
+			cullNs[0] += elapsedNs(start);
+			visibleTotal += visibleCount;
+
+			bvhVisible.clear();
+			start = std::chrono::high_resolution_clock::now();
+			bvh.queryFrustum(frustum, bvhVisible);
+			cullNs[1] += elapsedNs(start);
+			cullNodes += bvh.getLastQueryNodeCount();
+
+			// Listing a cube twice would pass the set comparison, so the counts must agree too
+			cullMismatches += countCullMismatches(frustum, centers, bvhVisible, bvhVisible.size(), tolerance);
+			std::sort(bvhVisible.begin(), bvhVisible.end());
+			cullMismatches += std::unique(bvhVisible.begin(), bvhVisible.end()) != bvhVisible.end() ? 1 : 0;
+
+			// Queries are drawn from around where the cubes are now
+			Vector3 boundsMin(FLT_MAX, FLT_MAX, FLT_MAX);
+			Vector3 boundsMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			for (const Vector3& center : centers)
+			{
+				boundsMin = Vector3::Min(boundsMin, center);
+				boundsMax = Vector3::Max(boundsMax, center);
+			}
+			boundsMin -= Vector3(5.0f, 5.0f, 5.0f);
+			boundsMax += Vector3(5.0f, 5.0f, 5.0f);
+
+			for (int query = 0; query < queriesPerFrame; ++query)
+			{
+				// Aim most rays at a cube so they hit something, and the rest anywhere
+				const Vector3 origin(random.nextFloat(boundsMin.x, boundsMax.x), random.nextFloat(boundsMin.y, boundsMax.y), random.nextFloat(boundsMin.z, boundsMax.z));
+				Vector3 direction(random.nextFloat(-1.0f, 1.0f), random.nextFloat(-1.0f, 1.0f), random.nextFloat(-1.0f, 1.0f));
+				if (!centers.empty() && random.nextBelow(4) != 0)
+				{
+					direction = centers[random.nextBelow(static_cast<uint32_t>(centers.size()))] - origin + direction;
+				}
+				if (direction.LengthSquared() < 1.0e-6f)
+				{
+					direction = Vector3(0.0f, 0.0f, 1.0f);
+				}
+				direction.Normalize();
+				const Ray ray(origin, direction);
+
+				int object = -1;
+				float distance = 0.0f;
+				start = std::chrono::high_resolution_clock::now();
+				const bool hit = raycastSpheres(ray, centers, object, distance);
+				rayNs[0] += elapsedNs(start);
+
+				int bvhObject = -1;
+				float bvhDistance = 0.0f;
+				start = std::chrono::high_resolution_clock::now();
+				const bool bvhHit = bvh.raycast(ray, bvhObject, bvhDistance);
+				rayNs[1] += elapsedNs(start);
+				rayNodes += bvh.getLastQueryNodeCount();
+
+				// Spheres hit at the same distance may come back in either order
+				const bool grazed = (hit && rayGrazes(ray, centers[object], tolerance)) || (bvhHit && rayGrazes(ray, centers[bvhObject], tolerance));
+				const bool sameHit = hit == bvhHit && (!hit || object == bvhObject || std::fabs(distance - bvhDistance) <= tolerance * std::max(distance, 1.0f));
+				rayMismatches += sameHit || grazed ? 0 : 1;
+				rayHits += hit ? 1 : 0;
+
+				const Vector3 boxCenter(random.nextFloat(boundsMin.x, boundsMax.x), random.nextFloat(boundsMin.y, boundsMax.y), random.nextFloat(boundsMin.z, boundsMax.z));
+				const Vector3 boxExtents(random.nextFloat(0.5f, 8.0f), random.nextFloat(0.5f, 8.0f), random.nextFloat(0.5f, 8.0f));
+				const Vector3 boxMin = boxCenter - boxExtents;
+				const Vector3 boxMax = boxCenter + boxExtents;
+
+				boxObjects.clear();
+				start = std::chrono::high_resolution_clock::now();
+				for (size_t i = 0; i < centers.size(); ++i)
+				{
+					const Vector3 sphereMin = centers[i] - Vector3(CUBE_BOUNDING_RADIUS);
+					const Vector3 sphereMax = centers[i] + Vector3(CUBE_BOUNDING_RADIUS);
+					if (sphereMin.x <= boxMax.x && sphereMax.x >= boxMin.x && sphereMin.y <= boxMax.y && sphereMax.y >= boxMin.y &&
+						sphereMin.z <= boxMax.z && sphereMax.z >= boxMin.z)
+					{
+						boxObjects.push_back(static_cast<int>(i));
+					}
+				}
+				boxNs[0] += elapsedNs(start);
+
+				bvhBoxObjects.clear();
+				start = std::chrono::high_resolution_clock::now();
+				bvh.queryBox(boxMin, boxMax, bvhBoxObjects);
+				boxNs[1] += elapsedNs(start);
+				boxNodes += bvh.getLastQueryNodeCount();
+
+				// Both use the same arithmetic, so the sets have to match exactly
+				std::sort(bvhBoxObjects.begin(), bvhBoxObjects.end());
+				boxMismatches += bvhBoxObjects != boxObjects ? 1 : 0;
+			}
+		}
+
+		const double frames = setup.frameCount;
+		const double queries = frames * queriesPerFrame;
+		printf("cubes: %zu  frames: %d  threads: %u  seed: %llu\n", setup.cubeCount, setup.frameCount, jobs.getThreadCount(),
+			static_cast<unsigned long long>(setup.config.seed));
+		printf("nodes: %zu  build: %.3f ms\n", bvh.getNodeCount(), buildNs / 1.0e6);
+		printf("update: %.3f ms/frame  rebuilds: %llu  cost against the last build: %.2fx on average\n", updateNs / frames / 1.0e6, rebuilds,
+			costRatioTotal / frames);
+		printf("frustum, flat: %.3f ms/frame  tree: %.3f ms/frame  %.1f nodes/frame  visible: %.1f/frame\n", cullNs[0] / frames / 1.0e6,
+			cullNs[1] / frames / 1.0e6, cullNodes / frames, visibleTotal / frames);
+		printf("ray, flat: %.2f us/ray  tree: %.2f us/ray  %.1f nodes/ray  hits: %llu of %.0f\n", rayNs[0] / queries / 1.0e3, rayNs[1] / queries / 1.0e3,
+			rayNodes / queries, rayHits, queries);
+		printf("box, flat: %.2f us/box  tree: %.2f us/box  %.1f nodes/box\n", boxNs[0] / queries / 1.0e3, boxNs[1] / queries / 1.0e3, boxNodes / queries);
+		printf("mismatches, frustum: %d  ray: %d  box: %d\n", cullMismatches, rayMismatches, boxMismatches);
+
+		const bool passed = cullMismatches == 0 && rayMismatches == 0 && boxMismatches == 0;
+		printf("%s\n", passed ? "PASSED" : "FAILED");
+		return passed ? 0 : 1;
+	}
+
+	// Runs the simulation and each frame culls the cubes to the frustum, draws the nearest
+	// --occluders of those left into an OcclusionBuffer and culls the ones it hides. The
+	// buffer drawn four pixels at a time in bands must match the one drawn a pixel at a time.
+	// Every cube in the frustum and then only those left are drawn into SoftwareRenderDevices
+	// at full size, and no pixel may come out nearer with the culled cubes drawn too.
+	int verifyOcclusion(const RunSetup& setup, JobSystem& jobs)
+	{
+		const float depthTolerance = 1.0e-6f;
+		const Matrix viewProjection = setup.view * setup.projection;
+		const Frustum frustum(viewProjection);
+		const size_t occluderCount = setup.config.occluderCount > 0 ? setup.config.occluderCount : 256;
+
+		std::vector<Vector3> positions;
+		generateSpawnPositions(setup.config, setup.cubeCount, positions);
+		std::vector<Cube> cubes;
+		cubes.reserve(setup.cubeCount);
+		for (size_t i = 0; i < setup.cubeCount; ++i)
+		{
+			cubes.push_back(Cube(positions[i], Vector3(0, 0, 0), RandomStream(setup.config.seed, static_cast<uint32_t>(i))));
+		}
+
+		OcclusionBuffer buffer;
+		OcclusionBuffer reference;
+		SoftwareRenderDevice everything(RASTER_WIDTH, RASTER_HEIGHT, jobs);
+		SoftwareRenderDevice unculled(RASTER_WIDTH, RASTER_HEIGHT, jobs);
+		for (SoftwareRenderDevice* pDevice : { &everything, &unculled })
+		{
+			pDevice->updateBuffer(RENDER_BUFFER_CUBE_VERTICES, CUBE_VERTICES, sizeof(CUBE_VERTICES));
+			pDevice->updateBuffer(RENDER_BUFFER_CUBE_INDICES, CUBE_INDICES, sizeof(CUBE_INDICES));
+		}
+		FrameConstants frameConstants;
+		frameConstants.mViewProjection = viewProjection.Transpose();
+		const float stepSeconds = static_cast<float>(1.0 / setup.config.stepRate);
+		std::vector<Vector3> centers(setup.cubeCount);
+		std::vector<int> visible(setup.cubeCount);
+		std::vector<int> unoccluded;
+		std::vector<int> occluders;
+		std::vector<Matrix> occluderWorlds;
+		std::vector<InstanceData> instances;
+		double occlusionNs[3] = { 0.0, 0.0, 0.0 };
+		double referenceNs = 0.0;
+		unsigned long long visibleTotal = 0;
+		unsigned long long unoccludedTotal = 0;
+		unsigned long long triangleTotal = 0;
+		unsigned long long skippedTotal = 0;
+		unsigned long long depthMismatches = 0;
+		unsigned long long revealedPixels = 0;
+		for (int frame = 0; frame < setup.frameCount; ++frame)
+		{
+			for (size_t i = 0; i < cubes.size(); ++i)
+			{
+				cubes[i].update(stepSeconds);
+				centers[i] = cubes[i].getPosition();
+			}
+			const size_t visibleCount = frustum.cullSpheres(centers.data(), centers.size(), CUBE_BOUNDING_RADIUS, 0, visible.data());
+
+			auto start = std::chrono::high_resolution_clock::now();
+			OcclusionBuffer::selectOccluders(viewProjection, centers.data(), visible.data(), visibleCount, occluderCount, occluders);
+			occluderWorlds.resize(occluders.size());
+			for (size_t i = 0; i < occluders.size(); ++i)
+			{
+				occluderWorlds[i] = cubes[occluders[i]].getWorldMatrix();
+			}
+			occlusionNs[0] += elapsedNs(start);
+
+			start = std::chrono::high_resolution_clock::now();
+			buffer.render(viewProjection, occluderWorlds.data(), occluderWorlds.size(), jobs);
+			occlusionNs[1] += elapsedNs(start);
+
+			start = std::chrono::high_resolution_clock::now();
+			reference.renderReference(viewProjection, occluderWorlds.data(), occluderWorlds.size());
+			referenceNs += elapsedNs(start);
+
+			unoccluded.assign(visible.begin(), visible.begin() + visibleCount);
+			start = std::chrono::high_resolution_clock::now();
+			unoccluded.resize(buffer.cullOccluded(centers.data(), CUBE_BOUNDING_RADIUS, unoccluded.data(), unoccluded.size(), jobs));
+			occlusionNs[2] += elapsedNs(start);
+
+			for (unsigned int y = 0; y < buffer.getHeight(); ++y)
+			{
+				for (unsigned int x = 0; x < buffer.getWidth(); ++x)
+				{
+					depthMismatches += std::fabs(buffer.getDepth(x, y) - reference.getDepth(x, y)) > depthTolerance ? 1 : 0;
+				}
+			}
+
+			// Nothing culled may win a pixel, occluders hidden behind nearer ones included
+			instances.resize(visibleCount);
+			for (size_t i = 0; i < visibleCount; ++i)
+			{
+				instances[i].mWorld = cubes[visible[i]].getWorldMatrix();
+			}
+			everything.beginFrame();
+			submitCubesInstanced(everything, frameConstants, instances.data(), instances.size());
+			everything.endFrame();
+
+			instances.resize(unoccluded.size());
+			for (size_t i = 0; i < unoccluded.size(); ++i)
+			{
+				instances[i].mWorld = cubes[unoccluded[i]].getWorldMatrix();
+			}
+			unculled.beginFrame();
+			submitCubesInstanced(unculled, frameConstants, instances.data(), instances.size());
+			unculled.endFrame();
+
+			for (unsigned int y = 0; y < everything.getHeight(); ++y)
+			{
+				for (unsigned int x = 0; x < everything.getWidth(); ++x)
+				{
+					revealedPixels += everything.getDepth(x, y) < unculled.getDepth(x, y) ? 1 : 0;
+				}
+			}
+
+			visibleTotal += visibleCount;
+			unoccludedTotal += unoccluded.size();
+			triangleTotal += buffer.getTriangleCount();
+			skippedTotal += buffer.getSkippedCount();
+		}
+
+		const double frames = setup.frameCount;
+		printf("cubes: %zu  frames: %d  threads: %u  occluders: %zu  buffer: %ux%u  seed: %llu\n", setup.cubeCount, setup.frameCount, jobs.getThreadCount(),
+			occluderCount, buffer.getWidth(), buffer.getHeight(), static_cast<unsigned long long>(setup.config.seed));
+		printf("in the frustum: %.1f/frame  after occlusion: %.1f/frame  triangles drawn: %.1f/frame  occluders left out: %.1f/frame\n",
+			visibleTotal / frames, unoccludedTotal / frames, triangleTotal / frames, skippedTotal / frames);
+		printf("select: %.3f ms/frame  draw: %.3f ms/frame  one pixel at a time: %.3f ms/frame  test: %.2f ns/cube\n", occlusionNs[0] / frames / 1.0e6,
+			occlusionNs[1] / frames / 1.0e6, referenceNs / frames / 1.0e6, visibleTotal > 0 ? occlusionNs[2] / visibleTotal : 0.0);
+		printf("pixels differing from one pixel at a time: %llu  pixels culled cubes would win at %ux%u: %llu\n", depthMismatches,
+			everything.getWidth(), everything.getHeight(), revealedPixels);
+
+		const bool passed = depthMismatches == 0 && revealedPixels == 0;
+		printf("%s\n", passed ? "PASSED" : "FAILED");
+		return passed ? 0 : 1;
+	}
+
+	// Entries in queue order that differ from sorting the same keys and items with
+	// std::stable_sort, which the radix sort must match exactly
+	int countQueueMismatches(const RenderQueue& queue, std::vector<std::pair<uint64_t, uint32_t>>& expected)
+	{
+		std::stable_sort(expected.begin(), expected.end(), [](const std::pair<uint64_t, uint32_t>& a, const std::pair<uint64_t, uint32_t>& b)
+		{
+			return a.first < b.first;
+		});
+
+		int mismatches = 0;
+		for (size_t i = 0; i < queue.getCount(); ++i)
+		{
+			mismatches += queue.getKey(i) != expected[i].first || queue.getItem(i) != expected[i].second ? 1 : 0;
+		}
+		return mismatches + static_cast<int>(expected.size() != queue.getCount() ? expected.size() : 0);
+	}
+
+	// Keys made at the near plane, the far plane and beyond it, in both passes, whose fields do
+	// not read back as they were given or whose depth is not at the end of its range it should be
+	int countKeyFieldErrors()
+	{
+		const uint32_t depthMax = (1u << RenderQueue::DEPTH_BITS) - 1;
+		const unsigned int shader = (1u << RenderQueue::SHADER_BITS) - 1;
+		const unsigned int material = (1u << RenderQueue::MATERIAL_BITS) - 2;
+		const float depths[] = { 0.0f, 1.0f, 2.0f };
+		const uint32_t opaqueDepths[] = { 0, depthMax, depthMax };
+
+		int errors = 0;
+		for (int pass = RenderQueue::PASS_OPAQUE; pass <= RenderQueue::PASS_TRANSPARENT; ++pass)
+		{
+			for (size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); ++i)
+			{
+				const uint64_t key = RenderQueue::makeKey(static_cast<RenderQueue::Pass>(pass), shader, material, depths[i]);
+				const uint32_t expectedDepth = pass == RenderQueue::PASS_OPAQUE ? opaqueDepths[i] : depthMax - opaqueDepths[i];
+				const uint64_t keyPass = key >> (RenderQueue::SHADER_BITS + RenderQueue::MATERIAL_BITS + RenderQueue::DEPTH_BITS);
+				const uint64_t keyShader = (key >> (RenderQueue::MATERIAL_BITS + RenderQueue::DEPTH_BITS)) & ((1u << RenderQueue::SHADER_BITS) - 1);
+				const uint64_t keyMaterial = (key >> RenderQueue::DEPTH_BITS) & ((1u << RenderQueue::MATERIAL_BITS) - 1);
+				errors += keyPass != static_cast<uint64_t>(pass) || keyShader != shader || keyMaterial != material ||
+					RenderQueue::getKeyDepth(key) != expectedDepth ? 1 : 0;
+			}
+		}
+		return errors;
+	}
+
+	// Runs the simulation and each frame culls the cubes to the frustum and sorts what is left
+	// through a RenderQueue as wWinMain does, on depth alone, and then again with each cube
+	// given a random pass, shader and material so every byte of the key is sorted on. The
+	// first is sorted as jobs and the second on this thread. Both orders must match a stable
+	// comparison sort, the cubes must come out nearest first, and keys at the near and far
+	// planes must keep every field where it belongs.
+	int verifyRenderQueue(const RunSetup& setup, JobSystem& jobs)
+	{
+		const int keyErrors = countKeyFieldErrors();
+
+		const Matrix viewProjection = setup.view * setup.projection;
+		const Frustum frustum(viewProjection);
+		std::vector<Cube> cubes = spawnCubes(setup);
+
+		const float stepSeconds = static_cast<float>(1.0 / setup.config.stepRate);
+		std::vector<Vector3> centers(setup.cubeCount);
+		std::vector<int> visible(setup.cubeCount);
+		std::vector<std::pair<uint64_t, uint32_t>> expected;
+		RenderQueue queue;
+		queue.reserve(setup.cubeCount);
+		double sortNs[2] = { 0.0, 0.0 };
+		double comparisonNs = 0.0;
+		unsigned long long visibleTotal = 0;
+		unsigned long long passTotals[2] = { 0, 0 };
+		int mismatches[2] = { 0, 0 };
+		int outOfOrder = 0;
+		for (int frame = 0; frame < setup.frameCount; ++frame)
+		{
+			for (size_t i = 0; i < cubes.size(); ++i)
+			{
+				cubes[i].update(stepSeconds);
+				centers[i] = cubes[i].getPosition();
+			}
+			const size_t visibleCount = frustum.cullSpheres(centers.data(), centers.size(), CUBE_BOUNDING_RADIUS, 0, visible.data());
+			visibleTotal += visibleCount;
+
+			queue.clear();
+			queue.pushOpaque(viewProjection, CAMERA_FAR_PLANE, RENDER_SHADER_CUBE_VS, 0, centers.data(), visible.data(), visibleCount);
+			expected.resize(visibleCount);
+			for (size_t i = 0; i < visibleCount; ++i)
+			{
+				expected[i] = std::make_pair(queue.getKey(i), queue.getItem(i));
+			}
+			auto start = std::chrono::high_resolution_clock::now();
+			queue.sort(jobs);
+			sortNs[0] += elapsedNs(start);
+			passTotals[0] += queue.getLastPassCount();
+
+			start = std::chrono::high_resolution_clock::now();
+			mismatches[0] += countQueueMismatches(queue, expected);
+			comparisonNs += elapsedNs(start);
+			for (size_t i = 1; i < queue.getCount(); ++i)
+			{
+				outOfOrder += RenderQueue::getKeyDepth(queue.getKey(i)) < RenderQueue::getKeyDepth(queue.getKey(i - 1)) ? 1 : 0;
+			}
+
+			// The same cubes under every kind of key, transparent ones included
+			RandomStream random(setup.config.seed, static_cast<uint32_t>(frame));
+			queue.clear();
+			for (size_t i = 0; i < visibleCount; ++i)
+			{
+				const RenderQueue::Pass pass = random.nextBelow(4) == 0 ? RenderQueue::PASS_TRANSPARENT : RenderQueue::PASS_OPAQUE;
+				const uint64_t key = RenderQueue::makeKey(pass, random.nextBelow(RENDER_SHADER_COUNT), random.nextBelow(1000), random.nextFloat());
+				queue.push(key, static_cast<uint32_t>(visible[i]));
+				expected[i] = std::make_pair(key, static_cast<uint32_t>(visible[i]));
+			}
+			start = std::chrono::high_resolution_clock::now();
+			queue.sort();
+			sortNs[1] += elapsedNs(start);
+			passTotals[1] += queue.getLastPassCount();
+			mismatches[1] += countQueueMismatches(queue, expected);
+		}
+
+		const double frames = setup.frameCount;
+		printf("cubes: %zu  frames: %d  threads: %u  seed: %llu  after culling: %.1f/frame\n", setup.cubeCount, setup.frameCount,
+			jobs.getThreadCount(), static_cast<unsigned long long>(setup.config.seed), visibleTotal / frames);
+		printf("depth keys: %.3f ms/frame  %.2f ns/item  %.1f digit passes  std::stable_sort: %.3f ms/frame\n", sortNs[0] / frames / 1.0e6,
+			visibleTotal > 0 ? sortNs[0] / visibleTotal : 0.0, passTotals[0] / frames, comparisonNs / frames / 1.0e6);
+		printf("mixed keys, one thread: %.3f ms/frame  %.2f ns/item  %.1f digit passes\n", sortNs[1] / frames / 1.0e6, visibleTotal > 0 ? sortNs[1] / visibleTotal : 0.0,
+			passTotals[1] / frames);
+		printf("entries differing from stable sort: %d depth, %d mixed  cubes drawn before a nearer one: %d\n", mismatches[0], mismatches[1], outOfOrder);
+		printf("keys at the near and far planes with a field out of place: %d\n", keyErrors);
+
+		const bool passed = mismatches[0] == 0 && mismatches[1] == 0 && outOfOrder == 0 && keyErrors == 0;
+		printf("%s\n", passed ? "PASSED" : "FAILED");
+		return passed ? 0 : 1;
+	}
+
+	// Pixels, colour or depth, that differ between two software render targets
+	unsigned long long countPixelMismatches(const SoftwareRenderDevice& a, const SoftwareRenderDevice& b)
+	{
+		unsigned long long mismatches = 0;
+		for (unsigned int y = 0; y < a.getHeight(); ++y)
+		{
+			for (unsigned int x = 0; x < a.getWidth(); ++x)
+			{
+				mismatches += a.getPixel(x, y) != b.getPixel(x, y) || a.getDepth(x, y) != b.getDepth(x, y) ? 1 : 0;
+			}
+		}
+		return mismatches;
+	}
+
+	// Runs the simulation and each frame draws every cube into a SoftwareRenderDevice, one draw
+	// at a time from the constant ring, timing the submission and the drawing together. The
+	// same frame is also drawn instanced into a second device and one pixel at a time, with the
+	// per-object path that uploads each world matrix, into a third. All three images must be
+	// identical, so the tiles, the SIMD lanes and both vertex shaders agree.
+	int verifyRasterizer(const RunSetup& setup, JobSystem& jobs)
+	{
+		SoftwareRenderDevice tiled(RASTER_WIDTH, RASTER_HEIGHT, jobs, CONSTANT_RANGE_ALIGNMENT);
+		SoftwareRenderDevice instanced(RASTER_WIDTH, RASTER_HEIGHT, jobs, CONSTANT_RANGE_ALIGNMENT);
+		SoftwareRenderDevice reference(RASTER_WIDTH, RASTER_HEIGHT, jobs, 0);
+		SoftwareRenderDevice* devices[] = { &tiled, &instanced, &reference };
+		for (SoftwareRenderDevice* pDevice : devices)
+		{
+			pDevice->attachRingBuffer(RENDER_BUFFER_OBJECT_CONSTANT_RING, CONSTANT_RING_BYTES);
+			pDevice->setClearColor(RASTER_CLEAR_COLOR);
+			pDevice->updateBuffer(RENDER_BUFFER_CUBE_VERTICES, CUBE_VERTICES, sizeof(CUBE_VERTICES));
+			pDevice->updateBuffer(RENDER_BUFFER_CUBE_INDICES, CUBE_INDICES, sizeof(CUBE_INDICES));
+		}
+
+		std::vector<Cube> cubes = spawnCubes(setup);
+		const float stepSeconds = static_cast<float>(1.0 / setup.config.stepRate);
+		FrameConstants frameConstants;
+		frameConstants.mViewProjection = (setup.view * setup.projection).Transpose();
+		std::vector<ObjectConstants> constants(setup.cubeCount);
+		std::vector<InstanceData> instances(setup.cubeCount);
+		double drawNs[3] = { 0.0, 0.0, 0.0 };
+		unsigned long long submittedTotal = 0;
+		unsigned long long rasterizedTotal = 0;
+		unsigned long long instancedMismatches = 0;
+		unsigned long long referenceMismatches = 0;
+		for (int frame = 0; frame < setup.frameCount; ++frame)
+		{
+			for (size_t i = 0; i < cubes.size(); ++i)
+			{
+				cubes[i].update(stepSeconds);
+				const Matrix world = cubes[i].getInterpolatedWorldMatrix(1.0f);
+				packConstants(world, constants[i]);
+				instances[i].mWorld = world;
+			}
+
+			auto start = std::chrono::high_resolution_clock::now();
+			tiled.beginFrame();
+			submitCubes(tiled, frameConstants, constants.data(), constants.size());
+			tiled.endFrame();
+			drawNs[0] += elapsedNs(start);
+
+			start = std::chrono::high_resolution_clock::now();
+			instanced.beginFrame();
+			submitCubesInstanced(instanced, frameConstants, instances.data(), instances.size());
+			instanced.endFrame();
+			drawNs[1] += elapsedNs(start);
+
+			start = std::chrono::high_resolution_clock::now();
+			reference.beginFrame();
+			submitCubes(reference, frameConstants, constants.data(), constants.size());
+			reference.endFrameReference();
+			drawNs[2] += elapsedNs(start);
+
+			submittedTotal += tiled.getSubmittedTriangleCount();
+			rasterizedTotal += tiled.getRasterizedTriangleCount();
+			instancedMismatches += countPixelMismatches(tiled, instanced);
+			referenceMismatches += countPixelMismatches(tiled, reference);
+		}
+
+		// Something has to have been drawn for the comparisons to mean anything
+		unsigned long long coveredPixels = 0;
+		for (unsigned int y = 0; y < tiled.getHeight(); ++y)
+		{
+			for (unsigned int x = 0; x < tiled.getWidth(); ++x)
+			{
+				coveredPixels += tiled.getDepth(x, y) < 1.0f ? 1 : 0;
+			}
+		}
+		uint64_t imageChecksum = 14695981039346656037ull;
+		for (uint32_t pixel : tiled.getColorBuffer())
+		{
+			imageChecksum = (imageChecksum ^ pixel) * 1099511628211ull;
+		}
+		const uint64_t invalidDraws = tiled.getInvalidDrawCount() + instanced.getInvalidDrawCount() + reference.getInvalidDrawCount();
+
+		const double frames = setup.frameCount;
+		const double seconds = drawNs[0] / 1.0e9;
+		printf("cubes: %zu  frames: %d  threads: %u  target: %ux%u  tile: %u  seed: %llu\n", setup.cubeCount, setup.frameCount, jobs.getThreadCount(),
+			tiled.getWidth(), tiled.getHeight(), SoftwareRenderDevice::TILE_SIZE, static_cast<unsigned long long>(setup.config.seed));
+		printf("triangles: %.1f/frame submitted  %.1f/frame rasterised after culling and clipping\n", submittedTotal / frames, rasterizedTotal / frames);
+		printf("tiled: %.3f ms/frame  %.1f frames/s  %.2f M triangles/s submitted  %.2f M rasterised\n", drawNs[0] / frames / 1.0e6,
+			seconds > 0.0 ? frames / seconds : 0.0, seconds > 0.0 ? submittedTotal / seconds / 1.0e6 : 0.0, seconds > 0.0 ? rasterizedTotal / seconds / 1.0e6 : 0.0);
+		printf("instanced: %.3f ms/frame  one pixel at a time: %.3f ms/frame\n", drawNs[1] / frames / 1.0e6, drawNs[2] / frames / 1.0e6);
+		printf("last frame: %llu pixels covered  image checksum %016llx\n", coveredPixels, static_cast<unsigned long long>(imageChecksum));
+		printf("pixels differing from instanced: %llu  from one pixel at a time: %llu  invalid draws: %llu\n", instancedMismatches, referenceMismatches,
+			static_cast<unsigned long long>(invalidDraws));
+
+		const bool passed = instancedMismatches == 0 && referenceMismatches == 0 && invalidDraws == 0 && (setup.cubeCount == 0 || coveredPixels > 0);
+		printf("%s\n", passed ? "PASSED" : "FAILED");
+		return passed ? 0 : 1;
+	}
+
+	// Drives a RingAllocator with random allocation sizes and a GPU that finishes each frame a
+	// random number of frames later, and checks against a byte-by-byte record of which frame
+	// last wrote where that no allocation ever overlaps a frame still in flight.
+	int verifyRingAllocator(int frameCount, uint64_t seed)
+	{
+		const size_t capacity = 64 * 1024;
+		const size_t alignments[] = { 16, 256 };
+		RandomStream random(seed, RandomStream::SPAWN_STREAM);
+		RingAllocator ring(capacity);
+		std::vector<int64_t> owners(capacity, -1);
+
+		int64_t completedFrame = -1;
+		unsigned long long allocations = 0;
+		unsigned long long full = 0;
+		unsigned long long discards = 0;
+		unsigned long long overlaps = 0;
+		unsigned long long badOffsets = 0;
+		for (int64_t frame = 0; frame < frameCount; ++frame)
+		{
+			// The GPU catches up to between zero and three frames behind
+			const int64_t latency = static_cast<int64_t>(random.nextBelow(4));
+			if (frame - latency - 1 > completedFrame)
+			{
+				completedFrame = frame - latency - 1;
+				ring.retireFrames(static_cast<uint64_t>(completedFrame));
+			}
+
+			const uint32_t requests = 1 + random.nextBelow(4);
+			for (uint32_t request = 0; request < requests; ++request)
+			{
+				const size_t bytes = 1 + random.nextBelow(static_cast<uint32_t>(capacity / 4));
+				const size_t alignment = alignments[random.nextBelow(2)];
+				size_t offset = ring.allocate(bytes, alignment);
+				if (offset == RingAllocator::INVALID_OFFSET)
+				{
+					++full;
+					if (ring.getFrameBytes() > 0)
+					{
+						continue;
+					}
+
+					// As Map(WRITE_DISCARD): fresh memory, so nothing in flight is overwritten
+					ring.reset();
+					std::fill(owners.begin(), owners.end(), -1);
+					++discards;
+					offset = ring.allocate(bytes, alignment);
+				}
+
+				++allocations;
+				if (offset % alignment != 0 || offset + bytes > capacity)
+				{
+					++badOffsets;
+					continue;
+				}
+				for (size_t i = offset; i < offset + bytes; ++i)
+				{
+					overlaps += owners[i] > completedFrame ? 1 : 0;
+					owners[i] = frame;
+				}
+			}
+
+			if (ring.getUsedBytes() > capacity)
+			{
+				++badOffsets;
+			}
+			ring.endFrame(static_cast<uint64_t>(frame));
+		}
+
+		printf("frames: %d  allocations: %llu  full: %llu  discards: %llu\n", frameCount, allocations, full, discards);
+		printf("bytes overwritten while in flight: %llu\n", overlaps);
+		printf("misaligned or out of range: %llu\n", badOffsets);
+
+		const bool passed = overlaps == 0 && badOffsets == 0;
+		printf("%s\n", passed ? "PASSED" : "FAILED");
+		return passed ? 0 : 1;
+	}
+
+	// Checks LatencyHistogram against sorting the same values: every bucket's top maps back to
+	// it, percentiles are never under the exact ones nor over them by more than the bucket
+	// precision, and merging halves gives the whole. Then runs simulate -> cull -> sort ->
+	// pack -> submit as a frame graph, recording every phase into FrameStats and closing an interval
+	// every STATS_INTERVAL_FRAMES frames, and writes the summary to statsPath.
+	int verifyFrameStats(const RunSetup& setup, JobSystem& jobs, const std::string& statsPath)
+	{
+		// Frame-like times from a microsecond to ten seconds, log-uniform, one in a hundred a hitch
+		const int sampleCount = 1000000;
+		RandomStream random(setup.config.seed, RandomStream::SPAWN_STREAM);
+		std::vector<uint64_t> samples(sampleCount);
+		for (uint64_t& sample : samples)
+		{
+			const float exponent = random.nextBelow(100) == 0 ? random.nextFloat(7.0f, 10.0f) : random.nextFloat(3.0f, 7.3f);
+			sample = static_cast<uint64_t>(std::pow(10.0, static_cast<double>(exponent)));
+		}
+
+		LatencyHistogram whole;
+		LatencyHistogram halves[2];
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < sampleCount; ++i)
+		{
+			whole.record(samples[i]);
+		}
+		const double recordNs = elapsedNs(start) / sampleCount;
+		for (int i = 0; i < sampleCount; ++i)
+		{
+			halves[i & 1].record(samples[i]);
+		}
+		halves[0].merge(halves[1]);
+
+		unsigned long long bucketErrors = 0;
+		for (size_t bucket = 0; bucket + 1 < LatencyHistogram::getBucketCount(); ++bucket)
+		{
+			const uint64_t highest = LatencyHistogram::getBucketHighest(bucket);
+			bucketErrors += LatencyHistogram::getBucketIndex(highest) != bucket || LatencyHistogram::getBucketIndex(highest + 1) != bucket + 1 ? 1 : 0;
+		}
+
+		std::vector<uint64_t> sorted = samples;
+		std::sort(sorted.begin(), sorted.end());
+		const double tolerance = 1.0 / (1u << (LatencyHistogram::SUB_BUCKET_BITS - 1));
+		const double percentiles[] = { 50.0, 90.0, 95.0, 99.0, 99.9, 100.0 };
+		double worstError = 0.0;
+		int percentileErrors = 0;
+		for (double percentile : percentiles)
+		{
+			const size_t rank = std::max<size_t>(static_cast<size_t>(std::ceil(percentile / 100.0 * sampleCount)), 1);
+			const uint64_t exact = sorted[rank - 1];
+			const uint64_t reported = whole.getPercentile(percentile);
+			const double error = static_cast<double>(reported - exact) / exact;
+			worstError = std::max(worstError, error);
+			percentileErrors += reported < exact || error > tolerance || halves[0].getPercentile(percentile) != reported ? 1 : 0;
+			printf("p%-5g exact %12.3f us  histogram %12.3f us\n", percentile, exact / 1.0e3, reported / 1.0e3);
+		}
+		const bool mergeMatches = halves[0].getCount() == whole.getCount() && halves[0].getMax() == whole.getMax() && halves[0].getMin() == whole.getMin();
+
+		// The frame loop of wWinMain, submitting into a recording device
+		const float stepSeconds = static_cast<float>(1.0 / setup.config.stepRate);
+		const Matrix viewProjection = setup.view * setup.projection;
+		const Frustum frustum(viewProjection);
+		std::vector<Cube> cubes = spawnCubes(setup);
+		std::vector<Vector3> centers(setup.cubeCount);
+		std::vector<int> visible(setup.cubeCount);
+		std::vector<ObjectConstants> constants(setup.cubeCount);
+		std::vector<InstanceData> instances(setup.cubeCount);
+		FrameConstants frameConstants;
+		frameConstants.mViewProjection = viewProjection.Transpose();
+		RecordingRenderDevice device(CONSTANT_RANGE_ALIGNMENT);
+		device.attachRingBuffer(RENDER_BUFFER_OBJECT_CONSTANT_RING, CONSTANT_RING_BYTES);
+		RenderQueue queue;
+		queue.reserve(setup.cubeCount);
+		size_t visibleCount = 0;
+
+		TaskGraph frameGraph;
+		const TaskGraph::NodeId simulateNode = frameGraph.addParallelTask("simulate", [&cubes]() { return cubes.size(); }, GRAIN_SIZE,
+			[&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				cubes[i].update(stepSeconds);
+				centers[i] = cubes[i].getPosition();
+			}
+		});
+		const TaskGraph::NodeId cullNode = frameGraph.addTask("cull", [&]()
+		{
+			visibleCount = frustum.cullSpheres(centers.data(), centers.size(), CUBE_BOUNDING_RADIUS, 0, visible.data());
+		});
+		const TaskGraph::NodeId sortNode = frameGraph.addTask("sort", [&]()
+		{
+			queue.clear();
+			queue.pushOpaque(viewProjection, CAMERA_FAR_PLANE, RENDER_SHADER_CUBE_VS, 0, centers.data(), visible.data(), visibleCount);
+			queue.sort(jobs);
+			queue.getItems(visible);
+		});
+		const TaskGraph::NodeId packNode = frameGraph.addParallelTask("pack", [&visibleCount]() { return visibleCount; }, GRAIN_SIZE,
+			[&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				if (setup.config.instanced)
+				{
+					instances[i].mWorld = cubes[visible[i]].getWorldMatrix();
+				}
+				else
+				{
+					packConstants(cubes[visible[i]].getWorldMatrix(), constants[i]);
+				}
+			}
+		});
+		const TaskGraph::NodeId submitNode = frameGraph.addMainThreadTask("submit", [&]()
+		{
+			device.beginFrame();
+			if (setup.config.instanced)
+			{
+				submitCubesInstanced(device, frameConstants, instances.data(), visibleCount);
+			}
+			else
+			{
+				submitCubes(device, frameConstants, constants.data(), visibleCount);
+			}
+			device.endFrame();
+		});
+		frameGraph.addDependency(simulateNode, cullNode);
+		frameGraph.addDependency(cullNode, sortNode);
+		frameGraph.addDependency(sortNode, packNode);
+		frameGraph.addDependency(packNode, submitNode);
+
+		// Every interval closed, to check the window FrameStats keeps against
+		FrameStats stats;
+		std::vector<FrameStats::IntervalSummary> closed;
+		auto intervalStart = std::chrono::high_resolution_clock::now();
+		auto lastFrameStart = intervalStart;
+		for (int frame = 0; frame < setup.frameCount; ++frame)
+		{
+			const auto frameStart = std::chrono::high_resolution_clock::now();
+			if (frame > 0)
+			{
+				stats.record(FrameStats::PHASE_FRAME, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(frameStart - lastFrameStart).count()));
+			}
+			lastFrameStart = frameStart;
+
+			frameGraph.run(jobs);
+			stats.record(FrameStats::PHASE_SIMULATE, frameGraph.getLastDurationNs(simulateNode));
+			stats.record(FrameStats::PHASE_CULL, frameGraph.getLastDurationNs(cullNode));
+			stats.record(FrameStats::PHASE_SORT, frameGraph.getLastDurationNs(sortNode));
+			stats.record(FrameStats::PHASE_PACK, frameGraph.getLastDurationNs(packNode));
+			stats.record(FrameStats::PHASE_SUBMIT, frameGraph.getLastDurationNs(submitNode));
+
+			if ((frame + 1) % STATS_INTERVAL_FRAMES == 0 || frame + 1 == setup.frameCount)
+			{
+				closed.push_back(stats.closeInterval(elapsedNs(intervalStart) / 1.0e9));
+				intervalStart = std::chrono::high_resolution_clock::now();
+			}
+		}
+
+		// Every phase but the frame, which needs two starts, is counted once a frame, and the
+		// intervals kept are the most recent closed
+		const size_t kept = stats.getKeptCount();
+		int countErrors = stats.getClosedCount() != closed.size() || kept != (closed.size() < FrameStats::MAX_INTERVALS ? closed.size() : FrameStats::MAX_INTERVALS) ? 1 : 0;
+		for (size_t i = 0; i < kept; ++i)
+		{
+			countErrors += memcmp(&stats.getInterval(i), &closed[closed.size() - kept + i], sizeof(FrameStats::IntervalSummary)) != 0 ? 1 : 0;
+		}
+		for (int phase = 0; phase < FrameStats::PHASE_COUNT; ++phase)
+		{
+			const LatencyHistogram& total = stats.getTotalHistogram(static_cast<FrameStats::Phase>(phase));
+			unsigned long long counted = 0;
+			uint64_t intervalMax = 0;
+			for (const FrameStats::IntervalSummary& interval : closed)
+			{
+				const FrameStats::PhaseSummary& summary = interval.phases[phase];
+				counted += summary.count;
+				intervalMax = std::max(intervalMax, summary.max);
+				countErrors += summary.count > 0 && !(summary.p50 <= summary.p95 && summary.p95 <= summary.p99 && summary.p99 <= summary.max) ? 1 : 0;
+			}
+			const unsigned long long expected = static_cast<unsigned long long>(setup.frameCount) - (phase == FrameStats::PHASE_FRAME ? 1 : 0);
+			countErrors += counted != expected || total.getCount() != expected || intervalMax != total.getMax() ? 1 : 0;
+		}
+
+		// A header, then a row per phase for each interval kept and for the whole run
+		const bool written = stats.writeSummary(statsPath.c_str());
+		unsigned long long lines = 0;
+		if (FILE* pFile = fopen(statsPath.c_str(), "r"))
+		{
+			for (int c = fgetc(pFile); c != EOF; c = fgetc(pFile))
+			{
+				lines += c == '\n' ? 1 : 0;
+			}
+			fclose(pFile);
+		}
+		const bool summaryComplete = written && lines == 1 + (kept + 1) * FrameStats::PHASE_COUNT;
+
+		printf("samples: %d  buckets: %zu  record: %.1f ns  worst percentile error: %.3f%% (tolerance %.3f%%)\n", sampleCount,
+			LatencyHistogram::getBucketCount(), recordNs, worstError * 100.0, tolerance * 100.0);
+		printf("buckets not round-tripping: %llu  percentiles out of tolerance: %d  merged halves match: %s\n", bucketErrors, percentileErrors,
+			mergeMatches ? "yes" : "no");
+		printf("cubes: %zu  frames: %d  threads: %u  intervals: %zu (%zu kept)  seed: %llu\n", setup.cubeCount, setup.frameCount, jobs.getThreadCount(), closed.size(), kept,
+			static_cast<unsigned long long>(setup.config.seed));
+		for (int phase = 0; phase < FrameStats::PHASE_COUNT; ++phase)
+		{
+			const FrameStats::PhaseSummary summary = FrameStats::summarize(stats.getTotalHistogram(static_cast<FrameStats::Phase>(phase)));
+			printf("  %-8s p50 %8.3f  p95 %8.3f  p99 %8.3f  max %8.3f ms\n", FrameStats::getPhaseName(static_cast<FrameStats::Phase>(phase)),
+				summary.p50 / 1.0e6, summary.p95 / 1.0e6, summary.p99 / 1.0e6, summary.max / 1.0e6);
+		}
+		printf("phase counts off: %d  summary: %s, %llu lines%s\n", countErrors, statsPath.c_str(), lines, summaryComplete ? "" : " (incomplete)");
+
+		const bool passed = bucketErrors == 0 && percentileErrors == 0 && mergeMatches && countErrors == 0 && summaryComplete && device.getInvalidDrawCount() == 0;
+		printf("%s\n", passed ? "PASSED" : "FAILED");
+		return passed ? 0 : 1;
+	}
+
+	// Runs the frame loop of wWinMain on fresh cubes runCount times, one more to warm up, and
+	// times each phase separately. The world matrices are rebuilt lazily, so reading them once
+	// before packing splits the rebuild from the packing. Every run is a sample in the report:
+	//   cube update         ns per cube of Cube::update
+	//   world matrix build  ns per cube of rebuilding the world matrix
+	//   constant pack       ns per cube of packing the world matrix into ObjectConstants
+	//   software frame      ms per frame of submitting and drawing into a SoftwareRenderDevice
+	int benchmarkSimulation(const RunSetup& setup, JobSystem& jobs, int runCount, const std::string& jsonPath)
+	{
+		BenchmarkReport report("cubeSim");
+		report.setProperty("cubes", static_cast<double>(setup.cubeCount));
+		report.setProperty("frames", setup.frameCount);
+		report.setProperty("runs", runCount);
+		report.setProperty("threads", jobs.getThreadCount());
+		report.setProperty("seed", std::to_string(setup.config.seed));
+		report.setProperty("step rate", setup.config.stepRate);
+		report.setProperty("target", std::to_string(RASTER_WIDTH) + "x" + std::to_string(RASTER_HEIGHT));
+
+		SoftwareRenderDevice device(RASTER_WIDTH, RASTER_HEIGHT, jobs, CONSTANT_RANGE_ALIGNMENT);
+		device.attachRingBuffer(RENDER_BUFFER_OBJECT_CONSTANT_RING, CONSTANT_RING_BYTES);
+		device.setClearColor(RASTER_CLEAR_COLOR);
+		device.updateBuffer(RENDER_BUFFER_CUBE_VERTICES, CUBE_VERTICES, sizeof(CUBE_VERTICES));
+		device.updateBuffer(RENDER_BUFFER_CUBE_INDICES, CUBE_INDICES, sizeof(CUBE_INDICES));
+
+		const float stepSeconds = static_cast<float>(1.0 / setup.config.stepRate);
+		FrameConstants frameConstants;
+		frameConstants.mViewProjection = (setup.view * setup.projection).Transpose();
+		std::vector<ObjectConstants> constants(setup.cubeCount);
+		const double cubeFrames = std::max(1.0, static_cast<double>(setup.cubeCount) * setup.frameCount);
+		float checksum = 0.0f;
+		for (int run = -1; run < runCount; ++run)
+		{
+			std::vector<Cube> cubes = spawnCubes(setup);
+			double updateNs = 0.0;
+			double buildNs = 0.0;
+			double packNs = 0.0;
+			double drawNs = 0.0;
+			for (int frame = 0; frame < setup.frameCount; ++frame)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				jobs.parallelFor(cubes.size(), GRAIN_SIZE, [&cubes, stepSeconds](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; ++i)
+					{
+						cubes[i].update(stepSeconds);
+					}
+				});
+				updateNs += elapsedNs(start);
+
+				start = std::chrono::high_resolution_clock::now();
+				jobs.parallelFor(cubes.size(), GRAIN_SIZE, [&cubes](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; ++i)
+					{
+						cubes[i].getWorldMatrix();
+					}
+				});
+				buildNs += elapsedNs(start);
+
+				start = std::chrono::high_resolution_clock::now();
+				jobs.parallelFor(cubes.size(), GRAIN_SIZE, [&](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; ++i)
+					{
+						packConstants(cubes[i].getWorldMatrix(), constants[i]);
+					}
+				});
+				packNs += elapsedNs(start);
+
+				start = std::chrono::high_resolution_clock::now();
+				device.beginFrame();
+				submitCubes(device, frameConstants, constants.data(), constants.size());
+				device.endFrame();
+				drawNs += elapsedNs(start);
+			}
+			if (run < 0)
+			{
+				continue;
+			}
+
+			report.addSample("cube update", "ns/cube", updateNs / cubeFrames);
+			report.addSample("world matrix build", "ns/cube", buildNs / cubeFrames);
+			report.addSample("constant pack", "ns/cube", packNs / cubeFrames);
+			report.addSample("software frame", "ms/frame", drawNs / std::max(1, setup.frameCount) / 1.0e6);
+			checksum = checksumConstants(constants);
+		}
+
+		printf("cubes: %zu  frames: %d  runs: %d  threads: %u  seed: %llu\n", setup.cubeCount, setup.frameCount, runCount, jobs.getThreadCount(),
+			static_cast<unsigned long long>(setup.config.seed));
+		printf("%-20s %-10s %10s %10s %8s\n", "metric", "unit", "median", "MAD", "spread");
+		for (const BenchmarkReport::Metric& metric : report.getMetrics())
+		{
+			const double median = metric.getMedian();
+			printf("%-20s %-10s %10.3f %10.3f %7.2f%%\n", metric.name.c_str(), metric.unit.c_str(), median, metric.getMad(),
+				median > 0.0 ? 100.0 * metric.getMad() / median : 0.0);
+		}
+		printf("checksum: %f  invalid draws: %llu\n", checksum, static_cast<unsigned long long>(device.getInvalidDrawCount()));
+
+		if (!report.write(jsonPath.c_str()))
+		{
+			fprintf(stderr, "cannot write %s\n", jsonPath.c_str());
+			return 1;
+		}
+		printf("report: %s\n", jsonPath.c_str());
+		return device.getInvalidDrawCount() == 0 ? 0 : 1;
+	}
+
+	// Runs the phases of benchmarkSimulation on the calling thread, since the counters only
+	// count the thread that opened them, starting and stopping them around each phase of every
+	// frame. Low IPC with many cache misses per cube marks a phase bound by memory, high IPC
+	// with few marks one bound by its arithmetic. Counters that cannot be opened show as "-",
+	// and with none at all only the times are reported.
+	int countHardwareEvents(const RunSetup& setup)
+	{
+		enum Phase
+		{
+			PHASE_UPDATE,
+			PHASE_BUILD,
+			PHASE_PACK,
+			PHASE_COUNT,
+		};
+		const char* phaseNames[PHASE_COUNT] = { "update", "matrix build", "pack" };
+
+		HardwareCounters counters;
+		HardwareCounters::Reading readings[PHASE_COUNT];
+		double phaseNs[PHASE_COUNT] = {};
+
+		const float stepSeconds = static_cast<float>(1.0 / setup.config.stepRate);
+		std::vector<ObjectConstants> constants(setup.cubeCount);
+		std::vector<Cube> cubes = spawnCubes(setup);
+		for (int frame = 0; frame < setup.frameCount; ++frame)
+		{
+			counters.start();
+			auto start = std::chrono::high_resolution_clock::now();
+			for (Cube& cube : cubes)
+			{
+				cube.update(stepSeconds);
+			}
+			phaseNs[PHASE_UPDATE] += elapsedNs(start);
+			readings[PHASE_UPDATE].add(counters.stop());
+
+			counters.start();
+			start = std::chrono::high_resolution_clock::now();
+			for (const Cube& cube : cubes)
+			{
+				cube.getWorldMatrix();
+			}
+			phaseNs[PHASE_BUILD] += elapsedNs(start);
+			readings[PHASE_BUILD].add(counters.stop());
+
+			counters.start();
+			start = std::chrono::high_resolution_clock::now();
+			for (size_t i = 0; i < cubes.size(); ++i)
+			{
+				packConstants(cubes[i].getWorldMatrix(), constants[i]);
+			}
+			phaseNs[PHASE_PACK] += elapsedNs(start);
+			readings[PHASE_PACK].add(counters.stop());
+		}
+
+		printf("cubes: %zu  frames: %d  threads: 1  seed: %llu\n", setup.cubeCount, setup.frameCount, static_cast<unsigned long long>(setup.config.seed));
+		if (!counters.isAnyAvailable())
+		{
+			printf("hardware counters unavailable (%s); reporting times only\n", counters.getError().c_str());
+		}
+		else if (!counters.getError().empty())
+		{
+			printf("some hardware counters unavailable (%s)\n", counters.getError().c_str());
+		}
+
+		const double cubeFrames = std::max(1.0, static_cast<double>(setup.cubeCount) * setup.frameCount);
+		printf("%-12s %9s", "per cube", "ns");
+		for (int counter = 0; counter < HardwareCounters::COUNTER_COUNT; ++counter)
+		{
+			printf(" %13s", HardwareCounters::getCounterName(static_cast<HardwareCounters::Counter>(counter)));
+		}
+		printf(" %6s\n", "IPC");
+		bool scaled = false;
+		for (int phase = 0; phase < PHASE_COUNT; ++phase)
+		{
+			printf("%-12s %9.2f", phaseNames[phase], phaseNs[phase] / cubeFrames);
+			for (int counter = 0; counter < HardwareCounters::COUNTER_COUNT; ++counter)
+			{
+				if (counters.isAvailable(static_cast<HardwareCounters::Counter>(counter)))
+				{
+					printf(" %13.3f", readings[phase].values[counter] / cubeFrames);
+				}
+				else
+				{
+					printf(" %13s", "-");
+				}
+			}
+			const bool ipcAvailable = counters.isAvailable(HardwareCounters::COUNTER_CYCLES) && counters.isAvailable(HardwareCounters::COUNTER_INSTRUCTIONS);
+			if (ipcAvailable)
+			{
+				printf(" %6.2f\n", readings[phase].getIpc());
+			}
+			else
+			{
+				printf(" %6s\n", "-");
+			}
+			scaled = scaled || readings[phase].scaled;
+		}
+		if (scaled)
+		{
+			printf("counters were multiplexed, so their counts are scaled estimates\n");
+		}
+		printf("checksum: %f\n", checksumConstants(constants));
+		return 0;
+	}
+
+#ifdef PROFILE
+	// Zones of one thread that do not nest: each must lie inside the zone open at its start,
+	// one level deeper, or be at depth 0. The draw sort must sit in the sort task.
+	unsigned long long countNestingErrors(const std::vector<Profiler::Event>& events)
+	{
+		std::vector<Profiler::Event> zones;
+		for (const Profiler::Event& event : events)
+		{
+			if (event.kind == Profiler::EVENT_ZONE)
+			{
+				zones.push_back(event);
+			}
+		}
+
+		// A parent starts no later than its children, and goes first when they start together
+		std::sort(zones.begin(), zones.end(), [](const Profiler::Event& a, const Profiler::Event& b)
+		{
+			return a.start != b.start ? a.start < b.start : a.depth < b.depth;
+		});
+
+		unsigned long long errors = 0;
+		std::vector<const Profiler::Event*> open;
+		for (const Profiler::Event& zone : zones)
+		{
+			while (open.size() > zone.depth)
+			{
+				open.pop_back();
+			}
+			if (open.size() != zone.depth)
+			{
+				++errors;
+				continue;
+			}
+			if (!open.empty())
+			{
+				const Profiler::Event& parent = *open.back();
+				errors += zone.start < parent.start || zone.getEnd() > parent.getEnd() ? 1 : 0;
+			}
+			if (strcmp(zone.name, "sort draws") == 0)
+			{
+				errors += open.empty() || strcmp(open.back()->name, "sort") != 0 ? 1 : 0;
+			}
+			open.push_back(&zone);
+		}
+		return errors;
+	}
+
+	// Runs simulate -> cull -> sort -> pack as a frame graph with every frame in a zone of its own,
+	// counting the cubes culled, and checks the profiler's rings: zones on every thread nest,
+	// and unless a ring overflowed there is one frame zone and one count per frame, and the
+	// counts add up. The trace is written to tracePath and must hold one line per event.
+	int verifyProfiler(const RunSetup& setup, JobSystem& jobs, const std::string& tracePath)
+	{
+		const float stepSeconds = static_cast<float>(1.0 / setup.config.stepRate);
+		const Frustum frustum(setup.view * setup.projection);
+		const Matrix viewProjection = setup.view * setup.projection;
+		std::vector<Cube> cubes = spawnCubes(setup);
+		std::vector<Vector3> centers(setup.cubeCount);
+		std::vector<int> visible(setup.cubeCount);
+		std::vector<ObjectConstants> constants(setup.cubeCount);
+		RenderQueue queue;
+		queue.reserve(setup.cubeCount);
+		size_t visibleCount = 0;
+		unsigned long long culledTotal = 0;
+
+		TaskGraph frameGraph;
+		const TaskGraph::NodeId simulateNode = frameGraph.addParallelTask("simulate", [&cubes]() { return cubes.size(); }, GRAIN_SIZE,
+			[&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				cubes[i].update(stepSeconds);
+				centers[i] = cubes[i].getPosition();
+			}
+		});
+		const TaskGraph::NodeId cullNode = frameGraph.addTask("cull", [&]()
+		{
+			visibleCount = frustum.cullSpheres(centers.data(), centers.size(), CUBE_BOUNDING_RADIUS, 0, visible.data());
+			culledTotal += setup.cubeCount - visibleCount;
+			PROFILE_COUNTER("cubes culled", setup.cubeCount - visibleCount);
+		});
+		const TaskGraph::NodeId sortNode = frameGraph.addTask("sort", [&]()
+		{
+			queue.clear();
+			queue.pushOpaque(viewProjection, CAMERA_FAR_PLANE, RENDER_SHADER_CUBE_VS, 0, centers.data(), visible.data(), visibleCount);
+			queue.sort(jobs);
+			queue.getItems(visible);
+		});
+		const TaskGraph::NodeId packNode = frameGraph.addParallelTask("pack", [&visibleCount]() { return visibleCount; }, GRAIN_SIZE,
+			[&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				packConstants(cubes[visible[i]].getWorldMatrix(), constants[i]);
+			}
+		});
+		frameGraph.addDependency(simulateNode, cullNode);
+		frameGraph.addDependency(cullNode, sortNode);
+		frameGraph.addDependency(sortNode, packNode);
+
+		PROFILE_THREAD_NAME("main");
+		Profiler::clear();
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int frame = 0; frame < setup.frameCount; ++frame)
+		{
+			PROFILE_ZONE("frame");
+			frameGraph.run(jobs);
+		}
+		const double frameNs = elapsedNs(start);
+
+		std::vector<Profiler::ThreadEvents> threads;
+		Profiler::collect(threads);
+		unsigned long long eventCount = 0;
+		unsigned long long dropped = 0;
+		unsigned long long nestingErrors = 0;
+		unsigned long long frameZones = 0;
+		unsigned long long culledCounts = 0;
+		unsigned long long culledSum = 0;
+		unsigned int deepest = 0;
+		for (const Profiler::ThreadEvents& thread : threads)
+		{
+			eventCount += thread.events.size();
+			dropped += thread.dropped;
+			nestingErrors += countNestingErrors(thread.events);
+			for (const Profiler::Event& event : thread.events)
+			{
+				deepest = std::max(deepest, event.depth);
+				frameZones += event.kind == Profiler::EVENT_ZONE && strcmp(event.name, "frame") == 0 ? 1 : 0;
+				if (event.kind == Profiler::EVENT_COUNTER && strcmp(event.name, "cubes culled") == 0)
+				{
+					++culledCounts;
+					culledSum += static_cast<unsigned long long>(event.value);
+				}
+			}
+		}
+
+		// Each line of the trace after the first is one event, or a thread's name
+		const bool written = Profiler::writeChromeTrace(tracePath.c_str());
+		unsigned long long lines = 0;
+		if (FILE* pFile = fopen(tracePath.c_str(), "r"))
+		{
+			for (int c = fgetc(pFile); c != EOF; c = fgetc(pFile))
+			{
+				lines += c == '\n' ? 1 : 0;
+			}
+			fclose(pFile);
+		}
+		const bool traceComplete = written && lines == eventCount + threads.size() + 2;
+
+		// What an empty zone costs the thread that opens it
+		const int zoneSamples = 1000000;
+		start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < zoneSamples; ++i)
+		{
+			PROFILE_ZONE("empty");
+		}
+		const double zoneNs = elapsedNs(start) / zoneSamples;
+		Profiler::clear();
+
+		const double frames = setup.frameCount;
+		printf("cubes: %zu  frames: %d  threads: %u  seed: %llu\n", setup.cubeCount, setup.frameCount, jobs.getThreadCount(),
+			static_cast<unsigned long long>(setup.config.seed));
+		printf("%.3f ms/frame  %.1f events/frame on %zu threads  %llu dropped  deepest zone: %u\n", frameNs / frames / 1.0e6,
+			eventCount / frames, threads.size(), dropped, deepest);
+		printf("frame zones: %llu  culled counts: %llu adding to %llu of %llu  zones not nested: %llu\n", frameZones, culledCounts, culledSum,
+			culledTotal, nestingErrors);
+		printf("empty zone: %.1f ns  trace: %s, %llu lines%s\n", zoneNs, tracePath.c_str(), lines, traceComplete ? "" : " (incomplete)");
+
+		const bool countsChecked = dropped == 0;
+		const bool passed = nestingErrors == 0 && traceComplete && eventCount > 0 &&
+			(!countsChecked || (frameZones == static_cast<unsigned long long>(setup.frameCount) && culledCounts == frameZones && culledSum == culledTotal));
+		printf("%s%s\n", passed ? "PASSED" : "FAILED", countsChecked ? "" : " (rings overflowed, so per-frame counts were not checked)");
+		return passed ? 0 : 1;
+	}
+#endif
+
+	RunResult runMode(const char* mode, const RunSetup& setup, JobSystem& jobs)
+	{
+		if (strcmp(mode, "field") == 0)
+		{
+			return runField(setup, jobs);
+		}
+		if (strcmp(mode, "overlap") == 0)
+		{
+			return runOverlap(setup, jobs);
+		}
+		return runCubes(setup, jobs);
+	}
+
+	// Sweeps the cube count by powers of ten. Each size runs for about the same number of
+	// cube-frames, and the sweep stops at the first size that cannot be allocated.
+	void runScaling(RunSetup setup, size_t maxCubes, JobSystem& jobs)
+	{
+		const char* modes[] = { "cube", "field", "overlap" };
+		const int maxFrames = setup.frameCount;
+
+		printf("threads: %u  seed: %llu\n", jobs.getThreadCount(), static_cast<unsigned long long>(setup.config.seed));
+		printf("%10s  %-8s %7s %14s %14s %14s %12s\n", "cubes", "mode", "frames", "update ns/cube", "pack ns/cube", "frame ns/cube", "bytes/cube");
+		for (size_t cubeCount = 100; cubeCount <= maxCubes; cubeCount *= 10)
+		{
+			setup.cubeCount = cubeCount;
+			setup.frameCount = static_cast<int>(std::max(3.0, std::min(static_cast<double>(maxFrames), SCALE_CUBE_FRAMES / cubeCount)));
+			for (const char* mode : modes)
+			{
+				RunResult result;
+				try
+				{
+					result = runMode(mode, setup, jobs);
+				}
+				catch (const std::bad_alloc&)
+				{
+					printf("%10zu  %-8s out of memory\n", cubeCount, mode);
+					return;
+				}
+
+				const double perCubeFrame = 1.0 / (static_cast<double>(setup.frameCount) * cubeCount);
+				if (strcmp(mode, "overlap") == 0)
+				{
+					printf("%10zu  %-8s %7d %14s %14s %14.2f %12.0f\n", cubeCount, mode, setup.frameCount, "-", "-",
+						result.frameNs * perCubeFrame, result.bytesPerCube);
+				}
+				else
+				{
+					printf("%10zu  %-8s %7d %14.2f %14.2f %14.2f %12.0f\n", cubeCount, mode, setup.frameCount,
+						result.updateNs * perCubeFrame, result.packNs * perCubeFrame, result.frameNs * perCubeFrame, result.bytesPerCube);
+				}
+				fflush(stdout);
+			}
+		}
+	}
+
+	bool parseCount(const std::string& argument, const char* prefix, unsigned long long& value)
+	{
+		const size_t prefixLength = strlen(prefix);
+		if (argument.compare(0, prefixLength, prefix) != 0)
+		{
+			return false;
+		}
+
+		// Route through the config parser so counts accept the same forms, such as 1e7
+		SimulationConfig scratch;
+		std::string error;
+		if (!applySetting("cubes", argument.substr(prefixLength), scratch, error))
+		{
+			return false;
+		}
+		value = scratch.cubeCount;
+		return true;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	SimulationConfig config;
+	std::vector<std::string> unparsed;
+	std::string error;
+	if (!parseCommandLine(argc, argv, config, unparsed, error))
+	{
+		fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+
+	const char* usage = "usage: %s [--cubes=N] [--frames=N] [--threads=N] [--seed=N] [--spawn-min=x,y,z] [--spawn-max=x,y,z]\n"
+		"       [--step-rate=N] [--max-cubes=N] [--trace=file] [--stats=file] [--runs=N] [--json=file] [--config=file]\n"
+		"       [cube|field|overlap|scale|verify|submit|record|cull|bvh|occlusion|queue|raster|profile|stats|ring|bench|counters]\n";
+	std::string mode = "cube";
+	unsigned long long frameCount = 1000;
+	unsigned long long maxCubes = 10000000;
+	std::string tracePath = "cubeSimTrace.json";
+	std::string statsPath = "cubeSimFrameStats.txt";
+	unsigned long long runCount = 10;
+	std::string jsonPath = "cubeSimBench.json";
+	for (const std::string& argument : unparsed)
+	{
+		if (argument == "cube" || argument == "field" || argument == "overlap" || argument == "scale" || argument == "verify" || argument == "submit" || argument == "record" ||
+			argument == "cull" || argument == "bvh" || argument == "occlusion" || argument == "queue" || argument == "raster" || argument == "profile" ||
+			argument == "stats" || argument == "ring" || argument == "bench" || argument == "counters")
+		{
+			mode = argument;
+		}
+		else if (argument.compare(0, 8, "--trace=") == 0 && argument.size() > 8)
+		{
+			tracePath = argument.substr(8);
+		}
+		else if (argument.compare(0, 8, "--stats=") == 0 && argument.size() > 8)
+		{
+			statsPath = argument.substr(8);
+		}
+		else if (argument.compare(0, 7, "--json=") == 0 && argument.size() > 7)
+		{
+			jsonPath = argument.substr(7);
+		}
+		else if (!parseCount(argument, "--frames=", frameCount) && !parseCount(argument, "--max-cubes=", maxCubes) && !parseCount(argument, "--runs=", runCount))
+		{
+			fprintf(stderr, "unknown argument '%s'\n", argument.c_str());
+			fprintf(stderr, usage, argv[0]);
+			return 1;
+		}
+	}
+	if (frameCount > 0x7FFFFFFF || runCount < 1 || runCount > 0x7FFFFFFF)
+	{
+		fprintf(stderr, usage, argv[0]);
+		return 1;
+	}
+
+	if (mode == "verify")
+	{
+		return verifyEulerTranslation(static_cast<int>(config.cubeCount), config.seed, static_cast<float>(1.0 / config.stepRate));
+	}
+	if (mode == "ring")
+	{
+		return verifyRingAllocator(static_cast<int>(frameCount), config.seed);
+	}
+
+	// The pool counts the calling thread, so ask for one worker fewer than the thread count
+	JobSystem jobs(config.threadCount > 0 ? config.threadCount - 1 : JobSystem::DEFAULT_WORKERS);
+
+	// Same camera as wWinMain with a 640x480 client area
+	RunSetup setup;
+	setup.config = config;
+	setup.cubeCount = config.cubeCount;
+	setup.frameCount = static_cast<int>(frameCount);
+	setup.view = Matrix::CreateLookAt(Vector3(0.0f, 2.0f, -5.0f), Vector3(0.0f, 1.0f, 0.0f), Vector3(0.0f, 1.0f, 0.0f));
+	setup.projection = Matrix::CreatePerspectiveFieldOfView(3.142f / 2.0f, 640.0f / 480.0f, 0.01f, CAMERA_FAR_PLANE);
+
+	if (mode == "scale")
+	{
+		runScaling(setup, static_cast<size_t>(maxCubes), jobs);
+		return 0;
+	}
+	if (mode == "submit")
+	{
+		return verifySubmission(setup);
+	}
+	if (mode == "record")
+	{
+		return verifyRecording(setup, jobs);
+	}
+	if (mode == "cull")
+	{
+		return verifyCulling(setup);
+	}
+	if (mode == "bvh")
+	{
+		return verifyBoundingVolumeHierarchy(setup, jobs);
+	}
+	if (mode == "occlusion")
+	{
+		return verifyOcclusion(setup, jobs);
+	}
+	if (mode == "queue")
+	{
+		return verifyRenderQueue(setup, jobs);
+	}
+	if (mode == "raster")
+	{
+		return verifyRasterizer(setup, jobs);
+	}
+	if (mode == "stats")
+	{
+		return verifyFrameStats(setup, jobs, statsPath);
+	}
+	if (mode == "counters")
+	{
+		return countHardwareEvents(setup);
+	}
+	if (mode == "bench")
+	{
+		return benchmarkSimulation(setup, jobs, static_cast<int>(runCount), jsonPath);
+	}
+	if (mode == "profile")
+	{
+#ifdef PROFILE
+		return verifyProfiler(setup, jobs, tracePath);
+#else
+		fprintf(stderr, "profile mode needs a build with PROFILE defined, such as -DCUBESIM_PROFILE=ON\n");
+		return 1;
+#endif
+	}
+
+	const RunResult result = runMode(mode.c_str(), setup, jobs);
+	const double cubeCount = static_cast<double>(setup.cubeCount);
+
+	printf("mode: %s  cubes: %zu  frames: %d  threads: %u  seed: %llu\n", mode.c_str(), setup.cubeCount, setup.frameCount,
+		jobs.getThreadCount(), static_cast<unsigned long long>(config.seed));
+	if (mode != "overlap")
+	{
+		printf("update: %.3f ms/frame  %.2f ns/cube\n", result.updateNs / setup.frameCount / 1.0e6, result.updateNs / setup.frameCount / cubeCount);
+		printf("pack: %.3f ms/frame  %.2f ns/cube\n", result.packNs / setup.frameCount / 1.0e6, result.packNs / setup.frameCount / cubeCount);
+	}
+	printf("frame: %.3f ms/frame  %.2f ns/cube\n", result.frameNs / setup.frameCount / 1.0e6, result.frameNs / setup.frameCount / cubeCount);
+	printf("memory: %.0f bytes/cube\n", result.bytesPerCube);
+	if (mode == "cube")
+	{
+		printf("world rebuilds: %.3f per cube per frame\n", static_cast<double>(result.rebuilds) / cubeCount / setup.frameCount);
+	}
+	printf("checksum: %f\n", result.checksum);
+
+	return 0;
+}
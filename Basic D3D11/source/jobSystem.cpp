@@ -0,0 +1,205 @@
+#include "../include/jobSystem.h"
+#include "../include/profiler.h"
+#include <string>
+
+namespace
+{
+	// Lets a thread find its own deque; threads outside any pool use queue 0
+	thread_local const JobSystem* t_pOwner = nullptr;
+	thread_local size_t t_queueIndex = 0;
+}
+
+JobSystem::JobSystem(unsigned int workerCount)
+	: m_queuedTasks(0)
+{
+	if (workerCount == DEFAULT_WORKERS)
+	{
+		const unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+	}
+
+	m_queues.reserve(workerCount + 1);
+	for (unsigned int i = 0; i < workerCount + 1; ++i)
+	{
+		m_queues.emplace_back(new WorkQueue());
+	}
+
+	m_workers.reserve(workerCount);
+	for (unsigned int i = 0; i < workerCount; ++i)
+	{
+		m_workers.emplace_back(&JobSystem::workerLoop, this, i + 1);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	wait();
+
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_quit = true;
+	}
+	m_workAvailable.notify_all();
+
+	for (std::thread& worker : m_workers)
+	{
+		worker.join();
+	}
+}
+
+void JobSystem::run(size_t count, size_t grainSize, const RangeFunction& body, JobCounter& counter)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	counter.pending.fetch_add(count, std::memory_order_relaxed);
+
+	Task task;
+	task.body = std::make_shared<const RangeFunction>(body);
+	task.begin = 0;
+	task.end = count;
+	task.grainSize = grainSize > 0 ? grainSize : 1;
+	task.pCounter = &counter;
+	push(task);
+}
+
+void JobSystem::run(const TaskFunction& task, JobCounter& counter)
+{
+	run(1, 1, [task](size_t, size_t) { task(); }, counter);
+}
+
+void JobSystem::dispatch(size_t count, size_t grainSize, const RangeFunction& body)
+{
+	run(count, grainSize, body, m_dispatched);
+}
+
+void JobSystem::waitFor(const JobCounter& counter)
+{
+	while (!counter.isDone())
+	{
+		if (!runOneTask())
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+bool JobSystem::runOneTask()
+{
+	Task task;
+	if (!pop(getQueueIndex(), task))
+	{
+		return false;
+	}
+
+	execute(task);
+	return true;
+}
+
+size_t JobSystem::getQueueIndex() const
+{
+	return t_pOwner == this ? t_queueIndex : 0;
+}
+
+void JobSystem::push(const Task& task)
+{
+	WorkQueue& queue = *m_queues[getQueueIndex()];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(task);
+	}
+	m_queuedTasks.fetch_add(1, std::memory_order_release);
+
+	// Taking the sleep lock stops a worker missing the wake-up between its check and its wait
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+	}
+	m_workAvailable.notify_one();
+}
+
+bool JobSystem::pop(size_t queueIndex, Task& task)
+{
+	// Newest first from our own deque, since it is the smallest piece and likely still in cache
+	{
+		WorkQueue& queue = *m_queues[queueIndex];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty())
+		{
+			task = queue.tasks.back();
+			queue.tasks.pop_back();
+			m_queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	// Otherwise steal the oldest, largest piece from someone else
+	const size_t queueCount = m_queues.size();
+	for (size_t i = 1; i < queueCount; ++i)
+	{
+		WorkQueue& victim = *m_queues[(queueIndex + i) % queueCount];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty())
+		{
+			task = victim.tasks.front();
+			victim.tasks.pop_front();
+			m_queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void JobSystem::execute(Task task)
+{
+	// Split on whole grains so every piece starts on a multiple of grainSize
+	while (task.end - task.begin > task.grainSize)
+	{
+		const size_t grains = (task.end - task.begin + task.grainSize - 1) / task.grainSize;
+		const size_t middle = task.begin + (grains / 2) * task.grainSize;
+
+		Task upper = task;
+		upper.begin = middle;
+		push(upper);
+
+		task.end = middle;
+	}
+
+	(*task.body)(task.begin, task.end);
+
+	// Read before releasing our share of the work: once pending reaches zero a waiter may
+	// destroy a counter that has no completion callback
+	JobCounter& counter = *task.pCounter;
+	const bool hasCallback = static_cast<bool>(counter.onComplete);
+	const size_t amount = task.end - task.begin;
+	if (counter.pending.fetch_sub(amount, std::memory_order_acq_rel) == amount && hasCallback)
+	{
+		counter.onComplete();
+	}
+}
+
+void JobSystem::workerLoop(size_t queueIndex)
+{
+	t_pOwner = this;
+	t_queueIndex = queueIndex;
+	PROFILE_THREAD_NAME(("worker " + std::to_string(queueIndex)).c_str());
+
+	for (;;)
+	{
+		Task task;
+		if (pop(queueIndex, task))
+		{
+			execute(task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_workAvailable.wait(lock, [this]() { return m_quit || m_queuedTasks.load(std::memory_order_acquire) > 0; });
+		if (m_quit && m_queuedTasks.load(std::memory_order_acquire) == 0)
+		{
+			return;
+		}
+	}
+}
@@ -0,0 +1,21 @@
+#include "../include/jsonEscape.h"
+
+void writeJsonEscaped(FILE* pFile, const char* text)
+{
+	for (; *text; ++text)
+	{
+		const unsigned char c = static_cast<unsigned char>(*text);
+		if (c == '"' || c == '\\')
+		{
+			fprintf(pFile, "\\%c", c);
+		}
+		else if (c < 0x20)
+		{
+			fprintf(pFile, "\\u%04x", c);
+		}
+		else
+		{
+			fputc(c, pFile);
+		}
+	}
+}
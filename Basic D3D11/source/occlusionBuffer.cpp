@@ -0,0 +1,448 @@
+#include "../include/occlusionBuffer.h"
+#include "../include/cubeRenderer.h"
+#include "../include/profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+namespace
+{
+	const unsigned int TRIANGLES_PER_CUBE = CUBE_INDEX_COUNT / 3;
+
+	// Vertices are snapped to this fraction of a pixel, so each moves by at most half of it
+	// either way
+	const float SUBPIXEL_STEPS = 4.0f;
+	const float SNAP_ERROR = 0.5f / SUBPIXEL_STEPS;
+
+	// Cubes per setup job and spheres per test job
+	const size_t SETUP_GRAIN_SIZE = 64;
+	const size_t TEST_GRAIN_SIZE = 256;
+
+	inline float snap(float value)
+	{
+		return std::floor(value * SUBPIXEL_STEPS + 0.5f) / SUBPIXEL_STEPS;
+	}
+
+	// Edge i runs from vertex i to the next. Inside a clockwise triangle every edge function is
+	// zero or more; with quarter-pixel vertices and cell corners each product and the
+	// difference are exact, so the lanes and the one-pixel path agree on every cell.
+	inline float edgeFunction(float rowTerm, float fromX, float dy, float px)
+	{
+		return rowTerm - (px - fromX) * dy;
+	}
+}
+
+OcclusionBuffer::OcclusionBuffer(unsigned int width, unsigned int height)
+	: m_triangleCount(0), m_skippedCount(0)
+{
+	width = std::min(std::max(width, 1u), MAX_SIZE);
+	height = std::min(std::max(height, 1u), MAX_SIZE);
+	m_width = (width + LANE_COUNT - 1) / LANE_COUNT * LANE_COUNT;
+	m_height = (height + BAND_HEIGHT - 1) / BAND_HEIGHT * BAND_HEIGHT;
+
+	Level size = { m_width, m_height };
+	m_levelSizes.push_back(size);
+	while (size.width > 1 || size.height > 1)
+	{
+		size.width = (size.width + 1) / 2;
+		size.height = (size.height + 1) / 2;
+		m_levelSizes.push_back(size);
+	}
+
+	m_levels.resize(m_levelSizes.size());
+	for (size_t level = 0; level < m_levels.size(); ++level)
+	{
+		m_levels[level].assign(m_levelSizes[level].width * m_levelSizes[level].height, 1.0f);
+	}
+}
+
+void OcclusionBuffer::selectOccluders(const Matrix& viewProjection, const Vector3* pCenters, const int* pIndices, size_t count, size_t maxOccluders,
+	std::vector<int>& occluders)
+{
+	std::vector<std::pair<float, int>> depths(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		const Vector3& center = pCenters[pIndices[i]];
+		depths[i].first = center.x * viewProjection._14 + center.y * viewProjection._24 + center.z * viewProjection._34 + viewProjection._44;
+		depths[i].second = pIndices[i];
+	}
+
+	const size_t kept = std::min(count, maxOccluders);
+	std::nth_element(depths.begin(), depths.begin() + kept, depths.end());
+	std::sort(depths.begin(), depths.begin() + kept);
+
+	occluders.resize(kept);
+	for (size_t i = 0; i < kept; ++i)
+	{
+		occluders[i] = depths[i].second;
+	}
+}
+
+bool OcclusionBuffer::setupCube(const Matrix& worldViewProjection, Triangle* pTriangles, unsigned int& count) const
+{
+	count = 0;
+
+	// Far enough outside the buffer that the edge tests stop being exact
+	const float guardX = m_width * 0.5f;
+	const float guardY = m_height * 0.5f;
+
+	float x[CUBE_VERTEX_COUNT];
+	float y[CUBE_VERTEX_COUNT];
+	float z[CUBE_VERTEX_COUNT];
+	for (unsigned int vertex = 0; vertex < CUBE_VERTEX_COUNT; ++vertex)
+	{
+		const Vector3& position = CUBE_VERTICES[vertex].Pos;
+		const Vector4 clip = Vector4::Transform(Vector4(position.x, position.y, position.z, 1.0f), worldViewProjection);
+		if (clip.w <= 0.0f || clip.z < 0.0f)
+		{
+			return false;
+		}
+
+		const float inverseW = 1.0f / clip.w;
+		const float screenX = (clip.x * inverseW * 0.5f + 0.5f) * m_width;
+		const float screenY = (0.5f - clip.y * inverseW * 0.5f) * m_height;
+		if (screenX < -guardX || screenX > m_width + guardX || screenY < -guardY || screenY > m_height + guardY)
+		{
+			return false;
+		}
+		x[vertex] = snap(screenX);
+		y[vertex] = snap(screenY);
+		z[vertex] = clip.z * inverseW;
+	}
+
+	for (unsigned int triangle = 0; triangle < TRIANGLES_PER_CUBE; ++triangle)
+	{
+		Triangle& out = pTriangles[count];
+		for (unsigned int corner = 0; corner < 3; ++corner)
+		{
+			const uint16_t vertex = CUBE_INDICES[triangle * 3 + corner];
+			out.x[corner] = x[vertex];
+			out.y[corner] = y[vertex];
+		}
+
+		// Positive for clockwise with y down, which is a face turned towards the camera
+		const float area = (out.x[1] - out.x[0]) * (out.y[2] - out.y[0]) - (out.x[2] - out.x[0]) * (out.y[1] - out.y[0]);
+		if (area <= 0.0f)
+		{
+			continue;
+		}
+
+		// Cells that lie wholly within the triangle's extent
+		const float minX = std::min(std::min(out.x[0], out.x[1]), out.x[2]);
+		const float maxX = std::max(std::max(out.x[0], out.x[1]), out.x[2]);
+		const float minY = std::min(std::min(out.y[0], out.y[1]), out.y[2]);
+		const float maxY = std::max(std::max(out.y[0], out.y[1]), out.y[2]);
+		out.minX = std::max(static_cast<int>(std::ceil(minX)), 0);
+		out.maxX = std::min(static_cast<int>(std::floor(maxX)) - 1, static_cast<int>(m_width) - 1);
+		out.minY = std::max(static_cast<int>(std::ceil(minY)), 0);
+		out.maxY = std::min(static_cast<int>(std::floor(maxY)) - 1, static_cast<int>(m_height) - 1);
+		if (out.minX > out.maxX || out.minY > out.maxY)
+		{
+			continue;
+		}
+
+		// The edge function falls fastest across a cell towards its corner least inside the
+		// edge. The unsnapped triangle covers the cell if the snapped one still does with every
+		// vertex moved by SNAP_ERROR towards it, which is the margin here.
+		for (int edge = 0; edge < 3; ++edge)
+		{
+			const int next = edge == 2 ? 0 : edge + 1;
+			const float dx = out.x[next] - out.x[edge];
+			const float dy = out.y[next] - out.y[edge];
+			out.edgeCornerX[edge] = dy > 0.0f ? 1.0f : 0.0f;
+			out.edgeCornerY[edge] = dx > 0.0f ? 0.0f : 1.0f;
+			out.edgeMargin[edge] = (std::fabs(dx) + std::fabs(dy)) * SNAP_ERROR;
+		}
+
+		// Depth after the divide is affine in screen space, so it is a plane over the triangle.
+		// It is raised by as much as snapping can have moved it, and read at the far corner.
+		const float z0 = z[CUBE_INDICES[triangle * 3]];
+		const float z1 = z[CUBE_INDICES[triangle * 3 + 1]];
+		const float z2 = z[CUBE_INDICES[triangle * 3 + 2]];
+		out.zdx = ((z1 - z0) * (out.y[2] - out.y[0]) - (z2 - z0) * (out.y[1] - out.y[0])) / area;
+		out.zdy = ((out.x[1] - out.x[0]) * (z2 - z0) - (out.x[2] - out.x[0]) * (z1 - z0)) / area;
+		out.z0 = z0 + (std::fabs(out.zdx) + std::fabs(out.zdy)) * SNAP_ERROR;
+		out.depthCornerX = out.zdx > 0.0f ? 1.0f : 0.0f;
+		out.depthCornerY = out.zdy > 0.0f ? 1.0f : 0.0f;
+		++count;
+	}
+	return true;
+}
+
+void OcclusionBuffer::setupAll(const Matrix* pWorlds, size_t count, JobSystem* pJobs)
+{
+	m_triangles.resize(count * TRIANGLES_PER_CUBE);
+	m_cubeTriangleCounts.resize(count);
+	m_cubeDrawn.resize(count);
+
+	auto body = [this, pWorlds](size_t begin, size_t end)
+	{
+		for (size_t cube = begin; cube < end; ++cube)
+		{
+			m_cubeDrawn[cube] = setupCube(pWorlds[cube] * m_viewProjection, &m_triangles[cube * TRIANGLES_PER_CUBE], m_cubeTriangleCounts[cube]) ? 1 : 0;
+		}
+	};
+	if (pJobs)
+	{
+		JobCounter setUp;
+		pJobs->run(count, SETUP_GRAIN_SIZE, body, setUp);
+		pJobs->waitFor(setUp);
+	}
+	else
+	{
+		body(0, count);
+	}
+
+	m_triangleCount = 0;
+	m_skippedCount = 0;
+	for (size_t cube = 0; cube < count; ++cube)
+	{
+		m_triangleCount += m_cubeTriangleCounts[cube];
+		m_skippedCount += m_cubeDrawn[cube] ? 0 : 1;
+	}
+}
+
+void OcclusionBuffer::render(const Matrix& viewProjection, const Matrix* pWorlds, size_t count, JobSystem& jobs)
+{
+	PROFILE_ZONE("occlusion render");
+	m_viewProjection = viewProjection;
+	setupAll(pWorlds, count, &jobs);
+
+	JobCounter rasterized;
+	jobs.run(m_height / BAND_HEIGHT, 1, [this](size_t begin, size_t end)
+	{
+		for (size_t band = begin; band < end; ++band)
+		{
+			rasterizeBand(static_cast<unsigned int>(band) * BAND_HEIGHT, static_cast<unsigned int>(band + 1) * BAND_HEIGHT);
+		}
+	}, rasterized);
+	jobs.waitFor(rasterized);
+
+	buildPyramid();
+}
+
+void OcclusionBuffer::renderReference(const Matrix& viewProjection, const Matrix* pWorlds, size_t count)
+{
+	m_viewProjection = viewProjection;
+	setupAll(pWorlds, count, nullptr);
+
+	float* pDepth = m_levels[0].data();
+	std::fill(m_levels[0].begin(), m_levels[0].end(), 1.0f);
+	for (size_t cube = 0; cube < m_cubeTriangleCounts.size(); ++cube)
+	{
+		for (unsigned int triangle = 0; triangle < m_cubeTriangleCounts[cube]; ++triangle)
+		{
+			rasterizeReference(m_triangles[cube * TRIANGLES_PER_CUBE + triangle], pDepth);
+		}
+	}
+
+	buildPyramid();
+}
+
+void OcclusionBuffer::rasterizeBand(unsigned int firstRow, unsigned int endRow)
+{
+	float* pDepth = m_levels[0].data();
+	std::fill(pDepth + firstRow * m_width, pDepth + endRow * m_width, 1.0f);
+
+	const XMVECTOR laneOffsets = XMVectorSet(0.0f, 1.0f, 2.0f, 3.0f);
+	for (size_t cube = 0; cube < m_cubeTriangleCounts.size(); ++cube)
+	{
+		for (unsigned int index = 0; index < m_cubeTriangleCounts[cube]; ++index)
+		{
+			const Triangle& triangle = m_triangles[cube * TRIANGLES_PER_CUBE + index];
+			const int minY = std::max(triangle.minY, static_cast<int>(firstRow));
+			const int maxY = std::min(triangle.maxY, static_cast<int>(endRow) - 1);
+			if (minY > maxY)
+			{
+				continue;
+			}
+
+			float dx[3];
+			XMVECTOR fromX[3];
+			XMVECTOR dy[3];
+			XMVECTOR corners[3];
+			XMVECTOR margins[3];
+			for (int edge = 0; edge < 3; ++edge)
+			{
+				const int next = edge == 2 ? 0 : edge + 1;
+				dx[edge] = triangle.x[next] - triangle.x[edge];
+				fromX[edge] = XMVectorReplicate(triangle.x[edge]);
+				dy[edge] = XMVectorReplicate(triangle.y[next] - triangle.y[edge]);
+				corners[edge] = XMVectorAdd(laneOffsets, XMVectorReplicate(triangle.edgeCornerX[edge]));
+				margins[edge] = XMVectorReplicate(triangle.edgeMargin[edge]);
+			}
+			const XMVECTOR zdx = XMVectorReplicate(triangle.zdx);
+			const XMVECTOR depthCorners = XMVectorAdd(laneOffsets, XMVectorReplicate(triangle.depthCornerX));
+
+			for (int row = minY; row <= maxY; ++row)
+			{
+				XMVECTOR rowTerms[3];
+				for (int edge = 0; edge < 3; ++edge)
+				{
+					rowTerms[edge] = XMVectorReplicate((row + triangle.edgeCornerY[edge] - triangle.y[edge]) * dx[edge]);
+				}
+				const XMVECTOR rowDepth = XMVectorReplicate(triangle.z0 + triangle.zdy * (row + triangle.depthCornerY - triangle.y[0]));
+
+				float* pRow = pDepth + row * m_width;
+				for (int x = triangle.minX & ~static_cast<int>(LANE_COUNT - 1); x <= triangle.maxX; x += LANE_COUNT)
+				{
+					const XMVECTOR cellX = XMVectorReplicate(static_cast<float>(x));
+					XMVECTOR inside = XMVectorTrueInt();
+					for (int edge = 0; edge < 3; ++edge)
+					{
+						const XMVECTOR px = XMVectorAdd(corners[edge], cellX);
+						inside = XMVectorAndInt(inside, XMVectorGreaterOrEqual(XMVectorSubtract(rowTerms[edge], XMVectorMultiply(XMVectorSubtract(px, fromX[edge]), dy[edge])), margins[edge]));
+					}
+					if (XMVector4EqualInt(inside, XMVectorFalseInt()))
+					{
+						continue;
+					}
+
+					XMFLOAT4* pPixels = reinterpret_cast<XMFLOAT4*>(pRow + x);
+					const XMVECTOR depth = XMLoadFloat4(pPixels);
+					const XMVECTOR z = XMVectorAdd(XMVectorMultiply(XMVectorSubtract(XMVectorAdd(depthCorners, cellX), fromX[0]), zdx), rowDepth);
+					const XMVECTOR nearer = XMVectorAndInt(inside, XMVectorLess(z, depth));
+					XMStoreFloat4(pPixels, XMVectorSelect(depth, z, nearer));
+				}
+			}
+		}
+	}
+}
+
+void OcclusionBuffer::rasterizeReference(const Triangle& triangle, float* pDepth) const
+{
+	for (int row = triangle.minY; row <= triangle.maxY; ++row)
+	{
+		const float rowDepth = triangle.z0 + triangle.zdy * (row + triangle.depthCornerY - triangle.y[0]);
+		for (int x = triangle.minX; x <= triangle.maxX; ++x)
+		{
+			bool inside = true;
+			for (int edge = 0; edge < 3; ++edge)
+			{
+				const int next = edge == 2 ? 0 : edge + 1;
+				const float rowTerm = (row + triangle.edgeCornerY[edge] - triangle.y[edge]) * (triangle.x[next] - triangle.x[edge]);
+				const float px = x + triangle.edgeCornerX[edge];
+				inside = inside && edgeFunction(rowTerm, triangle.x[edge], triangle.y[next] - triangle.y[edge], px) >= triangle.edgeMargin[edge];
+			}
+
+			float& depth = pDepth[row * m_width + x];
+			const float z = (x + triangle.depthCornerX - triangle.x[0]) * triangle.zdx + rowDepth;
+			if (inside && z < depth)
+			{
+				depth = z;
+			}
+		}
+	}
+}
+
+void OcclusionBuffer::buildPyramid()
+{
+	for (size_t level = 1; level < m_levels.size(); ++level)
+	{
+		const Level& below = m_levelSizes[level - 1];
+		const Level& size = m_levelSizes[level];
+		const std::vector<float>& source = m_levels[level - 1];
+		std::vector<float>& target = m_levels[level];
+		for (unsigned int y = 0; y < size.height; ++y)
+		{
+			const unsigned int y0 = y * 2;
+			const unsigned int y1 = std::min(y0 + 1, below.height - 1);
+			for (unsigned int x = 0; x < size.width; ++x)
+			{
+				const unsigned int x0 = x * 2;
+				const unsigned int x1 = std::min(x0 + 1, below.width - 1);
+				target[y * size.width + x] = std::max(std::max(source[y0 * below.width + x0], source[y0 * below.width + x1]),
+					std::max(source[y1 * below.width + x0], source[y1 * below.width + x1]));
+			}
+		}
+	}
+}
+
+bool OcclusionBuffer::isOccluded(const Vector3& center, float radius) const
+{
+	// The box around the sphere covers its outline on screen, and its nearest corner is at
+	// least as near as any point of the sphere
+	float minX = static_cast<float>(m_width);
+	float maxX = 0.0f;
+	float minY = static_cast<float>(m_height);
+	float maxY = 0.0f;
+	float nearest = 1.0f;
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		const Vector4 point(center.x + ((corner & 1) ? radius : -radius), center.y + ((corner & 2) ? radius : -radius),
+			center.z + ((corner & 4) ? radius : -radius), 1.0f);
+		const Vector4 clip = Vector4::Transform(point, m_viewProjection);
+		if (clip.w <= 0.0f || clip.z < 0.0f)
+		{
+			return false;
+		}
+
+		const float inverseW = 1.0f / clip.w;
+		const float screenX = (clip.x * inverseW * 0.5f + 0.5f) * m_width;
+		const float screenY = (0.5f - clip.y * inverseW * 0.5f) * m_height;
+		minX = std::min(minX, screenX);
+		maxX = std::max(maxX, screenX);
+		minY = std::min(minY, screenY);
+		maxY = std::max(maxY, screenY);
+		nearest = std::min(nearest, clip.z * inverseW);
+	}
+
+	// Every pixel the bounds touch; the parts off screen cannot show anyway
+	const int x0 = std::max(static_cast<int>(std::floor(minX)), 0);
+	const int x1 = std::min(static_cast<int>(std::floor(maxX)), static_cast<int>(m_width) - 1);
+	const int y0 = std::max(static_cast<int>(std::floor(minY)), 0);
+	const int y1 = std::min(static_cast<int>(std::floor(maxY)), static_cast<int>(m_height) - 1);
+	if (x0 > x1 || y0 > y1)
+	{
+		return false;
+	}
+
+	// The finest level at which the bounds span at most four cells each way
+	size_t level = 0;
+	while (level + 1 < m_levels.size() && (((x1 >> level) - (x0 >> level)) >= 4 || ((y1 >> level) - (y0 >> level)) >= 4))
+	{
+		++level;
+	}
+
+	const std::vector<float>& cells = m_levels[level];
+	const unsigned int levelWidth = m_levelSizes[level].width;
+	for (int y = y0 >> level; y <= (y1 >> level); ++y)
+	{
+		for (int x = x0 >> level; x <= (x1 >> level); ++x)
+		{
+			if (cells[y * levelWidth + x] >= nearest)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+size_t OcclusionBuffer::cullOccluded(const Vector3* pCenters, float radius, int* pIndices, size_t count, JobSystem& jobs)
+{
+	PROFILE_ZONE("occlusion test");
+	m_occluded.resize(count);
+	JobCounter tested;
+	jobs.run(count, TEST_GRAIN_SIZE, [this, pCenters, radius, pIndices](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			m_occluded[i] = isOccluded(pCenters[pIndices[i]], radius) ? 1 : 0;
+		}
+	}, tested);
+	jobs.waitFor(tested);
+
+	size_t kept = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (!m_occluded[i])
+		{
+			pIndices[kept++] = pIndices[i];
+		}
+	}
+	return kept;
+}
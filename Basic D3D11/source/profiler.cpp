@@ -0,0 +1,177 @@
+#include "../include/profiler.h"
+
+#ifdef PROFILE
+
+#include "../include/jsonEscape.h"
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+namespace
+{
+	// Written only by the thread that owns it. head counts every event ever written, so the
+	// ring holds [head - EVENTS_PER_THREAD, head) once it has wrapped.
+	struct ThreadRing
+	{
+		ThreadRing(uint32_t id) : thread(id), head(0), cleared(0), depth(0), events(Profiler::EVENTS_PER_THREAD) {}
+
+		uint32_t thread;
+		std::string name;
+		std::atomic<uint64_t> head;
+
+		// head at the last clear(), which only collect() and clear() touch
+		uint64_t cleared;
+
+		uint32_t depth;
+		std::vector<Profiler::Event> events;
+	};
+
+	std::mutex g_ringMutex;
+	std::vector<std::unique_ptr<ThreadRing>> g_rings;
+
+	ThreadRing& getThreadRing()
+	{
+		thread_local ThreadRing* pRing = nullptr;
+		if (!pRing)
+		{
+			std::lock_guard<std::mutex> lock(g_ringMutex);
+			g_rings.emplace_back(new ThreadRing(static_cast<uint32_t>(g_rings.size())));
+			pRing = g_rings.back().get();
+		}
+		return *pRing;
+	}
+
+	void record(ThreadRing& ring, const char* name, uint64_t start, int64_t value, Profiler::EventKind kind, uint32_t depth)
+	{
+		const uint64_t head = ring.head.load(std::memory_order_relaxed);
+		Profiler::Event& event = ring.events[head & (Profiler::EVENTS_PER_THREAD - 1)];
+		event.name = name;
+		event.start = start;
+		event.value = value;
+		event.kind = kind;
+		event.depth = depth;
+		ring.head.store(head + 1, std::memory_order_release);
+	}
+}
+
+Profiler::Zone::Zone(const char* name)
+	: m_name(name)
+{
+	m_depth = getThreadRing().depth++;
+	m_start = now();
+}
+
+Profiler::Zone::~Zone()
+{
+	const uint64_t end = now();
+	ThreadRing& ring = getThreadRing();
+	--ring.depth;
+	record(ring, m_name, m_start, static_cast<int64_t>(end - m_start), EVENT_ZONE, m_depth);
+}
+
+void Profiler::recordCounter(const char* name, int64_t value)
+{
+	ThreadRing& ring = getThreadRing();
+	record(ring, name, now(), value, EVENT_COUNTER, ring.depth);
+}
+
+void Profiler::setThreadName(const char* name)
+{
+	ThreadRing& ring = getThreadRing();
+	std::lock_guard<std::mutex> lock(g_ringMutex);
+	ring.name = name;
+}
+
+uint64_t Profiler::now()
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void Profiler::collect(std::vector<ThreadEvents>& threads)
+{
+	std::lock_guard<std::mutex> lock(g_ringMutex);
+	threads.resize(g_rings.size());
+	for (size_t i = 0; i < g_rings.size(); ++i)
+	{
+		const ThreadRing& ring = *g_rings[i];
+		const uint64_t head = ring.head.load(std::memory_order_acquire);
+		const uint64_t first = std::max(ring.cleared, head > EVENTS_PER_THREAD ? head - EVENTS_PER_THREAD : 0);
+
+		ThreadEvents& thread = threads[i];
+		thread.thread = ring.thread;
+		thread.name = ring.name.empty() ? "thread " + std::to_string(ring.thread) : ring.name;
+		thread.dropped = first - ring.cleared;
+		thread.events.clear();
+		for (uint64_t event = first; event < head; ++event)
+		{
+			thread.events.push_back(ring.events[event & (EVENTS_PER_THREAD - 1)]);
+		}
+	}
+}
+
+bool Profiler::writeChromeTrace(const char* path)
+{
+	std::vector<ThreadEvents> threads;
+	collect(threads);
+
+	// Timestamps are in microseconds from the earliest event
+	uint64_t origin = ~0ull;
+	for (const ThreadEvents& thread : threads)
+	{
+		for (const Event& event : thread.events)
+		{
+			origin = std::min(origin, event.start);
+		}
+	}
+
+	FILE* pFile = fopen(path, "w");
+	if (!pFile)
+	{
+		return false;
+	}
+
+	fprintf(pFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first = true;
+	for (const ThreadEvents& thread : threads)
+	{
+		fprintf(pFile, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"", first ? "" : ",\n", thread.thread);
+		writeJsonEscaped(pFile, thread.name.c_str());
+		fprintf(pFile, "\"}}");
+		first = false;
+
+		for (const Event& event : thread.events)
+		{
+			fprintf(pFile, ",\n{\"name\":\"");
+			writeJsonEscaped(pFile, event.name);
+			if (event.kind == EVENT_ZONE)
+			{
+				fprintf(pFile, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"depth\":%u}}", thread.thread,
+					(event.start - origin) / 1000.0, event.value / 1000.0, event.depth);
+			}
+			else
+			{
+				// Counter tracks belong to the process, so one name is one track across threads
+				fprintf(pFile, "\",\"ph\":\"C\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"args\":{\"value\":%lld}}", thread.thread,
+					(event.start - origin) / 1000.0, static_cast<long long>(event.value));
+			}
+		}
+	}
+	fprintf(pFile, "\n]}\n");
+
+	const bool written = ferror(pFile) == 0;
+	return fclose(pFile) == 0 && written;
+}
+
+void Profiler::clear()
+{
+	std::lock_guard<std::mutex> lock(g_ringMutex);
+	for (const std::unique_ptr<ThreadRing>& ring : g_rings)
+	{
+		ring->cleared = ring->head.load(std::memory_order_acquire);
+	}
+}
+
+#endif
@@ -0,0 +1,41 @@
+#include "../include/randomStream.h"
+
+void RandomStream::fill(uint64_t seed, uint32_t stream, uint32_t firstCounter, uint32_t* pOut, size_t count)
+{
+	size_t i = 0;
+
+	// Draws before the first whole block
+	for (; i < count && ((firstCounter + i) & 3) != 0; ++i)
+	{
+		pOut[i] = generate(seed, stream, firstCounter + static_cast<uint32_t>(i));
+	}
+
+	for (; i + 4 <= count; i += 4)
+	{
+		philox4x32(seed, stream, (firstCounter + static_cast<uint32_t>(i)) >> 2, pOut + i);
+	}
+
+	for (; i < count; ++i)
+	{
+		pOut[i] = generate(seed, stream, firstCounter + static_cast<uint32_t>(i));
+	}
+}
+
+void RandomStream::fillFloat(uint64_t seed, uint32_t stream, uint32_t firstCounter, float min, float max, float* pOut, size_t count)
+{
+	// Raw bits go through a block on the stack; writing them into the float output and
+	// reading them back would break strict aliasing
+	const size_t BLOCK_SIZE = 256;
+	uint32_t bits[BLOCK_SIZE];
+
+	const float range = max - min;
+	for (size_t first = 0; first < count; first += BLOCK_SIZE)
+	{
+		const size_t blockCount = count - first < BLOCK_SIZE ? count - first : BLOCK_SIZE;
+		fill(seed, stream, firstCounter + static_cast<uint32_t>(first), bits, blockCount);
+		for (size_t i = 0; i < blockCount; ++i)
+		{
+			pOut[first + i] = min + range * toUnitFloat(bits[i]);
+		}
+	}
+}
@@ -0,0 +1,321 @@
+#include "../include/recordingRenderDevice.h"
+#include <string.h>
+#include <algorithm>
+
+RecordingRenderDevice::RecordingRenderDevice(size_t constantBufferAlignment, unsigned int frameLatency)
+	: m_constantBufferAlignment(constantBufferAlignment), m_frameLatency(frameLatency)
+{
+	for (int buffer = 0; buffer < RENDER_BUFFER_COUNT; ++buffer)
+	{
+		m_lastAppendOffsets[buffer] = 0;
+	}
+	clearState();
+	resetCounters();
+}
+
+void RecordingRenderDevice::attachRingBuffer(RenderBuffer buffer, size_t capacity)
+{
+	m_rings[buffer] = RingAllocator(capacity);
+	m_buffers[buffer].assign(capacity, 0);
+}
+
+void RecordingRenderDevice::clearState()
+{
+	++m_callCounts[RENDER_CALL_CLEAR_STATE];
+
+	memset(&m_state, 0, sizeof(m_state));
+	m_state.renderTarget = -1;
+	m_state.depthState = -1;
+	m_state.topology = -1;
+	m_state.layout = -1;
+	m_state.vertexShader = -1;
+	m_state.pixelShader = -1;
+	m_state.indexBuffer = -1;
+	m_state.viewport = -1;
+	for (unsigned int slot = 0; slot < VERTEX_SLOT_COUNT; ++slot)
+	{
+		m_state.vertexBuffer[slot] = -1;
+	}
+	for (unsigned int slot = 0; slot < CONSTANT_SLOT_COUNT; ++slot)
+	{
+		m_state.constantBuffer[slot] = -1;
+		m_constantRangeValid[slot] = true;
+	}
+}
+
+void RecordingRenderDevice::beginFrame()
+{
+	// Frames up to m_frame - m_frameLatency are done on the pretend GPU
+	if (m_frame >= m_frameLatency)
+	{
+		for (RingAllocator& ring : m_rings)
+		{
+			ring.retireFrames(m_frame - m_frameLatency);
+		}
+	}
+}
+
+void RecordingRenderDevice::endFrame()
+{
+	for (RingAllocator& ring : m_rings)
+	{
+		ring.endFrame(m_frame);
+	}
+	++m_frame;
+}
+
+void RecordingRenderDevice::updateBuffer(RenderBuffer buffer, const void* pData, size_t bytes)
+{
+	++m_callCounts[RENDER_CALL_UPDATE_BUFFER];
+	m_bytesUploaded += bytes;
+
+	std::vector<uint8_t>& contents = m_buffers[buffer];
+	contents.resize(bytes);
+	if (bytes > 0)
+	{
+		memcpy(contents.data(), pData, bytes);
+	}
+}
+
+bool RecordingRenderDevice::appendBuffer(RenderBuffer buffer, const void* pData, size_t elementBytes, size_t count, size_t stride, size_t& offset)
+{
+	RingAllocator& ring = m_rings[buffer];
+	const size_t bytes = count * stride;
+	if (count == 0 || bytes > ring.getCapacity() || elementBytes > stride || m_constantBufferAlignment == 0)
+	{
+		return false;
+	}
+
+	offset = ring.allocate(bytes, m_constantBufferAlignment);
+	if (offset == RingAllocator::INVALID_OFFSET)
+	{
+		// Discarding would also lose anything appended earlier this frame
+		if (ring.getFrameBytes() > 0)
+		{
+			return false;
+		}
+		ring.reset();
+		++m_discards;
+		offset = ring.allocate(bytes, m_constantBufferAlignment);
+		if (offset == RingAllocator::INVALID_OFFSET)
+		{
+			return false;
+		}
+	}
+
+	++m_callCounts[RENDER_CALL_APPEND_BUFFER];
+	m_bytesUploaded += count * elementBytes;
+	m_lastAppendOffsets[buffer] = offset;
+
+	const uint8_t* pSource = static_cast<const uint8_t*>(pData);
+	uint8_t* pDestination = m_buffers[buffer].data() + offset;
+	for (size_t i = 0; i < count; ++i)
+	{
+		memcpy(pDestination + i * stride, pSource + i * elementBytes, elementBytes);
+	}
+	return true;
+}
+
+void RecordingRenderDevice::setRenderTarget(RenderTarget target)
+{
+	++m_callCounts[RENDER_CALL_SET_RENDER_TARGET];
+	m_state.renderTarget = target;
+}
+
+void RecordingRenderDevice::setDepthStencilState(RenderDepthState state)
+{
+	++m_callCounts[RENDER_CALL_SET_DEPTH_STENCIL_STATE];
+	m_state.depthState = state;
+}
+
+void RecordingRenderDevice::setViewport(RenderViewport viewport)
+{
+	++m_callCounts[RENDER_CALL_SET_VIEWPORT];
+	m_state.viewport = viewport;
+}
+
+void RecordingRenderDevice::setPrimitiveTopology(RenderTopology topology)
+{
+	++m_callCounts[RENDER_CALL_SET_PRIMITIVE_TOPOLOGY];
+	m_state.topology = topology;
+}
+
+void RecordingRenderDevice::setInputLayout(RenderLayout layout)
+{
+	++m_callCounts[RENDER_CALL_SET_INPUT_LAYOUT];
+	m_state.layout = layout;
+}
+
+void RecordingRenderDevice::setVertexShader(RenderShader shader)
+{
+	++m_callCounts[RENDER_CALL_SET_VERTEX_SHADER];
+	m_state.vertexShader = shader;
+}
+
+void RecordingRenderDevice::setPixelShader(RenderShader shader)
+{
+	++m_callCounts[RENDER_CALL_SET_PIXEL_SHADER];
+	m_state.pixelShader = shader;
+}
+
+void RecordingRenderDevice::setVertexConstantBuffer(unsigned int slot, RenderBuffer buffer)
+{
+	++m_callCounts[RENDER_CALL_SET_VERTEX_CONSTANT_BUFFER];
+	if (slot < CONSTANT_SLOT_COUNT)
+	{
+		m_state.constantBuffer[slot] = buffer;
+		m_state.constantOffset[slot] = 0;
+		m_state.constantBytes[slot] = 0;
+		m_constantRangeValid[slot] = true;
+	}
+}
+
+void RecordingRenderDevice::setVertexConstantBufferRange(unsigned int slot, RenderBuffer buffer, size_t offset, size_t bytes)
+{
+	++m_callCounts[RENDER_CALL_SET_VERTEX_CONSTANT_BUFFER_RANGE];
+	if (slot < CONSTANT_SLOT_COUNT)
+	{
+		m_state.constantBuffer[slot] = buffer;
+		m_state.constantOffset[slot] = offset;
+		m_state.constantBytes[slot] = bytes;
+
+		const size_t alignment = m_constantBufferAlignment;
+		m_constantRangeValid[slot] = alignment > 0 && offset % alignment == 0 && bytes % alignment == 0 &&
+			bytes > 0 && offset + bytes <= m_rings[buffer].getCapacity();
+	}
+}
+
+void RecordingRenderDevice::setVertexBuffer(unsigned int slot, RenderBuffer buffer, unsigned int stride)
+{
+	++m_callCounts[RENDER_CALL_SET_VERTEX_BUFFER];
+	if (slot < VERTEX_SLOT_COUNT)
+	{
+		m_state.vertexBuffer[slot] = buffer;
+		m_state.vertexStride[slot] = stride;
+	}
+}
+
+void RecordingRenderDevice::setIndexBuffer(RenderBuffer buffer)
+{
+	++m_callCounts[RENDER_CALL_SET_INDEX_BUFFER];
+	m_state.indexBuffer = buffer;
+}
+
+void RecordingRenderDevice::drawIndexed(unsigned int indexCount)
+{
+	++m_callCounts[RENDER_CALL_DRAW_INDEXED];
+	++m_instancesDrawn;
+	(void)indexCount;
+	recordDraw();
+
+	bool rangesValid = true;
+	for (unsigned int slot = 0; slot < CONSTANT_SLOT_COUNT; ++slot)
+	{
+		rangesValid = rangesValid && m_constantRangeValid[slot];
+	}
+	if (!rangesValid || !isOutputBound())
+	{
+		++m_invalidDraws;
+	}
+}
+
+void RecordingRenderDevice::drawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount)
+{
+	++m_callCounts[RENDER_CALL_DRAW_INDEXED_INSTANCED];
+	m_instancesDrawn += instanceCount;
+	(void)indexCount;
+	recordDraw();
+
+	// The instanced layout reads one element per instance from slot 1
+	const bool layoutValid = m_state.layout == RENDER_LAYOUT_CUBE_INSTANCED;
+	const bool streamValid = m_state.vertexBuffer[1] >= 0 && m_state.vertexStride[1] > 0 &&
+		m_buffers[m_state.vertexBuffer[1]].size() >= static_cast<size_t>(instanceCount) * m_state.vertexStride[1];
+	if (!layoutValid || !streamValid || !isOutputBound())
+	{
+		++m_invalidDraws;
+	}
+}
+
+void RecordingRenderDevice::recordDraw()
+{
+	// FNV-1a over the bound state a word at a time, chained from one draw to the next so order
+	// matters too
+	static_assert(sizeof(BoundState) % sizeof(uint64_t) == 0, "BoundState is hashed in whole words");
+	uint64_t words[sizeof(BoundState) / sizeof(uint64_t)];
+	memcpy(words, &m_state, sizeof(words));
+	for (uint64_t word : words)
+	{
+		m_drawStateChecksum = (m_drawStateChecksum ^ word) * 1099511628211ull;
+	}
+
+	// Then the constants the draw can read, so uploads made in the wrong order show up too
+	for (unsigned int slot = 0; slot < CONSTANT_SLOT_COUNT; ++slot)
+	{
+		if (m_state.constantBuffer[slot] < 0)
+		{
+			continue;
+		}
+
+		const std::vector<uint8_t>& contents = m_buffers[m_state.constantBuffer[slot]];
+		const size_t begin = std::min(static_cast<size_t>(m_state.constantOffset[slot]), contents.size());
+		const size_t end = m_state.constantBytes[slot] > 0 ? std::min(begin + static_cast<size_t>(m_state.constantBytes[slot]), contents.size()) : contents.size();
+		size_t i = begin;
+		for (; i + sizeof(uint64_t) <= end; i += sizeof(uint64_t))
+		{
+			uint64_t word;
+			memcpy(&word, &contents[i], sizeof(word));
+			m_drawStateChecksum = (m_drawStateChecksum ^ word) * 1099511628211ull;
+		}
+		for (; i < end; ++i)
+		{
+			m_drawStateChecksum = (m_drawStateChecksum ^ contents[i]) * 1099511628211ull;
+		}
+	}
+}
+
+void RecordingRenderDevice::resetCounters()
+{
+	for (int call = 0; call < RENDER_CALL_COUNT; ++call)
+	{
+		m_callCounts[call] = 0;
+	}
+	m_bytesUploaded = 0;
+	m_instancesDrawn = 0;
+	m_invalidDraws = 0;
+	m_discards = 0;
+	m_drawStateChecksum = 14695981039346656037ull;
+}
+
+uint64_t RecordingRenderDevice::getTotalCallCount() const
+{
+	uint64_t total = 0;
+	for (int call = 0; call < RENDER_CALL_COUNT; ++call)
+	{
+		total += m_callCounts[call];
+	}
+	return total;
+}
+
+const char* RecordingRenderDevice::getCallName(RenderCall call)
+{
+	switch (call)
+	{
+	case RENDER_CALL_UPDATE_BUFFER: return "UpdateSubresource/Map";
+	case RENDER_CALL_APPEND_BUFFER: return "Map(NO_OVERWRITE)";
+	case RENDER_CALL_CLEAR_STATE: return "ClearState";
+	case RENDER_CALL_SET_RENDER_TARGET: return "OMSetRenderTargets";
+	case RENDER_CALL_SET_DEPTH_STENCIL_STATE: return "OMSetDepthStencilState";
+	case RENDER_CALL_SET_VIEWPORT: return "RSSetViewports";
+	case RENDER_CALL_SET_PRIMITIVE_TOPOLOGY: return "IASetPrimitiveTopology";
+	case RENDER_CALL_SET_INPUT_LAYOUT: return "IASetInputLayout";
+	case RENDER_CALL_SET_VERTEX_SHADER: return "VSSetShader";
+	case RENDER_CALL_SET_PIXEL_SHADER: return "PSSetShader";
+	case RENDER_CALL_SET_VERTEX_CONSTANT_BUFFER: return "VSSetConstantBuffers";
+	case RENDER_CALL_SET_VERTEX_CONSTANT_BUFFER_RANGE: return "VSSetConstantBuffers1";
+	case RENDER_CALL_SET_VERTEX_BUFFER: return "IASetVertexBuffers";
+	case RENDER_CALL_SET_INDEX_BUFFER: return "IASetIndexBuffer";
+	case RENDER_CALL_DRAW_INDEXED: return "DrawIndexed";
+	case RENDER_CALL_DRAW_INDEXED_INSTANCED: return "DrawIndexedInstanced";
+	default: return "unknown";
+	}
+}
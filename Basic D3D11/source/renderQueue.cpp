@@ -0,0 +1,171 @@
+#include "../include/renderQueue.h"
+#include "../include/profiler.h"
+#include <string.h>
+#include <algorithm>
+
+using namespace DirectX::SimpleMath;
+
+namespace
+{
+	const unsigned int RADIX_SIZE = 1u << RenderQueue::RADIX_BITS;
+
+	inline uint64_t field(unsigned int value, unsigned int bits)
+	{
+		return value & ((1ull << bits) - 1);
+	}
+}
+
+uint64_t RenderQueue::makeKey(Pass pass, unsigned int shader, unsigned int material, float depth)
+{
+	const uint32_t depthMax = (1u << DEPTH_BITS) - 1;
+	depth = std::min(std::max(depth, 0.0f), 1.0f);
+
+	// In float, depthMax + 0.5 rounds up to 2^DEPTH_BITS and would spill into the material
+	uint32_t quantized = std::min(static_cast<uint32_t>(depth * static_cast<double>(depthMax) + 0.5), depthMax);
+	if (pass == PASS_TRANSPARENT)
+	{
+		quantized = depthMax - quantized;
+	}
+
+	return (field(pass, PASS_BITS) << (SHADER_BITS + MATERIAL_BITS + DEPTH_BITS)) | (field(shader, SHADER_BITS) << (MATERIAL_BITS + DEPTH_BITS)) |
+		(field(material, MATERIAL_BITS) << DEPTH_BITS) | quantized;
+}
+
+void RenderQueue::reserve(size_t count)
+{
+	m_entries.reserve(count);
+	m_scratch.reserve(count);
+}
+
+void RenderQueue::push(uint64_t key, uint32_t item)
+{
+	Entry entry;
+	entry.key = key;
+	entry.item = item;
+	m_entries.push_back(entry);
+}
+
+void RenderQueue::pushOpaque(const Matrix& viewProjection, float farPlane, unsigned int shader, unsigned int material, const Vector3* pCenters,
+	const int* pIndices, size_t count)
+{
+	// Clip-space w is the distance in front of the camera
+	const float scale = 1.0f / farPlane;
+	m_entries.reserve(m_entries.size() + count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		const Vector3& center = pCenters[pIndices[i]];
+		const float viewDepth = center.x * viewProjection._14 + center.y * viewProjection._24 + center.z * viewProjection._34 + viewProjection._44;
+		push(makeKey(PASS_OPAQUE, shader, material, viewDepth * scale), static_cast<uint32_t>(pIndices[i]));
+	}
+}
+
+void RenderQueue::sort()
+{
+	sortEntries(nullptr);
+}
+
+void RenderQueue::sort(JobSystem& jobs)
+{
+	sortEntries(&jobs);
+}
+
+void RenderQueue::sortEntries(JobSystem* pJobs)
+{
+	PROFILE_ZONE("sort draws");
+	m_lastPassCount = 0;
+	const size_t count = m_entries.size();
+	if (count < 2)
+	{
+		return;
+	}
+
+	// Blocks depend only on the count, and the result of a stable sort is unique anyway
+	const size_t blockCount = pJobs ? std::min(std::max<size_t>(count / SORT_BLOCK_SIZE, 1), MAX_SORT_BLOCKS) : 1;
+	auto forEachBlock = [pJobs, blockCount](const JobSystem::RangeFunction& body)
+	{
+		if (blockCount > 1)
+		{
+			JobCounter done;
+			pJobs->run(blockCount, 1, body, done);
+			pJobs->waitFor(done);
+		}
+		else
+		{
+			body(0, blockCount);
+		}
+	};
+
+	// Digits in which every key is the same would leave the order as it is, so find the bits
+	// that differ first and only count and scatter on the digits holding them
+	uint64_t anyBits = 0;
+	uint64_t allBits = ~0ull;
+	for (const Entry& entry : m_entries)
+	{
+		anyBits |= entry.key;
+		allBits &= entry.key;
+	}
+	const uint64_t differing = anyBits ^ allBits;
+
+	m_scratch.resize(count);
+	m_blockCounts.resize(blockCount * RADIX_SIZE);
+	for (unsigned int shift = 0; shift < 64; shift += RADIX_BITS)
+	{
+		if (((differing >> shift) & (RADIX_SIZE - 1)) == 0)
+		{
+			continue;
+		}
+
+		// Each block counts its own digits, then scatters from where the digits of the blocks
+		// before it end, so the entries keep their order within each digit
+		forEachBlock([this, shift, count, blockCount](size_t begin, size_t end)
+		{
+			for (size_t block = begin; block < end; ++block)
+			{
+				uint32_t* pCounts = &m_blockCounts[block * RADIX_SIZE];
+				std::fill(pCounts, pCounts + RADIX_SIZE, 0);
+				const Entry* pEntries = m_entries.data();
+				for (size_t i = count * block / blockCount; i < count * (block + 1) / blockCount; ++i)
+				{
+					++pCounts[(pEntries[i].key >> shift) & (RADIX_SIZE - 1)];
+				}
+			}
+		});
+
+		uint32_t offset = 0;
+		for (unsigned int digit = 0; digit < RADIX_SIZE; ++digit)
+		{
+			for (size_t block = 0; block < blockCount; ++block)
+			{
+				uint32_t& slot = m_blockCounts[block * RADIX_SIZE + digit];
+				const uint32_t digitCount = slot;
+				slot = offset;
+				offset += digitCount;
+			}
+		}
+
+		forEachBlock([this, shift, count, blockCount](size_t begin, size_t end)
+		{
+			for (size_t block = begin; block < end; ++block)
+			{
+				uint32_t* pOffsets = &m_blockCounts[block * RADIX_SIZE];
+				const Entry* pEntries = m_entries.data();
+				Entry* pTarget = m_scratch.data();
+				for (size_t i = count * block / blockCount; i < count * (block + 1) / blockCount; ++i)
+				{
+					pTarget[pOffsets[(pEntries[i].key >> shift) & (RADIX_SIZE - 1)]++] = pEntries[i];
+				}
+			}
+		});
+		m_entries.swap(m_scratch);
+		++m_lastPassCount;
+	}
+}
+
+void RenderQueue::getItems(std::vector<int>& items) const
+{
+	items.resize(m_entries.size());
+	for (size_t i = 0; i < m_entries.size(); ++i)
+	{
+		items[i] = static_cast<int>(m_entries[i].item);
+	}
+}
@@ -0,0 +1,81 @@
+#include "../include/ringAllocator.h"
+#include <assert.h>
+
+RingAllocator::RingAllocator(size_t capacity)
+	: m_capacity(capacity), m_head(0), m_tail(0), m_used(0), m_frameBytes(0)
+{
+}
+
+size_t RingAllocator::allocate(size_t bytes, size_t alignment)
+{
+	assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+	if (bytes == 0 || bytes > m_capacity)
+	{
+		return INVALID_OFFSET;
+	}
+
+	// Nothing live, so start again from the front rather than wrap part way through
+	if (m_used == 0)
+	{
+		m_head = 0;
+		m_tail = 0;
+	}
+
+	size_t offset = (m_head + alignment - 1) & ~(alignment - 1);
+	if (m_head < m_tail)
+	{
+		// Already wrapped: the only free space is between the head and the tail
+		if (offset > m_tail || m_tail - offset < bytes)
+		{
+			return INVALID_OFFSET;
+		}
+	}
+	else if (m_used > 0 && m_head == m_tail)
+	{
+		return INVALID_OFFSET;
+	}
+	else if (offset > m_capacity || m_capacity - offset < bytes)
+	{
+		// Not enough room before the end, so wrap to the front if the tail has moved far enough
+		if (m_tail < bytes)
+		{
+			return INVALID_OFFSET;
+		}
+		offset = 0;
+	}
+
+	// Alignment padding, and the tail of the buffer skipped when wrapping, stay with this frame
+	const size_t consumed = (offset >= m_head ? offset - m_head : m_capacity - m_head) + bytes;
+	m_used += consumed;
+	m_frameBytes += consumed;
+	m_head = offset + bytes;
+	return offset;
+}
+
+void RingAllocator::endFrame(uint64_t frame)
+{
+	assert(m_frames.empty() || m_frames.back().id < frame);
+	Frame closed = { frame, m_frameBytes };
+	m_frames.push_back(closed);
+	m_frameBytes = 0;
+}
+
+void RingAllocator::retireFrames(uint64_t completedFrame)
+{
+	while (!m_frames.empty() && m_frames.front().id <= completedFrame)
+	{
+		const size_t bytes = m_frames.front().bytes;
+		m_frames.pop_front();
+		m_used -= bytes;
+		m_tail = m_capacity > 0 ? (m_tail + bytes) % m_capacity : 0;
+	}
+}
+
+void RingAllocator::reset()
+{
+	m_head = 0;
+	m_tail = 0;
+	m_used = 0;
+	m_frameBytes = 0;
+	m_frames.clear();
+}
@@ -0,0 +1,436 @@
+// *************************************************************************************
+// File: simpleMathBenchmark.cpp
+//
+// Times the SimpleMath operations the cube loop leans on, each wrapping DirectXMath in
+// XMLoad/XMStore round trips, to put numbers on what those cost.
+//
+// Usage: SimpleMathBenchmark [--runs=N] [--run-ms=N] [--cpu=N] [--seed=N] [--json=path] [name...]
+//        --runs=N    timed runs of each operation; the median is reported (15)
+//        --run-ms=N  shortest run, in milliseconds; batches are doubled until a run
+//                    takes at least this long (20)
+//        --cpu=N     CPU to pin the thread to, -1 for the one it starts on (-1)
+//        --seed=N    seed of the inputs, fixed so runs can be compared (1)
+//        --json=path also write every run to a BenchmarkReport, for BenchmarkCompare
+//        name        only run operations whose name contains one of these
+//
+// Each operation runs over BATCH_SIZE different inputs from a RandomStream and writes every
+// result, so nothing folds to a constant. The thread is pinned and each operation warmed up
+// for a run before timing. ns/op is the median over runs. The spread is the median absolute
+// deviation from it, as a percentage; rerun anything whose spread is more than a few percent.
+// *************************************************************************************
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#elif defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+#include <DirectXMath.h>
+#include "../SimpleMath.h"
+#include "../include/benchmarkReport.h"
+#include "../include/randomStream.h"
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+namespace
+{
+	// Inputs per batch: 1024 matrices of each operand fit in L2, so this times the maths and
+	// not the memory
+	const size_t BATCH_SIZE = 1024;
+
+	// Results of every run are folded in here so the compiler must compute them
+	volatile float g_sink;
+
+	struct Benchmark
+	{
+		const char* name;
+
+		// Runs the operation over every input once and returns one of its results
+		std::function<float()> runBatch;
+	};
+
+	struct Inputs
+	{
+		std::vector<Matrix> matrices[2];
+		std::vector<float> angles;
+		std::vector<Vector3> positions;
+		std::vector<Vector3> directions;
+		std::vector<Quaternion> quaternions[2];
+		std::vector<float> fractions;
+		std::vector<Ray> rays;
+		std::vector<BoundingSphere> spheres;
+		std::vector<BoundingBox> boxes;
+		std::vector<Vector3> triangles;
+		std::vector<Plane> planes;
+	};
+
+	Vector3 randomUnit(RandomStream& random)
+	{
+		Vector3 v(random.nextFloat(-1.0f, 1.0f), random.nextFloat(-1.0f, 1.0f), random.nextFloat(-1.0f, 1.0f));
+		v.Normalize();
+		return v;
+	}
+
+	// Rays start around the origin and point towards the shapes about ten units out, so about
+	// half of them hit
+	void generateInputs(uint64_t seed, Inputs& inputs)
+	{
+		RandomStream random(seed, 0);
+		for (size_t i = 0; i < BATCH_SIZE; ++i)
+		{
+			const Vector3 rotation(random.nextFloat(-3.14f, 3.14f), random.nextFloat(-3.14f, 3.14f), random.nextFloat(-3.14f, 3.14f));
+			const Vector3 translation(random.nextFloat(-10.0f, 10.0f), random.nextFloat(-10.0f, 10.0f), random.nextFloat(-10.0f, 10.0f));
+			inputs.matrices[i & 1].push_back(Matrix::CreateFromEulerTranslation(rotation, translation));
+			inputs.matrices[(i & 1) ^ 1].push_back(Matrix::CreateFromEulerTranslation(translation * 0.1f, rotation));
+
+			inputs.angles.push_back(random.nextFloat(-6.28f, 6.28f));
+			inputs.positions.push_back(translation);
+			inputs.directions.push_back(randomUnit(random));
+			for (int q = 0; q < 2; ++q)
+			{
+				Quaternion quaternion(random.nextFloat(-1.0f, 1.0f), random.nextFloat(-1.0f, 1.0f), random.nextFloat(-1.0f, 1.0f), random.nextFloat(-1.0f, 1.0f));
+				quaternion.Normalize();
+				inputs.quaternions[q].push_back(quaternion);
+			}
+			inputs.fractions.push_back(random.nextFloat());
+
+			const Vector3 target = randomUnit(random) * 10.0f;
+			const Vector3 origin(random.nextFloat(-1.0f, 1.0f), random.nextFloat(-1.0f, 1.0f), random.nextFloat(-1.0f, 1.0f));
+			Vector3 aim = target + randomUnit(random) * 3.0f - origin;
+			aim.Normalize();
+			inputs.rays.push_back(Ray(origin, aim));
+
+			BoundingSphere sphere;
+			sphere.Center = target;
+			sphere.Radius = random.nextFloat(1.0f, 3.0f);
+			inputs.spheres.push_back(sphere);
+
+			BoundingBox box;
+			box.Center = target;
+			box.Extents = XMFLOAT3(random.nextFloat(0.5f, 2.0f), random.nextFloat(0.5f, 2.0f), random.nextFloat(0.5f, 2.0f));
+			inputs.boxes.push_back(box);
+
+			for (int corner = 0; corner < 3; ++corner)
+			{
+				inputs.triangles.push_back(target + randomUnit(random) * 3.0f);
+			}
+
+			const Vector3 normal = randomUnit(random);
+			inputs.planes.push_back(Plane(normal.x, normal.y, normal.z, -normal.Dot(target)));
+		}
+	}
+
+	double elapsedNs(const std::chrono::high_resolution_clock::time_point& start)
+	{
+		const auto end = std::chrono::high_resolution_clock::now();
+		return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+	}
+
+	double timeRun(const Benchmark& benchmark, size_t batches)
+	{
+		float sink = 0.0f;
+		const auto start = std::chrono::high_resolution_clock::now();
+		for (size_t batch = 0; batch < batches; ++batch)
+		{
+			sink += benchmark.runBatch();
+		}
+		const double ns = elapsedNs(start);
+		g_sink = g_sink + sink;
+		return ns;
+	}
+
+	// Doubles the batches per run until a run takes runMs, warms up with one more run and
+	// then times runCount runs, returning the ns/op of each
+	std::vector<double> runBenchmark(const Benchmark& benchmark, int runCount, double runMs)
+	{
+		size_t batches = 1;
+		while (timeRun(benchmark, batches) < runMs * 1.0e6 && batches < (1u << 30))
+		{
+			batches *= 2;
+		}
+		timeRun(benchmark, batches);
+
+		const double ops = static_cast<double>(batches * BATCH_SIZE);
+		std::vector<double> nsPerOp(runCount);
+		for (int run = 0; run < runCount; ++run)
+		{
+			nsPerOp[run] = timeRun(benchmark, batches) / ops;
+		}
+		return nsPerOp;
+	}
+
+	// Pins the calling thread to cpu, or to the CPU it is on when cpu is negative. Returns the
+	// CPU it was pinned to, or -1 where that is not supported or was refused.
+	int pinThread(int cpu)
+	{
+#if defined(__linux__)
+		if (cpu < 0)
+		{
+			cpu = sched_getcpu();
+		}
+		if (cpu < 0 || cpu >= CPU_SETSIZE)
+		{
+			return -1;
+		}
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		return sched_setaffinity(0, sizeof(set), &set) == 0 ? cpu : -1;
+#elif defined(_WIN32)
+		if (cpu < 0)
+		{
+			cpu = static_cast<int>(GetCurrentProcessorNumber());
+		}
+		if (cpu >= 64)
+		{
+			return -1;
+		}
+		return SetThreadAffinityMask(GetCurrentThread(), 1ull << cpu) != 0 ? cpu : -1;
+#else
+		return -1;
+#endif
+	}
+
+	void addBenchmarks(const Inputs& in, std::vector<Matrix>& matrixOut, std::vector<Vector3>& vectorOut, std::vector<Quaternion>& quaternionOut,
+		std::vector<Benchmark>& benchmarks)
+	{
+		const Vector3 up(0.0f, 1.0f, 0.0f);
+		const Matrix& transform = in.matrices[0][0];
+
+		benchmarks.push_back({ "Matrix * Matrix", [&]()
+		{
+			for (size_t i = 0; i < BATCH_SIZE; ++i)
+			{
+				matrixOut[i] = in.matrices[0][i] * in.matrices[1][i];
+			}
+			return matrixOut[BATCH_SIZE - 1]._41;
+		} });
+		benchmarks.push_back({ "Matrix::Transpose", [&]()
+		{
+			for (size_t i = 0; i < BATCH_SIZE; ++i)
+			{
+				matrixOut[i] = in.matrices[0][i].Transpose();
+			}
+			return matrixOut[BATCH_SIZE - 1]._14;
+		} });
+		benchmarks.push_back({ "Matrix::CreateRotationX", [&]()
+		{
+			for (size_t i = 0; i < BATCH_SIZE; ++i)
+			{
+				matrixOut[i] = Matrix::CreateRotationX(in.angles[i]);
+			}
+			return matrixOut[BATCH_SIZE - 1]._23;
+		} });
+		benchmarks.push_back({ "Matrix::CreateRotationY", [&]()
+		{
+			for (size_t i = 0; i < BATCH_SIZE; ++i)
+			{
+				matrixOut[i] = Matrix::CreateRotationY(in.angles[i]);
+			}
+			return matrixOut[BATCH_SIZE - 1]._13;
+		} });
+		benchmarks.push_back({ "Matrix::CreateRotationZ", [&]()
+		{
+			for (size_t i = 0; i < BATCH_SIZE; ++i)
+			{
+				matrixOut[i] = Matrix::CreateRotationZ(in.angles[i]);
+			}
+			return matrixOut[BATCH_SIZE - 1]._12;
+		} });
+		benchmarks.push_back({ "Matrix::CreateWorld", [&in, &matrixOut, up]()
+		{
+			for (size_t i = 0; i < BATCH_SIZE; ++i)
+			{
+				matrixOut[i] = Matrix::CreateWorld(in.positions[i], in.directions[i], up);
+			}
+			return matrixOut[BATCH_SIZE - 1]._31;
+		} });
+		benchmarks.push_back({ "Matrix::CreateLookAt", [&in, &matrixOut, up]()
+		{
+			for (size_t i = 0; i < BATCH_SIZE; ++i)
+			{
+				matrixOut[i] = Matrix::CreateLookAt(in.positions[i], in.positions[i] + in.directions[i], up);
+			}
+			return matrixOut[BATCH_SIZE - 1]._43;
+		} });
+		benchmarks.push_back({ "Vector3::Transform", [&in, &vectorOut, &transform]()
+		{
+			for (size_t i = 0; i < BATCH_SIZE; ++i)
+			{
+				vectorOut[i] = Vector3::Transform(in.positions[i], transform);
+			}
+			return vectorOut[BATCH_SIZE - 1].x;
+		} });
+		benchmarks.push_back({ "Vector3::Transform array", [&in, &vectorOut, &transform]()
+		{
+			Vector3::Transform(in.positions.data(), BATCH_SIZE, transform, vectorOut.data());
+			return vectorOut[BATCH_SIZE - 1].x;
+		} });
+		benchmarks.push_back({ "Quaternion::Slerp", [&]()
+		{
+			for (size_t i = 0; i < BATCH_SIZE; ++i)
+			{
+				quaternionOut[i] = Quaternion::Slerp(in.quaternions[0][i], in.quaternions[1][i], in.fractions[i]);
+			}
+			return quaternionOut[BATCH_SIZE - 1].w;
+		} });
+
+		// Misses leave their distance at 0, so the sum counts every hit
+		benchmarks.push_back({ "Ray::Intersects sphere", [&in]()
+		{
+			float total = 0.0f;
+			for (size_t i = 0; i < BATCH_SIZE; ++i)
+			{
+				float distance = 0.0f;
+				total += in.rays[i].Intersects(in.spheres[i], distance) ? distance : 0.0f;
+			}
+			return total;
+		} });
+		benchmarks.push_back({ "Ray::Intersects box", [&in]()
+		{
+			float total = 0.0f;
+			for (size_t i = 0; i < BATCH_SIZE; ++i)
+			{
+				float distance = 0.0f;
+				total += in.rays[i].Intersects(in.boxes[i], distance) ? distance : 0.0f;
+			}
+			return total;
+		} });
+		benchmarks.push_back({ "Ray::Intersects triangle", [&in]()
+		{
+			float total = 0.0f;
+			for (size_t i = 0; i < BATCH_SIZE; ++i)
+			{
+				float distance = 0.0f;
+				total += in.rays[i].Intersects(in.triangles[3 * i], in.triangles[3 * i + 1], in.triangles[3 * i + 2], distance) ? distance : 0.0f;
+			}
+			return total;
+		} });
+		benchmarks.push_back({ "Ray::Intersects plane", [&in]()
+		{
+			float total = 0.0f;
+			for (size_t i = 0; i < BATCH_SIZE; ++i)
+			{
+				float distance = 0.0f;
+				total += in.rays[i].Intersects(in.planes[i], distance) ? distance : 0.0f;
+			}
+			return total;
+		} });
+	}
+
+	bool parseOption(const char* argument, const char* prefix, long long& value)
+	{
+		const size_t prefixLength = strlen(prefix);
+		if (strncmp(argument, prefix, prefixLength) != 0)
+		{
+			return false;
+		}
+		char* pEnd = nullptr;
+		value = strtoll(argument + prefixLength, &pEnd, 10);
+		return pEnd != argument + prefixLength && *pEnd == '\0';
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	long long runCount = 15;
+	long long runMs = 20;
+	long long cpu = -1;
+	long long seed = 1;
+	std::string jsonPath;
+	std::vector<std::string> filters;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strncmp(argv[i], "--json=", 7) == 0 && argv[i][7] != '\0')
+		{
+			jsonPath = argv[i] + 7;
+			continue;
+		}
+		if (parseOption(argv[i], "--runs=", runCount) || parseOption(argv[i], "--run-ms=", runMs) || parseOption(argv[i], "--cpu=", cpu) ||
+			parseOption(argv[i], "--seed=", seed))
+		{
+			continue;
+		}
+		if (argv[i][0] == '-')
+		{
+			fprintf(stderr, "unknown argument '%s'\n", argv[i]);
+			fprintf(stderr, "usage: %s [--runs=N] [--run-ms=N] [--cpu=N] [--seed=N] [--json=path] [name...]\n", argv[0]);
+			return 1;
+		}
+		filters.push_back(argv[i]);
+	}
+	if (runCount < 1 || runMs < 1)
+	{
+		fprintf(stderr, "--runs and --run-ms must be at least 1\n");
+		return 1;
+	}
+
+	const int pinned = pinThread(static_cast<int>(cpu));
+
+	Inputs inputs;
+	generateInputs(static_cast<uint64_t>(seed), inputs);
+	std::vector<Matrix> matrixOut(BATCH_SIZE);
+	std::vector<Vector3> vectorOut(BATCH_SIZE);
+	std::vector<Quaternion> quaternionOut(BATCH_SIZE);
+	std::vector<Benchmark> benchmarks;
+	addBenchmarks(inputs, matrixOut, vectorOut, quaternionOut, benchmarks);
+
+	if (pinned >= 0)
+	{
+		printf("pinned to cpu %d", pinned);
+	}
+	else
+	{
+		printf("not pinned");
+	}
+	printf("  runs: %lld of at least %lld ms  batch: %zu  seed: %lld\n", runCount, runMs, BATCH_SIZE, seed);
+	printf("%-26s %10s %10s %8s %10s\n", "operation", "ns/op", "min ns/op", "spread", "Mops/s");
+
+	BenchmarkReport report("simpleMath");
+	report.setProperty("runs", static_cast<double>(runCount));
+	report.setProperty("run ms", static_cast<double>(runMs));
+	report.setProperty("batch", static_cast<double>(BATCH_SIZE));
+	report.setProperty("seed", std::to_string(seed));
+	report.setProperty("pinned", pinned >= 0 ? "yes" : "no");
+
+	for (const Benchmark& benchmark : benchmarks)
+	{
+		bool selected = filters.empty();
+		for (const std::string& filter : filters)
+		{
+			selected = selected || strstr(benchmark.name, filter.c_str()) != nullptr;
+		}
+		if (!selected)
+		{
+			continue;
+		}
+
+		const std::vector<double> nsPerOp = runBenchmark(benchmark, static_cast<int>(runCount), static_cast<double>(runMs));
+		for (double sample : nsPerOp)
+		{
+			report.addSample(benchmark.name, "ns/op", sample);
+		}
+		const BenchmarkReport::Metric& metric = *report.findMetric(benchmark.name);
+		const double median = metric.getMedian();
+		printf("%-26s %10.3f %10.3f %7.2f%% %10.1f\n", benchmark.name, median, *std::min_element(nsPerOp.begin(), nsPerOp.end()),
+			100.0 * metric.getMad() / median, 1.0e3 / median);
+		fflush(stdout);
+	}
+
+	if (!jsonPath.empty() && !report.write(jsonPath.c_str()))
+	{
+		fprintf(stderr, "cannot write %s\n", jsonPath.c_str());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,265 @@
+#include "../include/simulationConfig.h"
+#include "../include/randomStream.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+
+using namespace DirectX::SimpleMath;
+
+namespace
+{
+	std::string trim(const std::string& text)
+	{
+		const char* whitespace = " \t\r\n";
+		const size_t first = text.find_first_not_of(whitespace);
+		if (first == std::string::npos)
+		{
+			return std::string();
+		}
+		return text.substr(first, text.find_last_not_of(whitespace) - first + 1);
+	}
+
+	bool parseUnsigned(const std::string& text, unsigned long long& value)
+	{
+		if (text.empty() || text[0] == '-')
+		{
+			return false;
+		}
+
+		// Accept 1e6 as well as 1000000, since cube counts are easier to read that way
+		char* pEnd = nullptr;
+		errno = 0;
+		value = strtoull(text.c_str(), &pEnd, 10);
+		if (errno == 0 && *pEnd == '\0')
+		{
+			return true;
+		}
+
+		const double number = strtod(text.c_str(), &pEnd);
+		if (*pEnd != '\0' || !(number >= 0.0) || number > 1.8e19 || number != static_cast<double>(static_cast<unsigned long long>(number)))
+		{
+			return false;
+		}
+		value = static_cast<unsigned long long>(number);
+		return true;
+	}
+
+	bool isSetting(const std::string& name)
+	{
+		return name == "cubes" || name == "seed" || name == "spawn-min" || name == "spawn-max" || name == "step-rate" || name == "threads" || name == "instanced" ||
+			name == "deferred" || name == "occluders";
+	}
+
+	bool parseFloat(const std::string& text, double& value)
+	{
+		char* pEnd = nullptr;
+		value = strtod(text.c_str(), &pEnd);
+		return !text.empty() && *pEnd == '\0' && std::isfinite(value);
+	}
+
+	bool parseVector3(const std::string& text, Vector3& value)
+	{
+		float components[3];
+		size_t start = 0;
+		for (int i = 0; i < 3; ++i)
+		{
+			const size_t comma = text.find(',', start);
+			if ((i < 2) != (comma != std::string::npos))
+			{
+				return false;
+			}
+
+			double component;
+			if (!parseFloat(trim(text.substr(start, comma == std::string::npos ? std::string::npos : comma - start)), component))
+			{
+				return false;
+			}
+			components[i] = static_cast<float>(component);
+			start = comma + 1;
+		}
+
+		value = Vector3(components[0], components[1], components[2]);
+		return true;
+	}
+}
+
+SimulationConfig::SimulationConfig()
+	: cubeCount(100), seed(static_cast<uint64_t>(time(0))), spawnMin(-10.0f, 0.0f, 0.0f), spawnMax(10.0f, 0.0f, 0.0f),
+	stepRate(60.0), threadCount(0), instanced(true), deferredContexts(0), occluderCount(256)
+{
+}
+
+bool applySetting(const std::string& name, const std::string& value, SimulationConfig& config, std::string& error)
+{
+	bool valid = false;
+	unsigned long long number = 0;
+	double real = 0.0;
+	if (name == "cubes")
+	{
+		valid = parseUnsigned(value, number) && number > 0 && number <= MAX_CUBE_COUNT;
+		if (valid)
+		{
+			config.cubeCount = static_cast<size_t>(number);
+		}
+	}
+	else if (name == "seed")
+	{
+		valid = parseUnsigned(value, number);
+		if (valid)
+		{
+			config.seed = number;
+		}
+	}
+	else if (name == "spawn-min")
+	{
+		valid = parseVector3(value, config.spawnMin);
+	}
+	else if (name == "spawn-max")
+	{
+		valid = parseVector3(value, config.spawnMax);
+	}
+	else if (name == "step-rate")
+	{
+		valid = parseFloat(value, real) && real > 0.0;
+		if (valid)
+		{
+			config.stepRate = real;
+		}
+	}
+	else if (name == "threads")
+	{
+		valid = parseUnsigned(value, number) && number < 4096;
+		if (valid)
+		{
+			config.threadCount = static_cast<unsigned int>(number);
+		}
+	}
+	else if (name == "instanced")
+	{
+		valid = value == "0" || value == "1";
+		if (valid)
+		{
+			config.instanced = value == "1";
+		}
+	}
+	else if (name == "deferred")
+	{
+		valid = parseUnsigned(value, number) && number <= 64;
+		if (valid)
+		{
+			config.deferredContexts = static_cast<unsigned int>(number);
+		}
+	}
+	else if (name == "occluders")
+	{
+		valid = parseUnsigned(value, number) && number <= 65536;
+		if (valid)
+		{
+			config.occluderCount = static_cast<unsigned int>(number);
+		}
+	}
+	else
+	{
+		error = "unknown setting '" + name + "'";
+		return false;
+	}
+
+	if (!valid)
+	{
+		error = "bad value '" + value + "' for " + name;
+	}
+	return valid;
+}
+
+bool loadConfigFile(const char* path, SimulationConfig& config, std::string& error)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		error = std::string("cannot open config file '") + path + "'";
+		return false;
+	}
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		++lineNumber;
+		line = trim(line.substr(0, line.find('#')));
+		if (line.empty())
+		{
+			continue;
+		}
+
+		const size_t equals = line.find('=');
+		if (equals == std::string::npos || !applySetting(trim(line.substr(0, equals)), trim(line.substr(equals + 1)), config, error))
+		{
+			if (equals == std::string::npos)
+			{
+				error = "expected name = value";
+			}
+			error = std::string(path) + ":" + std::to_string(lineNumber) + ": " + error;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool parseCommandLine(int argc, const char* const argv[], SimulationConfig& config, std::vector<std::string>& unparsed, std::string& error)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string argument = argv[i];
+		const size_t equals = argument.find('=');
+		if (argument.compare(0, 2, "--") != 0 || equals == std::string::npos)
+		{
+			unparsed.push_back(argument);
+			continue;
+		}
+
+		const std::string name = argument.substr(2, equals - 2);
+		const std::string value = argument.substr(equals + 1);
+		if (name == "config")
+		{
+			if (!loadConfigFile(value.c_str(), config, error))
+			{
+				return false;
+			}
+			continue;
+		}
+
+		// Leave options meant for the caller alone
+		if (!isSetting(name))
+		{
+			unparsed.push_back(argument);
+			continue;
+		}
+		if (!applySetting(name, value, config, error))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void generateSpawnPositions(const SimulationConfig& config, size_t count, std::vector<Vector3>& positions)
+{
+	assert(count <= MAX_CUBE_COUNT);
+
+	std::vector<float> x(count);
+	std::vector<float> y(count);
+	std::vector<float> z(count);
+	const uint32_t axisCount = static_cast<uint32_t>(count);
+	RandomStream::fillFloat(config.seed, RandomStream::SPAWN_STREAM, 0, config.spawnMin.x, config.spawnMax.x, x.data(), count);
+	RandomStream::fillFloat(config.seed, RandomStream::SPAWN_STREAM, axisCount, config.spawnMin.y, config.spawnMax.y, y.data(), count);
+	RandomStream::fillFloat(config.seed, RandomStream::SPAWN_STREAM, axisCount * 2, config.spawnMin.z, config.spawnMax.z, z.data(), count);
+
+	positions.resize(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		positions[i] = Vector3(x[i], y[i], z[i]);
+	}
+}
@@ -0,0 +1,201 @@
+#include "../include/softwareCommandRecorder.h"
+#include <string.h>
+
+SoftwareCommandRecorder::SoftwareCommandRecorder(RenderDevice& immediate, unsigned int contextCount)
+	: m_immediate(immediate), m_finished(contextCount)
+{
+	for (unsigned int context = 0; context < contextCount; ++context)
+	{
+		m_contexts.emplace_back(new Context(immediate.getConstantBufferAlignment()));
+	}
+}
+
+RenderDevice& SoftwareCommandRecorder::getContext(unsigned int context)
+{
+	return *m_contexts[context];
+}
+
+void SoftwareCommandRecorder::finishCommandList(unsigned int context)
+{
+	m_contexts[context]->finish(m_finished[context]);
+}
+
+void SoftwareCommandRecorder::executeCommandLists(unsigned int count)
+{
+	for (unsigned int context = 0; context < count; ++context)
+	{
+		m_immediate.clearState();
+		play(m_finished[context]);
+		m_finished[context].commands.clear();
+		m_finished[context].data.clear();
+	}
+	if (count > 0)
+	{
+		m_immediate.clearState();
+	}
+}
+
+void SoftwareCommandRecorder::play(const CommandList& list)
+{
+	RenderDevice& device = m_immediate;
+	for (const Command& command : list.commands)
+	{
+		switch (command.call)
+		{
+		case RENDER_CALL_UPDATE_BUFFER:
+			device.updateBuffer(static_cast<RenderBuffer>(command.resource), list.data.data() + command.offset, command.bytes);
+			break;
+		case RENDER_CALL_CLEAR_STATE:
+			device.clearState();
+			break;
+		case RENDER_CALL_SET_RENDER_TARGET:
+			device.setRenderTarget(static_cast<RenderTarget>(command.resource));
+			break;
+		case RENDER_CALL_SET_DEPTH_STENCIL_STATE:
+			device.setDepthStencilState(static_cast<RenderDepthState>(command.resource));
+			break;
+		case RENDER_CALL_SET_VIEWPORT:
+			device.setViewport(static_cast<RenderViewport>(command.resource));
+			break;
+		case RENDER_CALL_SET_PRIMITIVE_TOPOLOGY:
+			device.setPrimitiveTopology(static_cast<RenderTopology>(command.resource));
+			break;
+		case RENDER_CALL_SET_INPUT_LAYOUT:
+			device.setInputLayout(static_cast<RenderLayout>(command.resource));
+			break;
+		case RENDER_CALL_SET_VERTEX_SHADER:
+			device.setVertexShader(static_cast<RenderShader>(command.resource));
+			break;
+		case RENDER_CALL_SET_PIXEL_SHADER:
+			device.setPixelShader(static_cast<RenderShader>(command.resource));
+			break;
+		case RENDER_CALL_SET_VERTEX_CONSTANT_BUFFER:
+			device.setVertexConstantBuffer(command.slot, static_cast<RenderBuffer>(command.resource));
+			break;
+		case RENDER_CALL_SET_VERTEX_CONSTANT_BUFFER_RANGE:
+			device.setVertexConstantBufferRange(command.slot, static_cast<RenderBuffer>(command.resource), command.offset, command.bytes);
+			break;
+		case RENDER_CALL_SET_VERTEX_BUFFER:
+			device.setVertexBuffer(command.slot, static_cast<RenderBuffer>(command.resource), command.count);
+			break;
+		case RENDER_CALL_SET_INDEX_BUFFER:
+			device.setIndexBuffer(static_cast<RenderBuffer>(command.resource));
+			break;
+		case RENDER_CALL_DRAW_INDEXED:
+			device.drawIndexed(command.count);
+			break;
+		case RENDER_CALL_DRAW_INDEXED_INSTANCED:
+			device.drawIndexedInstanced(command.count, command.instanceCount);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void SoftwareCommandRecorder::Context::finish(CommandList& list)
+{
+	// Swapping keeps both sets of storage, so a context stops allocating once it has seen its
+	// largest frame
+	list.commands.swap(m_recording.commands);
+	list.data.swap(m_recording.data);
+	m_recording.commands.clear();
+	m_recording.data.clear();
+}
+
+SoftwareCommandRecorder::Command& SoftwareCommandRecorder::Context::record(RenderCall call, int resource)
+{
+	Command command = { call, resource, 0, 0, 0, 0, 0 };
+	m_recording.commands.push_back(command);
+	return m_recording.commands.back();
+}
+
+void SoftwareCommandRecorder::Context::updateBuffer(RenderBuffer buffer, const void* pData, size_t bytes)
+{
+	// UpdateSubresource on a deferred context copies the data then too
+	Command& command = record(RENDER_CALL_UPDATE_BUFFER, buffer);
+	command.offset = m_recording.data.size();
+	command.bytes = bytes;
+	m_recording.data.resize(command.offset + bytes);
+	if (bytes > 0)
+	{
+		memcpy(m_recording.data.data() + command.offset, pData, bytes);
+	}
+}
+
+void SoftwareCommandRecorder::Context::clearState()
+{
+	record(RENDER_CALL_CLEAR_STATE, -1);
+}
+
+void SoftwareCommandRecorder::Context::setRenderTarget(RenderTarget target)
+{
+	record(RENDER_CALL_SET_RENDER_TARGET, target);
+}
+
+void SoftwareCommandRecorder::Context::setDepthStencilState(RenderDepthState state)
+{
+	record(RENDER_CALL_SET_DEPTH_STENCIL_STATE, state);
+}
+
+void SoftwareCommandRecorder::Context::setViewport(RenderViewport viewport)
+{
+	record(RENDER_CALL_SET_VIEWPORT, viewport);
+}
+
+void SoftwareCommandRecorder::Context::setPrimitiveTopology(RenderTopology topology)
+{
+	record(RENDER_CALL_SET_PRIMITIVE_TOPOLOGY, topology);
+}
+
+void SoftwareCommandRecorder::Context::setInputLayout(RenderLayout layout)
+{
+	record(RENDER_CALL_SET_INPUT_LAYOUT, layout);
+}
+
+void SoftwareCommandRecorder::Context::setVertexShader(RenderShader shader)
+{
+	record(RENDER_CALL_SET_VERTEX_SHADER, shader);
+}
+
+void SoftwareCommandRecorder::Context::setPixelShader(RenderShader shader)
+{
+	record(RENDER_CALL_SET_PIXEL_SHADER, shader);
+}
+
+void SoftwareCommandRecorder::Context::setVertexConstantBuffer(unsigned int slot, RenderBuffer buffer)
+{
+	record(RENDER_CALL_SET_VERTEX_CONSTANT_BUFFER, buffer).slot = slot;
+}
+
+void SoftwareCommandRecorder::Context::setVertexConstantBufferRange(unsigned int slot, RenderBuffer buffer, size_t offset, size_t bytes)
+{
+	Command& command = record(RENDER_CALL_SET_VERTEX_CONSTANT_BUFFER_RANGE, buffer);
+	command.slot = slot;
+	command.offset = offset;
+	command.bytes = bytes;
+}
+
+void SoftwareCommandRecorder::Context::setVertexBuffer(unsigned int slot, RenderBuffer buffer, unsigned int stride)
+{
+	Command& command = record(RENDER_CALL_SET_VERTEX_BUFFER, buffer);
+	command.slot = slot;
+	command.count = stride;
+}
+
+void SoftwareCommandRecorder::Context::setIndexBuffer(RenderBuffer buffer)
+{
+	record(RENDER_CALL_SET_INDEX_BUFFER, buffer);
+}
+
+void SoftwareCommandRecorder::Context::drawIndexed(unsigned int indexCount)
+{
+	record(RENDER_CALL_DRAW_INDEXED, -1).count = indexCount;
+}
+
+void SoftwareCommandRecorder::Context::drawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount)
+{
+	Command& command = record(RENDER_CALL_DRAW_INDEXED_INSTANCED, -1);
+	command.count = indexCount;
+	command.instanceCount = instanceCount;
+}
@@ -0,0 +1,755 @@
+#include "../include/softwareRenderDevice.h"
+#include "../include/VertexDefinitions.h"
+#include "../include/profiler.h"
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+namespace
+{
+	// Vertices are snapped to this fraction of a pixel
+	const float SUBPIXEL_STEPS = 16.0f;
+
+	// Triangles reaching further outside the screen than this many times its half-size are
+	// clipped there, which keeps the edge tests of huge triangles within float precision
+	const float GUARD_BAND = 4.0f;
+
+	// Near plane and then the guard band, as the clip-space dot products that are negative
+	// outside them
+	const Vector4 CLIP_PLANES[] =
+	{
+		Vector4(0.0f, 0.0f, 1.0f, 0.0f),
+		Vector4(1.0f, 0.0f, 0.0f, GUARD_BAND),
+		Vector4(-1.0f, 0.0f, 0.0f, GUARD_BAND),
+		Vector4(0.0f, 1.0f, 0.0f, GUARD_BAND),
+		Vector4(0.0f, -1.0f, 0.0f, GUARD_BAND),
+	};
+	const int CLIP_PLANE_COUNT = sizeof(CLIP_PLANES) / sizeof(CLIP_PLANES[0]);
+
+	// A triangle clipped by every plane has at most one more vertex per plane
+	const int MAX_CLIPPED_VERTICES = 3 + CLIP_PLANE_COUNT;
+
+	inline float snap(float value)
+	{
+		return std::floor(value * SUBPIXEL_STEPS + 0.5f) / SUBPIXEL_STEPS;
+	}
+
+	inline uint32_t packChannel(float value)
+	{
+		return static_cast<uint32_t>(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+	}
+
+	inline uint32_t packColor(float red, float green, float blue, float alpha)
+	{
+		return packChannel(red) | (packChannel(green) << 8) | (packChannel(blue) << 16) | (packChannel(alpha) << 24);
+	}
+
+	// Bits for the sides of the view volume a clip-space position is outside
+	inline unsigned int outcode(const Vector4& position)
+	{
+		return (position.x < -position.w ? 1u : 0u) | (position.x > position.w ? 2u : 0u) | (position.y < -position.w ? 4u : 0u) |
+			(position.y > position.w ? 8u : 0u) | (position.z < 0.0f ? 16u : 0u) | (position.z > position.w ? 32u : 0u);
+	}
+
+	// Whether the triangle has to be clipped before it can be set up
+	inline bool needsClipping(const Vector4& position)
+	{
+		const float guard = GUARD_BAND * position.w;
+		return position.z < 0.0f || position.x < -guard || position.x > guard || position.y < -guard || position.y > guard;
+	}
+
+	// Edge i runs from vertex i to the next and is zero or more inside a clockwise triangle.
+	// Pixel centres exactly on an edge belong to it only if it is a top or left edge, so
+	// triangles that share an edge never both draw a pixel.
+	inline bool isTopLeft(float dx, float dy)
+	{
+		return dy < 0.0f || (dy == 0.0f && dx > 0.0f);
+	}
+}
+
+SoftwareRenderDevice::SoftwareRenderDevice(unsigned int width, unsigned int height, JobSystem& jobs, size_t constantBufferAlignment)
+	: m_jobs(jobs), m_clearColor(0.0f, 0.0f, 0.0f, 1.0f), m_constantBufferAlignment(constantBufferAlignment), m_frame(0),
+	m_submittedTriangles(0), m_rasterizedTriangles(0), m_invalidDraws(0)
+{
+	m_width = (std::max(width, 1u) + LANE_COUNT - 1) / LANE_COUNT * LANE_COUNT;
+	m_height = std::max(height, 1u);
+	m_tilesX = (m_width + TILE_SIZE - 1) / TILE_SIZE;
+	m_tilesY = (m_height + TILE_SIZE - 1) / TILE_SIZE;
+	m_color.assign(m_width * m_height, 0);
+	m_depth.assign(m_width * m_height, 1.0f);
+	m_clearPixel = 0;
+
+	for (int buffer = 0; buffer < RENDER_BUFFER_COUNT; ++buffer)
+	{
+		m_bufferVersions[buffer] = 0;
+	}
+	clearState();
+
+	beginFrame();
+}
+
+void SoftwareRenderDevice::clearState()
+{
+	for (unsigned int slot = 0; slot < CONSTANT_SLOT_COUNT; ++slot)
+	{
+		m_constantBuffer[slot] = -1;
+		m_constantOffset[slot] = 0;
+		m_constantBytes[slot] = 0;
+	}
+	for (unsigned int slot = 0; slot < VERTEX_SLOT_COUNT; ++slot)
+	{
+		m_vertexBuffer[slot] = -1;
+		m_vertexStride[slot] = 0;
+	}
+	m_indexBuffer = -1;
+	m_renderTarget = -1;
+	m_viewport = -1;
+	m_topology = -1;
+	m_layout = -1;
+	m_vertexShader = -1;
+	m_pixelShader = -1;
+}
+
+void SoftwareRenderDevice::attachRingBuffer(RenderBuffer buffer, size_t capacity)
+{
+	m_rings[buffer] = RingAllocator(capacity);
+	m_buffers[buffer].assign(capacity, 0);
+	++m_bufferVersions[buffer];
+}
+
+void SoftwareRenderDevice::beginFrame()
+{
+	m_meshes.clear();
+	for (uint64_t& key : m_meshKey)
+	{
+		key = ~0ull;
+	}
+	m_viewProjections.clear();
+	m_draws.clear();
+	m_instances.clear();
+}
+
+void SoftwareRenderDevice::endFrame()
+{
+	finishFrame(false);
+}
+
+void SoftwareRenderDevice::endFrameReference()
+{
+	finishFrame(true);
+}
+
+void SoftwareRenderDevice::updateBuffer(RenderBuffer buffer, const void* pData, size_t bytes)
+{
+	std::vector<uint8_t>& contents = m_buffers[buffer];
+	contents.resize(bytes);
+	if (bytes > 0)
+	{
+		memcpy(contents.data(), pData, bytes);
+	}
+	++m_bufferVersions[buffer];
+}
+
+bool SoftwareRenderDevice::appendBuffer(RenderBuffer buffer, const void* pData, size_t elementBytes, size_t count, size_t stride, size_t& offset)
+{
+	RingAllocator& ring = m_rings[buffer];
+	const size_t bytes = count * stride;
+	if (count == 0 || bytes > ring.getCapacity() || elementBytes > stride || m_constantBufferAlignment == 0)
+	{
+		return false;
+	}
+
+	offset = ring.allocate(bytes, m_constantBufferAlignment);
+	if (offset == RingAllocator::INVALID_OFFSET)
+	{
+		// Everything before this frame has been drawn, so only this frame's data is in the way
+		if (ring.getFrameBytes() > 0)
+		{
+			return false;
+		}
+		ring.reset();
+		offset = ring.allocate(bytes, m_constantBufferAlignment);
+		if (offset == RingAllocator::INVALID_OFFSET)
+		{
+			return false;
+		}
+	}
+
+	const uint8_t* pSource = static_cast<const uint8_t*>(pData);
+	uint8_t* pDestination = m_buffers[buffer].data() + offset;
+	for (size_t i = 0; i < count; ++i)
+	{
+		memcpy(pDestination + i * stride, pSource + i * elementBytes, elementBytes);
+	}
+	++m_bufferVersions[buffer];
+	return true;
+}
+
+void SoftwareRenderDevice::setRenderTarget(RenderTarget target)
+{
+	m_renderTarget = target;
+}
+
+void SoftwareRenderDevice::setDepthStencilState(RenderDepthState state)
+{
+	// Only the default state exists, which is the depth test every draw here uses
+	(void)state;
+}
+
+void SoftwareRenderDevice::setViewport(RenderViewport viewport)
+{
+	// The one viewport covers the whole frame, which is the only area drawn to here
+	m_viewport = viewport;
+}
+
+void SoftwareRenderDevice::setPrimitiveTopology(RenderTopology topology)
+{
+	m_topology = topology;
+}
+
+void SoftwareRenderDevice::setInputLayout(RenderLayout layout)
+{
+	m_layout = layout;
+}
+
+void SoftwareRenderDevice::setVertexShader(RenderShader shader)
+{
+	m_vertexShader = shader;
+}
+
+void SoftwareRenderDevice::setPixelShader(RenderShader shader)
+{
+	m_pixelShader = shader;
+}
+
+void SoftwareRenderDevice::setVertexConstantBuffer(unsigned int slot, RenderBuffer buffer)
+{
+	if (slot < CONSTANT_SLOT_COUNT)
+	{
+		m_constantBuffer[slot] = buffer;
+		m_constantOffset[slot] = 0;
+		m_constantBytes[slot] = 0;
+	}
+}
+
+void SoftwareRenderDevice::setVertexConstantBufferRange(unsigned int slot, RenderBuffer buffer, size_t offset, size_t bytes)
+{
+	if (slot < CONSTANT_SLOT_COUNT)
+	{
+		m_constantBuffer[slot] = buffer;
+		m_constantOffset[slot] = offset;
+		m_constantBytes[slot] = bytes;
+	}
+}
+
+void SoftwareRenderDevice::setVertexBuffer(unsigned int slot, RenderBuffer buffer, unsigned int stride)
+{
+	if (slot < VERTEX_SLOT_COUNT)
+	{
+		m_vertexBuffer[slot] = buffer;
+		m_vertexStride[slot] = stride;
+	}
+}
+
+void SoftwareRenderDevice::setIndexBuffer(RenderBuffer buffer)
+{
+	m_indexBuffer = buffer;
+}
+
+void SoftwareRenderDevice::drawIndexed(unsigned int indexCount)
+{
+	uint32_t draw = 0;
+	Instance instance;
+	if (m_vertexShader != RENDER_SHADER_CUBE_VS || m_layout != RENDER_LAYOUT_CUBE || !readMatrix(1, instance.world) || !beginDraw(indexCount, draw))
+	{
+		++m_invalidDraws;
+		return;
+	}
+
+	instance.draw = draw;
+	m_instances.push_back(instance);
+}
+
+void SoftwareRenderDevice::drawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount)
+{
+	// VS_Instanced reads one world matrix per instance from slot 1, a row per element
+	const int stream = m_vertexBuffer[1];
+	const size_t stride = m_vertexStride[1];
+	uint32_t draw = 0;
+	if (m_vertexShader != RENDER_SHADER_CUBE_INSTANCED_VS || m_layout != RENDER_LAYOUT_CUBE_INSTANCED || stream < 0 || stride < sizeof(Matrix) ||
+		m_buffers[stream].size() < static_cast<size_t>(instanceCount) * stride || !beginDraw(indexCount, draw))
+	{
+		++m_invalidDraws;
+		return;
+	}
+
+	const uint8_t* pStream = m_buffers[stream].data();
+	const size_t first = m_instances.size();
+	m_instances.resize(first + instanceCount);
+	for (unsigned int i = 0; i < instanceCount; ++i)
+	{
+		memcpy(m_instances[first + i].world.m, pStream + i * stride, sizeof(Matrix));
+		m_instances[first + i].draw = draw;
+	}
+}
+
+bool SoftwareRenderDevice::readMatrix(unsigned int slot, Matrix& matrix) const
+{
+	if (m_constantBuffer[slot] < 0)
+	{
+		return false;
+	}
+
+	const std::vector<uint8_t>& contents = m_buffers[m_constantBuffer[slot]];
+	const size_t bytes = m_constantBytes[slot] > 0 ? m_constantBytes[slot] : contents.size() - std::min(m_constantOffset[slot], contents.size());
+	if (bytes < sizeof(Matrix) || m_constantOffset[slot] + sizeof(Matrix) > contents.size())
+	{
+		return false;
+	}
+
+	// The shaders read constants column by column, which is why they go up transposed
+	Matrix transposed;
+	memcpy(transposed.m, &contents[m_constantOffset[slot]], sizeof(Matrix));
+	matrix = transposed.Transpose();
+	return true;
+}
+
+bool SoftwareRenderDevice::beginDraw(unsigned int indexCount, uint32_t& draw)
+{
+	const int vertices = m_vertexBuffer[0];
+	const int indices = m_indexBuffer;
+	const unsigned int stride = m_vertexStride[0];
+	Matrix viewProjection;
+	if (m_renderTarget != RENDER_TARGET_BACK_BUFFER || m_viewport != RENDER_VIEWPORT_BACK_BUFFER || m_topology != RENDER_TOPOLOGY_TRIANGLE_LIST || m_pixelShader != RENDER_SHADER_CUBE_PS ||
+		vertices < 0 || indices < 0 || stride < sizeof(SimpleVertex) || m_buffers[indices].size() < static_cast<size_t>(indexCount) * sizeof(uint16_t) ||
+		!readMatrix(0, viewProjection))
+	{
+		return false;
+	}
+
+	// The cube draws all share one mesh, so it is copied once a frame
+	const uint64_t key[4] = { (static_cast<uint64_t>(vertices) << 32) | stride, m_bufferVersions[vertices],
+		(static_cast<uint64_t>(indices) << 32) | indexCount, m_bufferVersions[indices] };
+	if (memcmp(key, m_meshKey, sizeof(key)) != 0)
+	{
+		const std::vector<uint8_t>& vertexData = m_buffers[vertices];
+		const size_t vertexCount = vertexData.size() / stride;
+
+		Mesh mesh;
+		mesh.indices.resize(indexCount - indexCount % 3);
+		if (!mesh.indices.empty())
+		{
+			memcpy(mesh.indices.data(), m_buffers[indices].data(), mesh.indices.size() * sizeof(uint16_t));
+		}
+		for (uint16_t index : mesh.indices)
+		{
+			if (index >= vertexCount)
+			{
+				return false;
+			}
+		}
+
+		mesh.positions.resize(vertexCount);
+		mesh.colors.resize(vertexCount);
+		for (size_t i = 0; i < vertexCount; ++i)
+		{
+			SimpleVertex vertex;
+			memcpy(&vertex, &vertexData[i * stride], sizeof(SimpleVertex));
+			mesh.positions[i] = Vector4(vertex.Pos.x, vertex.Pos.y, vertex.Pos.z, 1.0f);
+			mesh.colors[i] = vertex.Color;
+		}
+
+		m_meshes.push_back(mesh);
+		memcpy(m_meshKey, key, sizeof(key));
+	}
+
+	if (m_viewProjections.empty() || memcmp(&m_viewProjections.back(), &viewProjection, sizeof(Matrix)) != 0)
+	{
+		m_viewProjections.push_back(viewProjection);
+	}
+
+	Draw record;
+	record.mesh = static_cast<uint32_t>(m_meshes.size() - 1);
+	record.viewProjection = static_cast<uint32_t>(m_viewProjections.size() - 1);
+	draw = static_cast<uint32_t>(m_draws.size());
+	m_draws.push_back(record);
+	return true;
+}
+
+void SoftwareRenderDevice::setupChunk(size_t index)
+{
+	PROFILE_ZONE("setup chunk");
+	Chunk& chunk = m_chunks[index];
+	chunk.triangles.clear();
+	chunk.bins.resize(m_tilesX * m_tilesY);
+	for (std::vector<uint32_t>& bin : chunk.bins)
+	{
+		bin.clear();
+	}
+	chunk.submittedTriangles = 0;
+
+	const size_t end = std::min((index + 1) * INSTANCES_PER_CHUNK, m_instances.size());
+	for (size_t i = index * INSTANCES_PER_CHUNK; i < end; ++i)
+	{
+		const Instance& instance = m_instances[i];
+		const Draw& draw = m_draws[instance.draw];
+		const Mesh& mesh = m_meshes[draw.mesh];
+
+		// VS: the position through the world and then the view-projection
+		const Matrix worldViewProjection = instance.world * m_viewProjections[draw.viewProjection];
+		chunk.clipPositions.resize(mesh.positions.size());
+		for (size_t vertex = 0; vertex < mesh.positions.size(); ++vertex)
+		{
+			chunk.clipPositions[vertex] = Vector4::Transform(mesh.positions[vertex], worldViewProjection);
+		}
+
+		chunk.submittedTriangles += mesh.indices.size() / 3;
+		for (size_t first = 0; first < mesh.indices.size(); first += 3)
+		{
+			ClipVertex polygon[MAX_CLIPPED_VERTICES];
+			unsigned int outside = ~0u;
+			bool clip = false;
+			for (int corner = 0; corner < 3; ++corner)
+			{
+				const uint16_t vertex = mesh.indices[first + corner];
+				polygon[corner].position = chunk.clipPositions[vertex];
+				polygon[corner].color = mesh.colors[vertex];
+				outside &= outcode(polygon[corner].position);
+				clip = clip || needsClipping(polygon[corner].position);
+			}
+
+			// Entirely outside one side of the view volume
+			if (outside != 0)
+			{
+				continue;
+			}
+			if (!clip)
+			{
+				setupTriangle(chunk, polygon);
+				continue;
+			}
+
+			// Sutherland-Hodgman against each plane. Crossings are always found from the vertex
+			// inside, so two triangles sharing a clipped edge get the same new vertex on it.
+			int count = 3;
+			for (int plane = 0; plane < CLIP_PLANE_COUNT && count >= 3; ++plane)
+			{
+				ClipVertex clipped[MAX_CLIPPED_VERTICES];
+				int clippedCount = 0;
+				for (int vertex = 0; vertex < count; ++vertex)
+				{
+					const ClipVertex& from = polygon[vertex];
+					const ClipVertex& to = polygon[vertex + 1 < count ? vertex + 1 : 0];
+					const float fromDistance = from.position.Dot(CLIP_PLANES[plane]);
+					const float toDistance = to.position.Dot(CLIP_PLANES[plane]);
+					if (fromDistance >= 0.0f)
+					{
+						clipped[clippedCount++] = from;
+					}
+					if ((fromDistance >= 0.0f) != (toDistance >= 0.0f))
+					{
+						const ClipVertex& in = fromDistance >= 0.0f ? from : to;
+						const ClipVertex& out = fromDistance >= 0.0f ? to : from;
+						const float inDistance = fromDistance >= 0.0f ? fromDistance : toDistance;
+						const float outDistance = fromDistance >= 0.0f ? toDistance : fromDistance;
+						const float t = inDistance / (inDistance - outDistance);
+						clipped[clippedCount].position = in.position + (out.position - in.position) * t;
+						clipped[clippedCount].color = in.color + (out.color - in.color) * t;
+						++clippedCount;
+					}
+				}
+				std::copy(clipped, clipped + clippedCount, polygon);
+				count = clippedCount;
+			}
+
+			for (int vertex = 2; vertex < count; ++vertex)
+			{
+				const ClipVertex fan[3] = { polygon[0], polygon[vertex - 1], polygon[vertex] };
+				setupTriangle(chunk, fan);
+			}
+		}
+	}
+}
+
+void SoftwareRenderDevice::setupTriangle(Chunk& chunk, const ClipVertex* pVertices)
+{
+	Triangle triangle;
+	float z[3];
+	float inverseW[3];
+	for (int corner = 0; corner < 3; ++corner)
+	{
+		const Vector4& clip = pVertices[corner].position;
+		if (clip.w <= 0.0f)
+		{
+			return;
+		}
+		inverseW[corner] = 1.0f / clip.w;
+		triangle.x[corner] = snap((clip.x * inverseW[corner] * 0.5f + 0.5f) * m_width);
+		triangle.y[corner] = snap((0.5f - clip.y * inverseW[corner] * 0.5f) * m_height);
+		z[corner] = clip.z * inverseW[corner];
+	}
+
+	// Positive for clockwise with y down, which is a face turned towards the camera
+	const float* x = triangle.x;
+	const float* y = triangle.y;
+	const float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (area <= 0.0f)
+	{
+		return;
+	}
+
+	// Pixels whose centres fall within the triangle's extent
+	triangle.minX = std::max(static_cast<int>(std::ceil(std::min(std::min(x[0], x[1]), x[2]) - 0.5f)), 0);
+	triangle.maxX = std::min(static_cast<int>(std::floor(std::max(std::max(x[0], x[1]), x[2]) - 0.5f)), static_cast<int>(m_width) - 1);
+	triangle.minY = std::max(static_cast<int>(std::ceil(std::min(std::min(y[0], y[1]), y[2]) - 0.5f)), 0);
+	triangle.maxY = std::min(static_cast<int>(std::floor(std::max(std::max(y[0], y[1]), y[2]) - 0.5f)), static_cast<int>(m_height) - 1);
+	if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+	{
+		return;
+	}
+
+	// Depth after the divide is affine in screen space. Colour is not, but colour / w and
+	// 1 / w are, and dividing one by the other per pixel gives the perspective-correct colour.
+	auto makePlane = [x, y, area](float a0, float a1, float a2)
+	{
+		AttributePlane plane;
+		plane.origin = a0;
+		plane.dx = ((a1 - a0) * (y[2] - y[0]) - (a2 - a0) * (y[1] - y[0])) / area;
+		plane.dy = ((x[1] - x[0]) * (a2 - a0) - (x[2] - x[0]) * (a1 - a0)) / area;
+		return plane;
+	};
+	triangle.z = makePlane(z[0], z[1], z[2]);
+	triangle.inverseW = makePlane(inverseW[0], inverseW[1], inverseW[2]);
+	for (int channel = 0; channel < 4; ++channel)
+	{
+		const float c0 = (&pVertices[0].color.x)[channel] * inverseW[0];
+		const float c1 = (&pVertices[1].color.x)[channel] * inverseW[1];
+		const float c2 = (&pVertices[2].color.x)[channel] * inverseW[2];
+		triangle.color[channel] = makePlane(c0, c1, c2);
+	}
+
+	const uint32_t index = static_cast<uint32_t>(chunk.triangles.size());
+	chunk.triangles.push_back(triangle);
+	for (int tileY = triangle.minY / static_cast<int>(TILE_SIZE); tileY <= triangle.maxY / static_cast<int>(TILE_SIZE); ++tileY)
+	{
+		for (int tileX = triangle.minX / static_cast<int>(TILE_SIZE); tileX <= triangle.maxX / static_cast<int>(TILE_SIZE); ++tileX)
+		{
+			chunk.bins[tileY * m_tilesX + tileX].push_back(index);
+		}
+	}
+}
+
+void SoftwareRenderDevice::rasterizeTile(unsigned int tile)
+{
+	PROFILE_ZONE("rasterize tile");
+	const int tileX0 = static_cast<int>((tile % m_tilesX) * TILE_SIZE);
+	const int tileY0 = static_cast<int>((tile / m_tilesX) * TILE_SIZE);
+	const int tileX1 = std::min(tileX0 + static_cast<int>(TILE_SIZE), static_cast<int>(m_width));
+	const int tileY1 = std::min(tileY0 + static_cast<int>(TILE_SIZE), static_cast<int>(m_height));
+	for (int row = tileY0; row < tileY1; ++row)
+	{
+		std::fill(&m_color[row * m_width + tileX0], &m_color[row * m_width + tileX1], m_clearPixel);
+		std::fill(&m_depth[row * m_width + tileX0], &m_depth[row * m_width + tileX1], 1.0f);
+	}
+
+	const XMVECTOR laneCenters = XMVectorSet(0.5f, 1.5f, 2.5f, 3.5f);
+	const XMVECTOR zero = XMVectorZero();
+	const XMVECTOR one = XMVectorSplatOne();
+	for (const Chunk& chunk : m_chunks)
+	{
+		for (uint32_t index : chunk.bins[tile])
+		{
+			const Triangle& triangle = chunk.triangles[index];
+			const int minX = std::max(triangle.minX, tileX0);
+			const int maxX = std::min(triangle.maxX, tileX1 - 1);
+			const int minY = std::max(triangle.minY, tileY0);
+			const int maxY = std::min(triangle.maxY, tileY1 - 1);
+
+			float dx[3];
+			bool topLeft[3];
+			XMVECTOR fromX[3];
+			XMVECTOR dy[3];
+			for (int edge = 0; edge < 3; ++edge)
+			{
+				const int next = edge == 2 ? 0 : edge + 1;
+				dx[edge] = triangle.x[next] - triangle.x[edge];
+				topLeft[edge] = isTopLeft(dx[edge], triangle.y[next] - triangle.y[edge]);
+				fromX[edge] = XMVectorReplicate(triangle.x[edge]);
+				dy[edge] = XMVectorReplicate(triangle.y[next] - triangle.y[edge]);
+			}
+			const XMVECTOR zdx = XMVectorReplicate(triangle.z.dx);
+			const XMVECTOR inverseWdx = XMVectorReplicate(triangle.inverseW.dx);
+			XMVECTOR colorDx[4];
+			for (int channel = 0; channel < 4; ++channel)
+			{
+				colorDx[channel] = XMVectorReplicate(triangle.color[channel].dx);
+			}
+
+			for (int row = minY; row <= maxY; ++row)
+			{
+				const float py = row + 0.5f;
+				const float offsetY = py - triangle.y[0];
+				XMVECTOR rowTerms[3];
+				for (int edge = 0; edge < 3; ++edge)
+				{
+					rowTerms[edge] = XMVectorReplicate((py - triangle.y[edge]) * dx[edge]);
+				}
+				const XMVECTOR rowDepth = XMVectorReplicate(triangle.z.origin + triangle.z.dy * offsetY);
+				const XMVECTOR rowInverseW = XMVectorReplicate(triangle.inverseW.origin + triangle.inverseW.dy * offsetY);
+				XMVECTOR rowColor[4];
+				for (int channel = 0; channel < 4; ++channel)
+				{
+					rowColor[channel] = XMVectorReplicate(triangle.color[channel].origin + triangle.color[channel].dy * offsetY);
+				}
+
+				float* pDepthRow = &m_depth[row * m_width];
+				uint32_t* pColorRow = &m_color[row * m_width];
+				for (int x = minX & ~static_cast<int>(LANE_COUNT - 1); x <= maxX; x += LANE_COUNT)
+				{
+					const XMVECTOR px = XMVectorAdd(laneCenters, XMVectorReplicate(static_cast<float>(x)));
+					XMVECTOR inside = XMVectorTrueInt();
+					for (int edge = 0; edge < 3; ++edge)
+					{
+						const XMVECTOR value = XMVectorSubtract(rowTerms[edge], XMVectorMultiply(XMVectorSubtract(px, fromX[edge]), dy[edge]));
+						inside = XMVectorAndInt(inside, topLeft[edge] ? XMVectorGreaterOrEqual(value, zero) : XMVectorGreater(value, zero));
+					}
+					if (XMVector4EqualInt(inside, XMVectorFalseInt()))
+					{
+						continue;
+					}
+
+					XMFLOAT4* pDepth = reinterpret_cast<XMFLOAT4*>(pDepthRow + x);
+					const XMVECTOR depth = XMLoadFloat4(pDepth);
+					const XMVECTOR offsetX = XMVectorSubtract(px, fromX[0]);
+					const XMVECTOR z = XMVectorAdd(XMVectorMultiply(offsetX, zdx), rowDepth);
+					XMVECTOR passed = XMVectorAndInt(inside, XMVectorLess(z, depth));
+					passed = XMVectorAndInt(passed, XMVectorAndInt(XMVectorGreaterOrEqual(z, zero), XMVectorLessOrEqual(z, one)));
+					if (XMVector4EqualInt(passed, XMVectorFalseInt()))
+					{
+						continue;
+					}
+					XMStoreFloat4(pDepth, XMVectorSelect(depth, z, passed));
+
+					// PS: the interpolated colour
+					const XMVECTOR w = XMVectorDivide(one, XMVectorAdd(XMVectorMultiply(offsetX, inverseWdx), rowInverseW));
+					XMFLOAT4 channels[4];
+					for (int channel = 0; channel < 4; ++channel)
+					{
+						XMStoreFloat4(&channels[channel], XMVectorMultiply(XMVectorAdd(XMVectorMultiply(offsetX, colorDx[channel]), rowColor[channel]), w));
+					}
+					for (size_t lane = 0; lane < LANE_COUNT; ++lane)
+					{
+						if (XMVectorGetIntByIndex(passed, lane) != 0)
+						{
+							pColorRow[x + lane] = packColor((&channels[0].x)[lane], (&channels[1].x)[lane], (&channels[2].x)[lane], (&channels[3].x)[lane]);
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+void SoftwareRenderDevice::rasterizeReference(const Triangle& triangle)
+{
+	for (int row = triangle.minY; row <= triangle.maxY; ++row)
+	{
+		const float py = row + 0.5f;
+		const float offsetY = py - triangle.y[0];
+		const float rowDepth = triangle.z.origin + triangle.z.dy * offsetY;
+		const float rowInverseW = triangle.inverseW.origin + triangle.inverseW.dy * offsetY;
+		for (int x = triangle.minX; x <= triangle.maxX; ++x)
+		{
+			const float px = x + 0.5f;
+			bool inside = true;
+			for (int edge = 0; edge < 3; ++edge)
+			{
+				const int next = edge == 2 ? 0 : edge + 1;
+				const float dx = triangle.x[next] - triangle.x[edge];
+				const float dy = triangle.y[next] - triangle.y[edge];
+				const float value = (py - triangle.y[edge]) * dx - (px - triangle.x[edge]) * dy;
+				inside = inside && (isTopLeft(dx, dy) ? value >= 0.0f : value > 0.0f);
+			}
+
+			float& depth = m_depth[row * m_width + x];
+			const float offsetX = px - triangle.x[0];
+			const float z = offsetX * triangle.z.dx + rowDepth;
+			if (!inside || !(z < depth) || z < 0.0f || z > 1.0f)
+			{
+				continue;
+			}
+			depth = z;
+
+			const float w = 1.0f / (offsetX * triangle.inverseW.dx + rowInverseW);
+			float channels[4];
+			for (int channel = 0; channel < 4; ++channel)
+			{
+				const AttributePlane& plane = triangle.color[channel];
+				channels[channel] = (offsetX * plane.dx + (plane.origin + plane.dy * offsetY)) * w;
+			}
+			m_color[row * m_width + x] = packColor(channels[0], channels[1], channels[2], channels[3]);
+		}
+	}
+}
+
+void SoftwareRenderDevice::finishFrame(bool reference)
+{
+	PROFILE_ZONE("software frame");
+	m_clearPixel = packColor(m_clearColor.x, m_clearColor.y, m_clearColor.z, m_clearColor.w);
+	m_chunks.resize((m_instances.size() + INSTANCES_PER_CHUNK - 1) / INSTANCES_PER_CHUNK);
+
+	if (reference)
+	{
+		std::fill(m_color.begin(), m_color.end(), m_clearPixel);
+		std::fill(m_depth.begin(), m_depth.end(), 1.0f);
+		for (size_t chunk = 0; chunk < m_chunks.size(); ++chunk)
+		{
+			setupChunk(chunk);
+			for (const Triangle& triangle : m_chunks[chunk].triangles)
+			{
+				rasterizeReference(triangle);
+			}
+		}
+	}
+	else
+	{
+		JobCounter setUp;
+		m_jobs.run(m_chunks.size(), 1, [this](size_t begin, size_t end)
+		{
+			for (size_t chunk = begin; chunk < end; ++chunk)
+			{
+				setupChunk(chunk);
+			}
+		}, setUp);
+		m_jobs.waitFor(setUp);
+
+		JobCounter rasterized;
+		m_jobs.run(m_tilesX * m_tilesY, 1, [this](size_t begin, size_t end)
+		{
+			for (size_t tile = begin; tile < end; ++tile)
+			{
+				rasterizeTile(static_cast<unsigned int>(tile));
+			}
+		}, rasterized);
+		m_jobs.waitFor(rasterized);
+	}
+
+	m_submittedTriangles = 0;
+	m_rasterizedTriangles = 0;
+	for (const Chunk& chunk : m_chunks)
+	{
+		m_submittedTriangles += chunk.submittedTriangles;
+		m_rasterizedTriangles += chunk.triangles.size();
+	}
+
+	// The frame is finished with as soon as it is drawn
+	for (RingAllocator& ring : m_rings)
+	{
+		ring.endFrame(m_frame);
+		ring.retireFrames(m_frame);
+	}
+	++m_frame;
+}
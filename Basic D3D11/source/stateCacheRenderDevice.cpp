@@ -0,0 +1,240 @@
+#include "../include/stateCacheRenderDevice.h"
+#include <string.h>
+
+StateCacheRenderDevice::StateCacheRenderDevice(RenderDevice& device)
+	: m_device(device), m_totalIssued(0), m_totalFiltered(0), m_frameUploadedBytes(0), m_lastFrameUploadedBytes(0)
+{
+	memset(m_frameIssued, 0, sizeof(m_frameIssued));
+	memset(m_frameFiltered, 0, sizeof(m_frameFiltered));
+	memset(m_lastFrameIssued, 0, sizeof(m_lastFrameIssued));
+	memset(m_lastFrameFiltered, 0, sizeof(m_lastFrameFiltered));
+	invalidate();
+}
+
+void StateCacheRenderDevice::invalidate()
+{
+	m_renderTarget = -1;
+	m_depthState = -1;
+	m_viewport = -1;
+	m_topology = -1;
+	m_layout = -1;
+	m_vertexShader = -1;
+	m_pixelShader = -1;
+	m_indexBuffer = -1;
+	for (ConstantBinding& binding : m_constants)
+	{
+		binding.buffer = -1;
+		binding.offset = 0;
+		binding.bytes = 0;
+	}
+	for (VertexBinding& binding : m_vertexBuffers)
+	{
+		binding.buffer = -1;
+		binding.stride = 0;
+	}
+}
+
+bool StateCacheRenderDevice::issue(RenderCall call, bool redundant)
+{
+	if (redundant)
+	{
+		++m_frameFiltered[call];
+		++m_totalFiltered;
+		return false;
+	}
+	++m_frameIssued[call];
+	++m_totalIssued;
+	return true;
+}
+
+uint64_t StateCacheRenderDevice::getIssuedCount() const
+{
+	uint64_t total = 0;
+	for (int call = 0; call < RENDER_CALL_COUNT; ++call)
+	{
+		total += m_lastFrameIssued[call];
+	}
+	return total;
+}
+
+uint64_t StateCacheRenderDevice::getFilteredCount() const
+{
+	uint64_t total = 0;
+	for (int call = 0; call < RENDER_CALL_COUNT; ++call)
+	{
+		total += m_lastFrameFiltered[call];
+	}
+	return total;
+}
+
+void StateCacheRenderDevice::beginFrame()
+{
+	m_device.beginFrame();
+}
+
+void StateCacheRenderDevice::endFrame()
+{
+	m_device.endFrame();
+	memcpy(m_lastFrameIssued, m_frameIssued, sizeof(m_frameIssued));
+	memcpy(m_lastFrameFiltered, m_frameFiltered, sizeof(m_frameFiltered));
+	memset(m_frameIssued, 0, sizeof(m_frameIssued));
+	memset(m_frameFiltered, 0, sizeof(m_frameFiltered));
+	m_lastFrameUploadedBytes = m_frameUploadedBytes;
+	m_frameUploadedBytes = 0;
+}
+
+void StateCacheRenderDevice::clearState()
+{
+	issue(RENDER_CALL_CLEAR_STATE, false);
+	invalidate();
+	m_device.clearState();
+}
+
+void StateCacheRenderDevice::updateBuffer(RenderBuffer buffer, const void* pData, size_t bytes)
+{
+	issue(RENDER_CALL_UPDATE_BUFFER, false);
+	m_frameUploadedBytes += bytes;
+	m_device.updateBuffer(buffer, pData, bytes);
+}
+
+bool StateCacheRenderDevice::appendBuffer(RenderBuffer buffer, const void* pData, size_t elementBytes, size_t count, size_t stride, size_t& offset)
+{
+	if (!m_device.appendBuffer(buffer, pData, elementBytes, count, stride, offset))
+	{
+		return false;
+	}
+	issue(RENDER_CALL_APPEND_BUFFER, false);
+	m_frameUploadedBytes += elementBytes * count;
+	return true;
+}
+
+void StateCacheRenderDevice::setRenderTarget(RenderTarget target)
+{
+	if (issue(RENDER_CALL_SET_RENDER_TARGET, m_renderTarget == target))
+	{
+		m_renderTarget = target;
+		m_device.setRenderTarget(target);
+	}
+}
+
+void StateCacheRenderDevice::setDepthStencilState(RenderDepthState state)
+{
+	if (issue(RENDER_CALL_SET_DEPTH_STENCIL_STATE, m_depthState == state))
+	{
+		m_depthState = state;
+		m_device.setDepthStencilState(state);
+	}
+}
+
+void StateCacheRenderDevice::setViewport(RenderViewport viewport)
+{
+	if (issue(RENDER_CALL_SET_VIEWPORT, m_viewport == viewport))
+	{
+		m_viewport = viewport;
+		m_device.setViewport(viewport);
+	}
+}
+
+void StateCacheRenderDevice::setPrimitiveTopology(RenderTopology topology)
+{
+	if (issue(RENDER_CALL_SET_PRIMITIVE_TOPOLOGY, m_topology == topology))
+	{
+		m_topology = topology;
+		m_device.setPrimitiveTopology(topology);
+	}
+}
+
+void StateCacheRenderDevice::setInputLayout(RenderLayout layout)
+{
+	if (issue(RENDER_CALL_SET_INPUT_LAYOUT, m_layout == layout))
+	{
+		m_layout = layout;
+		m_device.setInputLayout(layout);
+	}
+}
+
+void StateCacheRenderDevice::setVertexShader(RenderShader shader)
+{
+	if (issue(RENDER_CALL_SET_VERTEX_SHADER, m_vertexShader == shader))
+	{
+		m_vertexShader = shader;
+		m_device.setVertexShader(shader);
+	}
+}
+
+void StateCacheRenderDevice::setPixelShader(RenderShader shader)
+{
+	if (issue(RENDER_CALL_SET_PIXEL_SHADER, m_pixelShader == shader))
+	{
+		m_pixelShader = shader;
+		m_device.setPixelShader(shader);
+	}
+}
+
+void StateCacheRenderDevice::setVertexConstantBuffer(unsigned int slot, RenderBuffer buffer)
+{
+	ConstantBinding* pBinding = slot < CONSTANT_SLOT_COUNT ? &m_constants[slot] : nullptr;
+	const bool redundant = pBinding && pBinding->buffer == buffer && pBinding->bytes == 0;
+	if (issue(RENDER_CALL_SET_VERTEX_CONSTANT_BUFFER, redundant))
+	{
+		if (pBinding)
+		{
+			pBinding->buffer = buffer;
+			pBinding->offset = 0;
+			pBinding->bytes = 0;
+		}
+		m_device.setVertexConstantBuffer(slot, buffer);
+	}
+}
+
+void StateCacheRenderDevice::setVertexConstantBufferRange(unsigned int slot, RenderBuffer buffer, size_t offset, size_t bytes)
+{
+	ConstantBinding* pBinding = slot < CONSTANT_SLOT_COUNT ? &m_constants[slot] : nullptr;
+	const bool redundant = pBinding && pBinding->buffer == buffer && pBinding->offset == offset && pBinding->bytes == bytes;
+	if (issue(RENDER_CALL_SET_VERTEX_CONSTANT_BUFFER_RANGE, redundant))
+	{
+		if (pBinding)
+		{
+			pBinding->buffer = buffer;
+			pBinding->offset = offset;
+			pBinding->bytes = bytes;
+		}
+		m_device.setVertexConstantBufferRange(slot, buffer, offset, bytes);
+	}
+}
+
+void StateCacheRenderDevice::setVertexBuffer(unsigned int slot, RenderBuffer buffer, unsigned int stride)
+{
+	VertexBinding* pBinding = slot < VERTEX_SLOT_COUNT ? &m_vertexBuffers[slot] : nullptr;
+	const bool redundant = pBinding && pBinding->buffer == buffer && pBinding->stride == stride;
+	if (issue(RENDER_CALL_SET_VERTEX_BUFFER, redundant))
+	{
+		if (pBinding)
+		{
+			pBinding->buffer = buffer;
+			pBinding->stride = stride;
+		}
+		m_device.setVertexBuffer(slot, buffer, stride);
+	}
+}
+
+void StateCacheRenderDevice::setIndexBuffer(RenderBuffer buffer)
+{
+	if (issue(RENDER_CALL_SET_INDEX_BUFFER, m_indexBuffer == buffer))
+	{
+		m_indexBuffer = buffer;
+		m_device.setIndexBuffer(buffer);
+	}
+}
+
+void StateCacheRenderDevice::drawIndexed(unsigned int indexCount)
+{
+	issue(RENDER_CALL_DRAW_INDEXED, false);
+	m_device.drawIndexed(indexCount);
+}
+
+void StateCacheRenderDevice::drawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount)
+{
+	issue(RENDER_CALL_DRAW_INDEXED_INSTANCED, false);
+	m_device.drawIndexedInstanced(indexCount, instanceCount);
+}
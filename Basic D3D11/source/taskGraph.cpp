@@ -0,0 +1,159 @@
+#include "../include/taskGraph.h"
+#include "../include/profiler.h"
+#include <assert.h>
+#include <chrono>
+
+namespace
+{
+	uint64_t now()
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+}
+
+TaskGraph::NodeId TaskGraph::addNode(const char* name, NodeKind kind)
+{
+	const NodeId id = m_nodes.size();
+	m_nodes.emplace_back(new Node());
+
+	Node& node = *m_nodes.back();
+	node.name = name;
+	node.kind = kind;
+	node.counter.onComplete = [this, id]() { complete(id); };
+
+	return id;
+}
+
+TaskGraph::NodeId TaskGraph::addTask(const char* name, const JobSystem::TaskFunction& task)
+{
+	const NodeId id = addNode(name, NODE_TASK);
+#ifdef PROFILE
+	// Each node is a zone named after it, and its name lives as long as the graph
+	const char* pName = m_nodes[id]->name.c_str();
+	m_nodes[id]->task = [pName, task]() { PROFILE_ZONE(pName); task(); };
+#else
+	m_nodes[id]->task = task;
+#endif
+	return id;
+}
+
+TaskGraph::NodeId TaskGraph::addParallelTask(const char* name, const CountFunction& count, size_t grainSize, const JobSystem::RangeFunction& body)
+{
+	const NodeId id = addNode(name, NODE_PARALLEL);
+	m_nodes[id]->count = count;
+	m_nodes[id]->grainSize = grainSize;
+#ifdef PROFILE
+	const char* pName = m_nodes[id]->name.c_str();
+	m_nodes[id]->body = [pName, body](size_t begin, size_t end) { PROFILE_ZONE(pName); body(begin, end); };
+#else
+	m_nodes[id]->body = body;
+#endif
+	return id;
+}
+
+TaskGraph::NodeId TaskGraph::addMainThreadTask(const char* name, const JobSystem::TaskFunction& task)
+{
+	const NodeId id = addNode(name, NODE_MAIN_THREAD);
+	m_nodes[id]->task = task;
+	return id;
+}
+
+void TaskGraph::addDependency(NodeId before, NodeId after)
+{
+	assert(before < m_nodes.size() && after < m_nodes.size() && before != after);
+	m_nodes[before]->successors.push_back(after);
+	++m_nodes[after]->predecessorCount;
+}
+
+void TaskGraph::run(JobSystem& jobs)
+{
+	assert(m_remaining.isDone());
+	m_pJobs = &jobs;
+	m_remaining.pending = m_nodes.size();
+
+	for (const std::unique_ptr<Node>& node : m_nodes)
+	{
+		node->unresolved = node->predecessorCount;
+	}
+	for (NodeId id = 0; id < m_nodes.size(); ++id)
+	{
+		if (m_nodes[id]->predecessorCount == 0)
+		{
+			release(id);
+		}
+	}
+
+	while (!m_remaining.isDone())
+	{
+		NodeId mainThreadNode = 0;
+		bool haveMainThreadNode = false;
+		{
+			std::lock_guard<std::mutex> lock(m_mainThreadMutex);
+			if (!m_mainThreadReady.empty())
+			{
+				mainThreadNode = m_mainThreadReady.front();
+				m_mainThreadReady.pop_front();
+				haveMainThreadNode = true;
+			}
+		}
+
+		if (haveMainThreadNode)
+		{
+			PROFILE_ZONE(m_nodes[mainThreadNode]->name.c_str());
+			m_nodes[mainThreadNode]->task();
+			complete(mainThreadNode);
+		}
+		else if (!jobs.runOneTask())
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+void TaskGraph::release(NodeId id)
+{
+	Node& node = *m_nodes[id];
+	node.releasedAt = now();
+	switch (node.kind)
+	{
+	case NODE_TASK:
+		m_pJobs->run(node.task, node.counter);
+		break;
+
+	case NODE_PARALLEL:
+	{
+		const size_t count = node.count();
+		if (count == 0)
+		{
+			complete(id);
+		}
+		else
+		{
+			m_pJobs->run(count, node.grainSize, node.body, node.counter);
+		}
+		break;
+	}
+
+	case NODE_MAIN_THREAD:
+	{
+		std::lock_guard<std::mutex> lock(m_mainThreadMutex);
+		m_mainThreadReady.push_back(id);
+		break;
+	}
+	}
+}
+
+void TaskGraph::complete(NodeId id)
+{
+	m_nodes[id]->lastDurationNs = now() - m_nodes[id]->releasedAt;
+	for (NodeId successor : m_nodes[id]->successors)
+	{
+		if (--m_nodes[successor]->unresolved == 0)
+		{
+			release(successor);
+		}
+	}
+
+	// Only drop the count after the successors are queued, so run() cannot return early
+	m_remaining.pending.fetch_sub(1, std::memory_order_acq_rel);
+}